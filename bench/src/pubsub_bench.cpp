@@ -0,0 +1,1172 @@
+/**
+ * @file pubsub_bench.cpp
+ * @brief Micro-benchmarks for the PubSub server and clients.
+ *
+ * Each mode starts in-process servers on loopback ports, drives them with the
+ * producer and subscriber libraries, and prints one line per configuration.
+ *
+ * Usage: pubsub_bench <mode> [messages] [payload_bytes]
+ *
+ * Modes:
+ *   coalesce  Delivery throughput with a flush per message versus coalesced batch frames
+ *   fanin     Delivery throughput of one subscription over a growing number of topics
+ *   shm       Publish and delivery throughput over gRPC versus the shared-memory transport
+ *   transport Publish and delivery throughput over TCP loopback and Unix sockets, default and tuned
+ *   snapshot  Time to save and restore a snapshot of the retained messages
+ *   topics    Topic lookups in the registry versus std::unordered_map, and reclaiming idle topics
+ *   quota     Latency of a paced producer next to a flooding one, with and without a publisher quota
+ *   affinity  Publish latency with request threads unpinned and pinned per NUMA node
+ *   scheduled Holding and releasing delayed messages in the timing wheel versus a binary heap
+ *   compacted Keys retained, memory and catch-up of a state feed in ring and compacted topics
+ *   passthrough Fan-out of one producer's messages to a growing number of live subscribers
+ *   catchup   Publish latency while new subscribers replay a large backlog, with and without a catch-up rate
+ *   stats     Cost of recording receive statistics, per-thread shards versus one locked map, and end to end
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <malloc.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <grpcpp/grpcpp.h>
+#include "async_publisher.h"
+#include "cpu_affinity.h"
+#include "latency_histogram.h"
+#include "pubsub_clock.h"
+#include "pubsub_common.h"
+#include "pubsub_channel.h"
+#include "pubsub_service.h"
+#include "subscriber_client.h"
+#include "subscriber_stats.h"
+#include "timer_wheel.h"
+#include "topic_registry.h"
+
+namespace {
+
+/**
+ * @brief Silences std::cout for its lifetime.
+ *
+ * The service and clients log every RPC; the benchmark keeps that noise out
+ * of its results.
+ */
+class QuietScope {
+public:
+    QuietScope() : saved_(std::cout.rdbuf(nullptr)) {}
+    ~QuietScope() { std::cout.rdbuf(saved_); }
+
+private:
+    std::streambuf* saved_;
+};
+
+/**
+ * @brief A PubSub server running in this process on a free loopback port.
+ */
+struct BenchServer {
+    std::unique_ptr<PubSubServiceImpl> service;
+    std::unique_ptr<grpc::Server> server;
+    std::string address;
+
+    explicit BenchServer(size_t max_messages_per_topic, ServerOptions options = ServerOptions())
+        : service(new PubSubServiceImpl(max_messages_per_topic, options.partitions_per_topic)) {
+        service->SetRateLimits(options);
+        service->SetCompactedTopics(options);
+        service->SetThreadPlacement(options);
+        if (options.listen_addresses.empty() || options.listen_addresses[0] == "0.0.0.0:50051") {
+            options.listen_addresses = {"127.0.0.1:0"};
+        }
+        std::vector<int> ports;
+        server = BuildServer(service.get(), options, &ports);
+        address = ports[0] != 0 ? "127.0.0.1:" + std::to_string(ports[0]) : options.listen_addresses[0];
+    }
+
+    ~BenchServer() { server->Shutdown(std::chrono::system_clock::now()); }
+};
+
+/**
+ * @brief Publish a fixed number of messages round-robin over topics and wait for all of them.
+ * @param address The server address
+ * @param topics The topics to publish to
+ * @param messages Number of messages in total
+ * @param payload_bytes Size of each message's content
+ */
+void Fill(const std::string& address, const std::vector<std::string>& topics, size_t messages,
+          size_t payload_bytes) {
+    ProducerOptions options;
+    options.batch_size = 100;
+    options.linger = std::chrono::milliseconds(1);
+    AsyncPublisher publisher(address, options);
+    std::string payload(payload_bytes, 'x');
+    for (size_t i = 0; i < messages; i++) {
+        publisher.PublishAsync(topics[i % topics.size()], payload, AsyncPublisher::CompletionFn());
+    }
+    publisher.Flush();
+}
+
+/**
+ * @brief Time publishing a fixed number of messages to one topic until all have completed.
+ * @param address The server address
+ * @param messages Number of messages to publish
+ * @param payload_bytes Size of each message's content
+ * @param options Producer configuration
+ * @return Messages published per second
+ */
+double TimePublish(const std::string& address, size_t messages, size_t payload_bytes,
+                   const ProducerOptions& options) {
+    AsyncPublisher publisher(address, options);
+    std::string payload(payload_bytes, 'x');
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < messages; i++) {
+        publisher.PublishAsync("bench", payload, AsyncPublisher::CompletionFn());
+    }
+    publisher.Flush();
+    return messages / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Subscribe to topics and time how long the backlog takes to arrive.
+ * @param address The server address
+ * @param topics The topics to subscribe to
+ * @param messages Number of messages to wait for
+ * @param max_batch_size Messages per stream frame (1 uses Subscribe)
+ * @param shared_memory Whether to receive through shared memory
+ * @param channel Transport settings of the subscriber's channel
+ * @param stats Statistics the subscriber records into, or null for none
+ * @return Messages received per second, or 0 if they did not all arrive within 60 s
+ */
+double TimeDelivery(const std::string& address, const std::vector<std::string>& topics, size_t messages,
+                    size_t max_batch_size, bool shared_memory = false,
+                    const pubsub::common::ChannelOptions& channel = pubsub::common::ChannelOptions(),
+                    std::shared_ptr<SubscriberStats> stats = nullptr) {
+    SubscriberOptions options;
+    options.max_batch_size = max_batch_size;
+    options.shared_memory = shared_memory;
+    options.stats = stats;
+    SubscriberClient subscriber(pubsub::common::createChannel(address, channel), options);
+
+    std::atomic<size_t> received(0);
+    auto start = std::chrono::steady_clock::now();
+    subscriber.SubscribeToMultiple(topics, [&received](const std::string&, const Message&) { received++; });
+    while (received < messages) {
+        if (std::chrono::steady_clock::now() - start > std::chrono::seconds(60)) {
+            return 0;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    subscriber.Stop();
+    return messages / seconds;
+}
+
+/**
+ * @brief Compare delivery with a flush per message against coalesced frames.
+ *
+ * A topic is filled with a backlog, then read by a fresh subscriber: through
+ * Subscribe, which writes and flushes every message as its own frame, and
+ * through SubscribeBatched with growing batch sizes.
+ *
+ * @param messages Number of messages in the backlog
+ * @param payload_bytes Size of each message's content
+ */
+void RunCoalesce(size_t messages, size_t payload_bytes) {
+    std::cout << "Delivering " << messages << " messages of " << payload_bytes << " bytes" << std::endl;
+    std::cout << std::left << std::setw(24) << "delivery" << std::right << std::setw(14) << "msg/s" << std::endl;
+
+    for (size_t max_batch_size : {size_t(1), size_t(16), size_t(256), size_t(1024)}) {
+        double rate;
+        {
+            QuietScope quiet;
+            BenchServer server(messages);
+            Fill(server.address, {"bench"}, messages, payload_bytes);
+            rate = TimeDelivery(server.address, {"bench"}, messages, max_batch_size);
+        }
+        std::string label = max_batch_size == 1 ? "flush per message"
+                                                : "batches of " + std::to_string(max_batch_size);
+        std::cout << std::left << std::setw(24) << label
+                  << std::right << std::setw(14) << std::fixed << std::setprecision(0) << rate << std::endl;
+    }
+}
+
+/**
+ * @brief Measure how delivery scales with the number of topics in one subscription.
+ *
+ * The backlog is published round-robin over the topics, so every polling
+ * round interleaves messages of all of them and the server has to restore
+ * their publish order across topics.
+ *
+ * @param messages Number of messages in the backlog
+ * @param payload_bytes Size of each message's content
+ */
+void RunFanIn(size_t messages, size_t payload_bytes) {
+    std::cout << "Delivering " << messages << " messages of " << payload_bytes
+              << " bytes in batches of 256" << std::endl;
+    std::cout << std::left << std::setw(24) << "topics" << std::right << std::setw(14) << "msg/s" << std::endl;
+
+    for (size_t num_topics : {size_t(1), size_t(16), size_t(256)}) {
+        std::vector<std::string> topics;
+        for (size_t i = 0; i < num_topics; i++) {
+            topics.push_back("bench-" + std::to_string(i));
+        }
+        double rate;
+        {
+            QuietScope quiet;
+            BenchServer server(messages);
+            Fill(server.address, topics, messages, payload_bytes);
+            rate = TimeDelivery(server.address, topics, messages, 256);
+        }
+        std::cout << std::left << std::setw(24) << num_topics
+                  << std::right << std::setw(14) << std::fixed << std::setprecision(0) << rate << std::endl;
+    }
+}
+
+/**
+ * @brief Compare the gRPC and shared-memory transports for a same-host producer and subscriber.
+ *
+ * Publishing is measured with batches of 100 over gRPC against handing each
+ * message to the server's ring; delivery of the resulting backlog with
+ * batches of 256 against the subscriber's ring.
+ *
+ * @param messages Number of messages to publish and deliver
+ * @param payload_bytes Size of each message's content
+ */
+void RunSharedMemory(size_t messages, size_t payload_bytes) {
+    std::cout << "Publishing and delivering " << messages << " messages of " << payload_bytes
+              << " bytes" << std::endl;
+    std::cout << std::left << std::setw(24) << "transport" << std::right << std::setw(14) << "publish msg/s"
+              << std::setw(14) << "deliver msg/s" << std::endl;
+
+    for (bool shared_memory : {false, true}) {
+        double publish_rate;
+        double delivery_rate;
+        {
+            QuietScope quiet;
+            BenchServer server(messages);
+            ProducerOptions options;
+            options.batch_size = 100;
+            options.linger = std::chrono::milliseconds(1);
+            options.shared_memory = shared_memory;
+            publish_rate = TimePublish(server.address, messages, payload_bytes, options);
+            delivery_rate = TimeDelivery(server.address, {"bench"}, messages, 256, shared_memory);
+        }
+        std::cout << std::left << std::setw(24) << (shared_memory ? "shared memory" : "gRPC")
+                  << std::right << std::setw(14) << std::fixed << std::setprecision(0) << publish_rate
+                  << std::setw(14) << delivery_rate << std::endl;
+    }
+}
+
+/**
+ * @brief Compare TCP loopback with a Unix domain socket, each with default and tuned settings.
+ *
+ * Publishing sends one message per Publish RPC with 64 in flight, so the
+ * cost of each round trip through the transport dominates. Delivery reads
+ * the resulting backlog in batches of 256. The tuned settings disable
+ * HTTP/2 BDP probing on both sides, which otherwise pings the peer to size
+ * the flow-control window of a connection whose round trip is already
+ * microseconds, and give the server a poller per core.
+ *
+ * @param messages Number of messages to publish and deliver
+ * @param payload_bytes Size of each message's content
+ */
+void RunTransport(size_t messages, size_t payload_bytes) {
+    std::cout << "Publishing (unbatched, 64 in flight) and delivering " << messages << " messages of "
+              << payload_bytes << " bytes" << std::endl;
+    std::cout << std::left << std::setw(24) << "listener" << std::right << std::setw(14) << "publish msg/s"
+              << std::setw(14) << "deliver msg/s" << std::endl;
+
+    std::string socket_path = "/tmp/pubsub_bench_" + std::to_string(getpid()) + ".sock";
+    for (bool unix_socket : {false, true}) {
+        for (bool tuned : {false, true}) {
+            ServerOptions server_options;
+            server_options.listen_addresses = {unix_socket ? "unix:" + socket_path : "127.0.0.1:0"};
+            ProducerOptions producer_options;
+            producer_options.max_in_flight = 64;
+            pubsub::common::ChannelOptions channel;
+            if (tuned) {
+                server_options.bdp_probe = false;
+                server_options.min_pollers = static_cast<int>(std::thread::hardware_concurrency());
+                channel.bdp_probe = false;
+            }
+            producer_options.channel = channel;
+
+            double publish_rate;
+            double delivery_rate;
+            {
+                QuietScope quiet;
+                BenchServer server(messages, server_options);
+                publish_rate = TimePublish(server.address, messages, payload_bytes, producer_options);
+                delivery_rate = TimeDelivery(server.address, {"bench"}, messages, 256, false, channel);
+            }
+            std::string label = std::string(unix_socket ? "unix" : "tcp") + (tuned ? ", tuned" : ", default");
+            std::cout << std::left << std::setw(24) << label
+                      << std::right << std::setw(14) << std::fixed << std::setprecision(0) << publish_rate
+                      << std::setw(14) << delivery_rate << std::endl;
+        }
+    }
+    std::remove(socket_path.c_str());
+}
+
+/**
+ * @brief Time saving a snapshot of a full service and restoring it into a fresh one.
+ *
+ * The messages are stored through PublishBatch directly, without gRPC,
+ * spread over 16 topics.
+ *
+ * @param messages Number of retained messages
+ * @param payload_bytes Size of each message's content
+ */
+void RunSnapshot(size_t messages, size_t payload_bytes) {
+    const size_t num_topics = 16;
+    std::string path = "/tmp/pubsub_bench_" + std::to_string(getpid()) + ".snapshot";
+    double save_ms;
+    double load_ms;
+    {
+        QuietScope quiet;
+        PubSubServiceImpl service(messages / num_topics + 1);
+        PublishBatchRequest batch;
+        PublishBatchResponse response;
+        std::string payload(payload_bytes, 'x');
+        for (size_t i = 0; i < messages; i++) {
+            PublishRequest* request = batch.add_messages();
+            request->set_topic("bench-" + std::to_string(i % num_topics));
+            request->set_content(payload);
+            if (batch.messages_size() == 1000 || i + 1 == messages) {
+                service.PublishBatch(nullptr, &batch, &response);
+                batch.Clear();
+            }
+        }
+        int64_t start = pubsub::common::steadyNanos();
+        service.SaveSnapshot(path);
+        save_ms = (pubsub::common::steadyNanos() - start) / 1e6;
+
+        PubSubServiceImpl restored(messages / num_topics + 1);
+        start = pubsub::common::steadyNanos();
+        restored.LoadSnapshot(path);
+        load_ms = (pubsub::common::steadyNanos() - start) / 1e6;
+    }
+    struct stat st;
+    double megabytes = stat(path.c_str(), &st) == 0 ? st.st_size / 1e6 : 0;
+    std::remove(path.c_str());
+    std::cout << "Snapshot of " << messages << " messages of " << payload_bytes << " bytes ("
+              << std::fixed << std::setprecision(1) << megabytes << " MB)" << std::endl;
+    std::cout << std::left << std::setw(24) << "save" << std::right << std::setw(10) << std::setprecision(0)
+              << save_ms << " ms" << std::endl;
+    std::cout << std::left << std::setw(24) << "restore" << std::right << std::setw(10) << load_ms << " ms"
+              << std::endl;
+}
+
+/**
+ * @brief Get the heap memory allocated and not yet freed.
+ *
+ * Freed memory often stays resident in the allocator's free lists, so the
+ * resident set size would hide what the service actually releases.
+ *
+ * @return Allocated bytes in megabytes
+ */
+double HeapInUseMegabytes() {
+    return mallinfo2().uordblks / 1e6;
+}
+
+/**
+ * @brief Time topic lookups and the reclamation of idle topics.
+ *
+ * First looks up every name of @p topics distinct topics in shuffled order,
+ * in a TopicRegistry and in the std::unordered_map it replaced. Then stores
+ * one message in each topic of a service, without gRPC, and reclaims them all
+ * as idle, reporting the heap memory the service holds before and after.
+ *
+ * @param topics Number of distinct topics
+ * @param payload_bytes Size of each message's content
+ */
+void RunTopics(size_t topics, size_t payload_bytes) {
+    std::vector<std::string> names;
+    for (size_t i = 0; i < topics; i++) {
+        names.push_back("device/" + std::to_string(i * 7919) + "/telemetry");
+    }
+    TopicRegistry registry;
+    std::unordered_map<std::string, TopicId> map;
+    for (const auto& name : names) {
+        map.emplace(name, registry.Intern(name));
+    }
+    std::vector<std::string> lookups(names);
+    std::shuffle(lookups.begin(), lookups.end(), std::mt19937(42));
+
+    TopicId sum = 0;
+    int64_t start = pubsub::common::steadyNanos();
+    for (const auto& name : lookups) {
+        TopicId id = 0;
+        registry.Find(name, &id);
+        sum += id;
+    }
+    double registry_ns = static_cast<double>(pubsub::common::steadyNanos() - start) / topics;
+    start = pubsub::common::steadyNanos();
+    for (const auto& name : lookups) {
+        sum -= map.find(name)->second;
+    }
+    double map_ns = static_cast<double>(pubsub::common::steadyNanos() - start) / topics;
+
+    std::cout << "Lookups of " << topics << " topics" << (sum == 0 ? "" : " (mismatch)") << std::endl;
+    std::cout << std::left << std::setw(24) << "TopicRegistry" << std::right << std::setw(10) << std::fixed
+              << std::setprecision(1) << registry_ns << " ns" << std::endl;
+    std::cout << std::left << std::setw(24) << "std::unordered_map" << std::right << std::setw(10)
+              << map_ns << " ns" << std::endl;
+
+    double before, filled, after, reclaim_ms;
+    size_t reclaimed;
+    {
+        QuietScope quiet;
+        before = HeapInUseMegabytes();
+        PubSubServiceImpl service(100);
+        PublishBatchRequest batch;
+        PublishBatchResponse response;
+        std::string payload(payload_bytes, 'x');
+        for (size_t i = 0; i < topics; i++) {
+            PublishRequest* request = batch.add_messages();
+            request->set_topic(names[i]);
+            request->set_content(payload);
+            if (batch.messages_size() == 1000 || i + 1 == topics) {
+                service.PublishBatch(nullptr, &batch, &response);
+                batch.Clear();
+            }
+        }
+        filled = HeapInUseMegabytes();
+        start = pubsub::common::steadyNanos();
+        reclaimed = service.ReclaimIdleTopics(std::chrono::milliseconds(0));
+        reclaim_ms = (pubsub::common::steadyNanos() - start) / 1e6;
+        after = HeapInUseMegabytes();
+    }
+    std::cout << "Reclaimed " << reclaimed << " idle topics in " << std::setprecision(0) << reclaim_ms
+              << " ms; heap held by the service: " << std::setprecision(1) << filled - before << " MB before, "
+              << after - before << " MB after" << std::endl;
+}
+
+/**
+ * @brief Run a paced producer next to a flooding one and record the paced producer's latency.
+ * @param server_options Server settings, including its quotas
+ * @param flood Whether to run the flooding producer at all
+ * @param messages Publishes of the paced producer, one per millisecond
+ * @param payload_bytes Size of each message's content
+ * @param latency Receives the paced publishes' latencies from their scheduled send times
+ * @param noisy_rate Receives the flooding producer's stored messages per second
+ * @param noisy_failed Receives the number of the flooding producer's messages that failed
+ */
+void RunNeighbors(const ServerOptions& server_options, bool flood, size_t messages, size_t payload_bytes,
+                  pubsub::common::LatencyHistogram* latency, double* noisy_rate, size_t* noisy_failed) {
+    QuietScope quiet;
+    BenchServer server(1000, server_options);
+    std::string payload(payload_bytes, 'x');
+
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> stored(0), failed(0);
+    int64_t noisy_start = pubsub::common::steadyNanos();
+    std::thread noisy([&] {
+        ProducerOptions options;
+        options.client_id = "noisy";
+        options.batch_size = 100;
+        options.linger = std::chrono::milliseconds(1);
+        options.max_retries = 1000;
+        AsyncPublisher publisher(server.address, options);
+        while (flood && !stop) {
+            publisher.PublishAsync("noisy", payload, [&](const PublishResult& result) {
+                (result.status.ok() ? stored : failed)++;
+            });
+        }
+        publisher.Flush();
+    });
+
+    {
+        ProducerOptions options;
+        options.client_id = "quiet";
+        AsyncPublisher publisher(server.address, options);
+        publisher.PublishAsync("quiet", payload).wait();
+        int64_t start = pubsub::common::steadyNanos();
+        for (size_t i = 0; i < messages; i++) {
+            int64_t scheduled = start + static_cast<int64_t>(i) * 1000000;
+            std::this_thread::sleep_for(std::chrono::nanoseconds(scheduled - pubsub::common::steadyNanos()));
+            // Callbacks run on the publisher's single completion thread
+            publisher.PublishAsync("quiet", payload, [latency, scheduled](const PublishResult&) {
+                latency->Record(pubsub::common::steadyNanos() - scheduled);
+            });
+        }
+        publisher.Flush();
+    }
+    *noisy_rate = stored / ((pubsub::common::steadyNanos() - noisy_start) / 1e9);
+    stop = true;
+    noisy.join();
+    *noisy_failed = failed;
+}
+
+/**
+ * @brief Measure how a flooding producer affects the latency of a paced one.
+ *
+ * A quiet producer publishes one message per millisecond: alone, next to a
+ * noisy producer on its own connection that publishes batches as fast as
+ * the server accepts them, and next to the same producer with a quota on
+ * its client ID, whose rejected batches are retried after the server's
+ * retry-after hint.
+ *
+ * @param messages Publishes of the quiet producer (at most 5000)
+ * @param payload_bytes Size of each message's content
+ */
+void RunQuota(size_t messages, size_t payload_bytes) {
+    std::cout << std::left << std::setw(24) << "Noisy producer" << std::right << std::setw(10) << "p50 ms"
+              << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << std::setw(14) << "noisy msg/s"
+              << std::setw(10) << "failed" << std::endl;
+    for (int run = 0; run < 3; run++) {
+        ServerOptions server_options;
+        if (run == 2) {
+            server_options.publisher_rate_limits["noisy"].rate = 20000;
+        }
+        pubsub::common::LatencyHistogram latency;
+        double noisy_rate;
+        size_t noisy_failed;
+        RunNeighbors(server_options, run > 0, std::min<size_t>(messages, 5000), payload_bytes, &latency,
+                     &noisy_rate, &noisy_failed);
+
+        const char* label = run == 0 ? "absent" : run == 1 ? "unlimited" : "quota 20000 msg/s";
+        auto ms = [](int64_t nanos) { return nanos / 1e6; };
+        std::cout << std::left << std::setw(24) << label << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(10) << ms(latency.ValueAt(0.5)) << std::setw(10) << ms(latency.ValueAt(0.99))
+                  << std::setw(10) << ms(latency.Max()) << std::setw(14) << std::setprecision(0) << noisy_rate
+                  << std::setw(10) << noisy_failed << std::endl;
+    }
+}
+
+/**
+ * @brief Measure publish latency with and without NUMA pinning of request threads.
+ *
+ * One producer publishes at 2000 msg/s, round-robin over 16 topics of four
+ * partitions each, and records each publish's latency from its scheduled
+ * send time, while a subscriber receives every topic. The server runs once
+ * with its request threads left to the scheduler and once with each pinned
+ * to the NUMA node of the partition it serves. Delivery is not timed: the
+ * server polls subscriptions every 100 ms, which would hide any difference.
+ *
+ * @param messages Number of messages (at most 20000)
+ * @param payload_bytes Size of each message's content
+ */
+void RunAffinity(size_t messages, size_t payload_bytes) {
+    messages = std::min<size_t>(messages, 20000);
+    pubsub::common::CpuLayout layout;
+    std::cout << layout.Cpus().size() << " CPU(s) on " << layout.NodeCount() << " NUMA node(s)" << std::endl;
+    std::vector<std::string> topics;
+    for (int i = 0; i < 16; i++) {
+        topics.push_back("affinity-" + std::to_string(i));
+    }
+
+    std::cout << std::left << std::setw(24) << "Request threads" << std::right << std::setw(10) << "p50 ms"
+              << std::setw(10) << "p99 ms" << std::setw(10) << "p99.9 ms" << std::setw(10) << "max ms"
+              << std::setw(10) << "received" << std::endl;
+    for (bool pinned : {false, true}) {
+        ServerOptions server_options;
+        server_options.partitions_per_topic = 4;
+        server_options.numa_pinning = pinned;
+        pubsub::common::LatencyHistogram latency;  // Recorded by the producer's completion thread
+        std::atomic<size_t> received(0);
+        {
+            QuietScope quiet;
+            BenchServer server(1000, server_options);
+            SubscriberOptions subscriber_options;
+            subscriber_options.max_batch_size = 64;
+            SubscriberClient subscriber(pubsub::common::createChannel(server.address), subscriber_options);
+            subscriber.SubscribeToMultiple(topics, [&received](const std::string&, const Message&) { received++; });
+
+            AsyncPublisher publisher(server.address, ProducerOptions());
+            std::string payload(payload_bytes, 'x');
+            publisher.PublishAsync(topics[0], payload).wait();
+            int64_t start = pubsub::common::steadyNanos();
+            for (size_t i = 0; i < messages; i++) {
+                int64_t scheduled = start + static_cast<int64_t>(i) * 500000;
+                std::this_thread::sleep_for(std::chrono::nanoseconds(scheduled - pubsub::common::steadyNanos()));
+                publisher.PublishAsync(topics[i % topics.size()], std::to_string(i), payload,
+                                       [&latency, scheduled](const PublishResult&) {
+                                           latency.Record(pubsub::common::steadyNanos() - scheduled);
+                                       });
+            }
+            publisher.Flush();
+            int64_t deadline = pubsub::common::steadyNanos() + 5000000000LL;
+            while (received <= messages && pubsub::common::steadyNanos() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            subscriber.Stop();
+        }
+
+        auto ms = [](int64_t nanos) { return nanos / 1e6; };
+        std::cout << std::left << std::setw(24) << (pinned ? "pinned per NUMA node" : "unpinned") << std::right
+                  << std::fixed << std::setprecision(2) << std::setw(10) << ms(latency.ValueAt(0.5))
+                  << std::setw(10) << ms(latency.ValueAt(0.99)) << std::setw(10) << ms(latency.ValueAt(0.999))
+                  << std::setw(10) << ms(latency.Max()) << std::setw(10) << received << std::endl;
+    }
+}
+
+/**
+ * @brief Time holding and releasing delayed messages.
+ *
+ * First schedules @p messages timers with random delays of up to an hour in
+ * the hierarchical TimerWheel the service uses, and in a binary heap ordered
+ * by deadline, then steps both through the hour of simulated time a
+ * millisecond at a time, firing the timers as they fall due. Then publishes
+ * the same number of messages, without gRPC, falling due over two seconds
+ * once all are accepted, and reports how long the service took to accept them, the heap
+ * memory they held while pending, and how late after the last delivery time
+ * the last of them was stored.
+ *
+ * @param messages Number of delayed messages
+ * @param payload_bytes Size of each message's content
+ */
+void RunScheduled(size_t messages, size_t payload_bytes) {
+    using Clock = TimerWheel::Clock;
+    const int64_t horizon_ms = 3600 * 1000;
+    std::mt19937_64 rng(42);
+    std::vector<int64_t> delays(messages);
+    for (auto& delay : delays) {
+        delay = 1 + static_cast<int64_t>(rng() % horizon_ms);
+    }
+
+    std::vector<TimerWheel::Timer> timers(messages);
+    TimerWheel wheel(std::chrono::milliseconds(1), 256, 5);
+    Clock::time_point origin = Clock::now();
+    size_t fired = 0;
+    auto count = [&fired](TimerWheel::Timer*) { fired++; };
+    int64_t start = pubsub::common::steadyNanos();
+    for (size_t i = 0; i < messages; i++) {
+        wheel.ScheduleAt(&timers[i], origin + std::chrono::milliseconds(delays[i]));
+    }
+    double wheel_insert_ns = static_cast<double>(pubsub::common::steadyNanos() - start) / messages;
+    start = pubsub::common::steadyNanos();
+    for (int64_t ms = 1; ms <= horizon_ms + 1; ms++) {
+        wheel.Advance(origin + std::chrono::milliseconds(ms), count);
+    }
+    double wheel_expire_ns = static_cast<double>(pubsub::common::steadyNanos() - start) / messages;
+
+    using Entry = std::pair<int64_t, size_t>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+    start = pubsub::common::steadyNanos();
+    for (size_t i = 0; i < messages; i++) {
+        heap.emplace(delays[i], i);
+    }
+    double heap_insert_ns = static_cast<double>(pubsub::common::steadyNanos() - start) / messages;
+    start = pubsub::common::steadyNanos();
+    for (int64_t ms = 1; ms <= horizon_ms + 1; ms++) {
+        while (!heap.empty() && heap.top().first <= ms) {
+            heap.pop();
+            fired++;
+        }
+    }
+    double heap_expire_ns = static_cast<double>(pubsub::common::steadyNanos() - start) / messages;
+
+    std::cout << "Timers: " << messages << " due within an hour" << (fired == 2 * messages ? "" : " (mismatch)")
+              << std::endl;
+    std::cout << std::left << std::setw(24) << "" << std::right << std::setw(12) << "insert ns" << std::setw(12)
+              << "expire ns" << std::endl;
+    std::cout << std::left << std::setw(24) << "TimerWheel (5 levels)" << std::right << std::fixed
+              << std::setprecision(1) << std::setw(12) << wheel_insert_ns << std::setw(12) << wheel_expire_ns
+              << std::endl;
+    std::cout << std::left << std::setw(24) << "binary heap" << std::right << std::setw(12) << heap_insert_ns
+              << std::setw(12) << heap_expire_ns << std::endl;
+
+    const size_t num_topics = 16;
+    const int64_t spread_ms = 2000;
+    const int64_t base_ms = 5000;  // Nothing falls due before every message is accepted
+    double accept_ns, pending_mb, late_ms;
+    size_t stored = 0;
+    {
+        QuietScope quiet;
+        double before = HeapInUseMegabytes();
+        PubSubServiceImpl service(messages / num_topics + 1);
+        PublishBatchRequest batch;
+        PublishBatchResponse response;
+        std::string payload(payload_bytes, 'x');
+        int64_t last_due = 0;
+        start = pubsub::common::steadyNanos();
+        for (size_t i = 0; i < messages; i++) {
+            PublishRequest* request = batch.add_messages();
+            request->set_topic("scheduled-" + std::to_string(i % num_topics));
+            request->set_content(payload);
+            request->set_delay_ms(static_cast<uint32_t>(base_ms + delays[i] % spread_ms));
+            last_due = std::max<int64_t>(last_due, pubsub::common::steadyNanos() + request->delay_ms() * 1000000LL);
+            if (batch.messages_size() == 1000 || i + 1 == messages) {
+                service.PublishBatch(nullptr, &batch, &response);
+                batch.Clear();
+                response.Clear();
+            }
+        }
+        accept_ns = static_cast<double>(pubsub::common::steadyNanos() - start) / messages;
+        pending_mb = HeapInUseMegabytes() - before;
+        while (service.GetScheduledCount() > 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        late_ms = (pubsub::common::steadyNanos() - last_due) / 1e6;
+        for (size_t i = 0; i < num_topics; i++) {
+            stored += service.GetMessageCount("scheduled-" + std::to_string(i));
+        }
+    }
+    std::cout << "Service: " << messages << " messages of " << payload_bytes << " bytes due over "
+              << spread_ms / 1000 << " s, " << stored << " delivered" << std::endl;
+    std::cout << std::left << std::setw(24) << "accept" << std::right << std::setw(12) << accept_ns << " ns/msg"
+              << std::endl;
+    std::cout << std::left << std::setw(24) << "heap while pending" << std::right << std::setw(12) << pending_mb
+              << " MB" << std::endl;
+    std::cout << std::left << std::setw(24) << "last stored after due" << std::right << std::setw(12) << late_ms
+              << " ms" << std::endl;
+}
+
+/**
+ * @brief Compare ring and compacted topics holding a state feed.
+ *
+ * Publishes @p messages updates, without gRPC, to a topic with one key per
+ * hundred messages, drawn with a skew so that a few keys take most updates.
+ * The topic is a ring sized for one message per key, a ring large enough to
+ * hold every update, and compacted. A new subscriber then reads the whole
+ * topic over gRPC; the table shows how many keys it learned the value of,
+ * the heap the topic held, and how long catching up took.
+ *
+ * @param messages Number of updates
+ * @param payload_bytes Size of each message's content
+ */
+void RunCompacted(size_t messages, size_t payload_bytes) {
+    const size_t num_keys = std::max<size_t>(messages / 100, 1);
+    std::vector<std::string> keys(messages);
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    for (auto& key : keys) {
+        double u = uniform(rng);
+        key = "key-" + std::to_string(static_cast<size_t>(num_keys * u * u * u));
+    }
+    std::cout << messages << " updates of " << payload_bytes << " bytes to " << num_keys << " keys" << std::endl;
+    std::cout << std::left << std::setw(24) << "Topic" << std::right << std::setw(12) << "publish ns"
+              << std::setw(12) << "retained" << std::setw(12) << "keys" << std::setw(12) << "heap MB"
+              << std::setw(14) << "catch-up ms" << std::endl;
+
+    struct Config {
+        const char* name;
+        size_t capacity;
+        bool compacted;
+    };
+    for (const Config& config : {Config{"ring, 1 per key", num_keys, false},
+                                 Config{"ring, every update", messages, false},
+                                 Config{"compacted", 1, true}}) {
+        double publish_ns, heap_mb, catch_up_ms;
+        size_t retained;
+        std::unordered_set<std::string> learned;
+        {
+            QuietScope quiet;
+            ServerOptions options;
+            if (config.compacted) {
+                options.compacted_topics = {"state"};
+            }
+            double before = HeapInUseMegabytes();
+            BenchServer server(config.capacity, options);
+            PublishBatchRequest batch;
+            PublishBatchResponse response;
+            std::string payload(payload_bytes, 'x');
+            int64_t start = pubsub::common::steadyNanos();
+            for (size_t i = 0; i < messages; i++) {
+                PublishRequest* request = batch.add_messages();
+                request->set_topic("state");
+                request->set_key(keys[i]);
+                request->set_content(payload);
+                if (batch.messages_size() == 1000 || i + 1 == messages) {
+                    server.service->PublishBatch(nullptr, &batch, &response);
+                    batch.Clear();
+                    response.Clear();
+                }
+            }
+            publish_ns = static_cast<double>(pubsub::common::steadyNanos() - start) / messages;
+            heap_mb = HeapInUseMegabytes() - before;
+            retained = server.service->GetMessageCount("state");
+
+            std::mutex mutex;
+            size_t received = 0;
+            SubscriberClient subscriber(pubsub::common::createChannel(server.address));
+            start = pubsub::common::steadyNanos();
+            subscriber.SubscribeToMultiple({"state"}, [&](const std::string&, const Message& message) {
+                std::lock_guard<std::mutex> lock(mutex);
+                learned.insert(message.key());
+                received++;
+            });
+            int64_t deadline = start + 60000000000LL;
+            while (pubsub::common::steadyNanos() < deadline) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (received >= retained) {
+                        break;
+                    }
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+            catch_up_ms = (pubsub::common::steadyNanos() - start) / 1e6;
+            subscriber.Stop();
+        }
+        std::cout << std::left << std::setw(24) << config.name << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(12) << publish_ns << std::setw(12) << retained << std::setw(12) << learned.size()
+                  << std::setprecision(1) << std::setw(12) << heap_mb << std::setw(14) << catch_up_ms << std::endl;
+    }
+}
+
+/**
+ * @brief Measure fan-out of one producer's messages to a growing number of subscribers.
+ *
+ * The subscribers attach to one topic, receiving batches of up to 64
+ * messages, while a producer publishes to it in batches of 100. The topic
+ * retains every message, so none is missed; the time runs until every
+ * subscriber has received all of them.
+ *
+ * @param messages Number of messages to publish
+ * @param payload_bytes Size of each message's content
+ */
+void RunPassthrough(size_t messages, size_t payload_bytes) {
+    std::cout << "Publishing " << messages << " messages of " << payload_bytes << " bytes to live subscribers"
+              << std::endl;
+    std::cout << std::left << std::setw(24) << "subscribers" << std::right << std::setw(14) << "publish msg/s"
+              << std::setw(14) << "deliver msg/s" << std::setw(14) << "deliver MB/s" << std::endl;
+
+    for (size_t num_subscribers : {size_t(1), size_t(4), size_t(16)}) {
+        double publish_rate;
+        double delivery_rate = 0;
+        {
+            QuietScope quiet;
+            BenchServer server(messages);
+            std::unique_ptr<std::atomic<size_t>[]> received(new std::atomic<size_t>[num_subscribers]);
+            std::vector<std::unique_ptr<SubscriberClient>> subscribers;
+            SubscriberOptions options;
+            options.max_batch_size = 64;
+            for (size_t i = 0; i < num_subscribers; i++) {
+                received[i] = 0;
+                subscribers.emplace_back(new SubscriberClient(pubsub::common::createChannel(server.address), options));
+                std::atomic<size_t>* count = &received[i];
+                subscribers.back()->SubscribeToMultiple({"bench"}, [count](const std::string&, const Message&) {
+                    (*count)++;
+                });
+            }
+
+            ProducerOptions producer_options;
+            producer_options.batch_size = 100;
+            producer_options.linger = std::chrono::milliseconds(1);
+            auto start = std::chrono::steady_clock::now();
+            publish_rate = TimePublish(server.address, messages, payload_bytes, producer_options);
+            bool done = false;
+            while (!done && std::chrono::steady_clock::now() - start < std::chrono::seconds(120)) {
+                std::this_thread::sleep_for(std::chrono::microseconds(500));
+                done = true;
+                for (size_t i = 0; i < num_subscribers; i++) {
+                    done = done && received[i] >= messages;
+                }
+            }
+            if (done) {
+                delivery_rate = messages * num_subscribers /
+                    std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            for (auto& subscriber : subscribers) {
+                subscriber->Stop();
+            }
+        }
+        std::cout << std::left << std::setw(24) << num_subscribers
+                  << std::right << std::setw(14) << std::fixed << std::setprecision(0) << publish_rate
+                  << std::setw(14) << delivery_rate << std::setw(14) << std::setprecision(1)
+                  << delivery_rate * payload_bytes / 1e6 << std::endl;
+    }
+}
+
+/**
+ * @brief Measure how subscribers replaying a large backlog affect a paced producer.
+ *
+ * A topic is filled with a backlog, then a producer publishes to it once per
+ * millisecond and records each publish's latency from its scheduled send
+ * time: alone, while four new subscribers read the topic from its start, and
+ * while the same subscribers share a catch-up rate of @p messages msg/s. The
+ * time until the last subscriber has received the whole backlog and the
+ * peak heap growth during the replay are reported alongside.
+ *
+ * @param messages Number of messages in the backlog
+ * @param payload_bytes Size of each message's content
+ */
+void RunCatchUp(size_t messages, size_t payload_bytes) {
+    const size_t num_subscribers = 4;
+    std::cout << "Backlog of " << messages << " messages of " << payload_bytes << " bytes, "
+              << num_subscribers << " subscribers joining" << std::endl;
+    std::cout << std::left << std::setw(24) << "Catch-up" << std::right << std::setw(10) << "p50 ms"
+              << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << std::setw(14) << "catch-up ms"
+              << std::setw(14) << "peak heap MB" << std::endl;
+
+    for (int run = 0; run < 3; run++) {
+        pubsub::common::LatencyHistogram latency;
+        double catch_up_ms = 0;
+        double peak_heap = 0;
+        {
+            QuietScope quiet;
+            ServerOptions server_options;
+            if (run == 2) {
+                server_options.catch_up_rate_limit.rate = static_cast<double>(messages);
+            }
+            // Room for the paced publishes too, so the backlog is not evicted while it is read
+            BenchServer server(messages + 100000, server_options);
+            Fill(server.address, {"bench"}, messages, payload_bytes);
+            double filled_heap = HeapInUseMegabytes();
+
+            std::atomic<bool> sampling(true);
+            std::thread sampler([&] {
+                while (sampling) {
+                    peak_heap = std::max(peak_heap, HeapInUseMegabytes() - filled_heap);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                }
+            });
+
+            std::atomic<size_t> caught_up(0);
+            std::atomic<int64_t> last_caught_up(0);
+            std::unique_ptr<std::atomic<size_t>[]> received(new std::atomic<size_t>[num_subscribers]);
+            std::vector<std::unique_ptr<SubscriberClient>> subscribers;
+            int64_t start = pubsub::common::steadyNanos();
+            for (size_t i = 0; run > 0 && i < num_subscribers; i++) {
+                received[i] = 0;
+                subscribers.emplace_back(new SubscriberClient(pubsub::common::createChannel(server.address)));
+                std::atomic<size_t>* count = &received[i];
+                subscribers.back()->SubscribeToMultiple({"bench"}, [&, count](const std::string&, const Message&) {
+                    // Messages arrive in sequence order, so this one ends the backlog
+                    if (++*count == messages) {
+                        last_caught_up = pubsub::common::steadyNanos();
+                        caught_up++;
+                    }
+                });
+            }
+
+            {
+                AsyncPublisher publisher(server.address, ProducerOptions());
+                std::string payload(payload_bytes, 'x');
+                int64_t paced_start = pubsub::common::steadyNanos();
+                for (size_t i = 0; i < 2000 || (run > 0 && caught_up < num_subscribers); i++) {
+                    int64_t scheduled = paced_start + static_cast<int64_t>(i) * 1000000;
+                    if (scheduled - start > 120000000000LL) {
+                        break;
+                    }
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(scheduled - pubsub::common::steadyNanos()));
+                    // Callbacks run on the publisher's single completion thread
+                    publisher.PublishAsync("bench", payload, [&latency, scheduled](const PublishResult&) {
+                        latency.Record(pubsub::common::steadyNanos() - scheduled);
+                    });
+                }
+                publisher.Flush();
+            }
+            if (run > 0 && caught_up == num_subscribers) {
+                catch_up_ms = (last_caught_up - start) / 1e6;
+            }
+            sampling = false;
+            sampler.join();
+            for (auto& subscriber : subscribers) {
+                subscriber->Stop();
+            }
+        }
+
+        std::string label = run == 0 ? "no subscribers" : run == 1 ? "unlimited"
+                          : "shared " + std::to_string(messages) + " msg/s";
+        auto ms = [](int64_t nanos) { return nanos / 1e6; };
+        std::cout << std::left << std::setw(24) << label << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(10) << ms(latency.ValueAt(0.5)) << std::setw(10) << ms(latency.ValueAt(0.99))
+                  << std::setw(10) << ms(latency.Max()) << std::setw(14) << std::setprecision(0) << catch_up_ms
+                  << std::setw(14) << std::setprecision(1) << peak_heap << std::endl;
+    }
+}
+
+/**
+ * @brief Receive statistics kept the simple way: one map of topics guarded by a mutex.
+ */
+class LockedStats {
+public:
+    void Record(const Message& message) {
+        int64_t latency = pubsub::common::getCurrentTimestamp() - message.timestamp();
+        std::lock_guard<std::mutex> lock(mutex_);
+        Counters& counters = topics_[message.topic()];
+        counters.messages++;
+        counters.bytes += message.content().size();
+        counters.latency.Record(latency);
+    }
+
+private:
+    struct Counters {
+        uint64_t messages = 0;
+        uint64_t bytes = 0;
+        pubsub::common::LatencyHistogram latency;
+    };
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, Counters> topics_;
+};
+
+/**
+ * @brief Time recording messages from several threads at once while a reporter collects.
+ * @param threads Number of recording threads
+ * @param messages Messages recorded by each thread
+ * @param record Records one message
+ * @param collect Collects what was recorded; called every millisecond during the run
+ * @return Nanoseconds per recorded message per thread
+ */
+double TimeRecording(size_t threads, size_t messages, const std::function<void(const Message&)>& record,
+                     const std::function<void()>& collect) {
+    std::vector<std::vector<Message>> inputs(threads);
+    for (size_t t = 0; t < threads; t++) {
+        for (size_t i = 0; i < 64; i++) {
+            Message message;
+            message.set_topic("topic-" + std::to_string(i % 8));
+            message.set_partition(static_cast<uint32_t>(t));
+            message.set_sequence(i);
+            message.set_content(std::string(32, 'x'));
+            message.set_timestamp(pubsub::common::getCurrentTimestamp());
+            inputs[t].push_back(message);
+        }
+    }
+    std::atomic<bool> recording(true);
+    std::thread reporter([&] {
+        while (recording) {
+            collect();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    int64_t start = pubsub::common::steadyNanos();
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            std::vector<Message>& input = inputs[t];
+            for (size_t i = 0; i < messages; i++) {
+                Message& message = input[i % input.size()];
+                message.set_sequence(i);
+                record(message);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double ns = static_cast<double>(pubsub::common::steadyNanos() - start) / messages;
+    recording = false;
+    reporter.join();
+    return ns;
+}
+
+/**
+ * @brief Measure what recording receive statistics costs.
+ *
+ * First without gRPC: threads record messages over 8 topics into
+ * SubscriberStats, which keeps a shard per thread, and into one map guarded
+ * by a mutex, while a reporter collects every millisecond. Then end to end:
+ * a backlog is delivered to a subscriber with and without statistics.
+ *
+ * @param messages Messages recorded per thread, and in the delivered backlog
+ * @param payload_bytes Size of each delivered message's content
+ */
+void RunStats(size_t messages, size_t payload_bytes) {
+    std::cout << "Recording " << messages << " messages per thread" << std::endl;
+    std::cout << std::left << std::setw(24) << "threads" << std::right << std::setw(14) << "shards ns"
+              << std::setw(14) << "locked ns" << std::endl;
+    for (size_t threads : {size_t(1), size_t(2), size_t(4)}) {
+        SubscriberStats stats;
+        std::vector<SubscriberStats::TopicReport> reports;
+        double sharded = TimeRecording(threads, messages, [&stats](const Message& message) {
+            stats.Record(message);
+        }, [&stats, &reports] { stats.Collect(&reports); });
+        LockedStats locked;
+        double single = TimeRecording(threads, messages, [&locked](const Message& message) {
+            locked.Record(message);
+        }, [] {});
+        std::cout << std::left << std::setw(24) << threads << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(14) << sharded << std::setw(14) << single << std::endl;
+    }
+
+    std::cout << "Delivering " << messages << " messages of " << payload_bytes << " bytes" << std::endl;
+    std::cout << std::left << std::setw(24) << "delivery" << std::right << std::setw(14) << "msg/s" << std::endl;
+    for (bool with_stats : {false, true}) {
+        double rate;
+        {
+            QuietScope quiet;
+            BenchServer server(messages);
+            Fill(server.address, {"bench"}, messages, payload_bytes);
+            rate = TimeDelivery(server.address, {"bench"}, messages, 256, false, pubsub::common::ChannelOptions(),
+                                with_stats ? std::make_shared<SubscriberStats>() : nullptr);
+        }
+        std::cout << std::left << std::setw(24) << (with_stats ? "with statistics" : "without statistics")
+                  << std::right << std::setw(14) << std::fixed << std::setprecision(0) << rate << std::endl;
+    }
+}
+
+}  // namespace
+
+/**
+ * @brief Main function for the benchmark.
+ * @param argc Number of command line arguments
+ * @param argv Array of command line arguments
+ * @return int Exit status
+ */
+int main(int argc, char** argv) {
+    std::string mode = argc > 1 ? argv[1] : "";
+    size_t messages = argc > 2 ? std::stoul(argv[2]) : 100000;
+    size_t payload_bytes = argc > 3 ? std::stoul(argv[3]) : 32;
+
+    if (mode == "coalesce") {
+        RunCoalesce(messages, payload_bytes);
+        return 0;
+    }
+    if (mode == "fanin") {
+        RunFanIn(messages, payload_bytes);
+        return 0;
+    }
+    if (mode == "shm") {
+        RunSharedMemory(messages, payload_bytes);
+        return 0;
+    }
+    if (mode == "transport") {
+        RunTransport(messages, payload_bytes);
+        return 0;
+    }
+    if (mode == "snapshot") {
+        RunSnapshot(messages, payload_bytes);
+        return 0;
+    }
+    if (mode == "topics") {
+        RunTopics(messages, payload_bytes);
+        return 0;
+    }
+    if (mode == "quota") {
+        RunQuota(messages, payload_bytes);
+        return 0;
+    }
+    if (mode == "affinity") {
+        RunAffinity(messages, payload_bytes);
+        return 0;
+    }
+    if (mode == "scheduled") {
+        RunScheduled(messages, payload_bytes);
+        return 0;
+    }
+    if (mode == "compacted") {
+        RunCompacted(messages, payload_bytes);
+        return 0;
+    }
+    if (mode == "passthrough") {
+        RunPassthrough(messages, payload_bytes);
+        return 0;
+    }
+    if (mode == "catchup") {
+        RunCatchUp(messages, payload_bytes);
+        return 0;
+    }
+    if (mode == "stats") {
+        RunStats(messages, payload_bytes);
+        return 0;
+    }
+
+    std::cerr << "Usage: " << argv[0] << " <mode> [messages] [payload_bytes]" << std::endl;
+    std::cerr << "Modes: coalesce, fanin, shm, transport, snapshot, topics, quota, affinity, scheduled, compacted,"
+              << " passthrough, catchup, stats" << std::endl;
+    return 1;
+}
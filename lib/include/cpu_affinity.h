@@ -0,0 +1,83 @@
+/**
+ * @file cpu_affinity.h
+ * @brief CPU sets, their NUMA topology and thread pinning.
+ */
+
+#ifndef CPU_AFFINITY_H
+#define CPU_AFFINITY_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace pubsub {
+namespace common {
+
+/**
+ * @brief Parse a CPU list in the kernel's format, such as "0-3,8,10-11".
+ * @param list The list
+ * @param cpus Receives the CPUs in ascending order, without duplicates
+ * @return true if the list was well formed
+ */
+bool parseCpuList(const std::string& list, std::vector<int>* cpus);
+
+/**
+ * @brief Get the CPUs the calling thread may run on.
+ * @return The CPUs in ascending order
+ */
+std::vector<int> allowedCpus();
+
+/**
+ * @brief Restrict the calling thread to a set of CPUs.
+ *
+ * Threads started afterwards by the calling thread inherit the set.
+ *
+ * @param cpus The CPUs; must not be empty
+ * @return true if the affinity was changed
+ */
+bool pinCurrentThread(const std::vector<int>& cpus);
+
+/**
+ * @class CpuLayout
+ * @brief A set of CPUs grouped by the NUMA node they belong to.
+ *
+ * The nodes are read from sysfs; where it is not available every CPU is
+ * placed on a single node. Only nodes holding at least one of the CPUs are
+ * kept, numbered densely from zero in order of their first CPU.
+ */
+class CpuLayout {
+public:
+    /**
+     * @brief Constructs the layout of a set of CPUs.
+     * @param cpus The CPUs; the CPUs the calling thread may run on when empty
+     */
+    explicit CpuLayout(const std::vector<int>& cpus = std::vector<int>());
+
+    /**
+     * @brief Get the number of NUMA nodes the CPUs span.
+     * @return The node count, at least one
+     */
+    size_t NodeCount() const { return nodes_.size(); }
+
+    /**
+     * @brief Get the CPUs of one node.
+     * @param node A node index below NodeCount()
+     * @return The node's CPUs in ascending order
+     */
+    const std::vector<int>& NodeCpus(size_t node) const { return nodes_[node]; }
+
+    /**
+     * @brief Get every CPU of the layout.
+     * @return The CPUs in ascending order
+     */
+    const std::vector<int>& Cpus() const { return cpus_; }
+
+private:
+    std::vector<int> cpus_;
+    std::vector<std::vector<int>> nodes_;
+};
+
+} // namespace common
+} // namespace pubsub
+
+#endif // CPU_AFFINITY_H
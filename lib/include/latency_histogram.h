@@ -0,0 +1,144 @@
+/**
+ * @file latency_histogram.h
+ * @brief Declaration of the fixed-size histogram used to summarize latencies.
+ */
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace pubsub {
+namespace common {
+
+/**
+ * @class LatencyHistogram
+ * @brief Log-linear histogram of non-negative integer values, such as latencies in nanoseconds.
+ *
+ * Values below 128 get a bucket each; above that every power of two is split
+ * into 64 equal buckets, so any recorded value is reported within 1/64 (about
+ * 1.6%) of its true value over the full 64-bit range, in a fixed 30 KB of
+ * counters. Recording is an index computation and an increment, with no
+ * allocation, so it can run on a hot path. The count, minimum, maximum and
+ * sum are kept exactly.
+ *
+ * A histogram is not synchronized; give each recording thread its own and
+ * Merge them to report.
+ */
+class LatencyHistogram {
+public:
+    /**
+     * @brief Constructs an empty histogram.
+     */
+    LatencyHistogram();
+
+    /**
+     * @brief Count one value.
+     * @param value The value; negative values are counted as zero
+     */
+    void Record(int64_t value);
+
+    /**
+     * @brief Add every value counted by another histogram.
+     * @param other The histogram to add
+     */
+    void Merge(const LatencyHistogram& other);
+
+    /**
+     * @brief Forget every value.
+     */
+    void Reset();
+
+    /**
+     * @brief Get the value at a quantile.
+     * @param quantile The quantile, from 0 to 1 (0.99 for the 99th percentile)
+     * @return The highest value of the bucket holding that rank, capped at Max(); 0 when empty
+     */
+    int64_t ValueAt(double quantile) const;
+
+    /**
+     * @brief Get the number of values counted.
+     * @return The count
+     */
+    uint64_t Count() const { return count_; }
+
+    /**
+     * @brief Get the smallest value counted.
+     * @return The minimum, or 0 when empty
+     */
+    int64_t Min() const { return count_ ? min_ : 0; }
+
+    /**
+     * @brief Get the largest value counted.
+     * @return The maximum, or 0 when empty
+     */
+    int64_t Max() const { return max_; }
+
+    /**
+     * @brief Get the mean of the values counted.
+     * @return The mean, or 0 when empty
+     */
+    double Mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0; }
+
+private:
+    friend class ConcurrentLatencyHistogram;
+
+    static size_t BucketOf(uint64_t value);
+    static uint64_t HighestValueOf(size_t bucket);
+
+    std::vector<uint64_t> counts_;
+    uint64_t count_;
+    int64_t min_;
+    int64_t max_;
+    int64_t sum_;
+};
+
+/**
+ * @class ConcurrentLatencyHistogram
+ * @brief A LatencyHistogram that one thread records into while another drains it, without locks.
+ *
+ * The buckets are the same as LatencyHistogram's, held in atomics that only
+ * the recording thread writes, with plain relaxed loads and stores: no
+ * read-modify-write, so recording costs what LatencyHistogram's does. The
+ * draining thread never writes them; it remembers the counts it has taken
+ * and adds only the difference, so it can take interval statistics while
+ * recording continues. The interval's minimum and maximum are therefore
+ * those of its lowest and highest buckets, within the same 1/64 as the
+ * quantiles.
+ *
+ * Only one thread may record, and one drain at a time.
+ */
+class ConcurrentLatencyHistogram {
+public:
+    /**
+     * @brief Constructs an empty histogram.
+     */
+    ConcurrentLatencyHistogram();
+
+    /**
+     * @brief Count one value; called only by the recording thread.
+     * @param value The value; negative values are counted as zero
+     */
+    void Record(int64_t value);
+
+    /**
+     * @brief Add every value counted since the last drain to a histogram; called from any thread.
+     * @param into The histogram the values are added to
+     */
+    void Drain(LatencyHistogram* into);
+
+private:
+    std::unique_ptr<std::atomic<uint64_t>[]> counts_;  // Written by the recording thread
+    std::atomic<int64_t> sum_;
+    std::vector<uint64_t> drained_;                    // Counts already taken; used by Drain only
+    int64_t drained_sum_;
+};
+
+} // namespace common
+} // namespace pubsub
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,73 @@
+/**
+ * @file pubsub_channel.h
+ * @brief Client channel settings shared by the producer and subscriber libraries.
+ */
+
+#ifndef PUBSUB_CHANNEL_H
+#define PUBSUB_CHANNEL_H
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <grpcpp/grpcpp.h>
+
+namespace pubsub {
+namespace common {
+
+/**
+ * @struct ChannelOptions
+ * @brief Transport settings for a client channel; zero leaves the gRPC default.
+ *
+ * The settings mirror the server's ServerOptions. Keepalive pings more
+ * frequent than the server's keepalive_min_ping_interval are answered with
+ * GOAWAY, so the two must be raised together.
+ */
+struct ChannelOptions {
+    // Give the channel its own connection instead of sharing one with identical channels
+    bool local_subchannel_pool = false;
+
+    // Largest message the channel accepts (gRPC default: 4 MiB); -1 for unlimited
+    int max_receive_message_bytes = 0;
+
+    // Largest message the channel sends (gRPC default: unlimited)
+    int max_send_message_bytes = 0;
+
+    // Grow the HTTP/2 flow-control window from bandwidth-delay-product probes
+    bool bdp_probe = true;
+
+    // Interval between keepalive pings on an idle connection (0 disables them)
+    std::chrono::milliseconds keepalive_time{0};
+
+    // How long to wait for a keepalive ping to be answered before closing the connection
+    std::chrono::milliseconds keepalive_timeout{20000};
+
+    // Send keepalive pings even while no call is open
+    bool keepalive_permit_without_calls = false;
+};
+
+/**
+ * @brief Translate channel options into gRPC channel arguments.
+ * @param options The channel settings
+ * @return Arguments for grpc::CreateCustomChannel
+ */
+grpc::ChannelArguments channelArguments(const ChannelOptions& options);
+
+/**
+ * @brief Create a channel to a server with the given settings.
+ *
+ * The target may be a host:port pair or a Unix domain socket address such
+ * as unix:/run/pubsub.sock.
+ *
+ * @param target The server address
+ * @param options The channel settings
+ * @param credentials Channel credentials; insecure when null
+ * @return The channel
+ */
+std::shared_ptr<grpc::Channel> createChannel(const std::string& target,
+                                             const ChannelOptions& options = ChannelOptions(),
+                                             std::shared_ptr<grpc::ChannelCredentials> credentials = nullptr);
+
+} // namespace common
+} // namespace pubsub
+
+#endif // PUBSUB_CHANNEL_H
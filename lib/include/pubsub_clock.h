@@ -0,0 +1,41 @@
+/**
+ * @file pubsub_clock.h
+ * @brief Clock functions used to stamp and time messages.
+ */
+
+#ifndef PUBSUB_CLOCK_H
+#define PUBSUB_CLOCK_H
+
+#include <cstdint>
+
+namespace pubsub {
+namespace common {
+
+/**
+ * @brief Get the cached wall-clock time for stamping messages.
+ *
+ * Returns nanoseconds since the Unix epoch (UTC), the unit of
+ * Message.timestamp, so stamps from hosts with synchronized clocks can be
+ * compared. The value is refreshed about once a millisecond by a background
+ * thread started on first use; reading it is a single atomic load with no
+ * system or vDSO call. It never decreases: if the system clock steps
+ * backwards the cached time holds still until the system clock catches up.
+ *
+ * @return The cached time in nanoseconds since the Unix epoch
+ */
+int64_t coarseWallNanos();
+
+/**
+ * @brief Get a precise monotonic time for measuring intervals.
+ *
+ * Reads std::chrono::steady_clock. The epoch is arbitrary, so the value is
+ * only meaningful as a difference between two readings in one process.
+ *
+ * @return Nanoseconds since an arbitrary fixed point
+ */
+int64_t steadyNanos();
+
+} // namespace common
+} // namespace pubsub
+
+#endif // PUBSUB_CLOCK_H
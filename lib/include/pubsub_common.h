@@ -18,9 +18,23 @@ namespace common {
  */
 std::string generateMessageId();
 
+/**
+ * @brief Generate a unique message ID into an existing string.
+ *
+ * The ID is formatted on the stack and assigned to @p id, so a string that
+ * already has enough capacity is reused without allocating.
+ *
+ * @param id The string that receives the identifier
+ */
+void generateMessageId(std::string* id);
+
 /**
  * @brief Get the current timestamp.
- * @return The current time as an integer timestamp.
+ *
+ * Reads the cached clock of coarseWallNanos(), so it costs no system call
+ * and never decreases; the resolution is about a millisecond.
+ *
+ * @return The current time in nanoseconds since the Unix epoch (UTC)
  */
 int64_t getCurrentTimestamp();
 
@@ -0,0 +1,160 @@
+/**
+ * @file shm_ring.h
+ * @brief Declaration of the shared-memory ring buffer used for same-host transport.
+ */
+
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace pubsub {
+namespace common {
+
+/**
+ * @class ShmRing
+ * @brief Single-producer, single-consumer ring of length-prefixed records in POSIX shared memory.
+ *
+ * One process creates the segment and passes its name and a random token to
+ * the other over gRPC; the other opens it and checks the token, so a peer on
+ * another host (where the name does not exist) or a stale segment is
+ * rejected. Once both sides have it mapped the creator unlinks the name and
+ * the memory lives until both unmap it.
+ *
+ * The writer and reader only share two counters, each on its own cache line:
+ * bytes written and bytes read. Handing over a record costs one release
+ * store and one acquire load, with no system call. Records are 8-byte
+ * aligned and never wrap: a record that does not fit before the end of the
+ * buffer is preceded by a wrap marker and written at the start.
+ *
+ * Exactly one thread may write and one thread may read at a time.
+ *
+ * The peer can write anywhere in the segment, so every counter and length
+ * read from it is checked against the capacity and the other counter before
+ * it is used. A ring found inconsistent is marked corrupt and refuses all
+ * further reads and writes; its users drop it and fall back to gRPC.
+ */
+class ShmRing {
+public:
+    /**
+     * @brief Outcome of TryRead.
+     */
+    enum class ReadResult {
+        kRecord,   // A record was read
+        kEmpty,    // No record is waiting
+        kCorrupt   // The peer left the ring inconsistent; it can no longer be used
+    };
+
+    /**
+     * @brief Create and map a new segment under a unique name.
+     * @param capacity Size of the data area in bytes (rounded up to a multiple of 8)
+     * @return The ring, or nullptr if the segment could not be created
+     */
+    static std::unique_ptr<ShmRing> Create(size_t capacity);
+
+    /**
+     * @brief Map a segment created by another process.
+     * @param name The segment name
+     * @param token The token the creator stored in the segment
+     * @return The ring, or nullptr if the segment does not exist or the token does not match
+     */
+    static std::unique_ptr<ShmRing> Open(const std::string& name, uint64_t token);
+
+    /**
+     * @brief Destructor that unmaps the segment, unlinking it first if this side created it.
+     */
+    ~ShmRing();
+
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+
+    /**
+     * @brief Remove the segment's name; the mapping stays valid.
+     */
+    void Unlink();
+
+    /**
+     * @brief Append one record if there is room.
+     * @param data The record bytes
+     * @param size The record length; at most MaxRecordSize()
+     * @return true if the record was written, false if the ring is full or corrupt
+     */
+    bool TryWrite(const void* data, size_t size);
+
+    /**
+     * @brief Remove the oldest record if there is one.
+     * @param record Receives the record bytes
+     * @return Whether a record was read, the ring was empty, or the ring is corrupt
+     */
+    ReadResult TryRead(std::string* record);
+
+    /**
+     * @brief Tell whether a read or write found the ring inconsistent.
+     * @return true if the ring can no longer be used
+     */
+    bool Corrupt() const { return corrupt_; }
+
+    /**
+     * @brief Tell whether the reader has consumed every record written so far.
+     * @return true if the ring is empty
+     */
+    bool Empty() const;
+
+    /**
+     * @brief Get the largest record the ring accepts.
+     * @return The maximum record length in bytes
+     */
+    size_t MaxRecordSize() const;
+
+    /**
+     * @brief Get the segment name to pass to the peer.
+     * @return The name
+     */
+    const std::string& Name() const { return name_; }
+
+    /**
+     * @brief Get the token to pass to the peer.
+     * @return The token
+     */
+    uint64_t Token() const;
+
+    /**
+     * @brief Wait a little longer each round while a ring stays empty or full.
+     *
+     * Spins first, then yields, then sleeps for 50 us, so a busy ring is
+     * served within nanoseconds and an idle one costs little CPU.
+     *
+     * @param rounds Number of unsuccessful rounds so far; incremented
+     */
+    static void Pause(unsigned* rounds);
+
+private:
+    struct Header;
+
+    // Offset of the data area from the start of the segment
+    static const size_t kDataOffset;
+
+    ShmRing(const std::string& name, void* base, size_t mapped_size, bool owner);
+
+    // Mark the ring unusable and report it once
+    void MarkCorrupt(const char* reason);
+
+    std::string name_;
+    void* base_;
+    size_t mapped_size_;
+    bool owner_;
+    bool linked_;
+    Header* header_;
+    char* data_;
+    uint64_t capacity_;     // Copied from the header when mapped, so the peer cannot change it later
+    bool corrupt_;
+};
+
+} // namespace common
+} // namespace pubsub
+
+#endif // SHM_RING_H
@@ -0,0 +1,154 @@
+/**
+ * @file cpu_affinity.cpp
+ * @brief CPU sets, their NUMA topology and thread pinning.
+ */
+
+#include "cpu_affinity.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+
+namespace pubsub {
+namespace common {
+
+namespace {
+
+/**
+ * @brief Find the NUMA node of a CPU from sysfs.
+ *
+ * Each CPU directory contains a nodeN link to the node it belongs to.
+ *
+ * @param cpu The CPU
+ * @return The node number, or 0 when it cannot be determined
+ */
+int numaNodeOfCpu(int cpu) {
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        return 0;
+    }
+    int node = 0;
+    while (dirent* entry = readdir(dir)) {
+        if (std::strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+            node = std::atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+} // namespace
+
+/**
+ * @brief Parse a CPU list in the kernel's format, such as "0-3,8,10-11".
+ * @param list The list
+ * @param cpus Receives the CPUs in ascending order, without duplicates
+ * @return true if the list was well formed
+ */
+bool parseCpuList(const std::string& list, std::vector<int>* cpus) {
+    std::vector<int> parsed;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        std::string range = list.substr(start, end - start);
+        size_t dash = range.find('-');
+        char* rest = nullptr;
+        long first = std::strtol(range.c_str(), &rest, 10);
+        long last = first;
+        if (range.empty() || rest == range.c_str() ||
+            (dash == std::string::npos ? *rest != '\0' : rest != range.c_str() + dash)) {
+            return false;
+        }
+        if (dash != std::string::npos) {
+            const char* second = range.c_str() + dash + 1;
+            last = std::strtol(second, &rest, 10);
+            if (rest == second || *rest != '\0') {
+                return false;
+            }
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE) {
+            return false;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            parsed.push_back(static_cast<int>(cpu));
+        }
+        start = end + 1;
+    }
+    std::sort(parsed.begin(), parsed.end());
+    parsed.erase(std::unique(parsed.begin(), parsed.end()), parsed.end());
+    cpus->swap(parsed);
+    return true;
+}
+
+/**
+ * @brief Get the CPUs the calling thread may run on.
+ * @return The CPUs in ascending order
+ */
+std::vector<int> allowedCpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        return cpus;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+/**
+ * @brief Restrict the calling thread to a set of CPUs.
+ *
+ * Threads started afterwards by the calling thread inherit the set.
+ *
+ * @param cpus The CPUs; must not be empty
+ * @return true if the affinity was changed
+ */
+bool pinCurrentThread(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (error != 0) {
+        std::cerr << "Failed to set CPU affinity: " << std::strerror(error) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Constructs the layout of a set of CPUs.
+ * @param cpus The CPUs; the CPUs the calling thread may run on when empty
+ */
+CpuLayout::CpuLayout(const std::vector<int>& cpus) : cpus_(cpus.empty() ? allowedCpus() : cpus) {
+    std::sort(cpus_.begin(), cpus_.end());
+    // Ordered by first CPU because cpus_ is sorted and each node is inserted at its first CPU
+    std::map<int, size_t> node_index;
+    for (int cpu : cpus_) {
+        auto it = node_index.emplace(numaNodeOfCpu(cpu), nodes_.size()).first;
+        if (it->second == nodes_.size()) {
+            nodes_.emplace_back();
+        }
+        nodes_[it->second].push_back(cpu);
+    }
+    if (nodes_.empty()) {
+        nodes_.emplace_back();
+    }
+}
+
+} // namespace common
+} // namespace pubsub
@@ -0,0 +1,179 @@
+/**
+ * @file latency_histogram.cpp
+ * @brief Implementation of the fixed-size histogram used to summarize latencies.
+ */
+
+#include "latency_histogram.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace pubsub {
+namespace common {
+
+namespace {
+
+// Values below 2^kSubBucketBits are counted exactly; larger powers of two are
+// split into 2^(kSubBucketBits - 1) buckets each
+constexpr int kSubBucketBits = 7;
+constexpr uint64_t kExactLimit = 1ULL << kSubBucketBits;
+constexpr uint64_t kHalfSubBuckets = kExactLimit / 2;
+
+// Bucket of the largest 64-bit value, plus one
+constexpr size_t kBucketCount = (64 - kSubBucketBits) * kHalfSubBuckets + kExactLimit;
+
+} // namespace
+
+/**
+ * @brief Constructs an empty histogram.
+ */
+LatencyHistogram::LatencyHistogram() : counts_(kBucketCount, 0) {
+    Reset();
+}
+
+/**
+ * @brief Count one value.
+ * @param value The value; negative values are counted as zero
+ */
+void LatencyHistogram::Record(int64_t value) {
+    value = std::max<int64_t>(value, 0);
+    counts_[BucketOf(static_cast<uint64_t>(value))]++;
+    count_++;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+    sum_ += value;
+}
+
+/**
+ * @brief Add every value counted by another histogram.
+ * @param other The histogram to add
+ */
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < kBucketCount; i++) {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+    sum_ += other.sum_;
+}
+
+/**
+ * @brief Forget every value.
+ */
+void LatencyHistogram::Reset() {
+    std::fill(counts_.begin(), counts_.end(), 0);
+    count_ = 0;
+    min_ = std::numeric_limits<int64_t>::max();
+    max_ = 0;
+    sum_ = 0;
+}
+
+/**
+ * @brief Get the value at a quantile.
+ * @param quantile The quantile, from 0 to 1 (0.99 for the 99th percentile)
+ * @return The highest value of the bucket holding that rank, capped at Max(); 0 when empty
+ */
+int64_t LatencyHistogram::ValueAt(double quantile) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    quantile = std::min(std::max(quantile, 0.0), 1.0);
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(quantile * count_)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBucketCount; i++) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            return std::min<int64_t>(static_cast<int64_t>(HighestValueOf(i)), max_);
+        }
+    }
+    return max_;
+}
+
+/**
+ * @brief Map a value to its bucket.
+ *
+ * A value in [2^m, 2^(m+1)) with m >= kSubBucketBits is shifted right until
+ * it lies in [kHalfSubBuckets, kExactLimit); the shift selects the group of
+ * buckets and the shifted value the bucket within it.
+ *
+ * @param value The value
+ * @return The bucket index
+ */
+size_t LatencyHistogram::BucketOf(uint64_t value) {
+    if (value < kExactLimit) {
+        return static_cast<size_t>(value);
+    }
+    int magnitude = 63 - __builtin_clzll(value);
+    int shift = magnitude - kSubBucketBits + 1;
+    return static_cast<size_t>(shift) * kHalfSubBuckets + static_cast<size_t>(value >> shift);
+}
+
+/**
+ * @brief Get the largest value that maps to a bucket.
+ * @param bucket The bucket index
+ * @return The bucket's upper bound, inclusive
+ */
+uint64_t LatencyHistogram::HighestValueOf(size_t bucket) {
+    if (bucket < kExactLimit) {
+        return bucket;
+    }
+    size_t shift = (bucket - kExactLimit) / kHalfSubBuckets + 1;
+    uint64_t sub = bucket - shift * kHalfSubBuckets;
+    return ((sub + 1) << shift) - 1;
+}
+
+/**
+ * @brief Constructs an empty histogram.
+ */
+ConcurrentLatencyHistogram::ConcurrentLatencyHistogram()
+    : counts_(new std::atomic<uint64_t>[kBucketCount]()), sum_(0), drained_(kBucketCount, 0), drained_sum_(0) {}
+
+/**
+ * @brief Count one value; called only by the recording thread.
+ * @param value The value; negative values are counted as zero
+ */
+void ConcurrentLatencyHistogram::Record(int64_t value) {
+    value = std::max<int64_t>(value, 0);
+    std::atomic<uint64_t>& count = counts_[LatencyHistogram::BucketOf(static_cast<uint64_t>(value))];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    sum_.store(sum_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Add every value counted since the last drain to a histogram; called from any thread.
+ *
+ * The buckets and the sum are read one after another while recording goes
+ * on, so a value recorded meanwhile may have its bucket taken in one drain
+ * and its share of the sum in the next.
+ *
+ * @param into The histogram the values are added to
+ */
+void ConcurrentLatencyHistogram::Drain(LatencyHistogram* into) {
+    uint64_t taken = 0;
+    size_t lowest = kBucketCount;
+    size_t highest = 0;
+    for (size_t i = 0; i < kBucketCount; i++) {
+        uint64_t count = counts_[i].load(std::memory_order_relaxed);
+        if (count != drained_[i]) {
+            into->counts_[i] += count - drained_[i];
+            taken += count - drained_[i];
+            drained_[i] = count;
+            lowest = std::min(lowest, i);
+            highest = i;
+        }
+    }
+    int64_t sum = sum_.load(std::memory_order_relaxed);
+    into->sum_ += sum - drained_sum_;
+    drained_sum_ = sum;
+    if (taken == 0) {
+        return;
+    }
+    into->count_ += taken;
+    into->min_ = std::min(into->min_, static_cast<int64_t>(
+        lowest == 0 ? 0 : LatencyHistogram::HighestValueOf(lowest - 1) + 1));
+    into->max_ = std::max(into->max_, static_cast<int64_t>(LatencyHistogram::HighestValueOf(highest)));
+}
+
+} // namespace common
+} // namespace pubsub
@@ -0,0 +1,57 @@
+/**
+ * @file pubsub_channel.cpp
+ * @brief Client channel settings shared by the producer and subscriber libraries.
+ */
+
+#include "pubsub_channel.h"
+
+namespace pubsub {
+namespace common {
+
+/**
+ * @brief Translate channel options into gRPC channel arguments.
+ * @param options The channel settings
+ * @return Arguments for grpc::CreateCustomChannel
+ */
+grpc::ChannelArguments channelArguments(const ChannelOptions& options) {
+    grpc::ChannelArguments args;
+    if (options.local_subchannel_pool) {
+        // Without a local subchannel pool, channels with identical arguments share one connection
+        args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+    }
+    if (options.max_receive_message_bytes != 0) {
+        args.SetMaxReceiveMessageSize(options.max_receive_message_bytes);
+    }
+    if (options.max_send_message_bytes != 0) {
+        args.SetMaxSendMessageSize(options.max_send_message_bytes);
+    }
+    if (!options.bdp_probe) {
+        args.SetInt(GRPC_ARG_HTTP2_BDP_PROBE, 0);
+    }
+    if (options.keepalive_time.count() > 0) {
+        args.SetInt(GRPC_ARG_KEEPALIVE_TIME_MS, static_cast<int>(options.keepalive_time.count()));
+        args.SetInt(GRPC_ARG_KEEPALIVE_TIMEOUT_MS, static_cast<int>(options.keepalive_timeout.count()));
+        args.SetInt(GRPC_ARG_KEEPALIVE_PERMIT_WITHOUT_CALLS, options.keepalive_permit_without_calls ? 1 : 0);
+        // Keepalive pings carry no data; without this the client stops after two of them
+        args.SetInt(GRPC_ARG_HTTP2_MAX_PINGS_WITHOUT_DATA, 0);
+    }
+    return args;
+}
+
+/**
+ * @brief Create a channel to a server with the given settings.
+ * @param target The server address
+ * @param options The channel settings
+ * @param credentials Channel credentials; insecure when null
+ * @return The channel
+ */
+std::shared_ptr<grpc::Channel> createChannel(const std::string& target, const ChannelOptions& options,
+                                             std::shared_ptr<grpc::ChannelCredentials> credentials) {
+    if (!credentials) {
+        credentials = grpc::InsecureChannelCredentials();
+    }
+    return grpc::CreateCustomChannel(target, credentials, channelArguments(options));
+}
+
+} // namespace common
+} // namespace pubsub
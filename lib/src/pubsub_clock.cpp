@@ -0,0 +1,79 @@
+/**
+ * @file pubsub_clock.cpp
+ * @brief Clock functions used to stamp and time messages.
+ */
+
+#include "pubsub_clock.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace pubsub {
+namespace common {
+
+namespace {
+
+// How often the background thread refreshes the cached wall-clock time
+constexpr std::chrono::milliseconds kCoarseClockInterval(1);
+
+/**
+ * @brief Read the system wall clock.
+ * @return Nanoseconds since the Unix epoch
+ */
+int64_t systemWallNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @class CoarseClock
+ * @brief Wall-clock time cached in an atomic and refreshed by a background thread.
+ *
+ * The instance is created on first use and deliberately never destroyed, so
+ * threads that stamp messages during process shutdown never see it torn
+ * down.
+ */
+class CoarseClock {
+public:
+    CoarseClock() : now_(systemWallNanos()) {
+        std::thread(&CoarseClock::run, this).detach();
+    }
+
+    int64_t now() const { return now_.load(std::memory_order_relaxed); }
+
+private:
+    void run() {
+        while (true) {
+            std::this_thread::sleep_for(kCoarseClockInterval);
+            int64_t wall = systemWallNanos();
+            if (wall > now_.load(std::memory_order_relaxed)) {
+                now_.store(wall, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::atomic<int64_t> now_;
+};
+
+} // namespace
+
+/**
+ * @brief Get the cached wall-clock time for stamping messages.
+ * @return The cached time in nanoseconds since the Unix epoch
+ */
+int64_t coarseWallNanos() {
+    static CoarseClock* clock = new CoarseClock;
+    return clock->now();
+}
+
+/**
+ * @brief Get a precise monotonic time for measuring intervals.
+ * @return Nanoseconds since an arbitrary fixed point
+ */
+int64_t steadyNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace common
+} // namespace pubsub
@@ -4,8 +4,11 @@
  */
 
 #include "pubsub_common.h"
+#include "pubsub_clock.h"
+#include <atomic>
 #include <string>
-#include <chrono>
+#include <cstdio>
+#include <cinttypes>
 
 namespace pubsub {
 namespace common {
@@ -15,17 +18,34 @@ namespace common {
  * @return A unique string identifier for a message.
  */
 std::string generateMessageId() {
-    static int counter = 0;
-    return std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) 
-           + "-" + std::to_string(counter++);
+    std::string id;
+    generateMessageId(&id);
+    return id;
+}
+
+/**
+ * @brief Generate a unique message ID into an existing string.
+ *
+ * The ID combines the cached clock with a process-wide counter. Safe to call
+ * from several threads; the counter is atomic.
+ *
+ * @param id The string that receives the identifier
+ */
+void generateMessageId(std::string* id) {
+    static std::atomic<int> counter(0);
+    char buf[48];
+    int len = std::snprintf(buf, sizeof(buf), "%" PRId64 "-%d",
+                            coarseWallNanos(),
+                            counter.fetch_add(1, std::memory_order_relaxed));
+    id->assign(buf, static_cast<size_t>(len));
 }
 
 /**
  * @brief Get the current timestamp.
- * @return The current time as an integer timestamp.
+ * @return The cached wall-clock time in nanoseconds since the Unix epoch
  */
 int64_t getCurrentTimestamp() {
-    return std::chrono::system_clock::now().time_since_epoch().count();
+    return coarseWallNanos();
 }
 
 } // namespace common
@@ -0,0 +1,325 @@
+/**
+ * @file shm_ring.cpp
+ * @brief Implementation of the shared-memory ring buffer used for same-host transport.
+ */
+
+#include "shm_ring.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <random>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace pubsub {
+namespace common {
+
+namespace {
+
+// Identifies an initialized segment ("PSRING01")
+constexpr uint64_t kMagic = 0x5053524947303031ULL;
+
+// Length value of the marker that sends the reader back to the start of the buffer
+constexpr uint32_t kWrapMarker = 0xFFFFFFFFu;
+
+// Bytes of the length prefix in front of every record
+constexpr size_t kLengthSize = sizeof(uint32_t);
+
+/**
+ * @brief Round a size up to a multiple of an alignment.
+ * @param size The size
+ * @param alignment A power of two
+ * @return The rounded size
+ */
+size_t AlignUp(size_t size, size_t alignment) {
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+/**
+ * @brief Generate a random 64-bit value.
+ * @return The value
+ */
+uint64_t RandomU64() {
+    std::random_device rd;
+    return (static_cast<uint64_t>(rd()) << 32) ^ rd();
+}
+
+} // namespace
+
+/**
+ * @struct ShmRing::Header
+ * @brief Layout of the start of the segment; the data area follows at kDataOffset.
+ *
+ * Both processes access the counters through std::atomic, which is only
+ * valid across processes because 64-bit atomics are lock-free here.
+ */
+struct ShmRing::Header {
+    uint64_t magic;
+    uint64_t token;
+    uint64_t capacity;
+    alignas(64) std::atomic<uint64_t> head;   // Bytes written, advanced by the writer only
+    alignas(64) std::atomic<uint64_t> tail;   // Bytes read, advanced by the reader only
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared-memory counters must be lock-free");
+
+const size_t ShmRing::kDataOffset = AlignUp(sizeof(ShmRing::Header), 64);
+
+/**
+ * @brief Create and map a new segment under a unique name.
+ * @param capacity Size of the data area in bytes (rounded up to a multiple of 8)
+ * @return The ring, or nullptr if the segment could not be created
+ */
+std::unique_ptr<ShmRing> ShmRing::Create(size_t capacity) {
+    static std::atomic<unsigned> counter(0);
+    capacity = AlignUp(std::max<size_t>(capacity, 64), 8);
+    std::string name = "/pubsub-" + std::to_string(getpid()) + "-" + std::to_string(counter++) +
+                       "-" + std::to_string(RandomU64() & 0xFFFFFFFF);
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        std::cerr << "Cannot create shared memory segment " << name << ": " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+    size_t mapped_size = kDataOffset + capacity;
+    void* base = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(mapped_size)) == 0) {
+        base = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    int error = errno;
+    close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "Cannot map shared memory segment " << name << ": " << std::strerror(error) << std::endl;
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+
+    Header* header = new (base) Header;
+    header->token = RandomU64();
+    header->capacity = capacity;
+    header->head.store(0, std::memory_order_relaxed);
+    header->tail.store(0, std::memory_order_relaxed);
+    header->magic = kMagic;
+    return std::unique_ptr<ShmRing>(new ShmRing(name, base, mapped_size, true));
+}
+
+/**
+ * @brief Map a segment created by another process.
+ * @param name The segment name
+ * @param token The token the creator stored in the segment
+ * @return The ring, or nullptr if the segment does not exist or the token does not match
+ */
+std::unique_ptr<ShmRing> ShmRing::Open(const std::string& name, uint64_t token) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        std::cerr << "Cannot open shared memory segment " << name << ": " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+    struct stat st;
+    void* base = MAP_FAILED;
+    size_t mapped_size = 0;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) > kDataOffset) {
+        mapped_size = static_cast<size_t>(st.st_size);
+        base = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "Cannot map shared memory segment " << name << std::endl;
+        return nullptr;
+    }
+
+    const Header* header = static_cast<const Header*>(base);
+    uint64_t capacity = header->capacity;
+    if (header->magic != kMagic || header->token != token || capacity < 64 || capacity % 8 != 0 ||
+        capacity > mapped_size - kDataOffset) {
+        std::cerr << "Shared memory segment " << name << " does not belong to this peer" << std::endl;
+        munmap(base, mapped_size);
+        return nullptr;
+    }
+    return std::unique_ptr<ShmRing>(new ShmRing(name, base, mapped_size, false));
+}
+
+/**
+ * @brief Wraps a mapped segment.
+ * @param name The segment name
+ * @param base Start of the mapping
+ * @param mapped_size Length of the mapping
+ * @param owner Whether this side created the segment
+ */
+ShmRing::ShmRing(const std::string& name, void* base, size_t mapped_size, bool owner)
+    : name_(name), base_(base), mapped_size_(mapped_size), owner_(owner), linked_(owner),
+      header_(static_cast<Header*>(base)), data_(static_cast<char*>(base) + kDataOffset),
+      capacity_(header_->capacity), corrupt_(false) {}
+
+/**
+ * @brief Destructor that unmaps the segment, unlinking it first if this side created it.
+ */
+ShmRing::~ShmRing() {
+    Unlink();
+    munmap(base_, mapped_size_);
+}
+
+/**
+ * @brief Remove the segment's name; the mapping stays valid.
+ *
+ * Only the creating side unlinks; on the other side this does nothing.
+ */
+void ShmRing::Unlink() {
+    if (owner_ && linked_) {
+        shm_unlink(name_.c_str());
+        linked_ = false;
+    }
+}
+
+/**
+ * @brief Append one record if there is room.
+ *
+ * The record is copied in first and published by a release store of the
+ * head, so the reader never sees a partially written record.
+ *
+ * @param data The record bytes
+ * @param size The record length; at most MaxRecordSize()
+ * @return true if the record was written, false if the ring is full
+ */
+bool ShmRing::TryWrite(const void* data, size_t size) {
+    if (corrupt_ || size > MaxRecordSize()) {
+        return false;
+    }
+    uint64_t head = header_->head.load(std::memory_order_relaxed);
+    uint64_t tail = header_->tail.load(std::memory_order_acquire);
+    if (head - tail > capacity_ || head % 8 != 0 || tail % 8 != 0) {
+        MarkCorrupt("counters out of range");
+        return false;
+    }
+    size_t need = AlignUp(kLengthSize + size, 8);
+    size_t pos = head % capacity_;
+    size_t contiguous = capacity_ - pos;
+    size_t total = need <= contiguous ? need : contiguous + need;
+    if (capacity_ - (head - tail) < total) {
+        return false;
+    }
+
+    if (need > contiguous) {
+        std::memcpy(data_ + pos, &kWrapMarker, kLengthSize);
+        head += contiguous;
+        pos = 0;
+    }
+    uint32_t length = static_cast<uint32_t>(size);
+    std::memcpy(data_ + pos, &length, kLengthSize);
+    std::memcpy(data_ + pos + kLengthSize, data, size);
+    header_->head.store(head + need, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Remove the oldest record if there is one.
+ *
+ * The counters and the length are each loaded once and checked before use:
+ * the unread bytes must fit the capacity, a record must lie wholly before
+ * both the end of the buffer and the head, and so must the record after a
+ * wrap marker.
+ *
+ * @param record Receives the record bytes
+ * @return Whether a record was read, the ring was empty, or the ring is corrupt
+ */
+ShmRing::ReadResult ShmRing::TryRead(std::string* record) {
+    if (corrupt_) {
+        return ReadResult::kCorrupt;
+    }
+    uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+    uint64_t head = header_->head.load(std::memory_order_acquire);
+    if (head - tail > capacity_ || head % 8 != 0 || tail % 8 != 0) {
+        MarkCorrupt("counters out of range");
+        return ReadResult::kCorrupt;
+    }
+    if (tail == head) {
+        return ReadResult::kEmpty;
+    }
+    size_t pos = tail % capacity_;
+    uint32_t length;
+    std::memcpy(&length, data_ + pos, kLengthSize);
+    if (length == kWrapMarker) {
+        // The writer publishes the marker together with the record after it
+        tail += capacity_ - pos;
+        pos = 0;
+        if (tail >= head) {
+            MarkCorrupt("wrap marker without a record");
+            return ReadResult::kCorrupt;
+        }
+        std::memcpy(&length, data_, kLengthSize);
+    }
+    size_t size = AlignUp(kLengthSize + static_cast<size_t>(length), 8);
+    if (length > MaxRecordSize() || pos + size > capacity_ || size > head - tail) {
+        MarkCorrupt("record out of range");
+        return ReadResult::kCorrupt;
+    }
+    record->assign(data_ + pos + kLengthSize, length);
+    header_->tail.store(tail + size, std::memory_order_release);
+    return ReadResult::kRecord;
+}
+
+/**
+ * @brief Tell whether the reader has consumed every record written so far.
+ * @return true if the ring is empty
+ */
+bool ShmRing::Empty() const {
+    return header_->tail.load(std::memory_order_acquire) == header_->head.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Get the largest record the ring accepts.
+ *
+ * Half the capacity, so that a record always fits once the ring has
+ * drained, even when it has to wrap.
+ *
+ * @return The maximum record length in bytes
+ */
+size_t ShmRing::MaxRecordSize() const {
+    return capacity_ / 2 - kLengthSize;
+}
+
+/**
+ * @brief Mark the ring unusable and report it once.
+ * @param reason What was found inconsistent
+ */
+void ShmRing::MarkCorrupt(const char* reason) {
+    if (!corrupt_) {
+        std::cerr << "Corrupt shared memory segment " << name_ << ": " << reason << std::endl;
+        corrupt_ = true;
+    }
+}
+
+/**
+ * @brief Get the token to pass to the peer.
+ * @return The token
+ */
+uint64_t ShmRing::Token() const {
+    return header_->token;
+}
+
+/**
+ * @brief Wait a little longer each round while a ring stays empty or full.
+ * @param rounds Number of unsuccessful rounds so far; incremented
+ */
+void ShmRing::Pause(unsigned* rounds) {
+    unsigned round = (*rounds)++;
+    if (round < 100) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else if (round < 200) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+} // namespace common
+} // namespace pubsub
@@ -0,0 +1,360 @@
+/**
+ * @file pubsub_loadgen.cpp
+ * @brief Open-loop load generator for capacity planning of a PubSub server.
+ *
+ * Publishes at a target rate over several connections and topics, with
+ * Poisson or evenly spaced arrivals, and reports the latency of every publish
+ * from the moment it was scheduled until the server answered. Because send
+ * times follow the schedule rather than previous replies, a stalled server
+ * shows up as queueing delay in the latency instead of silently lowering the
+ * offered load (coordinated omission).
+ *
+ * With --slo-p99-ms the rate is raised by --ramp-factor every step until the
+ * 99th percentile exceeds the objective, publishes fail or the generator falls
+ * a whole step behind its schedule; the last rate that held is reported as
+ * the maximum sustainable throughput.
+ *
+ * Usage: pubsub_loadgen [server_address] [--option=value ...]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "async_publisher.h"
+#include "latency_histogram.h"
+#include "pubsub_clock.h"
+
+using pubsub::common::LatencyHistogram;
+
+namespace {
+
+/**
+ * @struct LoadOptions
+ * @brief Traffic shape and ramp settings of a load generator run.
+ */
+struct LoadOptions {
+    std::string address = "localhost:50051";
+
+    // Messages per second over all connections in the first (or only) step
+    double rate = 1000;
+
+    // Duration of each step
+    std::chrono::milliseconds step{10000};
+
+    // Poisson arrivals when true, evenly spaced ones otherwise
+    bool poisson = true;
+
+    // Ramp until the 99th percentile exceeds this many milliseconds (0 runs a single step)
+    double slo_p99_ms = 0;
+
+    // Rate multiplier between steps, and the rate at which the ramp stops (0 for no limit)
+    double ramp_factor = 1.25;
+    double max_rate = 0;
+
+    // Topics named <topic_prefix>-0 ... are published to round-robin
+    size_t topics = 1;
+    std::string topic_prefix = "loadgen";
+
+    // Independent producers, each with its own connection and sending thread
+    size_t connections = 1;
+
+    size_t payload_bytes = 100;
+
+    // Settings of every producer; num_channels is always 1
+    ProducerOptions producer;
+};
+
+/**
+ * @struct Connection
+ * @brief One producer and the results of its publishes in the current step.
+ */
+struct Connection {
+    std::unique_ptr<AsyncPublisher> publisher;
+
+    // Guards the fields below, which are updated by completion callbacks
+    std::mutex mutex;
+    LatencyHistogram latency;
+    uint64_t errors = 0;
+    int64_t last_completion = 0;
+
+    // Written by the sending thread only
+    uint64_t sent = 0;
+    bool fell_behind = false;
+};
+
+/**
+ * @struct StepResult
+ * @brief Aggregated outcome of one step.
+ */
+struct StepResult {
+    double target_rate = 0;
+    double sent_rate = 0;
+    double completed_rate = 0;
+    LatencyHistogram latency;
+    uint64_t errors = 0;
+    bool fell_behind = false;
+};
+
+/**
+ * @brief Publish on one connection according to its share of the schedule.
+ *
+ * Each message's scheduled time is drawn before it is sent, and its latency
+ * is measured from that time. When the producer blocks (its in-flight window
+ * is full) the following messages are sent late and their latency includes
+ * the wait. A generator that falls a whole step behind gives up, since the
+ * server is not keeping up with the rate.
+ *
+ * @param connection The connection to publish on
+ * @param index Position of the connection, used to offset its schedule and topics
+ * @param options The run settings
+ * @param rate Messages per second over all connections
+ * @param start Steady-clock time of the step's start in nanoseconds
+ */
+void Generate(Connection* connection, size_t index, const LoadOptions& options, double rate, int64_t start) {
+    double interval = 1e9 * options.connections / rate;
+    int64_t duration = std::chrono::duration_cast<std::chrono::nanoseconds>(options.step).count();
+    int64_t end = start + duration;
+    std::mt19937_64 random(std::random_device{}() + index);
+    std::exponential_distribution<double> exponential(1.0 / interval);
+    std::string payload(options.payload_bytes, 'x');
+    size_t topic = index % options.topics;
+
+    // Evenly spaced senders are staggered so the connections do not send in lockstep
+    double next = start + (options.poisson ? exponential(random) : interval * index / options.connections);
+    while (next < end) {
+        int64_t scheduled = static_cast<int64_t>(next);
+        int64_t now = pubsub::common::steadyNanos();
+        if (scheduled > now) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(scheduled - now));
+        } else if (now - scheduled > duration) {
+            connection->fell_behind = true;
+            break;
+        }
+        connection->publisher->PublishAsync(
+            options.topic_prefix + "-" + std::to_string(topic), payload,
+            [connection, scheduled](const PublishResult& result) {
+                int64_t done = pubsub::common::steadyNanos();
+                std::lock_guard<std::mutex> lock(connection->mutex);
+                if (result.ok()) {
+                    connection->latency.Record(done - scheduled);
+                } else {
+                    connection->errors++;
+                }
+                connection->last_completion = std::max(connection->last_completion, done);
+            });
+        connection->sent++;
+        topic = (topic + options.connections) % options.topics;
+        next += options.poisson ? exponential(random) : interval;
+    }
+}
+
+/**
+ * @brief Run one step at a fixed rate and wait for every publish it started.
+ * @param connections The connections to publish on
+ * @param options The run settings
+ * @param rate Messages per second over all connections
+ * @return The step's throughput and latency
+ */
+StepResult RunStep(std::vector<std::unique_ptr<Connection>>& connections, const LoadOptions& options,
+                   double rate) {
+    for (auto& connection : connections) {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        connection->latency.Reset();
+        connection->errors = 0;
+        connection->last_completion = 0;
+        connection->sent = 0;
+        connection->fell_behind = false;
+    }
+
+    int64_t start = pubsub::common::steadyNanos();
+    std::vector<std::thread> senders;
+    for (size_t i = 0; i < connections.size(); i++) {
+        senders.emplace_back(Generate, connections[i].get(), i, std::cref(options), rate, start);
+    }
+    for (auto& sender : senders) {
+        sender.join();
+    }
+    for (auto& connection : connections) {
+        connection->publisher->Flush();
+    }
+
+    StepResult result;
+    result.target_rate = rate;
+    uint64_t sent = 0;
+    int64_t last_completion = start;
+    for (auto& connection : connections) {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        result.latency.Merge(connection->latency);
+        result.errors += connection->errors;
+        result.fell_behind = result.fell_behind || connection->fell_behind;
+        last_completion = std::max(last_completion, connection->last_completion);
+        sent += connection->sent;
+    }
+    double seconds = std::chrono::duration<double>(options.step).count();
+    result.sent_rate = sent / seconds;
+    result.completed_rate = result.latency.Count() / std::max(seconds, (last_completion - start) / 1e9);
+    return result;
+}
+
+/**
+ * @brief Print the column headings of the step table.
+ */
+void PrintHeader() {
+    std::cout << std::right << std::setw(12) << "target/s" << std::setw(12) << "sent/s"
+              << std::setw(12) << "done/s" << std::setw(10) << "p50 ms" << std::setw(10) << "p90 ms"
+              << std::setw(10) << "p99 ms" << std::setw(10) << "p99.9 ms" << std::setw(10) << "max ms"
+              << std::setw(8) << "errors" << std::endl;
+}
+
+/**
+ * @brief Print one row of the step table.
+ * @param result The step to print
+ */
+void PrintStep(const StepResult& result) {
+    auto ms = [](int64_t nanos) { return nanos / 1e6; };
+    std::cout << std::right << std::fixed << std::setprecision(0) << std::setw(12) << result.target_rate
+              << std::setw(12) << result.sent_rate << std::setw(12) << result.completed_rate
+              << std::setprecision(3) << std::setw(10) << ms(result.latency.ValueAt(0.5))
+              << std::setw(10) << ms(result.latency.ValueAt(0.9))
+              << std::setw(10) << ms(result.latency.ValueAt(0.99))
+              << std::setw(10) << ms(result.latency.ValueAt(0.999))
+              << std::setw(10) << ms(result.latency.Max()) << std::setw(8) << result.errors
+              << (result.fell_behind ? "  fell behind" : "") << std::endl;
+}
+
+/**
+ * @brief Apply one --option=value argument to the run settings.
+ * @param arg The argument, including the leading dashes
+ * @param options The settings to update
+ * @return true if the option was recognized
+ */
+bool ParseOption(const std::string& arg, LoadOptions* options) {
+    size_t eq = arg.find('=');
+    std::string name = arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2);
+    std::string value = eq == std::string::npos ? std::string() : arg.substr(eq + 1);
+    if (name == "shm") {
+        options->producer.shared_memory = true;
+        return true;
+    }
+    if (value.empty()) {
+        return false;
+    }
+    if (name == "rate") {
+        options->rate = std::stod(value);
+    } else if (name == "step-seconds") {
+        options->step = std::chrono::milliseconds(static_cast<int64_t>(std::stod(value) * 1000));
+    } else if (name == "arrivals" && (value == "poisson" || value == "constant")) {
+        options->poisson = value == "poisson";
+    } else if (name == "slo-p99-ms") {
+        options->slo_p99_ms = std::stod(value);
+    } else if (name == "ramp-factor" && std::stod(value) > 1) {
+        options->ramp_factor = std::stod(value);
+    } else if (name == "max-rate") {
+        options->max_rate = std::stod(value);
+    } else if (name == "topics" && std::stoul(value) > 0) {
+        options->topics = std::stoul(value);
+    } else if (name == "topic-prefix") {
+        options->topic_prefix = value;
+    } else if (name == "connections" && std::stoul(value) > 0) {
+        options->connections = std::stoul(value);
+    } else if (name == "payload") {
+        options->payload_bytes = std::stoul(value);
+    } else if (name == "batch") {
+        options->producer.batch_size = std::stoul(value);
+    } else if (name == "linger-ms") {
+        options->producer.linger = std::chrono::milliseconds(std::stol(value));
+    } else if (name == "in-flight") {
+        options->producer.max_in_flight = std::stoul(value);
+    } else if (name == "client-id") {
+        options->producer.client_id = value;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+/**
+ * @brief Main function for the load generator.
+ * @param argc Number of command line arguments
+ * @param argv Array of command line arguments
+ * @return int Exit status
+ */
+int main(int argc, char** argv) {
+    LoadOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) {
+            options.address = arg;
+        } else if (!ParseOption(arg, &options)) {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            std::cerr << "Usage: " << argv[0] << " [server_address] [--rate=N] [--step-seconds=N]"
+                      << " [--arrivals=poisson|constant] [--slo-p99-ms=N] [--ramp-factor=N] [--max-rate=N]"
+                      << " [--topics=N] [--topic-prefix=NAME] [--connections=N] [--payload=BYTES]"
+                      << " [--batch=N] [--linger-ms=N] [--in-flight=N] [--client-id=ID] [--shm]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Connect every producer before the first step, so connection setup is not measured
+    std::vector<std::unique_ptr<Connection>> connections;
+    for (size_t i = 0; i < options.connections; i++) {
+        std::unique_ptr<Connection> connection(new Connection());
+        connection->publisher.reset(new AsyncPublisher(options.address, options.producer));
+        std::future<PublishResult> warmup = connection->publisher->PublishAsync(
+            options.topic_prefix + "-0", std::string(options.payload_bytes, 'x'));
+        if (!warmup.get().ok()) {
+            std::cerr << "Cannot publish to " << options.address << std::endl;
+            return EXIT_FAILURE;
+        }
+        connections.push_back(std::move(connection));
+    }
+
+    std::cout << "Publishing to " << options.address << " over " << options.connections << " connections and "
+              << options.topics << " topics, " << options.payload_bytes << "-byte messages, "
+              << (options.poisson ? "Poisson" : "constant") << " arrivals, "
+              << options.step.count() / 1000.0 << " s per step" << std::endl;
+    PrintHeader();
+
+    if (options.slo_p99_ms <= 0) {
+        PrintStep(RunStep(connections, options, options.rate));
+        return 0;
+    }
+
+    int64_t slo = static_cast<int64_t>(options.slo_p99_ms * 1e6);
+    double rate = options.rate;
+    double sustained = 0;
+    while (true) {
+        StepResult result = RunStep(connections, options, rate);
+        PrintStep(result);
+        if (result.errors > 0 || result.fell_behind || result.latency.ValueAt(0.99) > slo) {
+            break;
+        }
+        sustained = result.completed_rate;
+        if (options.max_rate > 0 && rate >= options.max_rate) {
+            break;
+        }
+        rate *= options.ramp_factor;
+        if (options.max_rate > 0) {
+            rate = std::min(rate, options.max_rate);
+        }
+    }
+
+    if (sustained == 0) {
+        std::cout << "No rate met the p99 objective of " << options.slo_p99_ms << " ms" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Maximum sustainable throughput: " << std::setprecision(0) << sustained
+              << " msg/s with p99 <= " << std::setprecision(3) << options.slo_p99_ms << " ms" << std::endl;
+    return 0;
+}
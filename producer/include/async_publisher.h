@@ -0,0 +1,259 @@
+/**
+ * @file async_publisher.h
+ * @brief Declaration of the pipelined, non-blocking Publisher client for the PubSub gRPC service.
+ */
+#ifndef ASYNC_PUBLISHER_H
+#define ASYNC_PUBLISHER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <grpcpp/grpcpp.h>
+#include "pubsub.pb.h"
+#include "pubsub.grpc.pb.h"
+#include "channel_pool.h"
+#include "producer_options.h"
+#include "shm_ring.h"
+
+using grpc::Channel;
+using pubsub::PubSub;
+
+/**
+ * @struct PublishResult
+ * @brief Outcome of a single asynchronously published message.
+ */
+struct PublishResult {
+    grpc::Status status;
+    std::string message_id;
+
+    // Set when the server had already stored this message from an earlier attempt
+    bool duplicate = false;
+
+    bool ok() const { return status.ok(); }
+};
+
+/**
+ * @class AsyncPublisher
+ * @brief Client that publishes messages without waiting for each RPC to complete.
+ *
+ * Publish calls return immediately with a future, or invoke a completion
+ * callback later. RPCs are driven by a completion queue serviced by a
+ * dedicated thread, and up to max_in_flight of them are outstanding at once,
+ * so producer throughput does not depend on the server round trip.
+ *
+ * With batch_size > 1, messages are accumulated and sent as one PublishBatch
+ * RPC once the batch is full or has lingered for the configured time, in the
+ * style of Kafka's batch.size/linger.ms.
+ *
+ * Messages are spread over a ChannelPool by the configured Partitioner. Every
+ * message carries the producer ID and a sequence number; an RPC that fails
+ * with a transient error is resent unchanged after an exponential backoff,
+ * so the server can recognise the retry. Sequence numbers are assigned when
+ * an RPC starts, and an RPC waits while it would get more than
+ * max_sequence_span ahead of the oldest unanswered one, so a slow RPC cannot
+ * fall out of the server's dedup window.
+ *
+ * With shared_memory set, the producer offers the server a shared-memory
+ * ring when it starts. If the server is on the same host and maps it, each
+ * message is serialized straight into the ring. The server confirms the
+ * records it stored on the attach stream, and each callback runs with its
+ * message ID once its record is confirmed. When the server detaches, the
+ * records it has not confirmed are resent over gRPC with their sequence
+ * numbers, so any it did store are recognised as duplicates, and later
+ * publishes go over gRPC as usual, as they do if the ring was never mapped.
+ */
+class AsyncPublisher {
+public:
+    using CompletionFn = std::function<void(const PublishResult&)>;
+
+    /**
+     * @brief Constructs an AsyncPublisher over an existing channel.
+     * @param channel Shared pointer to the gRPC channel
+     * @param options Producer configuration; num_channels and channel are ignored
+     */
+    AsyncPublisher(std::shared_ptr<Channel> channel,
+                   const ProducerOptions& options = ProducerOptions());
+
+    /**
+     * @brief Constructs an AsyncPublisher with its own pool of connections.
+     * @param target The server address
+     * @param options Producer configuration
+     */
+    AsyncPublisher(const std::string& target, const ProducerOptions& options = ProducerOptions());
+
+    /**
+     * @brief Destructor that flushes outstanding messages and stops the worker threads.
+     */
+    ~AsyncPublisher();
+
+    /**
+     * @brief Publish a message and get its result through a future.
+     * @param topic The topic to publish to
+     * @param content The message content
+     * @return A future that becomes ready once the server has answered
+     */
+    std::future<PublishResult> PublishAsync(const std::string& topic, const std::string& content);
+
+    /**
+     * @brief Publish a message and get its result through a callback.
+     *
+     * The callback runs on the completion-queue thread, or on the thread
+     * reading the shared-memory confirmations, and should not block, which
+     * includes publishing from it. This call blocks only while the in-flight
+     * window or the shared-memory ring is full.
+     *
+     * @param topic The topic to publish to
+     * @param content The message content
+     * @param callback Invoked once with the result of the publish
+     */
+    void PublishAsync(const std::string& topic, const std::string& content, CompletionFn callback);
+
+    /**
+     * @brief Publish a keyed message and get its result through a future.
+     *
+     * The server stores messages with the same key in the same topic
+     * partition, so they are delivered in publish order.
+     *
+     * @param topic The topic to publish to
+     * @param key The message key
+     * @param content The message content
+     * @return A future that becomes ready once the server has answered
+     */
+    std::future<PublishResult> PublishAsync(const std::string& topic, const std::string& key,
+                                            const std::string& content);
+
+    /**
+     * @brief Publish a keyed message and get its result through a callback.
+     * @param topic The topic to publish to
+     * @param key The message key
+     * @param content The message content
+     * @param callback Invoked once with the result of the publish
+     */
+    void PublishAsync(const std::string& topic, const std::string& key, const std::string& content,
+                      CompletionFn callback);
+
+    /**
+     * @brief Publish a prepared request and get its result through a future.
+     *
+     * Use this to set fields the other overloads do not, such as a delivery
+     * time (deliver_at) or delay (delay_ms) for scheduled delivery.
+     *
+     * @param request The message; its producer ID and sequence are filled in
+     * @return A future that becomes ready once the server has answered
+     */
+    std::future<PublishResult> PublishAsync(pubsub::PublishRequest request);
+
+    /**
+     * @brief Publish a prepared request and get its result through a callback.
+     * @param request The message; its producer ID and sequence are filled in
+     * @param callback Invoked once with the result of the publish
+     */
+    void PublishAsync(pubsub::PublishRequest request, CompletionFn callback);
+
+    /**
+     * @brief Send any lingering batches and wait until every publish has completed.
+     */
+    void Flush();
+
+    /**
+     * @brief Get the ID this producer stamps on its messages.
+     * @return The producer ID
+     */
+    const std::string& ProducerId() const { return producer_id_; }
+
+private:
+    struct Call;
+
+    // Messages accumulated for one channel, and when the first of them arrived
+    struct PendingBatch {
+        std::vector<pubsub::PublishRequest> requests;
+        std::vector<CompletionFn> callbacks;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    void Start();
+
+    // Send the accumulated batch of a channel, if any; requires mutex_ to be held
+    void SendPendingLocked(std::unique_lock<std::mutex>& lock, size_t channel);
+
+    // Wait for a free in-flight slot and start the RPC for the given messages; sequenced messages
+    // keep the sequence numbers they already carry
+    void StartCall(std::unique_lock<std::mutex>& lock, size_t channel,
+                   std::vector<pubsub::PublishRequest> requests, std::vector<CompletionFn> callbacks,
+                   bool sequenced = false);
+
+    // Issue one attempt of a call's RPC
+    void SendAttempt(Call* call);
+
+    // Backoff to wait before the given retry attempt, with jitter
+    std::chrono::milliseconds Backoff(int attempt);
+
+    // Offer the server a shared-memory ring and start watching the attachment
+    void AttachSharedMemory();
+
+    // Hand a message to the server through the ring; false if it must go over gRPC
+    bool PublishSharedMemory(pubsub::PublishRequest* request, CompletionFn* callback);
+
+    void SharedMemoryThread();
+
+    // Resend the records the server did not confirm before detaching from the ring
+    void ResendUnconfirmed();
+
+    void CompletionThread();
+    void LingerThread();
+
+    ChannelPool pool_;
+    ProducerOptions options_;
+    std::string producer_id_;
+    grpc::CompletionQueue cq_;
+
+    std::mutex mutex_;
+    std::condition_variable window_cv_;   // Signalled when an RPC completes
+    std::condition_variable linger_cv_;   // Signalled when a batch is started or on shutdown
+    size_t in_flight_;
+    uint64_t next_ticket_;                // Calls take tickets to wait for a slot in FIFO order
+    uint64_t serving_ticket_;             // Ticket of the call allowed to take the next slot
+    size_t pending_count_;                // Messages waiting in pending_
+    bool shutdown_;
+    uint64_t next_sequence_;
+    std::multiset<uint64_t> in_flight_sequences_;  // First sequence number of every RPC in flight
+    std::vector<PendingBatch> pending_;   // Indexed by channel
+
+    std::mt19937 rng_;                    // Backoff jitter, used by the completion thread only
+    std::chrono::system_clock::time_point throttled_until_;  // Last retry slot handed to a rate-limited
+                                                             // call; completion thread only
+
+    std::thread completion_thread_;
+    std::thread linger_thread_;
+
+    // Shared-memory transport; shm_mutex_ serializes writers and is taken before mutex_
+    std::mutex shm_mutex_;
+    std::unique_ptr<pubsub::common::ShmRing> shm_ring_;
+    std::unique_ptr<grpc::ClientContext> shm_context_;
+    std::unique_ptr<grpc::ClientReader<pubsub::SharedMemoryStatus>> shm_reader_;
+    std::atomic<bool> shm_active_;        // Cleared once the server has detached
+    std::thread shm_thread_;
+
+    // A message written into the ring whose result the server has not yet sent
+    struct Unconfirmed {
+        pubsub::PublishRequest request;
+        CompletionFn callback;
+    };
+
+    std::mutex unconfirmed_mutex_;        // Guards unconfirmed_; taken after mutex_
+    std::condition_variable confirmed_cv_;  // Signalled when unconfirmed_ empties
+    std::deque<Unconfirmed> unconfirmed_;   // In ring order
+};
+
+#endif // ASYNC_PUBLISHER_H
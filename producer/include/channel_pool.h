@@ -0,0 +1,63 @@
+/**
+ * @file channel_pool.h
+ * @brief Declaration of the pool of independent connections used by producers.
+ */
+#ifndef CHANNEL_POOL_H
+#define CHANNEL_POOL_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <grpcpp/grpcpp.h>
+#include "pubsub.grpc.pb.h"
+#include "pubsub_channel.h"
+
+using grpc::Channel;
+using pubsub::PubSub;
+
+/**
+ * @class ChannelPool
+ * @brief A fixed set of gRPC channels to one server, each with its own stub.
+ *
+ * Channels created by the pool use a local subchannel pool, so each of them
+ * opens its own HTTP/2 connection instead of sharing one. This spreads
+ * streams over several connections and server pollers.
+ */
+class ChannelPool {
+public:
+    /**
+     * @brief Creates a pool of independent connections to a server.
+     * @param target The server address
+     * @param size Number of channels to create (at least one)
+     * @param options Channel settings; a local subchannel pool is always used
+     * @param credentials Channel credentials; insecure when null
+     */
+    ChannelPool(const std::string& target, size_t size,
+                const pubsub::common::ChannelOptions& options = pubsub::common::ChannelOptions(),
+                std::shared_ptr<grpc::ChannelCredentials> credentials = nullptr);
+
+    /**
+     * @brief Wraps an existing channel as a pool of one.
+     * @param channel Shared pointer to the gRPC channel
+     */
+    explicit ChannelPool(std::shared_ptr<Channel> channel);
+
+    /**
+     * @brief Get the number of channels in the pool.
+     * @return The pool size
+     */
+    size_t Size() const { return stubs_.size(); }
+
+    /**
+     * @brief Get the stub bound to one of the pool's channels.
+     * @param index Channel index in [0, Size())
+     * @return The stub, owned by the pool
+     */
+    PubSub::Stub* Stub(size_t index) const { return stubs_[index].get(); }
+
+private:
+    std::vector<std::shared_ptr<Channel>> channels_;
+    std::vector<std::unique_ptr<PubSub::Stub>> stubs_;
+};
+
+#endif // CHANNEL_POOL_H
@@ -0,0 +1,56 @@
+/**
+ * @file partitioner.h
+ * @brief Declaration of the pluggable strategies that spread published messages over connections.
+ */
+#ifndef PARTITIONER_H
+#define PARTITIONER_H
+
+#include <atomic>
+#include <cstddef>
+#include "pubsub.pb.h"
+
+/**
+ * @class Partitioner
+ * @brief Chooses which pooled connection carries a published message.
+ *
+ * Messages assigned to the same partition travel over the same channel, so
+ * a partitioner that is stable for a topic keeps that topic's messages in
+ * order (given max_in_flight = 1). Implementations must be thread-safe.
+ */
+class Partitioner {
+public:
+    virtual ~Partitioner() = default;
+
+    /**
+     * @brief Choose a partition for a message.
+     * @param request The message about to be published
+     * @param num_partitions Number of available partitions, at least one
+     * @return A partition index in [0, num_partitions)
+     */
+    virtual size_t Partition(const pubsub::PublishRequest& request, size_t num_partitions) = 0;
+};
+
+/**
+ * @class HashPartitioner
+ * @brief Assigns every message of a topic to the same partition by hashing the topic name.
+ */
+class HashPartitioner : public Partitioner {
+public:
+    size_t Partition(const pubsub::PublishRequest& request, size_t num_partitions) override;
+};
+
+/**
+ * @class RoundRobinPartitioner
+ * @brief Spreads messages evenly over all partitions regardless of topic.
+ */
+class RoundRobinPartitioner : public Partitioner {
+public:
+    RoundRobinPartitioner() : next_(0) {}
+
+    size_t Partition(const pubsub::PublishRequest& request, size_t num_partitions) override;
+
+private:
+    std::atomic<size_t> next_;
+};
+
+#endif // PARTITIONER_H
@@ -0,0 +1,68 @@
+/**
+ * @file producer_options.h
+ * @brief Configuration shared by the producer clients.
+ */
+#ifndef PRODUCER_OPTIONS_H
+#define PRODUCER_OPTIONS_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "partitioner.h"
+#include "pubsub_channel.h"
+
+/**
+ * @struct ProducerOptions
+ * @brief Tuning knobs for AsyncPublisher and Publisher.
+ */
+struct ProducerOptions {
+    // Number of independent connections to open when constructed from a target address
+    size_t num_channels = 1;
+
+    // Transport settings of those connections
+    pubsub::common::ChannelOptions channel;
+
+    // Chooses the connection for each message; a HashPartitioner when null
+    std::shared_ptr<Partitioner> partitioner;
+
+    // Maximum number of RPCs outstanding at once; further publishes block until one completes
+    size_t max_in_flight = 64;
+
+    // Maximum number of messages packed into one PublishBatch RPC (1 disables batching)
+    size_t batch_size = 1;
+
+    // How long a partially filled batch may wait for more messages before it is sent
+    std::chrono::milliseconds linger{0};
+
+    // How many times a failed RPC is resent after a transient error
+    int max_retries = 5;
+
+    // Backoff before the first retry; doubles (times backoff_multiplier) per attempt
+    std::chrono::milliseconds initial_backoff{50};
+    std::chrono::milliseconds max_backoff{5000};
+    double backoff_multiplier = 2.0;
+
+    // Deadline applied to each RPC attempt (0 means no deadline)
+    std::chrono::milliseconds rpc_timeout{0};
+
+    // Maximum distance between the oldest unanswered sequence number and the newest one
+    // sent; must not exceed the server's dedup window (4096) or late messages are dropped
+    uint64_t max_sequence_span = 4096;
+
+    // Identifies this producer to the server; a random ID is generated when empty
+    std::string producer_id;
+
+    // Names the quota this producer's publishes count against on the server; when empty the
+    // server charges the producer's host address
+    std::string client_id;
+
+    // Hand messages to a server on the same host through a shared-memory ring instead of
+    // RPCs; falls back to gRPC when the server cannot map the ring or detaches
+    bool shared_memory = false;
+
+    // Size of the shared-memory ring; messages larger than half of it are sent over gRPC
+    size_t shared_memory_bytes = 4 << 20;
+};
+
+#endif // PRODUCER_OPTIONS_H
@@ -0,0 +1,124 @@
+/**
+ * @file publisher.h
+ * @brief Declaration of the Publisher client for the PubSub gRPC service.
+ */
+#ifndef PUBLISHER_H
+#define PUBLISHER_H
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include <grpcpp/grpcpp.h>
+#include "pubsub.pb.h"
+#include "pubsub.grpc.pb.h"
+#include "async_publisher.h"
+#include "producer_options.h"
+
+using grpc::Channel;
+using pubsub::PubSub;
+
+/**
+ * @class Publisher
+ * @brief Client for publishing messages to the PubSub gRPC service.
+ *
+ * Publisher is the convenience API of the producer library. All messages go
+ * through an AsyncPublisher, so blocking and non-blocking publishes share the
+ * same connection pool, partitioning, pipelining and retry logic.
+ */
+class Publisher {
+public:
+    /**
+     * @brief Constructs a Publisher client.
+     * @param channel Shared pointer to the gRPC channel
+     * @param options Producer configuration; num_channels and channel are ignored
+     */
+    Publisher(std::shared_ptr<Channel> channel, const ProducerOptions& options = ProducerOptions());
+
+    /**
+     * @brief Constructs a Publisher client with its own pool of connections.
+     * @param target The server address
+     * @param options Producer configuration
+     */
+    Publisher(const std::string& target, const ProducerOptions& options);
+
+    /**
+     * @brief Publish a message to a topic and wait for the result.
+     * @param topic The topic to publish to
+     * @param content The message content
+     * @return true if the message was published successfully, false otherwise
+     */
+    bool Publish(const std::string& topic, const std::string& content);
+
+    /**
+     * @brief Publish a keyed message to a topic and wait for the result.
+     * @param topic The topic to publish to
+     * @param key The message key; messages with the same key stay in order
+     * @param content The message content
+     * @return true if the message was published successfully, false otherwise
+     */
+    bool Publish(const std::string& topic, const std::string& key, const std::string& content);
+
+    /**
+     * @brief Publish a message that the server delivers only after a delay, and wait for the result.
+     * @param topic The topic to publish to
+     * @param content The message content
+     * @param delay How long after the server receives the message it is delivered
+     * @return true if the message was accepted for delivery, false otherwise
+     */
+    bool PublishDelayed(const std::string& topic, const std::string& content, std::chrono::milliseconds delay);
+
+    /**
+     * @brief Publish a message that the server delivers at a given time, and wait for the result.
+     * @param topic The topic to publish to
+     * @param content The message content
+     * @param when When the message is delivered; a time already passed delivers it immediately
+     * @return true if the message was accepted for delivery, false otherwise
+     */
+    bool PublishAt(const std::string& topic, const std::string& content,
+                   std::chrono::system_clock::time_point when);
+
+    /**
+     * @brief Publish a message to a topic without waiting for the result.
+     * @param topic The topic to publish to
+     * @param content The message content
+     * @return A future that becomes ready once the server has answered
+     */
+    std::future<PublishResult> PublishAsync(const std::string& topic, const std::string& content);
+
+    /**
+     * @brief Publish a message to multiple topics.
+     * @param topics Vector of topics to publish to
+     * @param content The message content
+     * @return Number of topics the message was successfully published to
+     */
+    int PublishToMultiple(const std::vector<std::string>& topics, const std::string& content);
+
+    /**
+     * @brief Register default topics for this publisher.
+     * @param topics Vector of topics to register
+     */
+    void RegisterTopics(const std::vector<std::string>& topics);
+
+    /**
+     * @brief Publish a message to all registered topics.
+     * @param content The message content
+     * @return Number of topics the message was successfully published to
+     */
+    int PublishToAll(const std::string& content);
+
+    /**
+     * @brief Wait until every message published so far has completed.
+     */
+    void Flush();
+
+private:
+    // Wait for a publish, logging its error if it failed; returns true on success
+    bool Await(const std::string& topic, std::future<PublishResult> result);
+
+    AsyncPublisher producer_;
+    std::vector<std::string> registered_topics_;
+};
+
+#endif // PUBLISHER_H
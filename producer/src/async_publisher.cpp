@@ -0,0 +1,710 @@
+/**
+ * @file async_publisher.cpp
+ * @brief Implementation of the pipelined, non-blocking Publisher client for the PubSub gRPC service.
+ */
+
+#include "async_publisher.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <grpcpp/alarm.h>
+#include <grpcpp/grpcpp.h>
+#include "pubsub.pb.h"
+#include "pubsub.grpc.pb.h"
+
+using grpc::ClientAsyncResponseReader;
+using grpc::ClientContext;
+using grpc::Status;
+using pubsub::PublishBatchRequest;
+using pubsub::PublishBatchResponse;
+using pubsub::PublishRequest;
+using pubsub::PublishResponse;
+using pubsub::SharedMemoryAttach;
+using pubsub::SharedMemoryStatus;
+
+namespace {
+
+/**
+ * @brief Check whether a failed RPC may succeed when resent.
+ * @param status The status of the failed attempt
+ * @return true for transient errors
+ */
+bool IsRetryable(const Status& status) {
+    switch (status.error_code()) {
+        case grpc::StatusCode::UNAVAILABLE:
+        case grpc::StatusCode::DEADLINE_EXCEEDED:
+        case grpc::StatusCode::RESOURCE_EXHAUSTED:
+        case grpc::StatusCode::ABORTED:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Read the server's hint of when a rate-limited publish would be admitted.
+ * @param context The context of the rejected attempt
+ * @return The retry-after-ms trailer, or zero when absent
+ */
+std::chrono::milliseconds RetryAfter(const ClientContext& context) {
+    const auto& trailers = context.GetServerTrailingMetadata();
+    auto it = trailers.find("retry-after-ms");
+    if (it == trailers.end()) {
+        return std::chrono::milliseconds(0);
+    }
+    return std::chrono::milliseconds(std::strtoll(std::string(it->second.data(), it->second.size()).c_str(),
+                                                  nullptr, 10));
+}
+
+/**
+ * @brief Generate a random producer ID.
+ * @return 16 hexadecimal characters
+ */
+std::string RandomProducerId() {
+    std::random_device rd;
+    uint64_t value = (static_cast<uint64_t>(rd()) << 32) ^ rd();
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(value));
+    return buf;
+}
+
+} // namespace
+
+/**
+ * @brief State of one outstanding Publish or PublishBatch RPC, across retries.
+ *
+ * The object is used as the completion-queue tag for both the RPC and the
+ * backoff alarm, and is deleted by the completion thread once its callbacks
+ * have run.
+ */
+struct AsyncPublisher::Call {
+    size_t channel = 0;
+    bool batch = false;
+    PublishRequest request;
+    PublishBatchRequest batch_request;
+
+    std::unique_ptr<ClientContext> context;
+    Status status;
+    PublishResponse response;
+    PublishBatchResponse batch_response;
+    std::unique_ptr<ClientAsyncResponseReader<PublishResponse>> reader;
+    std::unique_ptr<ClientAsyncResponseReader<PublishBatchResponse>> batch_reader;
+
+    uint64_t first_sequence = 0;
+    int attempt = 0;
+    bool backing_off = false;
+    grpc::Alarm alarm;
+
+    std::vector<CompletionFn> callbacks;
+};
+
+/**
+ * @brief Constructs an AsyncPublisher over an existing channel.
+ * @param channel Shared pointer to the gRPC channel
+ * @param options Producer configuration; num_channels and channel are ignored
+ */
+AsyncPublisher::AsyncPublisher(std::shared_ptr<Channel> channel, const ProducerOptions& options)
+    : pool_(channel), options_(options) {
+    Start();
+}
+
+/**
+ * @brief Constructs an AsyncPublisher with its own pool of connections.
+ * @param target The server address
+ * @param options Producer configuration
+ */
+AsyncPublisher::AsyncPublisher(const std::string& target, const ProducerOptions& options)
+    : pool_(target, options.num_channels, options.channel), options_(options) {
+    Start();
+}
+
+/**
+ * @brief Destructor that flushes outstanding messages and stops the worker threads.
+ */
+AsyncPublisher::~AsyncPublisher() {
+    Flush();
+    if (shm_thread_.joinable()) {
+        shm_context_->TryCancel();
+        shm_thread_.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        shutdown_ = true;
+    }
+    linger_cv_.notify_all();
+    linger_thread_.join();
+    cq_.Shutdown();
+    completion_thread_.join();
+}
+
+/**
+ * @brief Apply option defaults and start the worker threads.
+ */
+void AsyncPublisher::Start() {
+    if (options_.max_in_flight == 0) {
+        options_.max_in_flight = 1;
+    }
+    if (options_.max_sequence_span == 0) {
+        options_.max_sequence_span = 1;
+    }
+    if (!options_.partitioner) {
+        options_.partitioner = std::make_shared<HashPartitioner>();
+    }
+    producer_id_ = options_.producer_id.empty() ? RandomProducerId() : options_.producer_id;
+    in_flight_ = 0;
+    next_ticket_ = 0;
+    serving_ticket_ = 0;
+    pending_count_ = 0;
+    shutdown_ = false;
+    next_sequence_ = 1;
+    pending_.resize(pool_.Size());
+    rng_.seed(std::random_device()());
+    shm_active_ = false;
+
+    completion_thread_ = std::thread(&AsyncPublisher::CompletionThread, this);
+    linger_thread_ = std::thread(&AsyncPublisher::LingerThread, this);
+    if (options_.shared_memory) {
+        AttachSharedMemory();
+    }
+}
+
+/**
+ * @brief Offer the server a shared-memory ring and start watching the attachment.
+ *
+ * Creates the ring and opens a PublishSharedMemory stream on the first
+ * channel. If the server confirms that it mapped the ring, the ring's name
+ * is unlinked and a thread waits for the stream to end, which means the
+ * server has detached. Otherwise the producer stays on gRPC.
+ */
+void AsyncPublisher::AttachSharedMemory() {
+    std::unique_ptr<pubsub::common::ShmRing> ring = pubsub::common::ShmRing::Create(options_.shared_memory_bytes);
+    if (!ring) {
+        return;
+    }
+    SharedMemoryAttach attach;
+    attach.set_segment(ring->Name());
+    attach.set_token(ring->Token());
+
+    std::unique_ptr<ClientContext> context(new ClientContext);
+    if (!options_.client_id.empty()) {
+        context->AddMetadata("x-pubsub-client-id", options_.client_id);
+    }
+    std::unique_ptr<grpc::ClientReader<SharedMemoryStatus>> reader =
+        pool_.Stub(0)->PublishSharedMemory(context.get(), attach);
+    SharedMemoryStatus status;
+    if (!reader->Read(&status) || !status.attached()) {
+        Status result = reader->Finish();
+        std::cerr << "Shared memory transport unavailable, publishing over gRPC: "
+                  << result.error_message() << std::endl;
+        return;
+    }
+    ring->Unlink();
+
+    shm_ring_ = std::move(ring);
+    shm_context_ = std::move(context);
+    shm_reader_ = std::move(reader);
+    shm_active_ = true;
+    shm_thread_ = std::thread(&AsyncPublisher::SharedMemoryThread, this);
+}
+
+/**
+ * @brief Thread function that completes shared-memory publishes as the server confirms them.
+ *
+ * Every status after the first holds the results of the records the server
+ * read since the previous one, in ring order, which is the order of
+ * unconfirmed_. The records leave unconfirmed_ only after their callbacks
+ * have run, so Flush returns after them. Read fails once the stream ends,
+ * either because the destructor cancelled it or because the server went
+ * away; whatever is still unconfirmed then is resent over gRPC.
+ */
+void AsyncPublisher::SharedMemoryThread() {
+    SharedMemoryStatus status;
+    std::vector<CompletionFn> callbacks;
+    while (shm_reader_->Read(&status)) {
+        {
+            std::lock_guard<std::mutex> lock(unconfirmed_mutex_);
+            size_t count = std::min(static_cast<size_t>(status.results_size()), unconfirmed_.size());
+            for (size_t i = 0; i < count; i++) {
+                callbacks.push_back(std::move(unconfirmed_[i].callback));
+            }
+        }
+        for (size_t i = 0; i < callbacks.size(); i++) {
+            const PublishResponse& response = status.results(static_cast<int>(i));
+            PublishResult result;
+            if (response.success()) {
+                result.message_id = response.message_id();
+                result.duplicate = response.duplicate();
+            } else {
+                result.status = Status(grpc::StatusCode::UNKNOWN, "Publish rejected by server");
+            }
+            if (callbacks[i]) {
+                callbacks[i](result);
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(unconfirmed_mutex_);
+            unconfirmed_.erase(unconfirmed_.begin(), unconfirmed_.begin() + callbacks.size());
+            if (unconfirmed_.empty()) {
+                confirmed_cv_.notify_all();
+            }
+        }
+        callbacks.clear();
+    }
+    Status result = shm_reader_->Finish();
+    shm_active_ = false;
+    if (result.error_code() != grpc::StatusCode::CANCELLED) {
+        std::cerr << "Shared memory transport closed, publishing over gRPC: "
+                  << result.error_message() << std::endl;
+    }
+    ResendUnconfirmed();
+}
+
+/**
+ * @brief Resend the records the server did not confirm before detaching from the ring.
+ *
+ * Runs once shm_active_ is cleared. Taking shm_mutex_ waits out a writer
+ * still in PublishSharedMemory, so nothing is added to unconfirmed_ after
+ * this. The records go out in order in batches of up to 256, keeping their
+ * sequence numbers, so the server drops those it had stored without
+ * confirming. Each batch leaves unconfirmed_ under the same hold of mutex_
+ * in which its call takes a ticket, so Flush always finds it in one place
+ * or the other.
+ */
+void AsyncPublisher::ResendUnconfirmed() {
+    const size_t max_batch = 256;
+    std::lock_guard<std::mutex> shm_lock(shm_mutex_);
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        std::vector<PublishRequest> requests;
+        std::vector<CompletionFn> callbacks;
+        {
+            std::lock_guard<std::mutex> unconfirmed_lock(unconfirmed_mutex_);
+            while (!unconfirmed_.empty() && requests.size() < max_batch) {
+                requests.push_back(std::move(unconfirmed_.front().request));
+                callbacks.push_back(std::move(unconfirmed_.front().callback));
+                unconfirmed_.pop_front();
+            }
+            confirmed_cv_.notify_all();
+        }
+        if (requests.empty()) {
+            return;
+        }
+        size_t channel = options_.partitioner->Partition(requests.front(), pool_.Size());
+        StartCall(lock, channel, std::move(requests), std::move(callbacks), true);
+    }
+}
+
+/**
+ * @brief Hand a message to the server through the shared-memory ring.
+ *
+ * The message gets its sequence number under mutex_, subject to the same
+ * max_sequence_span limit as RPCs, and is written while shm_mutex_ is
+ * held, so messages enter the ring in sequence order. While the ring is
+ * full this waits for the server to read from it. A handed-over message
+ * waits in unconfirmed_ for the server's result; if the server detaches or
+ * the ring turns out corrupt before it is written, it stays there and is
+ * resent over gRPC once the attach stream has ended.
+ *
+ * @param request The message, stamped with the producer ID; moved from if handed over
+ * @param callback Its completion callback; moved from if handed over
+ * @return true if the message was handed over, false if it must go over gRPC
+ */
+bool AsyncPublisher::PublishSharedMemory(PublishRequest* request, CompletionFn* callback) {
+    std::lock_guard<std::mutex> shm_lock(shm_mutex_);
+    if (!shm_active_) {
+        return false;
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        window_cv_.wait(lock, [this] {
+            return in_flight_sequences_.empty() ||
+                   next_sequence_ < *in_flight_sequences_.begin() + options_.max_sequence_span;
+        });
+        request->set_sequence(next_sequence_++);
+    }
+    std::string record;
+    request->SerializeToString(&record);
+    if (record.size() > shm_ring_->MaxRecordSize()) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(unconfirmed_mutex_);
+        unconfirmed_.push_back(Unconfirmed{std::move(*request), std::move(*callback)});
+    }
+    unsigned idle = 0;
+    while (!shm_ring_->TryWrite(record.data(), record.size())) {
+        if (!shm_active_ || shm_ring_->Corrupt()) {
+            // Ends the attach stream if the server has not, which resends the message
+            shm_context_->TryCancel();
+            return true;
+        }
+        pubsub::common::ShmRing::Pause(&idle);
+    }
+    return true;
+}
+
+/**
+ * @brief Publish a message and get its result through a future.
+ * @param topic The topic to publish to
+ * @param content The message content
+ * @return A future that becomes ready once the server has answered
+ */
+std::future<PublishResult> AsyncPublisher::PublishAsync(const std::string& topic, const std::string& content) {
+    auto promise = std::make_shared<std::promise<PublishResult>>();
+    std::future<PublishResult> future = promise->get_future();
+    PublishAsync(topic, content, [promise](const PublishResult& result) {
+        promise->set_value(result);
+    });
+    return future;
+}
+
+/**
+ * @brief Publish a message without a key and get its result through a callback.
+ * @param topic The topic to publish to
+ * @param content The message content
+ * @param callback Invoked once with the result of the publish
+ */
+void AsyncPublisher::PublishAsync(const std::string& topic, const std::string& content, CompletionFn callback) {
+    PublishAsync(topic, std::string(), content, std::move(callback));
+}
+
+/**
+ * @brief Publish a keyed message and get its result through a future.
+ * @param topic The topic to publish to
+ * @param key The message key
+ * @param content The message content
+ * @return A future that becomes ready once the server has answered
+ */
+std::future<PublishResult> AsyncPublisher::PublishAsync(const std::string& topic, const std::string& key,
+                                                        const std::string& content) {
+    auto promise = std::make_shared<std::promise<PublishResult>>();
+    std::future<PublishResult> future = promise->get_future();
+    PublishAsync(topic, key, content, [promise](const PublishResult& result) {
+        promise->set_value(result);
+    });
+    return future;
+}
+
+/**
+ * @brief Publish a keyed message and get its result through a callback.
+ * @param topic The topic to publish to
+ * @param key The message key; empty for unkeyed messages
+ * @param content The message content
+ * @param callback Invoked once with the result of the publish
+ */
+void AsyncPublisher::PublishAsync(const std::string& topic, const std::string& key, const std::string& content,
+                                  CompletionFn callback) {
+    PublishRequest request;
+    request.set_topic(topic);
+    request.set_key(key);
+    request.set_content(content);
+    PublishAsync(std::move(request), std::move(callback));
+}
+
+/**
+ * @brief Publish a prepared request and get its result through a future.
+ * @param request The message; its producer ID and sequence are filled in
+ * @return A future that becomes ready once the server has answered
+ */
+std::future<PublishResult> AsyncPublisher::PublishAsync(PublishRequest request) {
+    auto promise = std::make_shared<std::promise<PublishResult>>();
+    std::future<PublishResult> future = promise->get_future();
+    PublishAsync(std::move(request), [promise](const PublishResult& result) {
+        promise->set_value(result);
+    });
+    return future;
+}
+
+/**
+ * @brief Publish a prepared request and get its result through a callback.
+ *
+ * The message is stamped with the producer ID and assigned a channel by the
+ * partitioner. Without batching its RPC is started right away. With
+ * batching it joins the channel's pending batch, which is sent once it
+ * reaches batch_size; the linger thread sends it earlier if it has waited
+ * for the linger time.
+ *
+ * @param request The message; its producer ID and sequence are filled in
+ * @param callback Invoked once with the result of the publish
+ */
+void AsyncPublisher::PublishAsync(PublishRequest request, CompletionFn callback) {
+    request.set_producer_id(producer_id_);
+
+    if (shm_active_ && PublishSharedMemory(&request, &callback)) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    size_t channel = options_.partitioner->Partition(request, pool_.Size());
+
+    if (options_.batch_size <= 1) {
+        std::vector<PublishRequest> requests(1);
+        requests[0] = std::move(request);
+        StartCall(lock, channel, std::move(requests), std::vector<CompletionFn>{std::move(callback)});
+        return;
+    }
+
+    PendingBatch& batch = pending_[channel];
+    if (batch.requests.empty()) {
+        batch.since = std::chrono::steady_clock::now();
+        linger_cv_.notify_one();
+    }
+    batch.requests.push_back(std::move(request));
+    batch.callbacks.push_back(std::move(callback));
+    pending_count_++;
+
+    if (batch.requests.size() >= options_.batch_size || options_.linger.count() == 0) {
+        SendPendingLocked(lock, channel);
+    }
+}
+
+/**
+ * @brief Send any lingering batches and wait until every publish has completed.
+ *
+ * Messages handed over through shared memory count as completed once the
+ * server has confirmed them, or, if it detached first, once they have been
+ * resent over gRPC and answered.
+ */
+void AsyncPublisher::Flush() {
+    {
+        std::unique_lock<std::mutex> unconfirmed_lock(unconfirmed_mutex_);
+        confirmed_cv_.wait(unconfirmed_lock, [this] { return unconfirmed_.empty(); });
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (size_t channel = 0; channel < pending_.size(); channel++) {
+        SendPendingLocked(lock, channel);
+    }
+    window_cv_.wait(lock, [this] {
+        return in_flight_ == 0 && pending_count_ == 0 && serving_ticket_ == next_ticket_;
+    });
+}
+
+/**
+ * @brief Send the accumulated batch of a channel, if any.
+ *
+ * The batch is detached from the pending state before waiting for a window
+ * slot, so new messages can start a fresh batch in the meantime.
+ *
+ * @param lock Lock on mutex_, held on entry and on return
+ * @param channel Index of the channel whose batch to send
+ */
+void AsyncPublisher::SendPendingLocked(std::unique_lock<std::mutex>& lock, size_t channel) {
+    PendingBatch& batch = pending_[channel];
+    if (batch.requests.empty()) {
+        return;
+    }
+    std::vector<PublishRequest> requests;
+    std::vector<CompletionFn> callbacks;
+    requests.swap(batch.requests);
+    callbacks.swap(batch.callbacks);
+    pending_count_ -= requests.size();
+    StartCall(lock, channel, std::move(requests), std::move(callbacks));
+}
+
+/**
+ * @brief Wait for a free in-flight slot and start the RPC for the given messages.
+ *
+ * A single message is sent with Publish, several with PublishBatch. The
+ * slot stays taken across retries until the completion thread finishes the
+ * call. Callers waiting for a slot are served first come, first served.
+ *
+ * The messages get their sequence numbers here rather than when they are
+ * published, so the numbers increase in the order RPCs start. A call also
+ * waits while its last sequence would be max_sequence_span or more past the
+ * first sequence of the oldest RPC still in flight. Sequenced messages,
+ * shared-memory records being resent, keep their numbers, which are older
+ * than any not yet given out, and do not wait for the span.
+ *
+ * @param lock Lock on mutex_, held on entry and on return
+ * @param channel Index of the channel to send on
+ * @param requests The messages to send
+ * @param callbacks One completion callback per message
+ * @param sequenced Whether the messages already carry their sequence numbers, in increasing order
+ */
+void AsyncPublisher::StartCall(std::unique_lock<std::mutex>& lock, size_t channel,
+                               std::vector<PublishRequest> requests, std::vector<CompletionFn> callbacks,
+                               bool sequenced) {
+    // Slots are granted in arrival order. Otherwise a batch started by the
+    // linger thread could lose every wakeup to the publishing thread and fall
+    // behind the server's dedup window.
+    uint64_t ticket = next_ticket_++;
+    uint64_t count = requests.size();
+    window_cv_.wait(lock, [this, ticket, count, sequenced] {
+        return serving_ticket_ == ticket && in_flight_ < options_.max_in_flight &&
+               (sequenced || in_flight_sequences_.empty() ||
+                next_sequence_ + count - 1 < *in_flight_sequences_.begin() + options_.max_sequence_span);
+    });
+    serving_ticket_++;
+    in_flight_++;
+    window_cv_.notify_all();
+
+    Call* call = new Call;
+    call->channel = channel;
+    if (sequenced) {
+        call->first_sequence = requests.front().sequence();
+    } else {
+        call->first_sequence = next_sequence_;
+        for (auto& request : requests) {
+            request.set_sequence(next_sequence_++);
+        }
+    }
+    in_flight_sequences_.insert(call->first_sequence);
+    call->callbacks = std::move(callbacks);
+    if (requests.size() == 1) {
+        call->request = std::move(requests[0]);
+    } else {
+        call->batch = true;
+        call->batch_request.mutable_messages()->Reserve(static_cast<int>(requests.size()));
+        for (auto& request : requests) {
+            *call->batch_request.add_messages() = std::move(request);
+        }
+    }
+    SendAttempt(call);
+}
+
+/**
+ * @brief Issue one attempt of a call's RPC.
+ *
+ * Each attempt needs a fresh ClientContext. The request itself is reused
+ * unchanged, so a retried message keeps its producer ID and sequence number.
+ *
+ * @param call The call to (re)send
+ */
+void AsyncPublisher::SendAttempt(Call* call) {
+    call->context.reset(new ClientContext);
+    if (!options_.client_id.empty()) {
+        call->context->AddMetadata("x-pubsub-client-id", options_.client_id);
+    }
+    if (options_.rpc_timeout.count() > 0) {
+        call->context->set_deadline(std::chrono::system_clock::now() + options_.rpc_timeout);
+    }
+    PubSub::Stub* stub = pool_.Stub(call->channel);
+    if (call->batch) {
+        call->batch_reader = stub->PrepareAsyncPublishBatch(call->context.get(), call->batch_request, &cq_);
+        call->batch_reader->StartCall();
+        call->batch_reader->Finish(&call->batch_response, &call->status, call);
+    } else {
+        call->reader = stub->PrepareAsyncPublish(call->context.get(), call->request, &cq_);
+        call->reader->StartCall();
+        call->reader->Finish(&call->response, &call->status, call);
+    }
+}
+
+/**
+ * @brief Backoff to wait before the given retry attempt.
+ *
+ * The delay grows by backoff_multiplier per attempt up to max_backoff and is
+ * drawn uniformly from the upper half of that range, so that producers
+ * failing together do not retry in lockstep.
+ *
+ * @param attempt The retry attempt, starting at 1
+ * @return The delay before resending
+ */
+std::chrono::milliseconds AsyncPublisher::Backoff(int attempt) {
+    double delay = options_.initial_backoff.count() * std::pow(options_.backoff_multiplier, attempt - 1);
+    delay = std::min(delay, static_cast<double>(options_.max_backoff.count()));
+    std::uniform_real_distribution<double> jitter(0.5, 1.0);
+    return std::chrono::milliseconds(static_cast<int64_t>(delay * jitter(rng_)));
+}
+
+/**
+ * @brief Thread function that completes RPCs as the server answers them.
+ *
+ * Transient failures are rescheduled through an alarm on the same
+ * completion queue. An attempt the server rejected for exceeding a quota
+ * waits for the server's retry-after hint instead of the exponential
+ * backoff, counted from the retry slot of the previous rejected call, so
+ * calls throttled together are resent spaced out rather than all at once.
+ * Otherwise each message's callback runs with its result
+ * and the call's in-flight slot is released. Exits once the completion
+ * queue has been shut down and drained.
+ */
+void AsyncPublisher::CompletionThread() {
+    void* tag;
+    bool ok;
+    while (cq_.Next(&tag, &ok)) {
+        Call* call = static_cast<Call*>(tag);
+        if (call->backing_off) {
+            call->backing_off = false;
+            SendAttempt(call);
+            continue;
+        }
+        if (!call->status.ok() && IsRetryable(call->status) && call->attempt < options_.max_retries) {
+            call->attempt++;
+            call->backing_off = true;
+            auto now = std::chrono::system_clock::now();
+            auto retry_at = now + Backoff(call->attempt);
+            std::chrono::milliseconds retry_after = RetryAfter(*call->context);
+            if (retry_after.count() > 0) {
+                // Queue behind the calls already waiting for quota, so they come back one by one
+                throttled_until_ = std::max(throttled_until_, now) + retry_after;
+                retry_at = throttled_until_;
+            }
+            call->alarm.Set(&cq_, retry_at, call);
+            continue;
+        }
+
+        std::unique_ptr<Call> done(call);
+        bool accepted = call->batch ? call->batch_response.success() : call->response.success();
+
+        PublishResult result;
+        result.status = call->status;
+        if (result.status.ok() && !accepted) {
+            result.status = Status(grpc::StatusCode::UNKNOWN, "Publish rejected by server");
+        }
+        for (size_t i = 0; i < call->callbacks.size(); i++) {
+            if (result.status.ok()) {
+                if (call->batch) {
+                    int index = static_cast<int>(i);
+                    const PublishBatchResponse& response = call->batch_response;
+                    result.message_id = index < response.message_ids_size() ? response.message_ids(index) : std::string();
+                    result.duplicate = index < response.duplicates_size() && response.duplicates(index);
+                } else {
+                    result.message_id = call->response.message_id();
+                    result.duplicate = call->response.duplicate();
+                }
+            }
+            if (call->callbacks[i]) {
+                call->callbacks[i](result);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            in_flight_--;
+            in_flight_sequences_.erase(in_flight_sequences_.find(call->first_sequence));
+        }
+        window_cv_.notify_all();
+    }
+}
+
+/**
+ * @brief Thread function that sends batches whose linger time has expired.
+ */
+void AsyncPublisher::LingerThread() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!shutdown_) {
+        if (pending_count_ == 0) {
+            linger_cv_.wait(lock);
+            continue;
+        }
+        auto now = std::chrono::steady_clock::now();
+        auto next_deadline = std::chrono::steady_clock::time_point::max();
+        for (size_t channel = 0; channel < pending_.size(); channel++) {
+            if (pending_[channel].requests.empty()) {
+                continue;
+            }
+            auto deadline = pending_[channel].since + options_.linger;
+            if (now >= deadline) {
+                SendPendingLocked(lock, channel);
+            } else {
+                next_deadline = std::min(next_deadline, deadline);
+            }
+        }
+        if (next_deadline != std::chrono::steady_clock::time_point::max()) {
+            linger_cv_.wait_until(lock, next_deadline);
+        }
+    }
+}
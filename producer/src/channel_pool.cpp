@@ -0,0 +1,35 @@
+/**
+ * @file channel_pool.cpp
+ * @brief Implementation of the pool of independent connections used by producers.
+ */
+
+#include "channel_pool.h"
+#include <algorithm>
+
+/**
+ * @brief Creates a pool of independent connections to a server.
+ * @param target The server address
+ * @param size Number of channels to create (at least one)
+ * @param options Channel settings; a local subchannel pool is always used
+ * @param credentials Channel credentials; insecure when null
+ */
+ChannelPool::ChannelPool(const std::string& target, size_t size,
+                         const pubsub::common::ChannelOptions& options,
+                         std::shared_ptr<grpc::ChannelCredentials> credentials) {
+    pubsub::common::ChannelOptions pooled = options;
+    pooled.local_subchannel_pool = true;
+    size = std::max<size_t>(size, 1);
+    for (size_t i = 0; i < size; i++) {
+        channels_.push_back(pubsub::common::createChannel(target, pooled, credentials));
+        stubs_.push_back(PubSub::NewStub(channels_.back()));
+    }
+}
+
+/**
+ * @brief Wraps an existing channel as a pool of one.
+ * @param channel Shared pointer to the gRPC channel
+ */
+ChannelPool::ChannelPool(std::shared_ptr<Channel> channel) {
+    channels_.push_back(channel);
+    stubs_.push_back(PubSub::NewStub(channel));
+}
@@ -0,0 +1,28 @@
+/**
+ * @file partitioner.cpp
+ * @brief Implementation of the pluggable strategies that spread published messages over connections.
+ */
+
+#include "partitioner.h"
+#include <functional>
+#include <string>
+
+/**
+ * @brief Choose a partition from the hash of the message's topic.
+ * @param request The message about to be published
+ * @param num_partitions Number of available partitions, at least one
+ * @return A partition index in [0, num_partitions)
+ */
+size_t HashPartitioner::Partition(const pubsub::PublishRequest& request, size_t num_partitions) {
+    return std::hash<std::string>()(request.topic()) % num_partitions;
+}
+
+/**
+ * @brief Choose the next partition in turn.
+ * @param request The message about to be published (unused)
+ * @param num_partitions Number of available partitions, at least one
+ * @return A partition index in [0, num_partitions)
+ */
+size_t RoundRobinPartitioner::Partition(const pubsub::PublishRequest& /*request*/, size_t num_partitions) {
+    return next_.fetch_add(1, std::memory_order_relaxed) % num_partitions;
+}
@@ -0,0 +1,184 @@
+/**
+ * @file publisher.cpp
+ * @brief Implementation of the Publisher client for the PubSub gRPC service.
+ */
+
+#include "publisher.h"
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+/**
+ * @brief Constructs a Publisher client.
+ * @param channel Shared pointer to the gRPC channel
+ * @param options Producer configuration; num_channels and channel are ignored
+ */
+Publisher::Publisher(std::shared_ptr<Channel> channel, const ProducerOptions& options)
+    : producer_(channel, options) {}
+
+/**
+ * @brief Constructs a Publisher client with its own pool of connections.
+ * @param target The server address
+ * @param options Producer configuration
+ */
+Publisher::Publisher(const std::string& target, const ProducerOptions& options)
+    : producer_(target, options) {}
+
+/**
+ * @brief Publishes a message to a topic and waits for the result.
+ *
+ * Transient failures are retried with backoff by the underlying
+ * AsyncPublisher before this call reports an error.
+ *
+ * @param topic The topic to publish to
+ * @param content The message content
+ * @return true if the message was published successfully, false otherwise
+ */
+bool Publisher::Publish(const std::string& topic, const std::string& content) {
+    return Publish(topic, std::string(), content);
+}
+
+/**
+ * @brief Publishes a keyed message to a topic and waits for the result.
+ *
+ * Transient failures are retried with backoff by the underlying
+ * AsyncPublisher before this call reports an error.
+ *
+ * @param topic The topic to publish to
+ * @param key The message key; messages with the same key stay in order
+ * @param content The message content
+ * @return true if the message was published successfully, false otherwise
+ */
+bool Publisher::Publish(const std::string& topic, const std::string& key, const std::string& content) {
+    return Await(topic, producer_.PublishAsync(topic, key, content));
+}
+
+/**
+ * @brief Publish a message that the server delivers only after a delay, and wait for the result.
+ *
+ * The delay runs from when the server receives the message, so it does not
+ * depend on the clocks of the two hosts agreeing.
+ *
+ * @param topic The topic to publish to
+ * @param content The message content
+ * @param delay How long after the server receives the message it is delivered
+ * @return true if the message was accepted for delivery, false otherwise
+ */
+bool Publisher::PublishDelayed(const std::string& topic, const std::string& content,
+                               std::chrono::milliseconds delay) {
+    pubsub::PublishRequest request;
+    request.set_topic(topic);
+    request.set_content(content);
+    request.set_delay_ms(static_cast<uint32_t>(std::min<int64_t>(std::max<int64_t>(delay.count(), 0),
+                                                                 std::numeric_limits<uint32_t>::max())));
+    return Await(topic, producer_.PublishAsync(std::move(request)));
+}
+
+/**
+ * @brief Publish a message that the server delivers at a given time, and wait for the result.
+ *
+ * The time is compared with the server's clock.
+ *
+ * @param topic The topic to publish to
+ * @param content The message content
+ * @param when When the message is delivered; a time already passed delivers it immediately
+ * @return true if the message was accepted for delivery, false otherwise
+ */
+bool Publisher::PublishAt(const std::string& topic, const std::string& content,
+                          std::chrono::system_clock::time_point when) {
+    pubsub::PublishRequest request;
+    request.set_topic(topic);
+    request.set_content(content);
+    request.set_deliver_at(std::max<int64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(when.time_since_epoch()).count(), 1));
+    return Await(topic, producer_.PublishAsync(std::move(request)));
+}
+
+/**
+ * @brief Publish a message to a topic without waiting for the result.
+ * @param topic The topic to publish to
+ * @param content The message content
+ * @return A future that becomes ready once the server has answered
+ */
+std::future<PublishResult> Publisher::PublishAsync(const std::string& topic, const std::string& content) {
+    return producer_.PublishAsync(topic, content);
+}
+
+/**
+ * @brief Publish a message to multiple topics.
+ *
+ * The publishes are pipelined and then awaited together, so the call takes
+ * roughly one round trip rather than one per topic.
+ *
+ * @param topics Vector of topics to publish to
+ * @param content The message content
+ * @return Number of topics the message was successfully published to
+ */
+int Publisher::PublishToMultiple(const std::vector<std::string>& topics, const std::string& content) {
+    std::vector<std::future<PublishResult>> results;
+    results.reserve(topics.size());
+    for (const auto& topic : topics) {
+        results.push_back(producer_.PublishAsync(topic, content));
+    }
+
+    int success_count = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+        PublishResult result = results[i].get();
+        if (result.ok()) {
+            success_count++;
+        } else {
+            std::cerr << "Error publishing message: " << result.status.error_code() << ": "
+                      << result.status.error_message() << " Topic: " << topics[i] << std::endl;
+        }
+    }
+    return success_count;
+}
+
+/**
+ * @brief Register default topics for this publisher.
+ * @param topics Vector of topics to register
+ */
+void Publisher::RegisterTopics(const std::vector<std::string>& topics) {
+    registered_topics_ = topics;
+    std::cout << "Registered " << topics.size() << " topics: ";
+    for (const auto& topic : topics) {
+        std::cout << topic << " ";
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * @brief Publish a message to all registered topics.
+ * @param content The message content
+ * @return Number of topics the message was successfully published to
+ */
+int Publisher::PublishToAll(const std::string& content) {
+    if (registered_topics_.empty()) {
+        std::cout << "No registered topics. Message not published." << std::endl;
+        return 0;
+    }
+    return PublishToMultiple(registered_topics_, content);
+}
+
+/**
+ * @brief Wait until every message published so far has completed.
+ */
+void Publisher::Flush() {
+    producer_.Flush();
+}
+
+/**
+ * @brief Wait for a publish and report its failure.
+ * @param topic The topic the message was published to
+ * @param result The pending result of the publish
+ * @return true if the message was published successfully, false otherwise
+ */
+bool Publisher::Await(const std::string& topic, std::future<PublishResult> result) {
+    PublishResult outcome = result.get();
+    if (!outcome.ok()) {
+        std::cerr << "Error publishing message: " << outcome.status.error_code() << ": "
+                  << outcome.status.error_message() << " Topic: " << topic << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -7,6 +7,7 @@
  */
 
 #include "publisher.h"
+#include "pubsub_channel.h"
 #include <iostream>
 #include <string>
 #include <chrono>
@@ -34,7 +35,7 @@ int main(int argc, char** argv) {
     if (argc > 3) content = argv[3];
     
     // Create a channel to the server
-    auto channel = grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials());
+    auto channel = pubsub::common::createChannel(server_address);
     Publisher publisher(channel);
     
     // Publish messages in a loop
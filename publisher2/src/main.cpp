@@ -6,7 +6,8 @@
  * Command line arguments can be used to specify the server address, topic, and message content.
  */
 
-#include "../include/publisher.h"
+#include "publisher.h"
+#include "pubsub_channel.h"
 #include <iostream>
 #include <string>
 #include <chrono>
@@ -43,7 +44,7 @@ int main(int argc, char** argv) {
     topics.push_back(topics_arg.substr(start));
     
     // Create a channel to the server
-    auto channel = grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials());
+    auto channel = pubsub::common::createChannel(server_address);
     Publisher publisher(channel);
     
     // Register topics with the publisher
@@ -0,0 +1,114 @@
+/**
+ * @file ack_tracker.h
+ * @brief Declaration of the per-stream record of delivered but unacknowledged messages.
+ */
+#ifndef ACK_TRACKER_H
+#define ACK_TRACKER_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+#include "timer_wheel.h"
+
+/**
+ * @class AckTracker
+ * @brief Tracks the messages a SubscribeAck stream is waiting to have acknowledged.
+ *
+ * Each subscribed topic keeps a deque of the messages delivered since its
+ * oldest unacknowledged one, in sequence order, and a hash index from
+ * sequence to entry. Only delivered sequences get an entry, so gaps in the
+ * sequence (compacted topics, evicted messages) cost nothing. Every
+ * unacknowledged entry carries a redelivery timer in a TimerWheel.
+ * Delivering, acknowledging and expiring a message are all O(1); cumulative
+ * acknowledgements cost O(1) per delivered message they cover.
+ *
+ * Topic partitions are identified by their index in the subscription (the
+ * "topic" arguments below). The tracker is not synchronized.
+ */
+class AckTracker {
+public:
+    /**
+     * @struct Expired
+     * @brief A message whose acknowledgement timed out and that must be sent again.
+     */
+    struct Expired {
+        size_t topic;
+        uint64_t sequence;
+        uint32_t attempt;   // Delivery attempt the redelivery will be
+    };
+
+    /**
+     * @brief Constructs a tracker for a subscription.
+     * @param num_topics Number of topics in the subscription
+     * @param ack_timeout How long a delivered message may stay unacknowledged
+     */
+    AckTracker(size_t num_topics, std::chrono::milliseconds ack_timeout);
+
+    /**
+     * @brief Record the first delivery of a message and start its timer.
+     *
+     * Sequences must be delivered in increasing order per topic; sequences
+     * skipped in between (evicted before delivery) are treated as acknowledged.
+     *
+     * @param topic Index of the message's topic
+     * @param sequence The message's sequence number
+     */
+    void Delivered(size_t topic, uint64_t sequence);
+
+    /**
+     * @brief Acknowledge every delivered message of a topic below a sequence.
+     * @param topic Index of the topic
+     * @param next_sequence One past the highest acknowledged sequence
+     */
+    void AckBelow(size_t topic, uint64_t next_sequence);
+
+    /**
+     * @brief Acknowledge one message; unknown or already acknowledged sequences are ignored.
+     * @param topic Index of the message's topic
+     * @param sequence The message's sequence number
+     */
+    void Ack(size_t topic, uint64_t sequence);
+
+    /**
+     * @brief Collect the messages whose timers expired and rearm their timers.
+     * @param now The current time
+     * @param expired Vector the expired messages are appended to
+     */
+    void Expire(TimerWheel::Clock::time_point now, std::vector<Expired>* expired);
+
+    /**
+     * @brief Get the number of delivered messages not yet acknowledged.
+     * @return The number of unacknowledged messages
+     */
+    size_t Unacked() const { return wheel_.Size(); }
+
+    /**
+     * @brief Get the wheel's tick, the granularity of redelivery.
+     * @return The tick duration
+     */
+    std::chrono::milliseconds Tick() const { return wheel_.Tick(); }
+
+private:
+    struct Entry : TimerWheel::Timer {
+        uint64_t sequence = 0;
+        uint32_t topic = 0;
+        uint32_t attempt = 1;
+    };
+
+    struct TopicState {
+        std::deque<Entry> entries;                     // By sequence; acknowledged entries have no timer linked
+        std::unordered_map<uint64_t, Entry*> index;    // Unacknowledged entries by sequence
+        uint64_t next = 0;                             // One past the highest sequence delivered
+    };
+
+    // Drop acknowledged entries from the front of a topic's range
+    void Trim(TopicState* state);
+
+    std::chrono::milliseconds ack_timeout_;
+    TimerWheel wheel_;
+    std::vector<TopicState> topics_;
+};
+
+#endif // ACK_TRACKER_H
@@ -0,0 +1,100 @@
+/**
+ * @file dedup_window.h
+ * @brief Declaration of the per-producer window used to drop retried publishes.
+ */
+#ifndef DEDUP_WINDOW_H
+#define DEDUP_WINDOW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @class DedupWindow
+ * @brief Remembers which recent sequence numbers each producer has published.
+ *
+ * For every producer the window keeps the highest sequence number seen and a
+ * ring bitmap of the kWindowSize sequences up to it. Checking a publish is
+ * amortized O(1) and needs no message history, only a fixed 512-byte bitmap
+ * per producer.
+ *
+ * Sequences more than kWindowSize below the high-water mark can no longer be
+ * told apart and are reported as duplicates. Pipelined producers deliver
+ * their messages out of order, so they must keep the distance between their
+ * oldest unanswered and newest sent sequence (ProducerOptions::max_sequence_span)
+ * within kWindowSize.
+ *
+ * Producers are kept in order of their last publish. At most max_producers
+ * are tracked; a new producer beyond that evicts the one that published
+ * least recently, and ExpireIdle forgets producers idle since a given time.
+ * A forgotten producer starts over with an empty window, so a retry of one
+ * of its old messages would be stored again.
+ *
+ * The window is not synchronized; callers must hold a lock.
+ */
+class DedupWindow {
+public:
+    // Number of sequences up to the high-water mark that are tracked individually
+    static constexpr uint64_t kWindowSize = 4096;
+
+    // Default limit on tracked producers: about 33 MB of bitmaps
+    static constexpr size_t kDefaultMaxProducers = 65536;
+
+    /**
+     * @brief Constructs an empty window.
+     * @param max_producers Most producers tracked at once; at least one is always kept
+     */
+    explicit DedupWindow(size_t max_producers = kDefaultMaxProducers);
+
+    /**
+     * @brief Record a publish and tell whether it was seen before.
+     *
+     * Publishes without a producer ID or with sequence 0 are not tracked and
+     * are always accepted.
+     *
+     * @param producer_id The producer that sent the message
+     * @param sequence The producer's sequence number for the message
+     * @param now Current time in nanoseconds, recorded as the producer's last publish
+     * @return true if the message is new and should be stored
+     */
+    bool Accept(const std::string& producer_id, uint64_t sequence, int64_t now);
+
+    /**
+     * @brief Forget every producer that has not published since a given time.
+     * @param idle_since Producers whose last publish is older than this are forgotten
+     * @return Number of producers forgotten
+     */
+    size_t ExpireIdle(int64_t idle_since);
+
+    /**
+     * @brief Change the limit on tracked producers, evicting the least recent beyond it.
+     * @param max_producers Most producers tracked at once; at least one is always kept
+     */
+    void SetMaxProducers(size_t max_producers);
+
+    /**
+     * @brief Get the number of producers being tracked.
+     * @return The number of producers
+     */
+    size_t Size() const { return index_.size(); }
+
+private:
+    static constexpr uint64_t kWords = kWindowSize / 64;
+
+    struct ProducerState {
+        std::string producer_id;
+        int64_t last_seen = 0;          // Time of the last publish
+        uint64_t high_water = 0;        // Highest sequence accepted
+        uint64_t seen[kWords] = {};     // Bit s % kWindowSize set: sequence s was accepted
+    };
+
+    using ProducerList = std::list<ProducerState>;
+
+    size_t max_producers_;
+    ProducerList producers_;  // Most recent publish first
+    std::unordered_map<std::string, ProducerList::iterator> index_;
+};
+
+#endif // DEDUP_WINDOW_H
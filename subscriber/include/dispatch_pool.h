@@ -0,0 +1,116 @@
+/**
+ * @file dispatch_pool.h
+ * @brief Declaration of the worker pool that runs subscriber callbacks off the reader thread.
+ */
+#ifndef DISPATCH_POOL_H
+#define DISPATCH_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "pubsub.pb.h"
+
+using pubsub::Message;
+
+/**
+ * @class DispatchPool
+ * @brief Work-stealing pool that handles messages in parallel while keeping per-key order.
+ *
+ * Every key (a topic, by default) owns a strand: a FIFO of its pending
+ * messages. A strand with pending messages is scheduled on exactly one
+ * worker's ready deque at a time, so the messages of one key are handled
+ * one after another in arrival order. Different keys run in parallel. A
+ * strand exists only while its key has messages queued or running, so
+ * high-cardinality keys cost memory only for the keys in flight.
+ *
+ * Each strand has a home worker chosen by hashing its key. A worker takes
+ * strands from the front of its own deque and, when that is empty, steals
+ * from the back of the other workers' deques, so a burst on a few keys does
+ * not leave the remaining workers idle.
+ */
+class DispatchPool {
+public:
+    using Handler = std::function<void(const Message&)>;
+
+    /**
+     * @brief Constructs the pool and starts its workers.
+     * @param num_workers Number of worker threads (at least one)
+     * @param max_pending Maximum number of queued messages before Dispatch blocks
+     * @param handler Function run for every dispatched message
+     */
+    DispatchPool(size_t num_workers, size_t max_pending, Handler handler);
+
+    /**
+     * @brief Destructor that handles all queued messages and stops the workers.
+     */
+    ~DispatchPool();
+
+    /**
+     * @brief Queue a message behind the earlier messages with the same key.
+     *
+     * Blocks while max_pending messages are already queued, which pushes back
+     * on the reader and, through flow control, on the server.
+     *
+     * @param key The ordering key
+     * @param message The message, moved into the queue
+     */
+    void Dispatch(const std::string& key, Message&& message);
+
+    /**
+     * @brief Wait until every message dispatched so far has been handled.
+     */
+    void Drain();
+
+    /**
+     * @brief Handle all queued messages and stop the workers.
+     */
+    void Stop();
+
+private:
+    struct Strand {
+        std::deque<Message> messages;
+        bool scheduled = false;            // Queued on a ready deque or being run
+        size_t home = 0;                   // Worker whose deque the strand is pushed to
+        const std::string* key = nullptr;  // The strand's key in strands_, to erase it by
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Strand*> ready;
+        std::thread thread;
+    };
+
+    // Maximum number of messages a worker takes from a strand before rescheduling it
+    static constexpr size_t kMaxBatch = 32;
+
+    void WorkerLoop(size_t index);
+
+    // Put a strand on a worker's ready deque and wake an idle worker
+    void Schedule(size_t worker, Strand* strand);
+
+    // Take a strand from the worker's own deque, or steal one from another worker
+    Strand* NextStrand(size_t index);
+
+    Handler handler_;
+    size_t max_pending_;
+
+    std::mutex mutex_;                        // Guards strands_, their contents and pending_
+    std::condition_variable space_cv_;        // Signalled when messages are handled
+    std::unordered_map<std::string, Strand> strands_;
+    size_t pending_;                          // Dispatched but not yet handled
+
+    std::mutex idle_mutex_;                   // Guards ready_count_ and stopping_
+    std::condition_variable idle_cv_;
+    size_t ready_count_;                      // Strands waiting on any ready deque
+    bool stopping_;
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+#endif // DISPATCH_POOL_H
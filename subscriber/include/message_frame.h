@@ -0,0 +1,140 @@
+/**
+ * @file message_frame.h
+ * @brief Declaration of the serialized message frames that carry payloads through the server unparsed.
+ */
+#ifndef MESSAGE_FRAME_H
+#define MESSAGE_FRAME_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <grpc/slice.h>
+#include <grpcpp/support/byte_buffer.h>
+#include <grpcpp/support/slice.h>
+#include "pubsub.pb.h"
+
+/**
+ * @class PendingFrame
+ * @brief A serialized Message, started with its content when published and finished when stored.
+ *
+ * The frame is a single reference-counted buffer. The content field goes
+ * first, copied straight from the publisher's request bytes; the fields
+ * that are only known once the message is stored (its ID, sequence number,
+ * timestamp, partition and incarnation) are appended behind it by Finish. Protobuf
+ * parsers accept fields in any order, so the finished frame is an ordinary
+ * serialized Message that the service retains as is and writes to every
+ * subscriber by reference, without encoding it again.
+ */
+class PendingFrame {
+public:
+    /**
+     * @brief Constructs an empty frame.
+     */
+    PendingFrame();
+
+    /**
+     * @brief Destructor that releases the frame's reference to its buffer.
+     */
+    ~PendingFrame();
+
+    PendingFrame(PendingFrame&& other) noexcept;
+    PendingFrame& operator=(PendingFrame&& other) noexcept;
+    PendingFrame(const PendingFrame&) = delete;
+    PendingFrame& operator=(const PendingFrame&) = delete;
+
+    /**
+     * @brief Allocate the frame and encode the head of its content field.
+     * @param content_size Size of the content
+     * @param topic_size Size of the topic name, to reserve room for it
+     * @param key_size Size of the key, to reserve room for it
+     * @return Where the caller copies the content to
+     */
+    char* Start(size_t content_size, size_t topic_size, size_t key_size);
+
+    /**
+     * @brief Allocate the frame with a copy of a published message's content.
+     * @param request The published message
+     */
+    void Assign(const pubsub::PublishRequest& request);
+
+    /**
+     * @brief Get the content, which stays readable after the frame is finished.
+     * @return The first byte of the content
+     */
+    const char* Content() const;
+
+    /**
+     * @brief Get the size of the content.
+     * @return The content size in bytes
+     */
+    size_t ContentSize() const { return content_size_; }
+
+    /**
+     * @brief Append the remaining fields of the Message.
+     * @param message_id The message ID
+     * @param topic The topic name
+     * @param timestamp When the message was stored, in nanoseconds since the Unix epoch
+     * @param sequence The message's position in its partition
+     * @param key The message key
+     * @param partition The partition index
+     * @param incarnation The incarnation of the partition
+     * @return The serialized Message, sharing the frame's buffer
+     */
+    grpc::Slice Finish(const std::string& message_id, const std::string& topic, int64_t timestamp,
+                       uint64_t sequence, const std::string& key, uint32_t partition, uint64_t incarnation);
+
+private:
+    grpc_slice slice_;      // Reference-counted buffer whose length is its capacity
+    size_t content_begin_;  // Offset of the content
+    size_t content_size_;
+};
+
+/**
+ * @brief Read a serialized PublishRequest, copying its content into a frame without parsing it.
+ * @param data The request's bytes
+ * @param size Number of bytes
+ * @param envelope Receives every field of the request except the content
+ * @param frame Receives a new frame holding the content
+ * @return true if the request was well formed
+ */
+bool ScanPublish(const char* data, size_t size, pubsub::PublishRequest* envelope, PendingFrame* frame);
+
+/**
+ * @brief Read a PublishRequest received as raw bytes, copying its content into a frame without parsing it.
+ * @param buffer The request as received
+ * @param envelope Receives every field of the request except the content
+ * @param frame Receives a new frame holding the content
+ * @return true if the request was well formed
+ */
+bool ScanPublish(grpc::ByteBuffer* buffer, pubsub::PublishRequest* envelope, PendingFrame* frame);
+
+/**
+ * @brief Read a PublishBatchRequest received as raw bytes, copying each content into a frame.
+ * @param buffer The request as received
+ * @param envelopes Receives every field of each request except its content
+ * @param frames Receives a new frame per request, parallel to the envelopes' messages
+ * @return true if the request was well formed
+ */
+bool ScanPublishBatch(grpc::ByteBuffer* buffer, pubsub::PublishBatchRequest* envelopes,
+                      std::vector<PendingFrame>* frames);
+
+/**
+ * @brief Read the sequence number and key of a serialized Message, skipping its other fields.
+ * @param data The message's bytes
+ * @param size Number of bytes
+ * @param sequence Receives the sequence number
+ * @param key Receives the key
+ * @return true if the message was well formed
+ */
+bool ReadFrameInfo(const char* data, size_t size, uint64_t* sequence, std::string* key);
+
+/**
+ * @brief Add a frame as the next message of a MessageBatch, by reference.
+ * @param frame The serialized Message
+ * @param delivery_attempt Delivery attempt to add to the message, or 0 to add none
+ * @param slices The batch's serialized form, which the entry is appended to
+ */
+void AppendBatchEntry(const grpc::Slice& frame, uint32_t delivery_attempt, std::vector<grpc::Slice>* slices);
+
+#endif // MESSAGE_FRAME_H
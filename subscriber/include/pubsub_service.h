@@ -5,40 +5,138 @@
 #ifndef PUBSUB_SERVICE_H
 #define PUBSUB_SERVICE_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <random>
 #include <string>
 #include <unordered_map>
 #include <vector>
 #include <mutex>
+#include <thread>
 #include <grpcpp/grpcpp.h>
 #include "pubsub.pb.h"
 #include "pubsub.grpc.pb.h"
+#include "topic_buffer.h"
+#include "message_frame.h"
+#include "topic_registry.h"
+#include "dedup_window.h"
+#include "ack_tracker.h"
+#include "timer_wheel.h"
+#include "cpu_affinity.h"
+#include "rate_limiter.h"
+#include "server_options.h"
 
+using grpc::ByteBuffer;
 using grpc::ServerContext;
 using grpc::ServerWriter;
+using grpc::ServerReaderWriter;
 using grpc::Status;
 using pubsub::PubSub;
 using pubsub::PublishRequest;
 using pubsub::PublishResponse;
+using pubsub::PublishBatchRequest;
+using pubsub::PublishBatchResponse;
 using pubsub::SubscribeRequest;
 using pubsub::Message;
+using pubsub::MessageBatch;
+using pubsub::AckRequest;
+using pubsub::SharedMemoryAttach;
+using pubsub::SharedMemoryStatus;
 
 /**
  * @class PubSubServiceImpl
  * @brief Implementation of the PubSub gRPC service for handling publish and subscribe requests.
+ *
+ * Every topic is split into a fixed number of partitions, each with its own
+ * lock, message buffer and sequence numbers. A message is stored in the
+ * partition selected by its key, so messages with the same key keep their
+ * order. The service lock only covers the topic registry and the dedup
+ * window; appends and reads of different partitions proceed in parallel.
+ *
+ * Partitions are reference counted. Publishes, subscriptions and snapshots
+ * hold a reference while they use one, so a topic that nobody references and
+ * that has been idle for a while can be unregistered by ReclaimIdleTopics,
+ * and its ID reused, without pausing anyone who is using other topics.
+ *
+ * Publishes can be subject to quotas per topic and per publisher, enforced
+ * with token buckets before the service lock is taken, so a publisher over
+ * its quota is turned away cheaply instead of queueing on the lock ahead of
+ * everyone else.
+ *
+ * Request threads can be pinned to the NUMA node that is home to the
+ * partition they serve, so that a partition is stored and delivered from
+ * one node's memory and caches.
+ *
+ * Messages travel through the server without being parsed or encoded
+ * again. Publishes are received as raw bytes, of which only the envelope
+ * (topic, key, producer and delivery time) is parsed; the payload is copied
+ * once, straight into the serialized Message it is stored as. Subscriptions
+ * write those stored frames to their streams by reference, so each message
+ * is encoded once however many subscribers receive it.
+ *
+ * Compacted topics keep the latest message of each key instead of the latest
+ * messages, so a subscriber starting from the beginning receives the current
+ * value of every key and then the updates that follow.
+ *
+ * A message published with a delivery time or delay is deduplicated and
+ * given its ID right away, but held in a hierarchical timing wheel until it
+ * is due; a single scheduler thread then stores it like a new publish.
+ * Holding and releasing a message is O(1), however many are pending.
  */
 class PubSubServiceImpl final : public PubSub::Service {
 public:
     /**
      * @brief Constructor for PubSubServiceImpl
-     * @param max_messages_per_topic Maximum number of messages to store per topic (defaults to 100)
+     * @param max_messages_per_topic Maximum number of messages to store per topic partition (defaults to 100)
+     * @param partitions_per_topic Number of partitions of every topic (defaults to 1)
      */
-    PubSubServiceImpl(size_t max_messages_per_topic = 100);
+    PubSubServiceImpl(size_t max_messages_per_topic = 100, size_t partitions_per_topic = 1);
+
+    /**
+     * @brief Destructor that stops the topic sweeper, the scheduler and the snapshot thread, writing a final snapshot.
+     *
+     * Messages still waiting for their delivery time are discarded.
+     */
+    ~PubSubServiceImpl();
+
+    /**
+     * @brief Enforce the publish quotas of the options; call before serving requests.
+     * @param options The per-topic and per-publisher rate limits and their overrides, the
+     *                limit on messages waiting for their delivery time, the rate at which
+     *                subscriptions replay retained messages and the number of producers
+     *                whose retries are deduplicated
+     */
+    void SetRateLimits(const ServerOptions& options);
+
+    /**
+     * @brief Compact the topics the options name; call before restoring a snapshot or serving requests.
+     * @param options The names and name prefixes of the compacted topics
+     */
+    void SetCompactedTopics(const ServerOptions& options);
+
+    /**
+     * @brief Pin request threads to the NUMA node of the partition they serve; call before serving requests.
+     * @param options The CPUs to use and whether to pin per NUMA node
+     */
+    void SetThreadPlacement(const ServerOptions& options);
+
+    /**
+     * @brief Log every message to stdout as it is stored if the options ask for it; call before serving requests.
+     * @param options Whether to log verbosely
+     */
+    void SetLogging(const ServerOptions& options);
 
     /**
      * @brief Publish a message to a topic.
-     * @param context The gRPC server context
+     *
+     * Requests arriving over gRPC are served from their raw bytes instead;
+     * this entry point stores messages published from within the process.
+     *
+     * @param context The gRPC server context, or null for a publish without a publisher quota
      * @param request The publish request
      * @param response The response to be sent back to the client
      * @return Status::OK if successful
@@ -47,21 +145,41 @@ public:
                   PublishResponse* response) override;
     
     /**
-     * @brief Subscribe to a topic or topics and receive messages.
-     * @param context The gRPC server context
-     * @param request The subscribe request
-     * @param writer The server writer used to stream messages to the client
-     * @return Status::OK when the client disconnects
+     * @brief Publish several messages in one request.
+     *
+     * Requests arriving over gRPC are served from their raw bytes instead;
+     * this entry point stores messages published from within the process.
+     *
+     * @param context The gRPC server context, or null for a publish without a publisher quota
+     * @param request The batch of publish requests
+     * @param response The response carrying one message ID per request
+     * @return Status::OK if successful
      */
-    Status Subscribe(ServerContext* context, const SubscribeRequest* request,
-                    ServerWriter<Message>* writer) override;
-
+    Status PublishBatch(ServerContext* context, const PublishBatchRequest* request,
+                        PublishBatchResponse* response) override;
+    
     /**
-     * @brief Set the list of topics to filter for this subscriber.
-     * @param topics The list of topics to subscribe to
+     * @brief Receive publishes from a same-host producer through its shared-memory ring.
+     * @param context The gRPC server context
+     * @param request The ring's name and token
+     * @param writer Confirms the attachment; the call stays open while the ring is used
+     * @return Status::OK when the producer detaches, FAILED_PRECONDITION if the ring cannot be opened,
+     *         DATA_LOSS if it was found corrupt
      */
-    void SetFilterTopics(const std::vector<std::string>& topics);
+    Status PublishSharedMemory(ServerContext* context, const SharedMemoryAttach* request,
+                               ServerWriter<SharedMemoryStatus>* writer) override;
     
+    /**
+     * @brief Deliver a subscription to a same-host subscriber through its shared-memory ring.
+     * @param context The gRPC server context
+     * @param request The ring's name and token, and the subscription
+     * @param writer Confirms the attachment; the call stays open while the ring is used
+     * @return Status::OK when the subscriber detaches, FAILED_PRECONDITION if the ring cannot be opened
+     *         or a message does not fit it, DATA_LOSS if it was found corrupt
+     */
+    Status SubscribeSharedMemory(ServerContext* context, const SharedMemoryAttach* request,
+                                 ServerWriter<SharedMemoryStatus>* writer) override;
+
     /**
      * @brief Get a list of all active topics
      * @return Vector of topic names
@@ -71,26 +189,270 @@ public:
     /**
      * @brief Get message count for a specific topic
      * @param topic The topic name
-     * @return Number of messages stored for the topic
+     * @return Number of messages stored for the topic, over all its partitions
      */
     size_t GetMessageCount(const std::string& topic) const;
 
+    /**
+     * @brief Get the number of messages waiting for their delivery time
+     * @return Number of scheduled messages not yet stored in their topics
+     */
+    size_t GetScheduledCount() const;
+
+    /**
+     * @brief Unregister topics that have no subscribers and have been idle for a while.
+     *
+     * Producers that have not published for as long are dropped from the dedup window.
+     *
+     * @param ttl How long a topic must have gone without a publish
+     * @return The number of topics reclaimed
+     */
+    size_t ReclaimIdleTopics(std::chrono::milliseconds ttl);
+
+    /**
+     * @brief Reclaim idle topics periodically from a background thread.
+     * @param ttl How long a topic must have gone without a publish
+     */
+    void StartTopicSweeper(std::chrono::milliseconds ttl);
+
+    /**
+     * @brief Stop the topic sweeper thread.
+     */
+    void StopTopicSweeper();
+
+    /**
+     * @brief Write the retained messages of every partition to a snapshot file.
+     * @param path The snapshot path; the previous snapshot is replaced atomically
+     * @return true if the snapshot was written
+     */
+    bool SaveSnapshot(const std::string& path);
+
+    /**
+     * @brief Restore the partitions stored in a snapshot file; call before serving requests.
+     * @param path The snapshot path
+     * @return true if a snapshot was loaded
+     */
+    bool LoadSnapshot(const std::string& path);
+
+    /**
+     * @brief Save a snapshot periodically from a background thread.
+     * @param path The snapshot path
+     * @param interval Time between snapshots
+     */
+    void StartSnapshots(const std::string& path, std::chrono::milliseconds interval);
+
+    /**
+     * @brief Stop the snapshot thread after it has written a final snapshot.
+     */
+    void StopSnapshots();
+
 private:
+    // Streams of the RPCs served as raw bytes
+    using PublishStream = grpc::ServerUnaryStreamer<ByteBuffer, PublishResponse>;
+    using PublishBatchStream = grpc::ServerUnaryStreamer<ByteBuffer, PublishBatchResponse>;
+    using FrameStream = grpc::ServerSplitStreamer<SubscribeRequest, ByteBuffer>;
+    using AckStream = ServerReaderWriter<ByteBuffer, AckRequest>;
+    
+    // A retained message on its way to a subscriber
+    struct Delivery {
+        uint64_t stamp;      // Service-wide append order
+        uint64_t sequence;
+        size_t source;       // Index of its partition in the subscription
+        uint32_t attempt;    // Delivery attempt to add to the message, or 0
+        grpc::Slice frame;   // The serialized Message, shared with the partition's buffer
+    };
+    
+    // Receives each polling round's messages and may lower the wait before the next
+    // round; returns false once the stream is broken
+    using DeliverFn = std::function<bool(std::vector<Delivery>*, std::chrono::milliseconds*)>;
+    
+    // One partition of a topic; mutex guards buffer and last_active
+    struct Partition {
+        Partition(const std::string& topic, uint32_t index, size_t capacity, bool compacted, int64_t created,
+                  uint64_t incarnation)
+            : topic(topic), index(index), buffer(capacity, compacted), last_active(created),
+              incarnation(incarnation) {}
+        
+        const std::string topic;
+        const uint32_t index;
+        std::mutex mutex;
+        TopicBuffer buffer;
+        int64_t last_active;  // Wall-clock nanoseconds of the last append, or of creation
+        uint64_t incarnation; // Random nonzero ID of this numbering of the partition; a snapshot restores it
+    };
+    
+    // A message held back until its delivery time, linked into scheduled_ through its Timer
+    // base; its fields are packed into one string to keep millions of them small
+    struct ScheduledMessage : TimerWheel::Timer {
+        ScheduledMessage(const PublishRequest& request, PendingFrame frame, const std::string& message_id,
+                         TimerWheel::Clock::time_point due);
+        
+        // Copy the fields out into reusable storage
+        void Unpack(std::string* topic, std::string* key, std::string* message_id) const;
+        
+        TimerWheel::Clock::time_point due;
+        uint32_t topic_size;
+        uint32_t key_size;
+        std::string fields;  // Topic, key and message ID, back to back
+        PendingFrame frame;  // The content, in the frame the message will be stored as
+    };
+    
+    // Resolved topic partitions of a subscription and the next sequence to deliver from each
+    struct Subscription {
+        std::vector<std::shared_ptr<Partition>> partitions;  // Keep the topics registered
+        std::vector<uint64_t> next_seq;     // Parallel to partitions
+        size_t first = 0;                   // Partition served first when the budget is limited
+        std::vector<uint64_t> catch_up_end; // Next sequence of each partition when it was opened
+        bool catching_up = false;           // Whether messages below catch_up_end remain to be sent
+        
+        // Scratch space of CollectNew, kept to reuse its allocations
+        std::vector<size_t> run_ends;       // End of each partition's run of collected messages
+        std::vector<Delivery> merged;
+    };
+    
+    // Serve the RPCs from and to raw bytes, bypassing Protobuf for the payloads
+    Status PublishRaw(ServerContext* context, PublishStream* stream);
+    Status PublishBatchRaw(ServerContext* context, PublishBatchStream* stream);
+    Status SubscribeRaw(ServerContext* context, FrameStream* stream);
+    Status SubscribeBatchedRaw(ServerContext* context, FrameStream* stream);
+    Status SubscribeAckRaw(ServerContext* context, AckStream* stream);
+    
+    // Store a published message whose content is already in its frame
+    Status PublishFrame(ServerContext* context, const PublishRequest& request, PendingFrame* frame,
+                        PublishResponse* response);
+    
+    // Store published messages whose contents are already in their frames, parallel to the requests
+    Status PublishFrames(ServerContext* context, const PublishBatchRequest& request,
+                         std::vector<PendingFrame>* frames, PublishBatchResponse* response);
+    
+    // Resolve the requested topics, partitions and resume cursors
+    void OpenSubscription(const SubscribeRequest* request, Subscription* subscription);
+    
+    // Append up to max_count new messages of the subscription, in append order
+    void CollectNew(Subscription* subscription, size_t max_count, std::vector<Delivery>* messages);
+    
+    // Append the next round of up to max_count messages of the subscription, a bounded chunk
+    // throttled while it replays its backlog; returns the wait before the next round, zero if
+    // more messages are ready and at most poll_interval
+    std::chrono::milliseconds CollectRound(Subscription* subscription, size_t max_count,
+                                           std::chrono::milliseconds poll_interval,
+                                           std::vector<Delivery>* messages);
+    
+    // Stream new messages of the requested topics to deliver until the client goes away
+    void PollSubscription(ServerContext* context, const SubscribeRequest* request,
+                          const DeliverFn& deliver);
+    
     // Generate a unique message ID
     std::string GenerateMessageId();
     
-    // Add a message to a topic queue, managing the maximum size
-    void AddMessageToTopic(const std::string& topic, const Message& message);
+    // Take the quota of count messages from the publisher of context (unless it is null) and
+    // from the topic of each message, and check that delayed messages fit among the scheduled
+    // ones. Returns RESOURCE_EXHAUSTED, with every quota left as it was and retry_after set to
+    // the nanoseconds until the publish would be admitted, if any quota is exhausted
+    Status Admit(ServerContext* context, const PublishRequest* const* requests, size_t count,
+                 int64_t* retry_after);
+    
+    // Move the calling thread onto the CPUs of the NUMA node that is home to a partition
+    void PinToNodeOf(const std::string& topic, uint32_t index);
     
-    // Maximum number of messages to store per topic
+    // Store the admitted messages of a batch, whose contents are in frames parallel to the requests
+    void StoreBatch(const PublishBatchRequest& request, std::vector<PendingFrame>* frames,
+                    PublishBatchResponse* response);
+    
+    // Hold accepted messages until they are due, starting the scheduler thread if needed
+    void ScheduleMessages(std::vector<std::unique_ptr<ScheduledMessage>>* messages);
+    
+    // Release scheduled messages into their topics as they fall due, until stopped
+    void RunScheduler();
+    
+    // Store messages that have fallen due
+    void ReleaseScheduled(const std::vector<ScheduledMessage*>& messages);
+    
+    // Stop the scheduler thread and discard the messages it still holds
+    void StopScheduler();
+    
+    // Find the partition a message is stored in, registering its topic if needed;
+    // requires mutex_ to be held
+    std::shared_ptr<Partition> PartitionForLocked(const std::string& topic, const std::string& key);
+    
+    // Store a new message, finishing its frame, in a partition under the ID in message_id, or a
+    // new one assigned to it if it is empty, returning the partition's message count; requires
+    // the partition's mutex to be held
+    size_t AddMessageToPartitionLocked(Partition* partition, const std::string& key, PendingFrame* frame,
+                                       std::string* message_id);
+    
+    // Register a topic and create its (empty) partitions; requires mutex_ to be held
+    TopicId InternTopicLocked(const std::string& topic);
+    
+    // Tell whether no one references a topic and it has not been published to since
+    // idle_since; requires mutex_ to be held
+    bool TopicIdleLocked(TopicId id, int64_t idle_since);
+    
+    // Maximum number of messages to store per partition
     size_t max_messages_per_topic_;
     
-    std::mutex mutex_;
-    std::unordered_map<std::string, std::vector<Message>> messages_by_topic_;
-    std::vector<std::string> filter_topics_; // List of topics to filter for this subscriber
+    // Number of partitions every topic is split into
+    size_t partitions_per_topic_;
+    
+    // Names and name prefixes (ending in '*') of the topics created compacted
+    std::vector<std::string> compacted_topics_;
+    
+    std::mutex mutex_;  // Guards the registry, the dedup window and the partition lists
+    TopicRegistry topic_registry_;
+    DedupWindow dedup_window_;  // Recently seen producer sequence numbers
+    std::vector<std::vector<std::shared_ptr<Partition>>> partitions_;  // Indexed by TopicId, then partition
+    std::mt19937_64 incarnation_rng_;  // Incarnations of new partitions
+    std::atomic<uint64_t> next_stamp_;  // Service-wide append order, taken under a partition's mutex
+    
+    // Publish quotas; null when no limit is set
+    std::unique_ptr<RateLimiter> topic_limiter_;
+    std::unique_ptr<RateLimiter> publisher_limiter_;
+    
+    // Rate shared by every subscription replaying its backlog; null when it is not limited
+    std::unique_ptr<TokenBucket> catch_up_bucket_;
+    size_t catch_up_chunk_;  // Messages a throttled subscription collects per round
+    
+    // CPUs by NUMA node that request threads are pinned to; null when threads are not pinned
+    std::unique_ptr<pubsub::common::CpuLayout> cpu_layout_;
+    
+    bool verbose_;  // Log every message and batch stored or scheduled, and every release
+    
+    // Messages waiting for their delivery time; schedule_mutex_ guards scheduled_,
+    // scheduler_thread_ and scheduler_stop_
+    std::mutex schedule_mutex_;
+    std::condition_variable schedule_cv_;
+    TimerWheel scheduled_;
+    std::thread scheduler_thread_;
+    bool scheduler_stop_;
+    std::atomic<size_t> scheduled_count_;  // Messages scheduled and not yet stored, readable without a lock
+    size_t max_scheduled_;                 // 0 for no limit
+    
+    // Periodic snapshots; snapshot_mutex_ guards snapshot_stop_
+    std::thread snapshot_thread_;
+    std::mutex snapshot_mutex_;
+    std::condition_variable snapshot_cv_;
+    bool snapshot_stop_;
+    
+    // Idle topic reclamation; sweeper_mutex_ guards sweeper_stop_
+    std::thread sweeper_thread_;
+    std::mutex sweeper_mutex_;
+    std::condition_variable sweeper_cv_;
+    bool sweeper_stop_;
 };
 
-// Server runner function
-void RunServer(const std::string& server_address, size_t max_messages_per_topic = 100);
+/**
+ * @brief Build and start a server hosting a PubSub service.
+ * @param service The service to register; must outlive the server
+ * @param options Listener addresses and transport tunables; the storage limits are not used
+ * @param selected_ports Receives the TCP port bound for each listener (0 for Unix sockets); may be null
+ * @return The started server, or nullptr if it could not be started
+ */
+std::unique_ptr<grpc::Server> BuildServer(PubSubServiceImpl* service, const ServerOptions& options,
+                                          std::vector<int>* selected_ports = nullptr);
+
+// Server runner functions
+void RunServer(const ServerOptions& options);
+void RunServer(const std::string& server_address, size_t max_messages_per_topic = 100,
+               size_t partitions_per_topic = 1);
 
 #endif // PUBSUB_SERVICE_H
@@ -0,0 +1,134 @@
+/**
+ * @file rate_limiter.h
+ * @brief Declaration of the token buckets that enforce publish quotas.
+ */
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @struct RateLimit
+ * @brief A sustained rate and a burst size, in messages.
+ */
+struct RateLimit {
+    // Messages per second; 0 for no limit
+    double rate = 0;
+
+    // Messages that may be published at once after an idle period; 0 for a tenth of a
+    // second's worth (at least one)
+    double burst = 0;
+};
+
+/**
+ * @class TokenBucket
+ * @brief Lock-free token bucket, kept as the time at which it will be full again.
+ *
+ * Instead of a token count and a refill timestamp, the bucket stores one
+ * "theoretical arrival time" (the generic cell rate algorithm): taking n
+ * tokens moves it n emission intervals into the future, and a request is
+ * refused while that would put it more than a burst ahead of now. Taking
+ * tokens is therefore a single compare-and-swap, and a refusal yields the
+ * exact time until the request would fit.
+ */
+class TokenBucket {
+public:
+    /**
+     * @brief Constructs a full bucket.
+     * @param limit The bucket's rate and burst; the rate must be positive
+     */
+    explicit TokenBucket(const RateLimit& limit);
+
+    /**
+     * @brief Take tokens if the bucket holds enough.
+     *
+     * A request larger than the burst is admitted when the bucket is full,
+     * leaving it in debt.
+     *
+     * @param count Number of tokens
+     * @param now Current steady-clock time in nanoseconds
+     * @return 0 if the tokens were taken, otherwise nanoseconds until they would be available
+     */
+    int64_t TryAcquire(uint64_t count, int64_t now);
+
+    /**
+     * @brief Return tokens taken for a request that was refused elsewhere.
+     * @param count Number of tokens
+     */
+    void Release(uint64_t count);
+
+    /**
+     * @brief Tell whether the bucket has refilled completely.
+     * @param now Current steady-clock time in nanoseconds
+     * @return true if the bucket is in the same state as a new one
+     */
+    bool Full(int64_t now) const;
+
+private:
+    const int64_t interval_;     // Nanoseconds per token
+    const int64_t tolerance_;    // Nanoseconds of tokens the bucket holds when full
+    std::atomic<int64_t> full_at_;
+};
+
+/**
+ * @class RateLimiter
+ * @brief Token buckets keyed by name, such as a topic or a publisher.
+ *
+ * Every key gets its own bucket with the default limit unless it has an
+ * override. Each thread caches the buckets it looked up, including the
+ * absence of a bucket for an unlimited key, so a publish takes no lock once
+ * its thread has seen the key; the shared map is locked only on a cache
+ * miss. The buckets themselves are lock-free. Full buckets carry no state,
+ * so unused ones are dropped whenever the map has doubled since the last
+ * pruning, which keeps its size proportional to the number of recently
+ * active keys. Pruning starts a new generation, and a thread's cache is
+ * cleared at its next lookup in a new generation, releasing the buckets it
+ * held for the next pruning.
+ */
+class RateLimiter {
+public:
+    /**
+     * @brief Constructs a limiter.
+     * @param default_limit Limit of every key without an override
+     * @param overrides Limits of individual keys
+     */
+    RateLimiter(const RateLimit& default_limit, const std::map<std::string, RateLimit>& overrides);
+
+    /**
+     * @brief Tell whether any key is limited.
+     * @return false if every limit is unlimited
+     */
+    bool Enabled() const { return enabled_; }
+
+    /**
+     * @brief Get the bucket of a key.
+     * @param key The topic or publisher
+     * @return The bucket, or nullptr if the key is not limited
+     */
+    std::shared_ptr<TokenBucket> BucketFor(const std::string& key);
+
+private:
+    struct LocalCache;
+
+    LocalCache& Cache();
+    std::shared_ptr<TokenBucket> SharedBucketFor(const std::string& key);
+
+    const RateLimit default_limit_;
+    const std::map<std::string, RateLimit> overrides_;
+    bool enabled_;
+    const uint64_t id_;  // Identifies this instance in the threads' caches; never reused
+    std::atomic<uint64_t> generation_;  // Incremented by every pruning
+
+    std::mutex mutex_;  // Guards buckets_ and prune_at_
+    std::unordered_map<std::string, std::shared_ptr<TokenBucket>> buckets_;
+    size_t prune_at_;   // Size of buckets_ at which full buckets are dropped
+};
+
+#endif // RATE_LIMITER_H
@@ -0,0 +1,110 @@
+/**
+ * @file server_options.h
+ * @brief Configuration for the PubSub server.
+ */
+#ifndef SERVER_OPTIONS_H
+#define SERVER_OPTIONS_H
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+#include "dedup_window.h"
+#include "rate_limiter.h"
+
+/**
+ * @struct ServerOptions
+ * @brief Listeners, storage limits and transport tunables of the PubSub server.
+ *
+ * Zero leaves the gRPC default for every transport setting.
+ */
+struct ServerOptions {
+    // Addresses to listen on: host:port pairs or Unix domain sockets such as unix:/run/pubsub.sock
+    std::vector<std::string> listen_addresses{"0.0.0.0:50051"};
+
+    // Maximum number of messages to store per topic partition
+    size_t max_messages_per_topic = 100;
+
+    // Number of partitions every topic is split into
+    size_t partitions_per_topic = 1;
+
+    // Largest message the server accepts and sends (gRPC default: 4 MiB received); -1 for unlimited
+    int max_message_bytes = 0;
+
+    // Completion queues and the range of polling threads per queue of the synchronous server
+    int num_cqs = 0;
+    int min_pollers = 0;
+    int max_pollers = 0;
+
+    // Resource quota: threads across pollers and open calls, and buffer memory in bytes.
+    // Every open Subscribe stream holds a thread, so max_threads also caps subscribers
+    int max_threads = 0;
+    size_t memory_quota_bytes = 0;
+
+    // Concurrent streams a client may open on one connection
+    int max_concurrent_streams = 0;
+
+    // Grow the HTTP/2 flow-control window from bandwidth-delay-product probes
+    bool bdp_probe = true;
+
+    // Interval between keepalive pings on an idle connection (0 disables them)
+    std::chrono::milliseconds keepalive_time{0};
+
+    // How long to wait for a keepalive ping to be answered before closing the connection
+    std::chrono::milliseconds keepalive_timeout{20000};
+
+    // Shortest interval between client pings the server tolerates (gRPC default: 5 minutes)
+    std::chrono::milliseconds keepalive_min_ping_interval{0};
+
+    // File the retained messages are restored from at startup and saved to periodically;
+    // snapshots are disabled when empty
+    std::string snapshot_path;
+
+    // Time between snapshots
+    std::chrono::milliseconds snapshot_interval{10000};
+
+    // Topics without subscribers that go this long without a publish are dropped with their
+    // retained messages, freeing their memory; 0 keeps every topic forever
+    std::chrono::milliseconds idle_topic_ttl{0};
+
+    // Topics that retain only the latest message of each key, without a limit on the number of
+    // keys; a name ending in '*' matches every topic starting with the rest of it
+    std::vector<std::string> compacted_topics;
+
+    // Publish quota of every topic, and of individual topics by name
+    RateLimit topic_rate_limit;
+    std::map<std::string, RateLimit> topic_rate_limits;
+
+    // Publish quota of every publisher, and of individual publishers by client ID or by
+    // peer address without its port (e.g. ipv4:10.0.0.7) for clients that send no ID
+    RateLimit publisher_rate_limit;
+    std::map<std::string, RateLimit> publisher_rate_limits;
+
+    // Messages per second that all subscriptions together replay from retained backlogs when
+    // they start or resume behind the end of their topics; messages published after a
+    // subscription opened are delivered without limit. A rate of 0 for no limit
+    RateLimit catch_up_rate_limit;
+
+    // Messages held back for later delivery the server keeps at most; publishes that would
+    // exceed it are rejected like those over a quota. 0 for no limit
+    size_t max_scheduled_messages = 0;
+
+    // Producers whose recent sequence numbers are remembered to drop retried publishes; the
+    // one that published least recently is forgotten to make room for a new one
+    size_t max_dedup_producers = DedupWindow::kDefaultMaxProducers;
+
+    // CPUs every server thread runs on; the CPUs the process was started with when empty
+    std::vector<int> cpus;
+
+    // Pin each request's thread to the CPUs of the NUMA node that is home to the partition it
+    // stores into or delivers from
+    bool numa_pinning = false;
+
+    // Log every message stored or scheduled, with its content, every batch and every release of
+    // scheduled messages to stdout; for debugging only, as it serializes publishes on the output
+    // stream
+    bool verbose = false;
+};
+
+#endif // SERVER_OPTIONS_H
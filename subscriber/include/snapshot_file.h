@@ -0,0 +1,178 @@
+/**
+ * @file snapshot_file.h
+ * @brief Declaration of the binary snapshot format of retained topic partitions.
+ */
+#ifndef SNAPSHOT_FILE_H
+#define SNAPSHOT_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/*
+ * A snapshot file holds the retained messages of every topic partition.
+ * Integers are in host byte order, so a snapshot is read back on the host
+ * that wrote it:
+ *
+ *   File    := magic u64 | version u32 | partitions_per_topic u32 | Section* | Trailer
+ *   Section := kSectionTag u32 | topic_length u32 | topic | partition u32 | incarnation u64 | Record* | End
+ *   Record  := length u32 | stamp u64 | serialized Message (length bytes)
+ *   End     := kEndOfSection u32 | next_sequence u64
+ *   Trailer := kTrailerTag u32 | section_count u64
+ *
+ * The trailer is written last, so a file without it is known to be incomplete.
+ */
+
+/**
+ * @class SnapshotWriter
+ * @brief Writes a snapshot to a temporary file and renames it into place on Commit.
+ *
+ * Until Commit succeeds the previous snapshot at the path is left untouched;
+ * a writer destroyed without committing removes its temporary file.
+ */
+class SnapshotWriter {
+public:
+    /**
+     * @brief Constructs a writer with no file open.
+     */
+    SnapshotWriter();
+
+    /**
+     * @brief Destructor that discards the temporary file unless it was committed.
+     */
+    ~SnapshotWriter();
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    /**
+     * @brief Create the temporary file and write the file header.
+     * @param path The final snapshot path
+     * @param partitions_per_topic Partition count of the server writing the snapshot
+     * @return true on success
+     */
+    bool Open(const std::string& path, uint32_t partitions_per_topic);
+
+    /**
+     * @brief Start the section of one topic partition.
+     * @param topic The topic name
+     * @param partition The partition index
+     * @param incarnation The partition's incarnation
+     */
+    void BeginSection(const std::string& topic, uint32_t partition, uint64_t incarnation);
+
+    /**
+     * @brief Encode one retained message as a record in memory.
+     * @param records Buffer the record is appended to
+     * @param stamp The message's append stamp
+     * @param message The serialized message
+     * @param size Size of the serialized message
+     */
+    static void AppendRecord(std::string* records, uint64_t stamp, const void* message, size_t size);
+
+    /**
+     * @brief Append records encoded by AppendRecord to the current section.
+     * @param records The encoded records
+     */
+    void WriteRecords(const std::string& records);
+
+    /**
+     * @brief Close the current section.
+     * @param next_sequence The sequence the partition's next message will receive
+     */
+    void EndSection(uint64_t next_sequence);
+
+    /**
+     * @brief Write the trailer, flush the file to disk and rename it to the snapshot path.
+     * @return true if the snapshot is now in place
+     */
+    bool Commit();
+
+private:
+    void Write(const void* data, size_t size);
+
+    std::string path_;
+    std::string temp_path_;
+    std::FILE* file_;
+    uint64_t sections_;
+};
+
+/**
+ * @class SnapshotReader
+ * @brief Reads a snapshot through a read-only memory mapping.
+ *
+ * Records are returned as pointers into the mapping, so the messages can be
+ * parsed without copying the file into memory first.
+ */
+class SnapshotReader {
+public:
+    /**
+     * @brief Constructs a reader with no file mapped.
+     */
+    SnapshotReader();
+
+    /**
+     * @brief Destructor that unmaps the file.
+     */
+    ~SnapshotReader();
+
+    SnapshotReader(const SnapshotReader&) = delete;
+    SnapshotReader& operator=(const SnapshotReader&) = delete;
+
+    /**
+     * @brief Map a snapshot and check its header and trailer.
+     * @param path The snapshot path
+     * @return true if the file is a complete snapshot
+     */
+    bool Open(const std::string& path);
+
+    /**
+     * @brief Get the partition count of the server that wrote the snapshot.
+     * @return Partitions per topic
+     */
+    uint32_t PartitionsPerTopic() const { return partitions_per_topic_; }
+
+    /**
+     * @brief Advance to the next section.
+     * @param topic Receives the topic name
+     * @param partition Receives the partition index
+     * @param incarnation Receives the partition's incarnation
+     * @return false once every section has been read, or if the file is corrupt
+     */
+    bool NextSection(std::string* topic, uint32_t* partition, uint64_t* incarnation);
+
+    /**
+     * @brief Advance to the next record of the current section.
+     * @param stamp Receives the message's append stamp
+     * @param data Receives a pointer to the serialized message inside the mapping
+     * @param size Receives the length of the serialized message
+     * @return false at the end of the section, or if the file is corrupt
+     */
+    bool NextRecord(uint64_t* stamp, const char** data, size_t* size);
+
+    /**
+     * @brief Get the next sequence of the section whose records were just read to the end.
+     * @return The partition's next sequence
+     */
+    uint64_t SectionNextSequence() const { return section_next_sequence_; }
+
+    /**
+     * @brief Tell whether the file was read without finding corruption.
+     * @return true if no error occurred
+     */
+    bool Ok() const { return ok_; }
+
+private:
+    bool Read(void* out, size_t size);
+
+    const char* base_;
+    size_t size_;
+    size_t pos_;
+    size_t end_;            // Start of the trailer
+    uint32_t partitions_per_topic_;
+    uint64_t section_next_sequence_;
+    bool ok_;
+};
+
+#endif // SNAPSHOT_FILE_H
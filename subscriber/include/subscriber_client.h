@@ -5,14 +5,24 @@
 #ifndef SUBSCRIBER_CLIENT_H
 #define SUBSCRIBER_CLIENT_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <random>
+#include <set>
 #include <string>
+#include <utility>
 #include <vector>
 #include <functional>
 #include <thread>
 #include <grpcpp/grpcpp.h>
 #include "pubsub.pb.h"
 #include "pubsub.grpc.pb.h"
+#include "dispatch_pool.h"
+#include "subscriber_options.h"
 
 using grpc::Channel;
 using pubsub::PubSub;
@@ -21,6 +31,31 @@ using pubsub::Message;
 /**
  * @class SubscriberClient
  * @brief Client for consuming messages from the PubSub gRPC service.
+ *
+ * With dispatch_threads set, the reader thread only receives messages and
+ * hands them to a DispatchPool, so a slow callback no longer stalls the
+ * stream. Callbacks for messages with the same ordering key still run one at
+ * a time in the order the messages arrived.
+ *
+ * The client remembers the sequence number of the last message received on
+ * each topic partition. When the stream breaks it reconnects with jittered exponential
+ * backoff and asks the server to resume right after those messages, so none
+ * are lost or delivered twice while they are still retained by the server.
+ *
+ * Unless max_batch_size is 1, messages are received through SubscribeBatched
+ * and unpacked before delivery; servers without that RPC are read through
+ * Subscribe instead.
+ *
+ * With ack set, messages are received through SubscribeAck instead and each
+ * one is acknowledged after its callback returns. Acks are sent in batches
+ * by a separate thread. A reconnect resumes from the oldest message not yet
+ * acknowledged, so every message is processed at least once.
+ *
+ * With shared_memory set (and ack unset), the client creates a
+ * shared-memory ring and asks the server to write the subscription into it
+ * through SubscribeSharedMemory. If the server cannot map the ring, for
+ * example because it runs on another host, the client switches to the gRPC
+ * streams for good.
  */
 class SubscriberClient {
 public:
@@ -30,8 +65,10 @@ public:
     /**
      * @brief Constructs a Subscriber client.
      * @param channel Shared pointer to the gRPC channel
+     * @param options Callback dispatch settings
      */
-    SubscriberClient(std::shared_ptr<Channel> channel);
+    SubscriberClient(std::shared_ptr<Channel> channel,
+                     const SubscriberOptions& options = SubscriberOptions());
     
     /**
      * @brief Destructor that ensures subscription thread is stopped.
@@ -55,16 +92,76 @@ public:
     bool SubscribeToMultiple(const std::vector<std::string>& topics, TopicCallbackFn callback);
     
     /**
-     * @brief Stop the subscription thread.
+     * @brief Stop the subscription thread and wait for pending callbacks.
+     *
+     * Cancels the open stream, so this returns promptly even while no
+     * messages are arriving.
      */
     void Stop();
 
 private:
     std::unique_ptr<PubSub::Stub> stub_;
+    SubscriberOptions options_;
     std::thread subscription_thread_;
-    bool running_;
+    std::atomic<bool> running_;
+    std::unique_ptr<DispatchPool> dispatch_pool_;
+
+    std::mutex stream_mutex_;                  // Guards context_; Stop waits on stop_cv_ with it
+    std::condition_variable stop_cv_;
+    grpc::ClientContext* context_;             // Context of the open stream, null between streams
+    std::mt19937 rng_;                         // Jitter for reconnect backoff
+
+    // A topic partition: the topic name and the partition index
+    using PartitionKey = std::pair<std::string, uint32_t>;
+
+    // Position in a topic partition: the next sequence number to receive, in the
+    // numbering of the partition's incarnation
+    struct Cursor {
+        uint64_t next_sequence = 0;
+        uint64_t incarnation = 0;
+    };
+
+    // Cursor per topic partition; used only by the subscription thread
+    std::map<PartitionKey, Cursor> cursors_;
+
+    // Ack mode: messages received on a topic partition and acknowledgements not yet sent
+    struct AckState {
+        std::set<uint64_t> outstanding;     // Received, callback not yet returned
+        std::vector<uint64_t> acked;        // Acknowledged since the last AckRequest
+        uint64_t next = 0;                  // One past the highest sequence received
+        uint64_t incarnation = 0;           // Incarnation the sequence numbers belong to
+    };
+
+    std::mutex ack_mutex_;                     // Guards ack_states_ and unsent_acks_
+    std::condition_variable ack_cv_;           // Wakes the ack sender when a batch is full
+    std::map<PartitionKey, AckState> ack_states_;
+    size_t unsent_acks_;
     
     void SubscriptionThread(const std::vector<std::string>& topics, TopicCallbackFn callback);
+
+    // Read one SubscribeAck stream until it ends, sending acks from a second thread
+    grpc::Status ReadAckStream(grpc::ClientContext* context, const pubsub::SubscribeRequest& request,
+                               const TopicCallbackFn& callback, int* attempt);
+
+    // Read one SubscribeSharedMemory attachment until it ends
+    grpc::Status ReadSharedMemoryStream(grpc::ClientContext* context, const pubsub::SubscribeRequest& request,
+                                        const TopicCallbackFn& callback, int* attempt);
+
+    // Record that a message's callback returned
+    void Acked(const Message& message);
+
+    // Move the unsent acks into a request; requires ack_mutex_ to be held
+    void CollectAcksLocked(pubsub::AckRequest* request);
+
+    // Oldest sequence of the topic not yet acknowledged
+    static uint64_t AckFloor(const AckState& state);
+
+    // Advance the message's topic cursor and hand the message to the callback,
+    // inline or through the dispatch pool
+    void Deliver(Message&& message, const TopicCallbackFn& callback);
+
+    // Delay before reconnect attempt number attempt (starting at 1)
+    std::chrono::milliseconds Backoff(int attempt);
 };
 
 #endif // SUBSCRIBER_CLIENT_H
@@ -0,0 +1,68 @@
+/**
+ * @file subscriber_options.h
+ * @brief Configuration for the subscriber client.
+ */
+#ifndef SUBSCRIBER_OPTIONS_H
+#define SUBSCRIBER_OPTIONS_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "pubsub.pb.h"
+
+class SubscriberStats;
+
+/**
+ * @struct SubscriberOptions
+ * @brief Tuning knobs for SubscriberClient.
+ */
+struct SubscriberOptions {
+    // Number of threads running callbacks (0 runs them inline on the reader thread)
+    size_t dispatch_threads = 0;
+
+    // Maximum number of received messages waiting for a callback before reading pauses
+    size_t max_pending = 10000;
+
+    // Messages with the same key are handed to the callback in order; the topic when empty
+    std::function<std::string(const pubsub::Message&)> ordering_key;
+
+    // Partitions of each topic to consume; empty consumes all of them
+    std::vector<uint32_t> partitions;
+
+    // Messages per stream frame requested from the server (1 streams one message per frame)
+    size_t max_batch_size = 256;
+
+    // How long the server may hold a partially filled batch waiting for more messages
+    std::chrono::milliseconds max_linger{0};
+
+    // Backoff before reconnecting a broken stream; grows by backoff_multiplier per failed attempt
+    std::chrono::milliseconds initial_backoff{100};
+    std::chrono::milliseconds max_backoff{10000};
+    double backoff_multiplier = 2.0;
+
+    // Acknowledge each message once its callback returns; unacknowledged messages are redelivered
+    bool ack = false;
+
+    // With ack: how long the server waits for an acknowledgement before redelivering
+    std::chrono::milliseconds ack_timeout{30000};
+
+    // With ack: maximum number of unacknowledged messages the server lets this subscriber hold
+    size_t max_unacked = 10000;
+
+    // Receive through a shared-memory ring when the server runs on the same host; falls back
+    // to gRPC when the server cannot map the ring. Not used in ack mode
+    bool shared_memory = false;
+
+    // Size of the shared-memory ring; a message larger than half of it moves the subscription to gRPC
+    size_t shared_memory_bytes = 4 << 20;
+
+    // Records receive rate, latency and sequence gaps per topic as messages arrive; may be
+    // shared by several clients
+    std::shared_ptr<SubscriberStats> stats;
+};
+
+#endif // SUBSCRIBER_OPTIONS_H
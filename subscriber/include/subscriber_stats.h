@@ -0,0 +1,107 @@
+/**
+ * @file subscriber_stats.h
+ * @brief Declaration of the receive rate, latency and sequence-gap statistics kept by subscribers.
+ */
+#ifndef SUBSCRIBER_STATS_H
+#define SUBSCRIBER_STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "latency_histogram.h"
+#include "pubsub.pb.h"
+
+/**
+ * @class SubscriberStats
+ * @brief Per-topic receive statistics, measured on the consumer side as messages arrive.
+ *
+ * Record is called once per message by the thread that read it. Each
+ * recording thread gets its own shard of counters and histograms on its
+ * first message, so recording takes no lock and writes no cache line that
+ * another recording thread writes. Collect drains every shard from the
+ * reporting thread and returns what arrived since the previous Collect.
+ *
+ * Latency is the receive time minus Message.timestamp, the time the server
+ * stored the message: it covers queueing in the server and the network, not
+ * the publisher's send. Both clocks are the millisecond-resolution wall
+ * clock, and across hosts the latency includes their clock offset.
+ *
+ * Sequence numbers are followed per partition. A message beyond the next
+ * expected sequence counts the skipped ones as missing: evicted from the
+ * server's buffer before this subscriber read them, or superseded on a
+ * compacted topic, where gaps are expected. A message below it counts as a
+ * duplicate, as when the server redelivers unacknowledged messages. The
+ * first message of a partition, or of a new incarnation of it, only sets
+ * the expectation. A SubscriberStats
+ * may be shared by several clients; since partitions are followed per
+ * recording thread, two clients reading the same topic do not see each
+ * other's messages as duplicates.
+ */
+class SubscriberStats {
+public:
+    /**
+     * @struct TopicReport
+     * @brief What one topic received during a reporting interval.
+     */
+    struct TopicReport {
+        std::string topic;
+        uint64_t messages = 0;    // Messages received in the interval
+        uint64_t bytes = 0;       // Content bytes received in the interval
+        uint64_t missing = 0;     // Sequence numbers skipped in the interval
+        uint64_t duplicates = 0;  // Messages at or below a sequence number already received
+        uint64_t total = 0;       // Messages received since the statistics were created
+        pubsub::common::LatencyHistogram latency;  // Store-to-receive latency in nanoseconds
+    };
+
+    /**
+     * @brief Constructs empty statistics; the first interval starts now.
+     */
+    SubscriberStats();
+
+    /**
+     * @brief Destructor that frees every shard; no thread may be recording.
+     */
+    ~SubscriberStats();
+
+    SubscriberStats(const SubscriberStats&) = delete;
+    SubscriberStats& operator=(const SubscriberStats&) = delete;
+
+    /**
+     * @brief Count a received message in the calling thread's shard.
+     * @param message The message, as received from the server
+     */
+    void Record(const pubsub::Message& message);
+
+    /**
+     * @brief Take everything recorded since the previous Collect.
+     * @param topics Receives one report per topic received since construction, sorted by topic
+     * @return Seconds since the previous Collect, or since construction for the first
+     */
+    double Collect(std::vector<TopicReport>* topics);
+
+    /**
+     * @brief Collect and print a table of each topic's rate, latency percentiles and gaps.
+     * @param out The stream to print to
+     */
+    void Print(std::ostream& out);
+
+private:
+    struct TopicCounters;
+    struct Shard;
+
+    Shard* LocalShard();
+
+    const uint64_t id_;  // Identifies this instance in the threads' shard caches; never reused
+
+    std::mutex mutex_;  // Guards the members below; taken by Collect and by a thread's first Record
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::chrono::steady_clock::time_point collected_at_;
+    std::map<std::string, uint64_t> totals_;  // Messages per topic up to the previous Collect
+};
+
+#endif // SUBSCRIBER_STATS_H
@@ -0,0 +1,147 @@
+/**
+ * @file timer_wheel.h
+ * @brief Declaration of the timing wheel used for message redelivery and scheduled delivery.
+ */
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/**
+ * @class TimerWheel
+ * @brief Hashed timing wheel with intrusive timers, optionally hierarchical.
+ *
+ * Time is divided into ticks; a timer due at tick t is linked into slot
+ * t % num_slots, where num_slots is a power of two. Scheduling and cancelling unlink or link one node, and
+ * advancing the wheel visits only the slots of the ticks that passed, so
+ * every operation is O(1) per timer regardless of how many are pending.
+ *
+ * With more than one level, each level's slots cover num_slots times the
+ * span of the level below: a timer due within num_slots ticks sits in
+ * level 0, one due within num_slots^2 ticks in level 1, and so on. When the
+ * wheel reaches the start of a higher-level slot, that slot's timers are
+ * moved down to the level their remaining delay calls for, so a timer is
+ * moved at most once per level before it fires, at exactly its tick. This
+ * covers delays of nearly num_slots^levels ticks (with 256 slots of 1 ms,
+ * 49 days for four levels) with levels * num_slots list heads, and no sorting.
+ *
+ * Timers are embedded in the caller's objects (derive from Timer), so the
+ * wheel never allocates per timer. Longer delays than the wheel covers are
+ * clamped. The wheel is not synchronized and must not be copied or moved
+ * while timers are linked.
+ */
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @struct Timer
+     * @brief Intrusive list node of a scheduled timer.
+     */
+    struct Timer {
+        Timer* prev = nullptr;
+        Timer* next = nullptr;
+        uint64_t deadline = 0;  // Tick at which the timer fires
+
+        /**
+         * @brief Tell whether the timer is linked into the wheel.
+         * @return true if the timer is scheduled
+         */
+        bool Scheduled() const { return next != nullptr; }
+    };
+
+    using ExpireFn = std::function<void(Timer*)>;
+
+    /**
+     * @brief Constructs an empty wheel whose tick 0 starts now.
+     * @param tick Duration of one tick (at least 1 ms)
+     * @param num_slots Number of slots per level, rounded up to a power of two
+     * @param levels Number of levels (at least 1); delays are clamped to between
+     *               (num_slots - 1) * num_slots^(levels - 1) and num_slots^levels - 1 ticks
+     */
+    TimerWheel(std::chrono::milliseconds tick, size_t num_slots, size_t levels = 1);
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    /**
+     * @brief Schedule a timer, or reschedule it if it is already linked.
+     * @param timer The timer to schedule
+     * @param delay How long from the wheel's current time until the timer fires
+     */
+    void Schedule(Timer* timer, std::chrono::milliseconds delay);
+
+    /**
+     * @brief Schedule a timer for a point in time, or reschedule it if it is already linked.
+     *
+     * Unlike Schedule, the deadline does not depend on when Advance last ran.
+     *
+     * @param timer The timer to schedule
+     * @param when When the timer fires; a time already passed fires on the next Advance
+     */
+    void ScheduleAt(Timer* timer, Clock::time_point when);
+
+    /**
+     * @brief Unlink a timer; does nothing if it is not scheduled.
+     * @param timer The timer to cancel
+     */
+    void Cancel(Timer* timer);
+
+    /**
+     * @brief Fire every timer due at or before @p now.
+     *
+     * Fired timers are unlinked before @p on_expire runs, which may schedule
+     * them again.
+     *
+     * @param now The current time
+     * @param on_expire Called once for every fired timer
+     * @return The number of timers fired
+     */
+    size_t Advance(Clock::time_point now, const ExpireFn& on_expire);
+
+    /**
+     * @brief Unlink every scheduled timer without waiting for it to be due.
+     * @param on_expire Called once for every unlinked timer, in no particular order
+     */
+    void Drain(const ExpireFn& on_expire);
+
+    /**
+     * @brief Get the number of scheduled timers.
+     * @return The number of timers linked into the wheel
+     */
+    size_t Size() const { return size_; }
+
+    /**
+     * @brief Get the duration of one tick.
+     * @return The tick duration
+     */
+    std::chrono::milliseconds Tick() const { return tick_; }
+
+private:
+    // Link a timer at the tail of the slot for its deadline, in the lowest level whose
+    // span covers the time left until then
+    void Link(Timer* timer);
+
+    // Remove a timer from its slot's list
+    void Unlink(Timer* timer);
+
+    // Relink the timers of one slot of a higher level into the levels below
+    void Cascade(size_t level, uint64_t tick);
+
+    // Latest tick a timer can be linked for without reusing the current top-level slot
+    uint64_t LastTick() const;
+
+    std::chrono::milliseconds tick_;
+    Clock::time_point start_;      // Time at which tick 0 began
+    uint64_t current_tick_;        // Last tick processed by Advance
+    size_t slot_bits_;             // log2 of the slots per level; a level-n slot spans 2^(n * slot_bits_) ticks
+    size_t num_slots_;             // Slots per level
+    size_t levels_;
+    std::vector<Timer> slots_;     // Sentinel heads of circular lists, level by level
+    size_t size_;
+};
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,149 @@
+/**
+ * @file topic_buffer.h
+ * @brief Declaration of the fixed-capacity message store used for each topic.
+ */
+#ifndef TOPIC_BUFFER_H
+#define TOPIC_BUFFER_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <grpcpp/support/slice.h>
+
+/**
+ * @class TopicBuffer
+ * @brief Ring of serialized messages holding the retained messages of one topic.
+ *
+ * Each message is kept as its serialized Message frame, a reference-counted
+ * buffer that is never modified once stored. Readers take references to the
+ * frames instead of copies, and subscriptions write those references to
+ * their streams, so a message is encoded once however many subscribers
+ * receive it. Slots are created lazily until the buffer reaches its
+ * capacity; from then on each append replaces the frame in the oldest slot,
+ * whose buffer is freed once no writer references it any more.
+ *
+ * Every appended message is assigned a sequence number that increases by one
+ * per append, and keeps a stamp given by the caller that orders it against
+ * the messages of other buffers. The buffer is not synchronized; callers
+ * must hold a lock.
+ *
+ * A compacted buffer instead retains the latest message of every key, with
+ * no capacity limit: appending a message replaces the one with the same key
+ * in place, so memory grows with the number of keys rather than with the
+ * publish rate. Reading from sequence 0 yields the current value of every
+ * key, oldest update first, and reading on from the returned sequence
+ * yields the keys updated since; the sequences of replaced messages are
+ * skipped. Lookups by key go through a hash table, and an index of
+ * (sequence, key) in append order finds where a read starts by binary
+ * search. Entries of the index made stale by later updates are dropped once
+ * they outnumber the live ones, so each append costs amortized O(1).
+ */
+class TopicBuffer {
+public:
+    /**
+     * @brief Constructs an empty buffer.
+     * @param capacity Maximum number of messages to retain (at least one slot is kept); ignored
+     *                 when compacted
+     * @param compacted Retain the latest message of every key instead of the latest messages
+     */
+    explicit TopicBuffer(size_t capacity, bool compacted = false);
+
+    /**
+     * @brief Claim the slot for the next message, evicting the oldest one when full.
+     * @param stamp Ordering stamp of the message; must not decrease between appends
+     * @param key The message's key; in a compacted buffer the message replaces the one with this key
+     * @return The slot to store the message's frame in; it still holds the frame it replaces
+     */
+    grpc::Slice* Append(uint64_t stamp, const std::string& key = std::string());
+
+    /**
+     * @brief Visit at most @p max_count retained messages with a sequence at or after @p from.
+     * @param from The first sequence number the caller has not seen yet
+     * @param max_count Maximum number of messages to visit
+     * @param visit Called with the stamp, sequence number and frame of each, oldest first
+     * @return The sequence number to pass on the next call
+     */
+    uint64_t VisitSince(uint64_t from, size_t max_count,
+                        const std::function<void(uint64_t, uint64_t, const grpc::Slice&)>& visit) const;
+
+    /**
+     * @brief Look up a retained message by sequence number.
+     * @param sequence The message's sequence number
+     * @return The message's frame, or nullptr if it was evicted or not appended yet
+     */
+    const grpc::Slice* Get(uint64_t sequence) const;
+
+    /**
+     * @brief Drop every retained message and continue numbering at @p next_sequence.
+     * @param next_sequence The sequence number the next appended message will receive
+     */
+    void Reset(uint64_t next_sequence);
+
+    /**
+     * @brief Continue numbering at a later sequence, leaving a gap.
+     *
+     * A ring cannot hold a gap, so it drops its messages; a compacted buffer keeps them.
+     *
+     * @param next_sequence The sequence number the next appended message will receive
+     */
+    void Skip(uint64_t next_sequence);
+
+    /**
+     * @brief Get the number of retained messages.
+     * @return Number of messages currently stored, which for a compacted buffer is the number of keys
+     */
+    size_t Size() const { return compacted_ ? latest_.size() : slots_.size(); }
+
+    /**
+     * @brief Tell whether the buffer retains the latest message per key.
+     * @return true if the buffer is compacted
+     */
+    bool Compacted() const { return compacted_; }
+
+    /**
+     * @brief Get the sequence number that the next appended message will receive.
+     * @return The next sequence number
+     */
+    uint64_t NextSequence() const { return next_sequence_; }
+
+private:
+    // Latest message of one key of a compacted buffer
+    struct KeyEntry {
+        uint64_t sequence = 0;
+        uint64_t stamp = 0;
+        grpc::Slice frame;
+    };
+    
+    // Sequence of an entry of order_ and the key entry it was appended as; stale once the
+    // key entry's sequence differs
+    using OrderEntry = std::pair<uint64_t, const KeyEntry*>;
+    
+    // Visit the live entries of order_ from a sequence on, like VisitSince
+    template <typename VisitFn>
+    uint64_t VisitCompacted(uint64_t from, size_t max_count, const VisitFn& visit) const;
+    
+    // Position in order_ of the first entry with a sequence at or after from
+    size_t OrderIndex(uint64_t from) const;
+    
+    // Drop the stale entries of order_
+    void CompactOrder();
+    
+    // Position of a retained sequence in slots_
+    size_t SlotOf(uint64_t sequence) const { return static_cast<size_t>((sequence - base_) % capacity_); }
+    
+    size_t capacity_;
+    bool compacted_;
+    uint64_t next_sequence_;
+    uint64_t base_;  // Sequence stored in slots_[0] since the slots were last emptied
+    std::vector<grpc::Slice> slots_;  // Slot for sequence s lives at SlotOf(s)
+    std::vector<uint64_t> stamps_;  // Parallel to slots_
+    
+    // Compacted buffers only; entries of latest_ never move, so order_ can point at them
+    std::unordered_map<std::string, KeyEntry> latest_;
+    std::vector<OrderEntry> order_;  // Ascending by sequence
+};
+
+#endif // TOPIC_BUFFER_H
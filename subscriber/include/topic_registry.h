@@ -0,0 +1,122 @@
+/**
+ * @file topic_registry.h
+ * @brief Declaration of the registry that interns topic names into dense integer IDs.
+ */
+#ifndef TOPIC_REGISTRY_H
+#define TOPIC_REGISTRY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Dense integer handle for an interned topic name.
+ *
+ * IDs start at zero and the IDs of removed topics are handed out again, so
+ * they can be used directly as indices into flat per-topic arrays that never
+ * grow beyond the largest number of topics registered at once.
+ */
+using TopicId = uint32_t;
+
+/**
+ * @class TopicRegistry
+ * @brief Interns each topic name once and maps it to a TopicId.
+ *
+ * A topic name is hashed when it is first seen and whenever a request names
+ * it; everything downstream of that lookup works with the integer ID. The
+ * index is an open-addressing hash table with linear probing. Each 16-byte
+ * slot holds part of the name's hash, the ID and a pointer to the name,
+ * which is stored with its length in a single allocation, so a lookup
+ * usually costs one cache line of slots and one read of the name, and no
+ * node is allocated per topic. Removal shifts the following slots back
+ * instead of leaving tombstones, so lookups do not slow down as topics come
+ * and go. The registry is not synchronized; callers must hold a lock.
+ */
+class TopicRegistry {
+public:
+    /**
+     * @brief Constructs an empty registry.
+     */
+    TopicRegistry();
+
+    /**
+     * @brief Destructor that frees the interned names.
+     */
+    ~TopicRegistry();
+
+    TopicRegistry(const TopicRegistry&) = delete;
+    TopicRegistry& operator=(const TopicRegistry&) = delete;
+
+    /**
+     * @brief Get the ID of a topic, registering it if it is new.
+     * @param name The topic name
+     * @return The topic's ID
+     */
+    TopicId Intern(const std::string& name);
+
+    /**
+     * @brief Look up the ID of a topic without registering it.
+     * @param name The topic name
+     * @param id Receives the topic's ID when found
+     * @return true if the topic is registered
+     */
+    bool Find(const std::string& name, TopicId* id) const;
+
+    /**
+     * @brief Unregister a topic, making its ID available to the next new topic.
+     * @param id A registered topic ID
+     */
+    void Remove(TopicId id);
+
+    /**
+     * @brief Tell whether an ID below IdLimit() belongs to a registered topic.
+     * @param id The topic ID
+     * @return true if the topic is registered
+     */
+    bool Registered(TopicId id) const { return id < names_.size() && names_[id] != nullptr; }
+
+    /**
+     * @brief Get the interned name of a topic.
+     * @param id A registered topic ID
+     * @return A copy of the topic name
+     */
+    std::string Name(TopicId id) const;
+
+    /**
+     * @brief Get the number of registered topics.
+     * @return The number of topics
+     */
+    size_t Size() const { return size_; }
+
+    /**
+     * @brief Get one past the largest ID handed out so far.
+     * @return The bound of every registered ID
+     */
+    size_t IdLimit() const { return names_.size(); }
+
+private:
+    // A slot holds the low 32 bits of the name's hash, which also select its home slot.
+    // name points at a block holding the name's length and hash (uint32_t each)
+    // followed by its characters
+    struct Slot {
+        uint32_t hash;
+        TopicId id;
+        const char* name;
+    };
+
+    static constexpr TopicId kEmpty = UINT32_MAX;
+
+    // Index of the slot holding the name, or of the empty slot ending its probe sequence
+    size_t Probe(const char* data, size_t size, uint32_t hash) const;
+
+    // Double the table and reinsert every registered topic
+    void Grow();
+
+    std::vector<Slot> slots_;               // Power-of-two size, at most half full
+    std::vector<char*> names_;              // Indexed by TopicId; null for free IDs
+    std::vector<TopicId> free_ids_;         // IDs of removed topics, reused first
+    size_t size_;
+};
+
+#endif // TOPIC_REGISTRY_H
@@ -0,0 +1,115 @@
+/**
+ * @file ack_tracker.cpp
+ * @brief Implementation of the per-stream record of delivered but unacknowledged messages.
+ */
+#include "ack_tracker.h"
+
+namespace {
+
+// Number of wheel slots; the tick is chosen so that the ack timeout fits in one rotation
+constexpr size_t kWheelSlots = 512;
+
+}  // namespace
+
+/**
+ * @brief Constructs a tracker for a subscription.
+ * @param num_topics Number of topics in the subscription
+ * @param ack_timeout How long a delivered message may stay unacknowledged
+ */
+AckTracker::AckTracker(size_t num_topics, std::chrono::milliseconds ack_timeout)
+    : ack_timeout_(ack_timeout),
+      wheel_(std::chrono::milliseconds(ack_timeout.count() / (kWheelSlots - 2) + 1), kWheelSlots),
+      topics_(num_topics) {}
+
+/**
+ * @brief Record the first delivery of a message and start its timer.
+ *
+ * std::deque keeps references to its elements valid when elements are added
+ * or removed at either end, so the intrusive timers stay linked safely.
+ *
+ * @param topic Index of the message's topic
+ * @param sequence The message's sequence number
+ */
+void AckTracker::Delivered(size_t topic, uint64_t sequence) {
+    TopicState& state = topics_[topic];
+    if (state.index.empty()) {
+        state.entries.clear();
+    } else if (sequence < state.next) {
+        return;
+    }
+    state.next = sequence + 1;
+    state.entries.emplace_back();
+    Entry& entry = state.entries.back();
+    entry.sequence = sequence;
+    entry.topic = static_cast<uint32_t>(topic);
+    wheel_.Schedule(&entry, ack_timeout_);
+    state.index.emplace(sequence, &entry);
+}
+
+/**
+ * @brief Acknowledge every delivered message of a topic below a sequence.
+ * @param topic Index of the topic
+ * @param next_sequence One past the highest acknowledged sequence
+ */
+void AckTracker::AckBelow(size_t topic, uint64_t next_sequence) {
+    if (topic >= topics_.size()) {
+        return;
+    }
+    TopicState& state = topics_[topic];
+    while (!state.entries.empty() && state.entries.front().sequence < next_sequence) {
+        Entry& entry = state.entries.front();
+        if (entry.Scheduled()) {
+            wheel_.Cancel(&entry);
+            state.index.erase(entry.sequence);
+        }
+        state.entries.pop_front();
+    }
+    Trim(&state);
+}
+
+/**
+ * @brief Acknowledge one message; unknown or already acknowledged sequences are ignored.
+ * @param topic Index of the message's topic
+ * @param sequence The message's sequence number
+ */
+void AckTracker::Ack(size_t topic, uint64_t sequence) {
+    if (topic >= topics_.size()) {
+        return;
+    }
+    TopicState& state = topics_[topic];
+    auto it = state.index.find(sequence);
+    if (it == state.index.end()) {
+        return;
+    }
+    wheel_.Cancel(it->second);
+    state.index.erase(it);
+    Trim(&state);
+}
+
+/**
+ * @brief Collect the messages whose timers expired and rearm their timers.
+ *
+ * A redelivered message gets a full ack timeout again and its attempt count
+ * goes up.
+ *
+ * @param now The current time
+ * @param expired Vector the expired messages are appended to
+ */
+void AckTracker::Expire(TimerWheel::Clock::time_point now, std::vector<Expired>* expired) {
+    wheel_.Advance(now, [this, expired](TimerWheel::Timer* timer) {
+        Entry* entry = static_cast<Entry*>(timer);
+        entry->attempt++;
+        expired->push_back(Expired{entry->topic, entry->sequence, entry->attempt});
+        wheel_.Schedule(entry, ack_timeout_);
+    });
+}
+
+/**
+ * @brief Drop acknowledged entries from the front of a topic's range.
+ * @param state The topic's state
+ */
+void AckTracker::Trim(TopicState* state) {
+    while (!state->entries.empty() && !state->entries.front().Scheduled()) {
+        state->entries.pop_front();
+    }
+}
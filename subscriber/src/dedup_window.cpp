@@ -0,0 +1,108 @@
+/**
+ * @file dedup_window.cpp
+ * @brief Implementation of the per-producer window used to drop retried publishes.
+ */
+#include "dedup_window.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+constexpr uint64_t DedupWindow::kWindowSize;
+constexpr size_t DedupWindow::kDefaultMaxProducers;
+constexpr uint64_t DedupWindow::kWords;
+
+/**
+ * @brief Constructs an empty window.
+ * @param max_producers Most producers tracked at once; at least one is always kept
+ */
+DedupWindow::DedupWindow(size_t max_producers) : max_producers_(std::max<size_t>(max_producers, 1)) {}
+
+/**
+ * @brief Record a publish and tell whether it was seen before.
+ *
+ * A sequence above the high-water mark slides the window forward, clearing
+ * the bits of the sequences it skips. Each sequence is cleared at most once,
+ * so sliding is amortized O(1) per publish. A sequence inside the window is
+ * accepted once, when its bit is still clear. Anything older than the window
+ * is treated as a duplicate.
+ *
+ * The producer moves to the front of the recency list; a producer seen for
+ * the first time reuses the least recent entry's storage when the limit is
+ * reached.
+ *
+ * @param producer_id The producer that sent the message
+ * @param sequence The producer's sequence number for the message
+ * @param now Current time in nanoseconds, recorded as the producer's last publish
+ * @return true if the message is new and should be stored
+ */
+bool DedupWindow::Accept(const std::string& producer_id, uint64_t sequence, int64_t now) {
+    if (producer_id.empty() || sequence == 0) {
+        return true;
+    }
+
+    auto found = index_.find(producer_id);
+    if (found != index_.end()) {
+        producers_.splice(producers_.begin(), producers_, found->second);
+    } else if (index_.size() >= max_producers_) {
+        producers_.splice(producers_.begin(), producers_, std::prev(producers_.end()));
+        ProducerState& evicted = producers_.front();
+        index_.erase(evicted.producer_id);
+        evicted = ProducerState();
+        evicted.producer_id = producer_id;
+        index_.emplace(producer_id, producers_.begin());
+    } else {
+        producers_.emplace_front();
+        producers_.front().producer_id = producer_id;
+        index_.emplace(producer_id, producers_.begin());
+    }
+    ProducerState& state = producers_.front();
+    state.last_seen = now;
+    if (sequence > state.high_water) {
+        if (sequence - state.high_water >= kWindowSize) {
+            std::memset(state.seen, 0, sizeof(state.seen));
+        } else {
+            for (uint64_t s = state.high_water + 1; s < sequence; s++) {
+                state.seen[(s % kWindowSize) / 64] &= ~(uint64_t(1) << (s % 64));
+            }
+        }
+        state.high_water = sequence;
+    } else if (state.high_water - sequence >= kWindowSize) {
+        return false;
+    } else if (state.seen[(sequence % kWindowSize) / 64] & (uint64_t(1) << (sequence % 64))) {
+        return false;
+    }
+
+    state.seen[(sequence % kWindowSize) / 64] |= uint64_t(1) << (sequence % 64);
+    return true;
+}
+
+/**
+ * @brief Forget every producer that has not published since a given time.
+ *
+ * Idle producers are at the back of the recency list, so this costs O(1)
+ * per producer forgotten.
+ *
+ * @param idle_since Producers whose last publish is older than this are forgotten
+ * @return Number of producers forgotten
+ */
+size_t DedupWindow::ExpireIdle(int64_t idle_since) {
+    size_t expired = 0;
+    while (!producers_.empty() && producers_.back().last_seen < idle_since) {
+        index_.erase(producers_.back().producer_id);
+        producers_.pop_back();
+        expired++;
+    }
+    return expired;
+}
+
+/**
+ * @brief Change the limit on tracked producers, evicting the least recent beyond it.
+ * @param max_producers Most producers tracked at once; at least one is always kept
+ */
+void DedupWindow::SetMaxProducers(size_t max_producers) {
+    max_producers_ = std::max<size_t>(max_producers, 1);
+    while (index_.size() > max_producers_) {
+        index_.erase(producers_.back().producer_id);
+        producers_.pop_back();
+    }
+}
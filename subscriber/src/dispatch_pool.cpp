@@ -0,0 +1,199 @@
+/**
+ * @file dispatch_pool.cpp
+ * @brief Implementation of the worker pool that runs subscriber callbacks off the reader thread.
+ */
+#include "dispatch_pool.h"
+#include <algorithm>
+
+constexpr size_t DispatchPool::kMaxBatch;
+
+/**
+ * @brief Constructs the pool and starts its workers.
+ * @param num_workers Number of worker threads (at least one)
+ * @param max_pending Maximum number of queued messages before Dispatch blocks
+ * @param handler Function run for every dispatched message
+ */
+DispatchPool::DispatchPool(size_t num_workers, size_t max_pending, Handler handler)
+    : handler_(std::move(handler)), max_pending_(std::max<size_t>(max_pending, 1)),
+      pending_(0), ready_count_(0), stopping_(false) {
+    num_workers = std::max<size_t>(num_workers, 1);
+    for (size_t i = 0; i < num_workers; i++) {
+        workers_.emplace_back(new Worker);
+    }
+    for (size_t i = 0; i < num_workers; i++) {
+        workers_[i]->thread = std::thread(&DispatchPool::WorkerLoop, this, i);
+    }
+}
+
+/**
+ * @brief Destructor that handles all queued messages and stops the workers.
+ */
+DispatchPool::~DispatchPool() {
+    Stop();
+}
+
+/**
+ * @brief Queue a message behind the earlier messages with the same key.
+ *
+ * If the key's strand was idle it is scheduled on its home worker.
+ *
+ * @param key The ordering key
+ * @param message The message, moved into the queue
+ */
+void DispatchPool::Dispatch(const std::string& key, Message&& message) {
+    Strand* to_schedule = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        space_cv_.wait(lock, [this] { return pending_ < max_pending_; });
+
+        auto it = strands_.find(key);
+        if (it == strands_.end()) {
+            it = strands_.emplace(key, Strand()).first;
+            it->second.home = std::hash<std::string>()(key) % workers_.size();
+            it->second.key = &it->first;
+        }
+        Strand& strand = it->second;
+        strand.messages.push_back(std::move(message));
+        pending_++;
+        if (!strand.scheduled) {
+            strand.scheduled = true;
+            to_schedule = &strand;
+        }
+    }
+    if (to_schedule) {
+        Schedule(to_schedule->home, to_schedule);
+    }
+}
+
+/**
+ * @brief Wait until every message dispatched so far has been handled.
+ */
+void DispatchPool::Drain() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    space_cv_.wait(lock, [this] { return pending_ == 0; });
+}
+
+/**
+ * @brief Handle all queued messages and stop the workers.
+ *
+ * Workers only exit once no strand is ready, so every message dispatched
+ * before this call is handled.
+ */
+void DispatchPool::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        if (stopping_) {
+            return;
+        }
+        stopping_ = true;
+    }
+    idle_cv_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+/**
+ * @brief Put a strand on a worker's ready deque and wake an idle worker.
+ * @param worker Index of the worker whose deque receives the strand
+ * @param strand The strand to schedule
+ */
+void DispatchPool::Schedule(size_t worker, Strand* strand) {
+    {
+        std::lock_guard<std::mutex> lock(workers_[worker]->mutex);
+        workers_[worker]->ready.push_back(strand);
+    }
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        ready_count_++;
+    }
+    idle_cv_.notify_one();
+}
+
+/**
+ * @brief Take a strand from the worker's own deque, or steal one from another worker.
+ *
+ * The owner takes from the front to keep FIFO fairness between keys; thieves
+ * take from the back to stay clear of the owner.
+ *
+ * @param index Index of the calling worker
+ * @return A ready strand, or nullptr if no worker has one
+ */
+DispatchPool::Strand* DispatchPool::NextStrand(size_t index) {
+    Strand* strand = nullptr;
+    for (size_t i = 0; i < workers_.size() && !strand; i++) {
+        Worker& victim = *workers_[(index + i) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.ready.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            strand = victim.ready.front();
+            victim.ready.pop_front();
+        } else {
+            strand = victim.ready.back();
+            victim.ready.pop_back();
+        }
+    }
+    if (strand) {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        ready_count_--;
+    }
+    return strand;
+}
+
+/**
+ * @brief Thread function for one worker.
+ *
+ * Runs up to kMaxBatch messages of a strand, then reschedules the strand on
+ * this worker if it still has messages, so that long-running keys take
+ * turns with the others. A strand left empty is erased: only a scheduled
+ * strand is referenced outside strands_, so nothing else points to it.
+ *
+ * @param index Index of this worker
+ */
+void DispatchPool::WorkerLoop(size_t index) {
+    std::vector<Message> batch;
+    batch.reserve(kMaxBatch);
+    while (true) {
+        Strand* strand = NextStrand(index);
+        if (!strand) {
+            std::unique_lock<std::mutex> lock(idle_mutex_);
+            idle_cv_.wait(lock, [this] { return ready_count_ > 0 || stopping_; });
+            if (stopping_ && ready_count_ == 0) {
+                return;
+            }
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (!strand->messages.empty() && batch.size() < kMaxBatch) {
+                batch.push_back(std::move(strand->messages.front()));
+                strand->messages.pop_front();
+            }
+        }
+
+        for (const auto& message : batch) {
+            handler_(message);
+        }
+
+        bool reschedule;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_ -= batch.size();
+            reschedule = !strand->messages.empty();
+            if (!reschedule) {
+                strands_.erase(*strand->key);
+            }
+        }
+        space_cv_.notify_all();
+        batch.clear();
+
+        if (reschedule) {
+            Schedule(index, strand);
+        }
+    }
+}
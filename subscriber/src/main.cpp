@@ -3,11 +3,143 @@
  * @brief Entry point for the Subscriber server application.
  *
  * This application starts the PubSub gRPC server and listens for incoming connections from clients.
- * The server address can be specified via command line arguments.
+ * The server addresses can be specified via command line arguments.
+ *
+ * Usage: subscriber [addresses] [max_messages] [partitions] [--option=value ...]
+ *
+ * addresses is a comma-separated list of host:port pairs and unix:/path sockets.
  */
 
+#include <cstdlib>
+#include <map>
+#include <vector>
 #include "pubsub_service.h"
 
+namespace {
+
+/**
+ * @brief Split a comma-separated list.
+ * @param list The list
+ * @return The elements, in order
+ */
+std::vector<std::string> SplitList(const std::string& list) {
+    std::vector<std::string> items;
+    size_t start = 0, end = 0;
+    while ((end = list.find(',', start)) != std::string::npos) {
+        items.push_back(list.substr(start, end - start));
+        start = end + 1;
+    }
+    items.push_back(list.substr(start));
+    return items;
+}
+
+/**
+ * @brief Parse a rate limit given as RATE or RATE/BURST, in messages.
+ * @param value The limit
+ * @return The rate limit
+ */
+RateLimit ParseRateLimit(const std::string& value) {
+    RateLimit limit;
+    size_t slash = value.find('/');
+    limit.rate = std::stod(value.substr(0, slash));
+    if (slash != std::string::npos) {
+        limit.burst = std::stod(value.substr(slash + 1));
+    }
+    return limit;
+}
+
+/**
+ * @brief Parse a named rate limit given as NAME=RATE or NAME=RATE/BURST.
+ * @param value The named limit
+ * @param limits Receives the limit under its name
+ * @return true if the value names a limit
+ */
+bool ParseNamedRateLimit(const std::string& value, std::map<std::string, RateLimit>* limits) {
+    size_t eq = value.rfind('=');
+    if (eq == std::string::npos || eq == 0) {
+        return false;
+    }
+    (*limits)[value.substr(0, eq)] = ParseRateLimit(value.substr(eq + 1));
+    return true;
+}
+
+/**
+ * @brief Apply one --option=value argument to the server options.
+ * @param arg The argument, including the leading dashes
+ * @param options The options to update
+ * @return true if the option was recognized
+ */
+bool ParseOption(const std::string& arg, ServerOptions* options) {
+    size_t eq = arg.find('=');
+    std::string name = arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2);
+    std::string value = eq == std::string::npos ? std::string() : arg.substr(eq + 1);
+    if (name == "no-bdp-probe") {
+        options->bdp_probe = false;
+        return true;
+    }
+    if (name == "numa-pin") {
+        options->numa_pinning = true;
+        return true;
+    }
+    if (name == "verbose") {
+        options->verbose = true;
+        return true;
+    }
+    if (value.empty()) {
+        return false;
+    }
+    if (name == "max-message-bytes") {
+        options->max_message_bytes = std::stoi(value);
+    } else if (name == "cqs") {
+        options->num_cqs = std::stoi(value);
+    } else if (name == "min-pollers") {
+        options->min_pollers = std::stoi(value);
+    } else if (name == "max-pollers") {
+        options->max_pollers = std::stoi(value);
+    } else if (name == "max-threads") {
+        options->max_threads = std::stoi(value);
+    } else if (name == "memory-quota") {
+        options->memory_quota_bytes = std::stoul(value);
+    } else if (name == "max-streams") {
+        options->max_concurrent_streams = std::stoi(value);
+    } else if (name == "keepalive-ms") {
+        options->keepalive_time = std::chrono::milliseconds(std::stol(value));
+    } else if (name == "keepalive-timeout-ms") {
+        options->keepalive_timeout = std::chrono::milliseconds(std::stol(value));
+    } else if (name == "min-ping-interval-ms") {
+        options->keepalive_min_ping_interval = std::chrono::milliseconds(std::stol(value));
+    } else if (name == "snapshot") {
+        options->snapshot_path = value;
+    } else if (name == "snapshot-interval-ms") {
+        options->snapshot_interval = std::chrono::milliseconds(std::stol(value));
+    } else if (name == "idle-topic-ttl-ms") {
+        options->idle_topic_ttl = std::chrono::milliseconds(std::stol(value));
+    } else if (name == "cpus") {
+        return pubsub::common::parseCpuList(value, &options->cpus);
+    } else if (name == "topic-rate") {
+        options->topic_rate_limit = ParseRateLimit(value);
+    } else if (name == "topic-rate-for") {
+        return ParseNamedRateLimit(value, &options->topic_rate_limits);
+    } else if (name == "publisher-rate") {
+        options->publisher_rate_limit = ParseRateLimit(value);
+    } else if (name == "publisher-rate-for") {
+        return ParseNamedRateLimit(value, &options->publisher_rate_limits);
+    } else if (name == "compacted") {
+        options->compacted_topics = SplitList(value);
+    } else if (name == "catch-up-rate") {
+        options->catch_up_rate_limit = ParseRateLimit(value);
+    } else if (name == "max-scheduled") {
+        options->max_scheduled_messages = std::stoul(value);
+    } else if (name == "max-dedup-producers") {
+        options->max_dedup_producers = std::stoul(value);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
 /**
  * @brief Main function for the Subscriber server.
  *
@@ -18,17 +150,29 @@
  * @return int Exit status
  */
 int main(int argc, char** argv) {
-    std::string server_address = "0.0.0.0:50051";
-    size_t max_messages = 100;  // Default max messages per topic
-    
-    // Parse command line arguments
-    if (argc > 1) server_address = argv[1];
-    if (argc > 2) max_messages = std::stoul(argv[2]);
-    
-    std::cout << "Starting PubSub server on " << server_address << std::endl;
-    std::cout << "Maximum messages per topic: " << max_messages << std::endl;
-    
-    RunServer(server_address, max_messages);
-    
+    ServerOptions options;
+    options.listen_addresses = {"0.0.0.0:50051"};
+    options.max_messages_per_topic = 100;  // Default max messages per topic partition
+    options.partitions_per_topic = 1;      // Default partitions per topic
+
+    // Parse command line arguments: positional values first, --option=value anywhere
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) {
+            positional.push_back(arg);
+        } else if (!ParseOption(arg, &options)) {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (positional.size() > 0) options.listen_addresses = SplitList(positional[0]);
+    if (positional.size() > 1) options.max_messages_per_topic = std::stoul(positional[1]);
+    if (positional.size() > 2) options.partitions_per_topic = std::stoul(positional[2]);
+
+    std::cout << "Starting PubSub server on " << (positional.empty() ? "0.0.0.0:50051" : positional[0]) << std::endl;
+
+    RunServer(options);
+
     return 0;
 }
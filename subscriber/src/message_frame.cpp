@@ -0,0 +1,399 @@
+/**
+ * @file message_frame.cpp
+ * @brief Implementation of the serialized message frames that carry payloads through the server unparsed.
+ */
+#include "message_frame.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+#include <grpcpp/support/proto_buffer_reader.h>
+
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::internal::WireFormatLite;
+using pubsub::Message;
+using pubsub::PublishBatchRequest;
+using pubsub::PublishRequest;
+
+namespace {
+
+// Longest ID generateMessageId produces: a 64-bit timestamp, a dash and a 32-bit counter
+constexpr size_t kMaxMessageIdSize = 20 + 1 + 11;
+
+// Where the content of a request lies in the bytes it was read from
+struct ContentSpan {
+    uint64_t offset = 0;
+    uint32_t size = 0;
+};
+
+/**
+ * @brief Get the encoded size of a length-delimited field with a one-byte tag.
+ * @param size Size of the field's value
+ * @return The field's size in bytes
+ */
+size_t DelimitedFieldSize(size_t size) {
+    return 1 + CodedOutputStream::VarintSize32(static_cast<uint32_t>(size)) + size;
+}
+
+/**
+ * @brief Get the most bytes the fields Finish appends can take.
+ * @param id_size Size of the message ID
+ * @param topic_size Size of the topic name
+ * @param key_size Size of the key
+ * @return An upper bound of their encoded size
+ */
+size_t FieldsBound(size_t id_size, size_t topic_size, size_t key_size) {
+    // The timestamp and sequence are varints of up to 10 bytes, the partition of up to 5,
+    // and the incarnation is 8 fixed bytes
+    return DelimitedFieldSize(id_size) + DelimitedFieldSize(topic_size) + DelimitedFieldSize(key_size) +
+           2 * (1 + 10) + (1 + 5) + (1 + 8);
+}
+
+/**
+ * @brief Read the fields of a PublishRequest up to the end of the input's current limit.
+ *
+ * The content is skipped; only its position is recorded. Fields of an
+ * unexpected wire type are skipped like unknown fields, as Protobuf does.
+ *
+ * @param input The input, limited to the request
+ * @param envelope Receives every field except the content
+ * @param content Receives where the content is
+ * @return true if the request was well formed
+ */
+bool ScanPublishFields(CodedInputStream* input, PublishRequest* envelope, ContentSpan* content) {
+    while (uint32_t tag = input->ReadTag()) {
+        int field = WireFormatLite::GetTagFieldNumber(tag);
+        WireFormatLite::WireType type = WireFormatLite::GetTagWireType(tag);
+        bool delimited = type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED;
+        bool varint = type == WireFormatLite::WIRETYPE_VARINT;
+        uint64_t value = 0;
+        bool ok;
+        if (delimited && field == PublishRequest::kContentFieldNumber) {
+            ok = input->ReadVarint32(&content->size);
+            content->offset = static_cast<uint64_t>(input->CurrentPosition());
+            ok = ok && input->Skip(static_cast<int>(content->size));
+        } else if (delimited && field == PublishRequest::kTopicFieldNumber) {
+            ok = WireFormatLite::ReadString(input, envelope->mutable_topic());
+        } else if (delimited && field == PublishRequest::kProducerIdFieldNumber) {
+            ok = WireFormatLite::ReadString(input, envelope->mutable_producer_id());
+        } else if (delimited && field == PublishRequest::kKeyFieldNumber) {
+            ok = WireFormatLite::ReadString(input, envelope->mutable_key());
+        } else if (varint && field == PublishRequest::kSequenceFieldNumber) {
+            ok = input->ReadVarint64(&value);
+            envelope->set_sequence(value);
+        } else if (varint && field == PublishRequest::kDeliverAtFieldNumber) {
+            ok = input->ReadVarint64(&value);
+            envelope->set_deliver_at(static_cast<int64_t>(value));
+        } else if (varint && field == PublishRequest::kDelayMsFieldNumber) {
+            ok = input->ReadVarint64(&value);
+            envelope->set_delay_ms(static_cast<uint32_t>(value));
+        } else {
+            ok = WireFormatLite::SkipField(input, tag);
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    return input->BytesUntilLimit() == 0;
+}
+
+/**
+ * @brief Copy a content out of the slices of a received request.
+ * @param slices The request's slices, in order
+ * @param content Where the content lies
+ * @param out Where to copy it to
+ */
+void CopyFromSlices(const std::vector<grpc::Slice>& slices, const ContentSpan& content, char* out) {
+    uint64_t offset = content.offset;
+    size_t remaining = content.size;
+    for (const grpc::Slice& slice : slices) {
+        if (remaining == 0) {
+            break;
+        }
+        if (offset >= slice.size()) {
+            offset -= slice.size();
+            continue;
+        }
+        size_t count = std::min<size_t>(remaining, slice.size() - offset);
+        std::memcpy(out, slice.begin() + offset, count);
+        out += count;
+        remaining -= count;
+        offset = 0;
+    }
+}
+
+} // namespace
+
+/**
+ * @brief Constructs an empty frame.
+ */
+PendingFrame::PendingFrame() : slice_(grpc_empty_slice()), content_begin_(0), content_size_(0) {}
+
+/**
+ * @brief Destructor that releases the frame's reference to its buffer.
+ */
+PendingFrame::~PendingFrame() {
+    grpc_slice_unref(slice_);
+}
+
+PendingFrame::PendingFrame(PendingFrame&& other) noexcept
+    : slice_(other.slice_), content_begin_(other.content_begin_), content_size_(other.content_size_) {
+    other.slice_ = grpc_empty_slice();
+    other.content_size_ = 0;
+}
+
+PendingFrame& PendingFrame::operator=(PendingFrame&& other) noexcept {
+    std::swap(slice_, other.slice_);
+    std::swap(content_begin_, other.content_begin_);
+    std::swap(content_size_, other.content_size_);
+    return *this;
+}
+
+/**
+ * @brief Allocate the frame and encode the head of its content field.
+ *
+ * The buffer has room for the fields Finish appends, so that finishing the
+ * frame does not allocate or move the content.
+ *
+ * @param content_size Size of the content
+ * @param topic_size Size of the topic name, to reserve room for it
+ * @param key_size Size of the key, to reserve room for it
+ * @return Where the caller copies the content to
+ */
+char* PendingFrame::Start(size_t content_size, size_t topic_size, size_t key_size) {
+    content_begin_ = DelimitedFieldSize(content_size) - content_size;
+    content_size_ = content_size;
+    grpc_slice_unref(slice_);
+    slice_ = grpc_slice_malloc_large(content_begin_ + content_size + FieldsBound(kMaxMessageIdSize, topic_size, key_size));
+    uint8_t* out = GRPC_SLICE_START_PTR(slice_);
+    out = WireFormatLite::WriteTagToArray(Message::kContentFieldNumber, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, out);
+    out = CodedOutputStream::WriteVarint32ToArray(static_cast<uint32_t>(content_size), out);
+    return reinterpret_cast<char*>(out);
+}
+
+/**
+ * @brief Allocate the frame with a copy of a published message's content.
+ * @param request The published message
+ */
+void PendingFrame::Assign(const PublishRequest& request) {
+    const std::string& content = request.content();
+    std::memcpy(Start(content.size(), request.topic().size(), request.key().size()), content.data(), content.size());
+}
+
+/**
+ * @brief Get the content, which stays readable after the frame is finished.
+ * @return The first byte of the content
+ */
+const char* PendingFrame::Content() const {
+    return reinterpret_cast<const char*>(GRPC_SLICE_START_PTR(slice_)) + content_begin_;
+}
+
+/**
+ * @brief Append the remaining fields of the Message.
+ *
+ * Fields holding their default value are left out, as Protobuf would. Call
+ * at most once per Start.
+ *
+ * @param message_id The message ID
+ * @param topic The topic name
+ * @param timestamp When the message was stored, in nanoseconds since the Unix epoch
+ * @param sequence The message's position in its partition
+ * @param key The message key
+ * @param partition The partition index
+ * @param incarnation The incarnation of the partition
+ * @return The serialized Message, sharing the frame's buffer
+ */
+grpc::Slice PendingFrame::Finish(const std::string& message_id, const std::string& topic, int64_t timestamp,
+                                 uint64_t sequence, const std::string& key, uint32_t partition,
+                                 uint64_t incarnation) {
+    size_t content_end = content_begin_ + content_size_;
+    size_t needed = content_end + FieldsBound(message_id.size(), topic.size(), key.size());
+    if (needed > GRPC_SLICE_LENGTH(slice_)) {
+        // Only an ID longer than the generated ones, or a frame never started, gets here
+        grpc_slice larger = grpc_slice_malloc_large(needed);
+        if (content_end > 0) {
+            std::memcpy(GRPC_SLICE_START_PTR(larger), GRPC_SLICE_START_PTR(slice_), content_end);
+        }
+        grpc_slice_unref(slice_);
+        slice_ = larger;
+    }
+    uint8_t* begin = GRPC_SLICE_START_PTR(slice_);
+    uint8_t* out = begin + content_end;
+    out = WireFormatLite::WriteStringToArray(Message::kMessageIdFieldNumber, message_id, out);
+    out = WireFormatLite::WriteStringToArray(Message::kTopicFieldNumber, topic, out);
+    out = WireFormatLite::WriteInt64ToArray(Message::kTimestampFieldNumber, timestamp, out);
+    if (sequence != 0) {
+        out = WireFormatLite::WriteUInt64ToArray(Message::kSequenceFieldNumber, sequence, out);
+    }
+    if (!key.empty()) {
+        out = WireFormatLite::WriteStringToArray(Message::kKeyFieldNumber, key, out);
+    }
+    if (partition != 0) {
+        out = WireFormatLite::WriteUInt32ToArray(Message::kPartitionFieldNumber, partition, out);
+    }
+    if (incarnation != 0) {
+        out = WireFormatLite::WriteFixed64ToArray(Message::kIncarnationFieldNumber, incarnation, out);
+    }
+    grpc_slice frame = grpc_slice_ref(slice_);
+    GRPC_SLICE_SET_LENGTH(frame, static_cast<size_t>(out - begin));
+    return grpc::Slice(frame, grpc::Slice::STEAL_REF);
+}
+
+/**
+ * @brief Read a serialized PublishRequest, copying its content into a frame without parsing it.
+ * @param data The request's bytes
+ * @param size Number of bytes
+ * @param envelope Receives every field of the request except the content
+ * @param frame Receives a new frame holding the content
+ * @return true if the request was well formed
+ */
+bool ScanPublish(const char* data, size_t size, PublishRequest* envelope, PendingFrame* frame) {
+    CodedInputStream input(reinterpret_cast<const uint8_t*>(data), static_cast<int>(size));
+    input.PushLimit(static_cast<int>(size));
+    ContentSpan content;
+    if (!ScanPublishFields(&input, envelope, &content)) {
+        return false;
+    }
+    std::memcpy(frame->Start(content.size, envelope->topic().size(), envelope->key().size()),
+                data + content.offset, content.size);
+    return true;
+}
+
+/**
+ * @brief Read a PublishRequest received as raw bytes, copying its content into a frame without parsing it.
+ *
+ * A request in a single slice is read in place; otherwise the request is
+ * read across its slices and the content copied out of them piecewise.
+ *
+ * @param buffer The request as received
+ * @param envelope Receives every field of the request except the content
+ * @param frame Receives a new frame holding the content
+ * @return true if the request was well formed
+ */
+bool ScanPublish(grpc::ByteBuffer* buffer, PublishRequest* envelope, PendingFrame* frame) {
+    std::vector<grpc::Slice> slices;
+    if (!buffer->Dump(&slices).ok()) {
+        return false;
+    }
+    if (slices.size() == 1) {
+        return ScanPublish(reinterpret_cast<const char*>(slices[0].begin()), slices[0].size(), envelope, frame);
+    }
+    grpc::ProtoBufferReader reader(buffer);
+    CodedInputStream input(&reader);
+    input.PushLimit(static_cast<int>(buffer->Length()));
+    ContentSpan content;
+    if (!ScanPublishFields(&input, envelope, &content)) {
+        return false;
+    }
+    CopyFromSlices(slices, content, frame->Start(content.size, envelope->topic().size(), envelope->key().size()));
+    return true;
+}
+
+/**
+ * @brief Read a PublishBatchRequest received as raw bytes, copying each content into a frame.
+ * @param buffer The request as received
+ * @param envelopes Receives every field of each request except its content
+ * @param frames Receives a new frame per request, parallel to the envelopes' messages
+ * @return true if the request was well formed
+ */
+bool ScanPublishBatch(grpc::ByteBuffer* buffer, PublishBatchRequest* envelopes, std::vector<PendingFrame>* frames) {
+    std::vector<grpc::Slice> slices;
+    if (!buffer->Dump(&slices).ok()) {
+        return false;
+    }
+    grpc::ProtoBufferReader reader(buffer);
+    CodedInputStream input(&reader);
+    input.PushLimit(static_cast<int>(buffer->Length()));
+    std::vector<ContentSpan> contents;
+    while (uint32_t tag = input.ReadTag()) {
+        if (tag == WireFormatLite::MakeTag(PublishBatchRequest::kMessagesFieldNumber,
+                                           WireFormatLite::WIRETYPE_LENGTH_DELIMITED)) {
+            uint32_t size;
+            if (!input.ReadVarint32(&size)) {
+                return false;
+            }
+            CodedInputStream::Limit limit = input.PushLimit(static_cast<int>(size));
+            contents.emplace_back();
+            if (!ScanPublishFields(&input, envelopes->add_messages(), &contents.back())) {
+                return false;
+            }
+            input.PopLimit(limit);
+        } else if (!WireFormatLite::SkipField(&input, tag)) {
+            return false;
+        }
+    }
+    if (input.BytesUntilLimit() != 0) {
+        return false;
+    }
+    frames->clear();
+    frames->resize(contents.size());
+    for (size_t i = 0; i < contents.size(); i++) {
+        const PublishRequest& envelope = envelopes->messages(static_cast<int>(i));
+        CopyFromSlices(slices, contents[i],
+                       (*frames)[i].Start(contents[i].size, envelope.topic().size(), envelope.key().size()));
+    }
+    return true;
+}
+
+/**
+ * @brief Read the sequence number and key of a serialized Message, skipping its other fields.
+ * @param data The message's bytes
+ * @param size Number of bytes
+ * @param sequence Receives the sequence number
+ * @param key Receives the key
+ * @return true if the message was well formed
+ */
+bool ReadFrameInfo(const char* data, size_t size, uint64_t* sequence, std::string* key) {
+    CodedInputStream input(reinterpret_cast<const uint8_t*>(data), static_cast<int>(size));
+    input.PushLimit(static_cast<int>(size));
+    *sequence = 0;
+    key->clear();
+    while (uint32_t tag = input.ReadTag()) {
+        bool ok;
+        if (tag == WireFormatLite::MakeTag(Message::kSequenceFieldNumber, WireFormatLite::WIRETYPE_VARINT)) {
+            ok = input.ReadVarint64(sequence);
+        } else if (tag == WireFormatLite::MakeTag(Message::kKeyFieldNumber,
+                                                  WireFormatLite::WIRETYPE_LENGTH_DELIMITED)) {
+            ok = WireFormatLite::ReadString(&input, key);
+        } else {
+            ok = WireFormatLite::SkipField(&input, tag);
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    return input.BytesUntilLimit() == 0;
+}
+
+/**
+ * @brief Add a frame as the next message of a MessageBatch, by reference.
+ *
+ * The entry is the field's tag and length in a small slice of its own, the
+ * frame itself, and, for a delivery attempt, one more field after it; a
+ * field repeated later in a message overrides an earlier one, so the frame
+ * is never rewritten.
+ *
+ * @param frame The serialized Message
+ * @param delivery_attempt Delivery attempt to add to the message, or 0 to add none
+ * @param slices The batch's serialized form, which the entry is appended to
+ */
+void AppendBatchEntry(const grpc::Slice& frame, uint32_t delivery_attempt, std::vector<grpc::Slice>* slices) {
+    uint8_t attempt[1 + 5];
+    uint8_t* attempt_end = attempt;
+    if (delivery_attempt > 0) {
+        attempt_end = WireFormatLite::WriteUInt32ToArray(Message::kDeliveryAttemptFieldNumber, delivery_attempt,
+                                                         attempt);
+    }
+    size_t attempt_size = static_cast<size_t>(attempt_end - attempt);
+    uint8_t head[1 + 5];
+    uint8_t* head_end = WireFormatLite::WriteTagToArray(pubsub::MessageBatch::kMessagesFieldNumber,
+                                                        WireFormatLite::WIRETYPE_LENGTH_DELIMITED, head);
+    head_end = CodedOutputStream::WriteVarint32ToArray(static_cast<uint32_t>(frame.size() + attempt_size), head_end);
+    slices->emplace_back(head, static_cast<size_t>(head_end - head));
+    slices->push_back(frame);
+    if (attempt_size > 0) {
+        slices->emplace_back(attempt, attempt_size);
+    }
+}
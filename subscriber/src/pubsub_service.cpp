@@ -4,74 +4,1233 @@
  */
 #include "pubsub_service.h"
 #include "pubsub_common.h"
+#include "shm_ring.h"
+#include "snapshot_file.h"
+#include "pubsub_clock.h"
+#include "cpu_affinity.h"
+#include <csignal>
+#include <pthread.h>
 #include <thread>
 #include <chrono>
 #include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <map>
+#include <queue>
+#include <grpcpp/support/method_handler.h>
+
+namespace {
+
+// Indices of the methods served from raw bytes, in the order the service declares them
+constexpr int kPublishMethod = 0;
+constexpr int kPublishBatchMethod = 1;
+constexpr int kSubscribeMethod = 2;
+constexpr int kSubscribeBatchedMethod = 3;
+constexpr int kSubscribeAckMethod = 4;
+
+// Metadata naming the publisher whose quota a publish counts against
+constexpr char kClientIdHeader[] = "x-pubsub-client-id";
+
+// Trailing metadata of a rejected publish: milliseconds until it would be admitted
+constexpr char kRetryAfterHeader[] = "retry-after-ms";
+
+// Scheduled delivery: 1 ms ticks, and 256 slots on each of 5 levels reach beyond 30 years
+constexpr std::chrono::milliseconds kScheduleTick(1);
+constexpr size_t kScheduleSlots = 256;
+constexpr size_t kScheduleLevels = 5;
+
+// Scheduled messages stored under one acquisition of the service lock
+constexpr size_t kReleaseChunk = 1024;
+
+// Suggested wait before retrying a publish refused because too many messages are scheduled
+constexpr int64_t kScheduleFullRetryAfter = 100000000;
+
+/**
+ * @brief Tell whether a topic matches any of a list of names and name prefixes.
+ * @param patterns Topic names, and prefixes followed by '*'
+ * @param topic The topic name
+ * @return true if a name equals the topic or a prefix starts it
+ */
+bool MatchesTopic(const std::vector<std::string>& patterns, const std::string& topic) {
+    for (const auto& pattern : patterns) {
+        if (!pattern.empty() && pattern.back() == '*'
+                ? topic.compare(0, pattern.size() - 1, pattern, 0, pattern.size() - 1) == 0
+                : topic == pattern) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Get how long a message is to be held back.
+ * @param request The published message
+ * @param now Current wall-clock time in nanoseconds since the Unix epoch
+ * @return Nanoseconds until the message is due; 0 or less to store it now
+ */
+int64_t DeliveryDelay(const PublishRequest& request, int64_t now) {
+    if (request.deliver_at() > 0) {
+        return request.deliver_at() - now;
+    }
+    return static_cast<int64_t>(request.delay_ms()) * 1000000;
+}
+
+/**
+ * @brief Identify the publisher of a call for its quota.
+ *
+ * A client ID sent as metadata names the publisher, so that every process of
+ * a service can share one quota, or processes on one host can have their
+ * own. Otherwise the peer address is used without its port, so all the
+ * connections of a host share a quota.
+ *
+ * @param context The call's server context
+ * @return The publisher's quota key
+ */
+std::string PublisherOf(ServerContext* context) {
+    const auto& metadata = context->client_metadata();
+    auto it = metadata.find(kClientIdHeader);
+    if (it != metadata.end()) {
+        return std::string(it->second.data(), it->second.size());
+    }
+    std::string peer = context->peer();
+    if (peer.compare(0, 5, "ipv4:") == 0 || peer.compare(0, 5, "ipv6:") == 0) {
+        size_t port = peer.rfind(':');
+        if (port > 5) {
+            peer.resize(port);
+        }
+    }
+    return peer;
+}
+
+/**
+ * @brief Hash a string with 64-bit FNV-1a.
+ * @param value The string
+ * @return The hash
+ */
+uint64_t Fnv1a(const std::string& value) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : value) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Choose the partition of a message from its key.
+ *
+ * Uses 64-bit FNV-1a rather than std::hash so that the mapping is the same
+ * on every platform and clients can compute it themselves.
+ *
+ * @param key The message key
+ * @param num_partitions Number of partitions of the topic
+ * @return A partition index in [0, num_partitions)
+ */
+uint32_t PartitionOfKey(const std::string& key, size_t num_partitions) {
+    return static_cast<uint32_t>(Fnv1a(key) % num_partitions);
+}
+
+/**
+ * @brief Merge runs of deliveries that are each sorted by stamp into one sorted sequence.
+ *
+ * A min-heap holds the head of every run, so merging n deliveries from k
+ * runs takes O(n log k) comparisons of integers. Entries are swapped rather
+ * than copied; @p scratch keeps the displaced objects for reuse.
+ *
+ * @param entries The deliveries; the runs start at index @p first
+ * @param first Index of the first entry of the first run
+ * @param run_ends End index of each run, in increasing order
+ * @param scratch Buffer used for the merged sequence
+ */
+template <typename Entry>
+void MergeRuns(std::vector<Entry>* entries, size_t first, const std::vector<size_t>& run_ends,
+               std::vector<Entry>* scratch) {
+    using Head = std::pair<uint64_t, size_t>;  // Stamp of the run's next entry, run index
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    std::vector<size_t> next(run_ends.size());
+    for (size_t run = 0; run < run_ends.size(); run++) {
+        next[run] = run == 0 ? first : run_ends[run - 1];
+        if (next[run] < run_ends[run]) {
+            heads.emplace((*entries)[next[run]].stamp, run);
+        }
+    }
+    
+    scratch->resize(entries->size() - first);
+    for (size_t out = 0; !heads.empty(); out++) {
+        size_t run = heads.top().second;
+        heads.pop();
+        std::swap((*scratch)[out], (*entries)[next[run]]);
+        if (++next[run] < run_ends[run]) {
+            heads.emplace((*entries)[next[run]].stamp, run);
+        }
+    }
+    for (size_t i = 0; i < scratch->size(); i++) {
+        std::swap((*entries)[first + i], (*scratch)[i]);
+    }
+}
+
+// Messages a subscription collects per polling round, which bounds how long a partition's
+// lock is held and how much a round holds while a large backlog is replayed
+constexpr size_t kMaxRoundSize = 1024;
+
+// Messages copied out of a partition per lock acquisition while writing a snapshot
+constexpr size_t kSnapshotChunk = 256;
+
+// Topics checked per acquisition of the service lock while reclaiming idle topics
+constexpr size_t kSweepBatch = 256;
+
+}  // namespace
 
 /**
  * @brief Constructor for PubSubServiceImpl
- * @param max_messages_per_topic Maximum number of messages to store per topic
+ * @param max_messages_per_topic Maximum number of messages to store per topic partition
+ * @param partitions_per_topic Number of partitions of every topic (at least one)
+ */
+PubSubServiceImpl::PubSubServiceImpl(size_t max_messages_per_topic, size_t partitions_per_topic)
+    : max_messages_per_topic_(max_messages_per_topic),
+      partitions_per_topic_(std::max<size_t>(partitions_per_topic, 1)),
+      incarnation_rng_(std::random_device()()), next_stamp_(0), catch_up_chunk_(kMaxRoundSize), verbose_(false),
+      scheduled_(kScheduleTick, kScheduleSlots, kScheduleLevels), scheduler_stop_(false),
+      scheduled_count_(0), max_scheduled_(0), snapshot_stop_(false), sweeper_stop_(false) {
+    // Payloads pass through as raw bytes; the generated handlers would parse and re-encode them
+    MarkMethodStreamed(kPublishMethod, new grpc::internal::StreamedUnaryHandler<ByteBuffer, PublishResponse>(
+        [this](ServerContext* context, PublishStream* stream) { return PublishRaw(context, stream); }));
+    MarkMethodStreamed(kPublishBatchMethod,
+        new grpc::internal::StreamedUnaryHandler<ByteBuffer, PublishBatchResponse>(
+            [this](ServerContext* context, PublishBatchStream* stream) { return PublishBatchRaw(context, stream); }));
+    MarkMethodStreamed(kSubscribeMethod,
+        new grpc::internal::SplitServerStreamingHandler<SubscribeRequest, ByteBuffer>(
+            [this](ServerContext* context, FrameStream* stream) { return SubscribeRaw(context, stream); }));
+    MarkMethodStreamed(kSubscribeBatchedMethod,
+        new grpc::internal::SplitServerStreamingHandler<SubscribeRequest, ByteBuffer>(
+            [this](ServerContext* context, FrameStream* stream) { return SubscribeBatchedRaw(context, stream); }));
+    MarkMethodStreamed(kSubscribeAckMethod,
+        new grpc::internal::BidiStreamingHandler<PubSubServiceImpl, AckRequest, ByteBuffer>(
+            std::mem_fn(&PubSubServiceImpl::SubscribeAckRaw), this));
+}
+
+/**
+ * @brief Destructor that stops the topic sweeper, the scheduler and the snapshot thread, writing a final snapshot
+ *
+ * Messages still waiting for their delivery time are discarded.
+ */
+PubSubServiceImpl::~PubSubServiceImpl() {
+    StopTopicSweeper();
+    StopScheduler();
+    StopSnapshots();
+}
+
+/**
+ * @brief Enforce the publish quotas of the options; call before serving requests
+ * @param options The per-topic and per-publisher rate limits and their overrides, the
+ *                limit on messages waiting for their delivery time, the rate at which
+ *                subscriptions replay retained messages and the number of producers
+ *                whose retries are deduplicated
+ */
+void PubSubServiceImpl::SetRateLimits(const ServerOptions& options) {
+    max_scheduled_ = options.max_scheduled_messages;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        dedup_window_.SetMaxProducers(options.max_dedup_producers);
+    }
+    const RateLimit& catch_up = options.catch_up_rate_limit;
+    catch_up_bucket_.reset(catch_up.rate > 0 ? new TokenBucket(catch_up) : nullptr);
+    // A throttled round takes no more than a burst, so the bucket never goes into debt
+    double burst = catch_up.burst > 0 ? catch_up.burst : catch_up.rate / 10;
+    catch_up_chunk_ = catch_up.rate > 0
+        ? static_cast<size_t>(std::max(1.0, std::min(burst, static_cast<double>(kMaxRoundSize))))
+        : kMaxRoundSize;
+    topic_limiter_.reset(new RateLimiter(options.topic_rate_limit, options.topic_rate_limits));
+    if (!topic_limiter_->Enabled()) {
+        topic_limiter_.reset();
+    }
+    publisher_limiter_.reset(new RateLimiter(options.publisher_rate_limit, options.publisher_rate_limits));
+    if (!publisher_limiter_->Enabled()) {
+        publisher_limiter_.reset();
+    }
+}
+
+/**
+ * @brief Compact the topics the options name; call before restoring a snapshot or serving requests
+ *
+ * Only topics created afterwards are affected; a topic keeps its mode until it is reclaimed.
+ *
+ * @param options The names and name prefixes of the compacted topics
+ */
+void PubSubServiceImpl::SetCompactedTopics(const ServerOptions& options) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    compacted_topics_ = options.compacted_topics;
+    if (!compacted_topics_.empty()) {
+        std::cout << "Compacting topics:";
+        for (const auto& pattern : compacted_topics_) {
+            std::cout << " " << pattern;
+        }
+        std::cout << std::endl;
+    }
+}
+
+/**
+ * @brief Pin request threads to the NUMA node of the partition they serve; call before serving requests
+ * @param options The CPUs to use and whether to pin per NUMA node
+ */
+void PubSubServiceImpl::SetThreadPlacement(const ServerOptions& options) {
+    if (!options.numa_pinning) {
+        cpu_layout_.reset();
+        return;
+    }
+    cpu_layout_.reset(new pubsub::common::CpuLayout(options.cpus));
+    std::cout << "Pinning request threads to " << cpu_layout_->NodeCount() << " NUMA node(s) of "
+              << cpu_layout_->Cpus().size() << " CPU(s)" << std::endl;
+}
+
+/**
+ * @brief Log every message to stdout as it is stored if the options ask for it; call before serving requests
+ *
+ * Off by default: writing each payload to stdout and flushing it would
+ * cost more than storing the message, and would serialize the publishing
+ * threads on the stream.
+ *
+ * @param options Whether to log verbosely
+ */
+void PubSubServiceImpl::SetLogging(const ServerOptions& options) {
+    verbose_ = options.verbose;
+}
+
+/**
+ * @brief Move the calling thread onto the CPUs of a partition's NUMA node
+ *
+ * Every partition has a home node, chosen from its topic and index so that
+ * the partitions of one topic are spread over the nodes. A request thread is
+ * moved there before it touches the partition, so the partition's buffer is
+ * first allocated and then always appended to and read from on one node,
+ * and its cache lines stay in that node's caches. The node a thread was last
+ * pinned to is remembered, so a thread that keeps serving the same node pays
+ * for the system call once.
+ *
+ * @param topic The partition's topic
+ * @param index The partition's index
+ */
+void PubSubServiceImpl::PinToNodeOf(const std::string& topic, uint32_t index) {
+    if (!cpu_layout_) {
+        return;
+    }
+    thread_local const pubsub::common::CpuLayout* pinned_layout = nullptr;
+    thread_local size_t pinned_node = 0;
+    size_t node = (Fnv1a(topic) + index) % cpu_layout_->NodeCount();
+    if (pinned_layout == cpu_layout_.get() && pinned_node == node) {
+        return;
+    }
+    const std::vector<int>& cpus = cpu_layout_->NodeCpus(node);
+    if (!cpus.empty() && pubsub::common::pinCurrentThread(cpus)) {
+        pinned_layout = cpu_layout_.get();
+        pinned_node = node;
+    }
+}
+
+/**
+ * @brief Take the quota of a publish from its publisher and its topics
+ *
+ * The publisher is charged for every message first, then each topic for its
+ * share of the messages. If any bucket refuses, the tokens already taken are
+ * returned, so a rejected publish costs nobody quota. Nothing is locked but
+ * the limiters' bucket maps, and nothing at all when no limit is set.
+ * Before any of that, the delayed messages of the publish must fit under the
+ * limit on scheduled messages; the check reads the count without a lock, so
+ * concurrent publishes may overshoot it slightly.
+ *
+ * @param context The gRPC server context; null skips the publisher's quota
+ * @param requests The messages of the publish
+ * @param count Number of messages
+ * @param retry_after Receives the nanoseconds until the publish would be admitted, or 0
+ * @return Status::OK if admitted, RESOURCE_EXHAUSTED if a quota is exhausted
+ */
+Status PubSubServiceImpl::Admit(ServerContext* context, const PublishRequest* const* requests, size_t count,
+                                int64_t* retry_after) {
+    *retry_after = 0;
+    if (max_scheduled_ > 0) {
+        int64_t wall_now = pubsub::common::getCurrentTimestamp();
+        size_t delayed = 0;
+        for (size_t i = 0; i < count; i++) {
+            delayed += DeliveryDelay(*requests[i], wall_now) > 0 ? 1 : 0;
+        }
+        if (delayed > 0 && scheduled_count_.load(std::memory_order_relaxed) + delayed > max_scheduled_) {
+            *retry_after = kScheduleFullRetryAfter;
+            return Status(grpc::StatusCode::RESOURCE_EXHAUSTED,
+                          "Limit of " + std::to_string(max_scheduled_) + " scheduled messages reached");
+        }
+    }
+    if ((!topic_limiter_ && !publisher_limiter_) || count == 0) {
+        return Status::OK;
+    }
+    int64_t now = pubsub::common::steadyNanos();
+    
+    std::shared_ptr<TokenBucket> publisher_bucket;
+    if (publisher_limiter_ && context) {
+        std::string publisher = PublisherOf(context);
+        publisher_bucket = publisher_limiter_->BucketFor(publisher);
+        if (publisher_bucket) {
+            *retry_after = publisher_bucket->TryAcquire(count, now);
+            if (*retry_after > 0) {
+                return Status(grpc::StatusCode::RESOURCE_EXHAUSTED,
+                              "Publish rate limit of client " + publisher + " exceeded");
+            }
+        }
+    }
+    if (!topic_limiter_) {
+        return Status::OK;
+    }
+    
+    // Charge each topic once for all of its messages
+    std::vector<const std::string*> topics(count);
+    for (size_t i = 0; i < count; i++) {
+        topics[i] = &requests[i]->topic();
+    }
+    std::sort(topics.begin(), topics.end(),
+              [](const std::string* a, const std::string* b) { return *a < *b; });
+    std::vector<std::pair<std::shared_ptr<TokenBucket>, uint64_t>> charged;
+    for (size_t first = 0, last; first < count; first = last) {
+        last = first + 1;
+        while (last < count && *topics[last] == *topics[first]) {
+            last++;
+        }
+        std::shared_ptr<TokenBucket> bucket = topic_limiter_->BucketFor(*topics[first]);
+        if (!bucket) {
+            continue;
+        }
+        *retry_after = bucket->TryAcquire(last - first, now);
+        if (*retry_after > 0) {
+            for (auto& entry : charged) {
+                entry.first->Release(entry.second);
+            }
+            if (publisher_bucket) {
+                publisher_bucket->Release(count);
+            }
+            return Status(grpc::StatusCode::RESOURCE_EXHAUSTED,
+                          "Publish rate limit of topic " + *topics[first] + " exceeded");
+        }
+        charged.emplace_back(std::move(bucket), last - first);
+    }
+    return Status::OK;
+}
+
+/**
+ * @brief Publishes a message to a specified topic from within the process
+ *
+ * The content is copied into a frame and the message stored as PublishFrame
+ * stores the publishes that PublishRaw reads off the wire.
+ *
+ * @param context The gRPC server context, or null for a publish without a publisher quota
+ * @param request The publish request containing topic and content
+ * @param response The response to be sent back to the client
+ * @return Status::OK if successful, RESOURCE_EXHAUSTED if a rate limit is exceeded
+ */
+Status PubSubServiceImpl::Publish(ServerContext* context, const PublishRequest* request,
+              PublishResponse* response) {
+    PendingFrame frame;
+    frame.Assign(*request);
+    return PublishFrame(context, *request, &frame, response);
+}
+
+/**
+ * @brief Serves a Publish call from the raw bytes of its request
+ *
+ * Only the envelope of the request is parsed; the content is copied once,
+ * straight into the frame the message will be stored as.
+ *
+ * @param context The gRPC server context
+ * @param stream Carries the request in and the response out
+ * @return The status of the publish, INVALID_ARGUMENT if the request is malformed
+ */
+Status PubSubServiceImpl::PublishRaw(ServerContext* context, PublishStream* stream) {
+    ByteBuffer buffer;
+    if (!stream->Read(&buffer)) {
+        return Status(grpc::StatusCode::CANCELLED, "Publish request was not received");
+    }
+    PublishRequest envelope;
+    PendingFrame frame;
+    if (!ScanPublish(&buffer, &envelope, &frame)) {
+        return Status(grpc::StatusCode::INVALID_ARGUMENT, "Malformed publish request");
+    }
+    buffer.Clear();
+    
+    PublishResponse response;
+    Status status = PublishFrame(context, envelope, &frame, &response);
+    if (status.ok()) {
+        stream->Write(response);
+    }
+    return status;
+}
+
+/**
+ * @brief Publishes a message whose content is already in its frame
+ * 
+ * It generates a unique ID for each message, finishes the frame into the
+ * message buffer of the partition selected by the message key, and makes it
+ * available for subscribers. Only the duplicate check and partition lookup
+ * take the service lock; the append holds just the partition's lock.
+ * A message whose producer ID and sequence number were already seen is a
+ * retry and is acknowledged without being stored again. A message over its
+ * topic's or its publisher's quota is rejected before either lock is taken,
+ * with a retry-after-ms trailer telling the client when to try again.
+ * A message with a delivery time or delay still in the future is given its
+ * ID and handed to the scheduler, frame and all, instead of being stored.
+ * 
+ * @param context The gRPC server context, or null for a publish without a publisher quota
+ * @param request The published message; its content is ignored
+ * @param frame The frame holding the content
+ * @param response The response to be sent back to the client
+ * @return Status::OK if successful, RESOURCE_EXHAUSTED if a rate limit is exceeded
+ */
+Status PubSubServiceImpl::PublishFrame(ServerContext* context, const PublishRequest& request, PendingFrame* frame,
+                                       PublishResponse* response) {
+    const std::string& topic = request.topic();
+    
+    int64_t retry_after;
+    const PublishRequest* requests = &request;
+    Status admitted = Admit(context, &requests, 1, &retry_after);
+    if (!admitted.ok()) {
+        if (context) {
+            context->AddTrailingMetadata(kRetryAfterHeader, std::to_string((retry_after + 999999) / 1000000));
+        }
+        return admitted;
+    }
+    
+    PinToNodeOf(topic, PartitionOfKey(request.key(), partitions_per_topic_));
+    
+    // Drop retries of messages that were already stored; the ID is generated directly into the response
+    int64_t now = pubsub::common::getCurrentTimestamp();
+    int64_t delay = DeliveryDelay(request, now);
+    std::shared_ptr<Partition> partition;
+    bool duplicate;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        duplicate = !dedup_window_.Accept(request.producer_id(), request.sequence(), now);
+        if (!duplicate && delay <= 0) {
+            partition = PartitionForLocked(topic, request.key());
+        }
+    }
+    
+    if (duplicate) {
+        std::cout << "Dropped duplicate message from producer " << request.producer_id()
+                  << " (sequence " << request.sequence() << ") to topic: " << topic << std::endl;
+    } else if (partition) {
+        size_t partition_size;
+        {
+            std::lock_guard<std::mutex> lock(partition->mutex);
+            partition_size = AddMessageToPartitionLocked(partition.get(), request.key(), frame,
+                                                         response->mutable_message_id());
+        }
+        if (verbose_) {
+            std::cout << "Published message: ";
+            std::cout.write(frame->Content(), frame->ContentSize());
+            std::cout << " to topic: " << topic 
+                      << " with ID: " << response->message_id() 
+                      << " (Total messages in partition " << partition->index << ": "
+                      << partition_size << ")" << std::endl;
+        }
+    } else {
+        pubsub::common::generateMessageId(response->mutable_message_id());
+        if (verbose_) {
+            // Logged before the scheduler owns the frame, since it may store and release it at once
+            std::cout << "Scheduled message: ";
+            std::cout.write(frame->Content(), frame->ContentSize());
+            std::cout << " to topic: " << topic
+                      << " with ID: " << response->message_id()
+                      << " for delivery in " << (delay + 999999) / 1000000 << " ms" << std::endl;
+        }
+        std::vector<std::unique_ptr<ScheduledMessage>> scheduled(1);
+        scheduled[0].reset(new ScheduledMessage(request, std::move(*frame), response->message_id(),
+                                                TimerWheel::Clock::now() + std::chrono::nanoseconds(delay)));
+        ScheduleMessages(&scheduled);
+    }
+    
+    // Set the response
+    response->set_success(true);
+    response->set_duplicate(duplicate);
+    
+    return Status::OK;
+}
+
+/**
+ * @brief Publishes a batch of messages from within the process
+ *
+ * Each content is copied into a frame and the batch stored as PublishFrames
+ * stores the batches that PublishBatchRaw reads off the wire.
+ *
+ * @param context The gRPC server context, or null for a publish without a publisher quota
+ * @param request The batch of publish requests
+ * @param response The response carrying one message ID per request
+ * @return Status::OK if successful, RESOURCE_EXHAUSTED if a rate limit is exceeded
+ */
+Status PubSubServiceImpl::PublishBatch(ServerContext* context, const PublishBatchRequest* request,
+                                       PublishBatchResponse* response) {
+    std::vector<PendingFrame> frames(request->messages_size());
+    for (int i = 0; i < request->messages_size(); i++) {
+        frames[i].Assign(request->messages(i));
+    }
+    return PublishFrames(context, *request, &frames, response);
+}
+
+/**
+ * @brief Serves a PublishBatch call from the raw bytes of its request
+ * @param context The gRPC server context
+ * @param stream Carries the request in and the response out
+ * @return The status of the publish, INVALID_ARGUMENT if the request is malformed
+ */
+Status PubSubServiceImpl::PublishBatchRaw(ServerContext* context, PublishBatchStream* stream) {
+    ByteBuffer buffer;
+    if (!stream->Read(&buffer)) {
+        return Status(grpc::StatusCode::CANCELLED, "Publish request was not received");
+    }
+    PublishBatchRequest envelopes;
+    std::vector<PendingFrame> frames;
+    if (!ScanPublishBatch(&buffer, &envelopes, &frames)) {
+        return Status(grpc::StatusCode::INVALID_ARGUMENT, "Malformed publish request");
+    }
+    buffer.Clear();
+    
+    PublishBatchResponse response;
+    Status status = PublishFrames(context, envelopes, &frames, &response);
+    if (status.ok()) {
+        stream->Write(response);
+    }
+    return status;
+}
+
+/**
+ * @brief Publishes a batch of messages whose contents are already in their frames
+ *
+ * The duplicate checks and partition lookups of the whole batch happen under
+ * a single acquisition of the service lock; the messages are then appended
+ * to their partitions in request order. Duplicates are skipped individually.
+ * This is the RPC used by client-side batching in AsyncPublisher. Quotas
+ * are charged for the whole batch at once: if any of its topics or its
+ * publisher is over quota, no message is stored.
+ *
+ * @param context The gRPC server context, or null for a publish without a publisher quota
+ * @param request The batch of publish requests; their contents are ignored
+ * @param frames The frames holding the contents, parallel to the requests
+ * @param response The response carrying one message ID per request
+ * @return Status::OK if successful, RESOURCE_EXHAUSTED if a rate limit is exceeded
+ */
+Status PubSubServiceImpl::PublishFrames(ServerContext* context, const PublishBatchRequest& request,
+                                        std::vector<PendingFrame>* frames, PublishBatchResponse* response) {
+    int64_t retry_after;
+    Status admitted = Admit(context, request.messages().data(), request.messages_size(), &retry_after);
+    if (!admitted.ok()) {
+        if (context) {
+            context->AddTrailingMetadata(kRetryAfterHeader, std::to_string((retry_after + 999999) / 1000000));
+        }
+        return admitted;
+    }
+    if (request.messages_size() > 0) {
+        const PublishRequest& first = request.messages(0);
+        PinToNodeOf(first.topic(), PartitionOfKey(first.key(), partitions_per_topic_));
+    }
+    StoreBatch(request, frames, response);
+    
+    if (verbose_) {
+        std::cout << "Published batch of " << request.messages_size() << " messages" << std::endl;
+    }
+    
+    response->set_success(true);
+    return Status::OK;
+}
+
+/**
+ * @brief Store the admitted messages of a batch
+ *
+ * Messages with a delivery time or delay still in the future are given their
+ * IDs and handed to the scheduler together, after the others are stored.
+ *
+ * @param request The batch of publish requests
+ * @param frames The frames holding the contents, parallel to the requests; stored frames are finished
+ *               and scheduled ones moved out
+ * @param response Receives one message ID and duplicate flag per request
+ */
+void PubSubServiceImpl::StoreBatch(const PublishBatchRequest& request, std::vector<PendingFrame>* frames,
+                                   PublishBatchResponse* response) {
+    int64_t now = pubsub::common::getCurrentTimestamp();
+    std::vector<std::shared_ptr<Partition>> partitions(request.messages_size());
+    std::vector<int64_t> delays(request.messages_size(), 0);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int i = 0; i < request.messages_size(); i++) {
+            const PublishRequest& msg = request.messages(i);
+            bool duplicate = !dedup_window_.Accept(msg.producer_id(), msg.sequence(), now);
+            if (!duplicate) {
+                delays[i] = std::max<int64_t>(DeliveryDelay(msg, now), 0);
+                if (delays[i] == 0) {
+                    partitions[i] = PartitionForLocked(msg.topic(), msg.key());
+                }
+            }
+            response->add_duplicates(duplicate);
+        }
+    }
+    std::vector<std::unique_ptr<ScheduledMessage>> scheduled;
+    TimerWheel::Clock::time_point steady_now = TimerWheel::Clock::now();
+    for (int i = 0; i < request.messages_size(); i++) {
+        std::string* message_id = response->add_message_ids();
+        if (partitions[i]) {
+            std::lock_guard<std::mutex> lock(partitions[i]->mutex);
+            AddMessageToPartitionLocked(partitions[i].get(), request.messages(i).key(), &(*frames)[i], message_id);
+        } else if (delays[i] > 0) {
+            pubsub::common::generateMessageId(message_id);
+            scheduled.emplace_back(new ScheduledMessage(request.messages(i), std::move((*frames)[i]), *message_id,
+                                                        steady_now + std::chrono::nanoseconds(delays[i])));
+        }
+    }
+    if (!scheduled.empty()) {
+        ScheduleMessages(&scheduled);
+    }
+}
+
+/**
+ * @brief Constructs a scheduled message, packing its fields into one string
+ * @param request The published message
+ * @param frame The frame holding the content
+ * @param message_id The ID given to the message
+ * @param due When the message falls due
+ */
+PubSubServiceImpl::ScheduledMessage::ScheduledMessage(const PublishRequest& request, PendingFrame frame,
+                                                      const std::string& message_id,
+                                                      TimerWheel::Clock::time_point due)
+    : due(due), topic_size(static_cast<uint32_t>(request.topic().size())),
+      key_size(static_cast<uint32_t>(request.key().size())), frame(std::move(frame)) {
+    fields.reserve(topic_size + key_size + message_id.size());
+    fields.append(request.topic()).append(request.key()).append(message_id);
+}
+
+/**
+ * @brief Copy a scheduled message's fields out into reusable storage
+ * @param topic Receives the topic
+ * @param key Receives the key
+ * @param message_id Receives the message ID
+ */
+void PubSubServiceImpl::ScheduledMessage::Unpack(std::string* topic, std::string* key,
+                                                 std::string* message_id) const {
+    const char* data = fields.data();
+    topic->assign(data, topic_size);
+    key->assign(data + topic_size, key_size);
+    message_id->assign(data + topic_size + key_size, fields.size() - topic_size - key_size);
+}
+
+/**
+ * @brief Hold accepted messages until they are due
+ *
+ * The messages are linked into the timing wheel under its lock, which is
+ * separate from the service lock, and the scheduler thread is started on the
+ * first call. The wheel's deadlines are steady-clock times, so a delivery
+ * time is kept relative to when the message was accepted even if the wall
+ * clock is changed afterwards.
+ *
+ * @param messages The messages, each with its due time set; ownership passes to the wheel
+ */
+void PubSubServiceImpl::ScheduleMessages(std::vector<std::unique_ptr<ScheduledMessage>>* messages) {
+    bool was_empty;
+    {
+        std::lock_guard<std::mutex> lock(schedule_mutex_);
+        if (!scheduler_thread_.joinable()) {
+            scheduler_thread_ = std::thread(&PubSubServiceImpl::RunScheduler, this);
+        }
+        was_empty = scheduled_.Size() == 0;
+        for (auto& message : *messages) {
+            scheduled_.ScheduleAt(message.get(), message->due);
+            message.release();
+        }
+        scheduled_count_.fetch_add(messages->size(), std::memory_order_relaxed);
+    }
+    messages->clear();
+    if (was_empty) {
+        schedule_cv_.notify_all();
+    }
+}
+
+/**
+ * @brief Release scheduled messages into their topics as they fall due
+ *
+ * The thread sleeps while nothing is scheduled, and otherwise wakes once per
+ * tick of the wheel. Due messages are unlinked under the wheel's lock and
+ * stored after it is released, so publishes can keep scheduling meanwhile.
+ */
+void PubSubServiceImpl::RunScheduler() {
+    std::vector<ScheduledMessage*> due;
+    auto collect = [&due](TimerWheel::Timer* timer) { due.push_back(static_cast<ScheduledMessage*>(timer)); };
+    std::unique_lock<std::mutex> lock(schedule_mutex_);
+    while (!scheduler_stop_) {
+        if (scheduled_.Size() == 0) {
+            schedule_cv_.wait(lock);
+            continue;
+        }
+        schedule_cv_.wait_for(lock, scheduled_.Tick());
+        scheduled_.Advance(TimerWheel::Clock::now(), collect);
+        if (due.empty()) {
+            continue;
+        }
+        lock.unlock();
+        ReleaseScheduled(due);
+        for (ScheduledMessage* message : due) {
+            delete message;
+        }
+        scheduled_count_.fetch_sub(due.size(), std::memory_order_relaxed);
+        due.clear();
+        lock.lock();
+    }
+}
+
+/**
+ * @brief Store messages that have fallen due
+ *
+ * The messages are stored in the order they fell due, a chunk at a time, so
+ * the service lock is never held for long however many are released at once.
+ * The dedup window already accepted them when they were published.
+ *
+ * @param messages The due messages, in the order to store them
+ */
+void PubSubServiceImpl::ReleaseScheduled(const std::vector<ScheduledMessage*>& messages) {
+    std::vector<std::shared_ptr<Partition>> partitions;
+    std::string topic;
+    std::string key;
+    std::string message_id;
+    for (size_t first = 0; first < messages.size(); first += kReleaseChunk) {
+        size_t last = std::min(messages.size(), first + kReleaseChunk);
+        partitions.clear();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (size_t i = first; i < last; i++) {
+                messages[i]->Unpack(&topic, &key, &message_id);
+                partitions.push_back(PartitionForLocked(topic, key));
+            }
+        }
+        for (size_t i = first; i < last; i++) {
+            messages[i]->Unpack(&topic, &key, &message_id);
+            Partition* partition = partitions[i - first].get();
+            std::lock_guard<std::mutex> lock(partition->mutex);
+            AddMessageToPartitionLocked(partition, key, &messages[i]->frame, &message_id);
+        }
+    }
+    if (verbose_) {
+        std::cout << "Delivered " << messages.size() << " scheduled message(s)" << std::endl;
+    }
+}
+
+/**
+ * @brief Stop the scheduler thread and discard the messages it still holds
+ */
+void PubSubServiceImpl::StopScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(schedule_mutex_);
+        scheduler_stop_ = true;
+    }
+    schedule_cv_.notify_all();
+    if (scheduler_thread_.joinable()) {
+        scheduler_thread_.join();
+    }
+    std::lock_guard<std::mutex> lock(schedule_mutex_);
+    scheduled_.Drain([](TimerWheel::Timer* timer) { delete static_cast<ScheduledMessage*>(timer); });
+    scheduled_count_.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Subscribes to a topic and streams messages to the client
+ *
+ * This method implements a streaming RPC that sends messages to subscribers,
+ * one stream frame per message, until the client disconnects. Each frame is
+ * the message's stored serialization, written by reference. Messages are
+ * not logged individually; a flushed log line per message cost as much as
+ * the write itself. Clients that receive bursts should use SubscribeBatched,
+ * which coalesces a burst into few frames.
+ *
+ * @param context The gRPC server context
+ * @param stream Carries the subscribe request in and the serialized messages out
+ * @return Status::OK when the client disconnects
+ */
+Status PubSubServiceImpl::SubscribeRaw(ServerContext* context, FrameStream* stream) {
+    SubscribeRequest request;
+    if (!stream->Read(&request)) {
+        return Status::OK;
+    }
+    
+    // Writes carry no buffer hint: a synchronous Write only returns once its
+    // bytes have been handed to the transport, and a hinted write is held back
+    // until a later write flushes it, so hinting here would block the stream.
+    PollSubscription(context, &request, [stream](std::vector<Delivery>* messages, std::chrono::milliseconds*) {
+        for (const auto& msg : *messages) {
+            if (!stream->Write(ByteBuffer(&msg.frame, 1))) {
+                return false;
+            }
+        }
+        return true;
+    });
+    
+    std::cout << "Subscriber disconnected from topics." << std::endl;
+    return Status::OK;
+}
+
+/**
+ * @brief Subscribes to topics and streams messages to the client in batches
+ *
+ * Delivers the same messages as Subscribe, packed into MessageBatch frames of
+ * up to max_batch_size messages, which saves the framing, flush and syscall
+ * of a write per message. A batch is assembled from the stored frames by
+ * reference, with a few bytes of framing per message. A full batch is
+ * written at once. A partially filled batch waits up to max_linger_ms for
+ * more messages before it is written.
+ *
+ * @param context The gRPC server context
+ * @param stream Carries the subscribe request in and the serialized batches out
+ * @return Status::OK when the client disconnects
+ */
+Status PubSubServiceImpl::SubscribeBatchedRaw(ServerContext* context, FrameStream* stream) {
+    SubscribeRequest request;
+    if (!stream->Read(&request)) {
+        return Status::OK;
+    }
+    const size_t max_batch_size = request.max_batch_size() > 0
+        ? request.max_batch_size() : std::numeric_limits<size_t>::max();
+    const std::chrono::milliseconds max_linger(request.max_linger_ms());
+    
+    // Cleared slice vectors keep their capacity, so refilling one does not allocate
+    std::vector<grpc::Slice> batch;
+    size_t batch_size = 0;
+    std::chrono::steady_clock::time_point batch_started;
+    auto flush = [&]() {
+        ByteBuffer buffer(batch.data(), batch.size());
+        batch.clear();
+        batch_size = 0;
+        return stream->Write(buffer);
+    };
+    
+    PollSubscription(context, &request, [&](std::vector<Delivery>* messages, std::chrono::milliseconds* next_poll) {
+        for (const auto& msg : *messages) {
+            if (batch_size == 0) {
+                batch_started = std::chrono::steady_clock::now();
+            }
+            AppendBatchEntry(msg.frame, 0, &batch);
+            if (++batch_size >= max_batch_size && !flush()) {
+                return false;
+            }
+        }
+        
+        if (batch_size > 0) {
+            auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - batch_started);
+            if (waited >= max_linger) {
+                if (!flush()) {
+                    return false;
+                }
+            } else {
+                *next_poll = std::min(*next_poll, max_linger - waited);
+            }
+        }
+        return true;
+    });
+    
+    std::cout << "Batched subscriber disconnected from topics." << std::endl;
+    return Status::OK;
+}
+
+/**
+ * @brief Subscribes to topics with acknowledgements and redelivers what is not acknowledged
+ *
+ * The first request of the stream carries the subscription; every later
+ * request carries acknowledgements, read on a separate thread so acks keep
+ * flowing while a write is blocked on flow control. Each delivered message
+ * gets a redelivery timer in an AckTracker. A message that is not
+ * acknowledged within ack_timeout_ms is sent again with its
+ * delivery_attempt incremented, for as long as the topic still retains it.
+ * The attempt is appended to the stored frame as an extra field, so
+ * redeliveries are not encoded again either.
+ * New messages are only delivered while fewer than max_unacked messages are
+ * outstanding, so a stalled subscriber does not accumulate timers without
+ * bound.
+ *
+ * @param context The gRPC server context
+ * @param stream Carries the subscription and acks in, and serialized message batches out
+ * @return Status::OK when the client disconnects
  */
-PubSubServiceImpl::PubSubServiceImpl(size_t max_messages_per_topic)
-    : max_messages_per_topic_(max_messages_per_topic) {}
+Status PubSubServiceImpl::SubscribeAckRaw(ServerContext* context, AckStream* stream) {
+    AckRequest first;
+    if (!stream->Read(&first)) {
+        return Status::OK;
+    }
+    const SubscribeRequest& request = first.subscribe();
+    const std::chrono::milliseconds ack_timeout(request.ack_timeout_ms() > 0 ? request.ack_timeout_ms() : 30000);
+    const size_t max_unacked = request.max_unacked() > 0 ? request.max_unacked() : 10000;
+    const size_t max_batch_size = request.max_batch_size() > 0
+        ? request.max_batch_size() : std::numeric_limits<size_t>::max();
+    
+    Subscription subscription;
+    OpenSubscription(&request, &subscription);
+    std::map<std::pair<std::string, uint32_t>, size_t> partition_index;
+    for (size_t i = 0; i < subscription.partitions.size(); i++) {
+        Partition* partition = subscription.partitions[i].get();
+        partition_index[std::make_pair(partition->topic, partition->index)] = i;
+    }
+    
+    // The tracker is shared with the ack reader; it is never locked together with another mutex
+    std::mutex ack_mutex;
+    AckTracker tracker(subscription.partitions.size(), ack_timeout);
+    auto apply_acks = [&](const AckRequest& acks) {
+        std::lock_guard<std::mutex> lock(ack_mutex);
+        for (const auto& ack : acks.acks()) {
+            auto it = partition_index.find(std::make_pair(ack.topic(), ack.partition()));
+            if (it == partition_index.end()) {
+                continue;
+            }
+            tracker.AckBelow(it->second, ack.cumulative());
+            for (uint64_t sequence : ack.sequences()) {
+                tracker.Ack(it->second, sequence);
+            }
+        }
+    };
+    apply_acks(first);
+    
+    std::atomic<bool> reader_done(false);
+    std::thread ack_reader([&] {
+        AckRequest acks;
+        while (stream->Read(&acks)) {
+            apply_acks(acks);
+        }
+        reader_done = true;
+    });
+    
+    const std::chrono::milliseconds poll_interval = std::min(std::chrono::milliseconds(100), tracker.Tick());
+    std::vector<AckTracker::Expired> expired;
+    std::vector<Delivery> messages;
+    std::vector<grpc::Slice> batch;
+    bool broken = false;
+    while (!context->IsCancelled() && !reader_done && !broken) {
+        expired.clear();
+        messages.clear();
+        size_t budget;
+        {
+            std::lock_guard<std::mutex> lock(ack_mutex);
+            tracker.Expire(std::chrono::steady_clock::now(), &expired);
+            budget = tracker.Unacked() < max_unacked ? max_unacked - tracker.Unacked() : 0;
+        }
+        
+        // Redeliveries come first; messages evicted in the meantime cannot be sent again
+        size_t lost = 0;
+        for (auto& e : expired) {
+            Partition* partition = subscription.partitions[e.topic].get();
+            std::lock_guard<std::mutex> lock(partition->mutex);
+            const grpc::Slice* frame = partition->buffer.Get(e.sequence);
+            if (frame) {
+                messages.push_back(Delivery{0, e.sequence, e.topic, e.attempt, *frame});
+            } else {
+                expired[lost++] = e;
+            }
+        }
+        if (lost > 0) {
+            std::lock_guard<std::mutex> lock(ack_mutex);
+            for (size_t i = 0; i < lost; i++) {
+                tracker.Ack(expired[i].topic, expired[i].sequence);
+            }
+            std::cerr << "Dropped " << lost << " unacknowledged messages that are no longer retained" << std::endl;
+        }
+        
+        size_t redelivered = messages.size();
+        std::chrono::milliseconds next_poll = CollectRound(&subscription, budget, poll_interval, &messages);
+        if (messages.size() > redelivered) {
+            // Tracked before the write so that an ack can never arrive first
+            std::lock_guard<std::mutex> lock(ack_mutex);
+            for (size_t i = redelivered; i < messages.size(); i++) {
+                messages[i].attempt = 1;
+                tracker.Delivered(messages[i].source, messages[i].sequence);
+            }
+        }
+        
+        for (size_t i = 0; i < messages.size() && !broken; i++) {
+            AppendBatchEntry(messages[i].frame, messages[i].attempt, &batch);
+            if (i + 1 == messages.size() || (i + 1) % max_batch_size == 0) {
+                broken = !stream->Write(ByteBuffer(batch.data(), batch.size()));
+                batch.clear();
+            }
+        }
+        
+        std::this_thread::sleep_for(next_poll);
+    }
+    
+    // Unblock the ack reader if the client is still connected
+    context->TryCancel();
+    ack_reader.join();
+    
+    std::cout << "Acknowledging subscriber disconnected from topics." << std::endl;
+    return Status::OK;
+}
 
 /**
- * @brief Publishes a message to a specified topic
- * 
- * This method handles client requests to publish messages to a topic.
- * It generates a unique ID for each message, stores it in the server's
- * memory, and makes it available for subscribers.
- * 
+ * @brief Receive publishes from a same-host producer through its shared-memory ring
+ *
+ * The producer creates the ring and this call maps it. Each serialized
+ * PublishRequest the producer writes is read here without any HTTP/2
+ * framing, its content copied straight into a frame; records are drained in
+ * groups of up to 256 and stored like a PublishBatch, so dedup, partitioning and quotas work as for RPCs. A
+ * group over quota is held until its tokens are available rather than
+ * rejected, which pushes back on the producer through the full ring. Each
+ * stored group is confirmed on the stream with one result per record, so
+ * the producer completes a message only once it is stored. After the
+ * producer cancels the call the ring is drained once more, without waiting
+ * for quota, so nothing it handed over before detaching is lost.
+ *
  * @param context The gRPC server context
- * @param request The publish request containing topic and content
- * @param response The response to be sent back to the client
- * @return Status::OK if successful
+ * @param request The ring's name and token
+ * @param writer Confirms the attachment, then the records read from the ring; the call stays open
+ *               while the ring is used
+ * @return Status::OK when the producer detaches, FAILED_PRECONDITION if the ring cannot be opened,
+ *         DATA_LOSS if it was found corrupt
  */
-Status PubSubServiceImpl::Publish(ServerContext* context, const PublishRequest* request,
-              PublishResponse* response) {
-    std::string topic = request->topic();
-    std::string content = request->content();
-    
-    // Generate a unique message ID
-    std::string message_id = pubsub::common::generateMessageId();
-    
-    // Create a new message
-    Message msg;
-    msg.set_message_id(message_id);
-    msg.set_topic(topic);
-    msg.set_content(content);
-    msg.set_timestamp(pubsub::common::getCurrentTimestamp());
+Status PubSubServiceImpl::PublishSharedMemory(ServerContext* context, const SharedMemoryAttach* request,
+                                              ServerWriter<SharedMemoryStatus>* writer) {
+    std::unique_ptr<pubsub::common::ShmRing> ring =
+        pubsub::common::ShmRing::Open(request->segment(), request->token());
+    if (!ring) {
+        return Status(grpc::StatusCode::FAILED_PRECONDITION, "Shared memory segment is not accessible");
+    }
+    SharedMemoryStatus status;
+    status.set_attached(true);
+    if (!writer->Write(status)) {
+        return Status::OK;
+    }
+    std::cout << "Shared memory publisher attached: " << request->segment() << std::endl;
     
-    // Store the message using our helper function
-    AddMessageToTopic(topic, msg);
+    const int max_batch = 256;
+    PublishBatchRequest batch;
+    PublishBatchResponse response;
+    std::vector<PendingFrame> frames(max_batch);
+    std::string record;
+    unsigned idle = 0;
+    using ReadResult = pubsub::common::ShmRing::ReadResult;
+    while (!ring->Corrupt()) {
+        batch.Clear();
+        status.Clear();
+        while (batch.messages_size() < max_batch && ring->TryRead(&record) == ReadResult::kRecord) {
+            PendingFrame* frame = &frames[batch.messages_size()];
+            PublishResponse* result = status.add_results();
+            if (!ScanPublish(record.data(), record.size(), batch.add_messages(), frame)) {
+                std::cerr << "Dropped malformed record from " << request->segment() << std::endl;
+                batch.mutable_messages()->RemoveLast();
+                continue;
+            }
+            result->set_success(true);
+        }
+        if (batch.messages_size() > 0) {
+            // Over quota, leave the rest of the ring unread so the producer's writes back up
+            int64_t retry_after;
+            while (!Admit(context, batch.messages().data(), batch.messages_size(), &retry_after).ok() &&
+                   !context->IsCancelled()) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(
+                    std::min<int64_t>(retry_after, 100000000)));
+            }
+            const PublishRequest& first = batch.messages(0);
+            PinToNodeOf(first.topic(), PartitionOfKey(first.key(), partitions_per_topic_));
+            response.Clear();
+            StoreBatch(batch, &frames, &response);
+            int stored = 0;
+            for (PublishResponse& result : *status.mutable_results()) {
+                if (result.success()) {
+                    result.set_message_id(response.message_ids(stored));
+                    result.set_duplicate(response.duplicates(stored));
+                    stored++;
+                }
+            }
+        }
+        if (status.results_size() > 0) {
+            // Fails only once the producer is gone, which ends the loop below
+            writer->Write(status);
+            idle = 0;
+            continue;
+        }
+        if (context->IsCancelled() && ring->Empty()) {
+            break;
+        }
+        pubsub::common::ShmRing::Pause(&idle);
+    }
     
-    std::cout << "Published message: " << content 
-              << " to topic: " << topic 
-              << " with ID: " << message_id 
-              << " (Total messages in topic: " << GetMessageCount(topic) << ")" << std::endl;
+    std::cout << "Shared memory publisher detached: " << request->segment() << std::endl;
+    if (ring->Corrupt()) {
+        // The producer falls back to gRPC when the call ends
+        return Status(grpc::StatusCode::DATA_LOSS, "Shared memory ring is corrupt");
+    }
+    return Status::OK;
+}
+
+/**
+ * @brief Deliver a subscription to a same-host subscriber through its shared-memory ring
+ *
+ * Runs the same polling loop as Subscribe, but copies each message's
+ * stored frame into the subscriber's ring instead of a gRPC stream.
+ * When the ring is full the loop waits for the subscriber to catch up. A
+ * message too large for the ring ends the attachment right before it, so
+ * the subscriber, having read everything up to it, resubscribes over gRPC
+ * from its cursor instead of losing the message.
+ *
+ * @param context The gRPC server context
+ * @param request The ring's name and token, and the subscription
+ * @param writer Confirms the attachment; the call stays open while the ring is used
+ * @return Status::OK when the subscriber detaches, FAILED_PRECONDITION if the ring cannot be opened
+ *         or a message does not fit it, DATA_LOSS if it was found corrupt
+ */
+Status PubSubServiceImpl::SubscribeSharedMemory(ServerContext* context, const SharedMemoryAttach* request,
+                                                ServerWriter<SharedMemoryStatus>* writer) {
+    std::unique_ptr<pubsub::common::ShmRing> ring =
+        pubsub::common::ShmRing::Open(request->segment(), request->token());
+    if (!ring) {
+        return Status(grpc::StatusCode::FAILED_PRECONDITION, "Shared memory segment is not accessible");
+    }
+    SharedMemoryStatus status;
+    status.set_attached(true);
+    if (!writer->Write(status)) {
+        return Status::OK;
+    }
     
-    // Set the response
-    response->set_success(true);
-    response->set_message_id(message_id);
+    std::string oversized;  // Why the attachment ended early, if a message did not fit
+    PollSubscription(context, &request->subscribe(), [&](std::vector<Delivery>* messages, std::chrono::milliseconds*) {
+        for (const auto& msg : *messages) {
+            if (msg.frame.size() > ring->MaxRecordSize()) {
+                oversized = "Message of " + std::to_string(msg.frame.size()) + " bytes does not fit the " +
+                            std::to_string(ring->MaxRecordSize()) + "-byte records of the shared memory ring";
+                return false;
+            }
+            unsigned idle = 0;
+            while (!ring->TryWrite(msg.frame.begin(), msg.frame.size())) {
+                if (context->IsCancelled() || ring->Corrupt()) {
+                    return false;
+                }
+                pubsub::common::ShmRing::Pause(&idle);
+            }
+        }
+        return true;
+    });
     
+    std::cout << "Shared memory subscriber disconnected from topics." << std::endl;
+    if (ring->Corrupt()) {
+        return Status(grpc::StatusCode::DATA_LOSS, "Shared memory ring is corrupt");
+    }
+    if (!oversized.empty()) {
+        // The subscriber continues over gRPC from the message that did not fit
+        return Status(grpc::StatusCode::FAILED_PRECONDITION, oversized);
+    }
     return Status::OK;
 }
 
 /**
- * @brief Subscribes to a topic and streams messages to the client
+ * @brief Resolve the requested topics, partitions and resume cursors of a subscription
  *
- * This method implements a streaming RPC that sends messages to subscribers.
- * It maintains a connection with the client until they disconnect, continuously
- * checking for and sending new messages that match the requested topic.
- * Each subscriber receives all messages published to the topic after they connect.
+ * Topics are interned so that a subscription may name topics nobody has
+ * published to yet. A cursor taken from another incarnation of its
+ * partition, or beyond the partition's end, points into a numbering that
+ * no longer exists: the partition is then read from its oldest retained
+ * message, and the incarnation on the delivered messages tells the client
+ * that its position was reset. Cursors without an incarnation are only
+ * checked against the end.
  *
- * @param context The gRPC server context
- * @param request The subscribe request containing the topic to subscribe to
- * @param writer The server writer used to stream messages to the client
- * @return Status::OK when the client disconnects
+ * @param request The subscribe request with the topics, partitions and cursors
+ * @param subscription Receives the resolved topics and starting sequences
  */
-Status PubSubServiceImpl::Subscribe(ServerContext* context, const SubscribeRequest* request,
-                ServerWriter<Message>* writer) {
+void PubSubServiceImpl::OpenSubscription(const SubscribeRequest* request, Subscription* subscription) {
     std::vector<std::string> topics;
     
     // First check if the topics repeated field is used
@@ -91,56 +1250,191 @@ Status PubSubServiceImpl::Subscribe(ServerContext* context, const SubscribeReque
         topics.push_back(topic_str.substr(start));
     }
     
-    SetFilterTopics(topics);
+    // Resolve the topic names once; the poll loop only touches flat arrays
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<TopicId> seen;
+        for (const auto& topic : topics) {
+            TopicId id = InternTopicLocked(topic);
+            if (std::find(seen.begin(), seen.end(), id) != seen.end()) {
+                continue;
+            }
+            seen.push_back(id);
+            for (const auto& partition : partitions_[id]) {
+                if (request->partitions_size() == 0 ||
+                    std::find(request->partitions().begin(), request->partitions().end(),
+                              partition->index) != request->partitions().end()) {
+                    subscription->partitions.push_back(partition);
+                    subscription->next_seq.push_back(0);
+                }
+            }
+        }
+        for (const auto& cursor : request->cursors()) {
+            for (size_t i = 0; i < subscription->partitions.size(); i++) {
+                Partition* partition = subscription->partitions[i].get();
+                if (partition->topic != cursor.topic() || partition->index != cursor.partition()) {
+                    continue;
+                }
+                std::lock_guard<std::mutex> partition_lock(partition->mutex);
+                bool same_incarnation = cursor.incarnation() == 0 || cursor.incarnation() == partition->incarnation;
+                if (same_incarnation && cursor.next_sequence() <= partition->buffer.NextSequence()) {
+                    subscription->next_seq[i] = cursor.next_sequence();
+                } else {
+                    std::cerr << "Cursor at sequence " << cursor.next_sequence() << " of partition "
+                              << partition->index << " of topic " << partition->topic
+                              << (same_incarnation ? " is beyond its end" : " is from an earlier incarnation")
+                              << "; starting from the oldest retained message" << std::endl;
+                }
+            }
+        }
+        // What is retained now is the backlog; messages published from here on are live
+        for (size_t i = 0; i < subscription->partitions.size(); i++) {
+            Partition* partition = subscription->partitions[i].get();
+            std::lock_guard<std::mutex> partition_lock(partition->mutex);
+            subscription->catch_up_end.push_back(partition->buffer.NextSequence());
+            subscription->catching_up = subscription->catching_up ||
+                                        subscription->next_seq[i] < subscription->catch_up_end[i];
+        }
+    }
 
-    std::cout << "New subscriber for " << topics.size() << " topics: ";
-    for (const auto& t : filter_topics_) std::cout << t << " ";
+    if (!subscription->partitions.empty()) {
+        PinToNodeOf(subscription->partitions[0]->topic, subscription->partitions[0]->index);
+    }
+    
+    std::cout << "New subscriber for " << subscription->partitions.size() << " partitions of topics: ";
+    for (const auto& t : topics) std::cout << t << " ";
+    if (request->cursors_size() > 0) std::cout << "(resuming)";
     std::cout << std::endl;
+}
 
-    // Keep track of the last message ID processed for each topic
-    std::unordered_map<std::string, std::string> last_msg_id_by_topic;
-    
-    while (!context->IsCancelled()) {
-        std::vector<Message> messages_to_send;
+/**
+ * @brief Append the messages published to the subscription's topics since the last call
+ *
+ * Each partition is locked only while references to its frames are
+ * taken; no message is copied. When
+ * @p max_count cuts a round short, the partition served first rotates so
+ * that one busy partition cannot starve the others.
+ *
+ * A partition's messages are already in append order, so the collected runs
+ * only need to be merged by their service-wide append stamps rather than
+ * sorted. Wall-clock timestamps are not compared: they can step backwards
+ * and tie.
+ *
+ * @param subscription The subscription, whose cursors are advanced
+ * @param max_count Maximum number of messages to append
+ * @param messages Vector the messages are appended to
+ */
+void PubSubServiceImpl::CollectNew(Subscription* subscription, size_t max_count,
+                                   std::vector<Delivery>* messages) {
+    size_t first = messages->size();
+    size_t num_partitions = subscription->partitions.size();
+    subscription->run_ends.clear();
+    for (size_t n = 0; n < num_partitions && max_count > 0; n++) {
+        size_t i = (subscription->first + n) % num_partitions;
+        Partition* partition = subscription->partitions[i].get();
+        size_t before = messages->size();
         {
-            std::lock_guard<std::mutex> lock(mutex_);
-            for (const auto& topic : filter_topics_) {
-                auto it = messages_by_topic_.find(topic);
-                if (it != messages_by_topic_.end()) {
-                    for (const auto& msg : it->second) {
-                        auto topic_it = last_msg_id_by_topic.find(topic);
-                        if (topic_it == last_msg_id_by_topic.end() || 
-                            msg.message_id() > topic_it->second) {
-                            messages_to_send.push_back(msg);
-                            last_msg_id_by_topic[topic] = msg.message_id();
-                        }
-                    }
-                }
-            }
+            std::lock_guard<std::mutex> lock(partition->mutex);
+            subscription->next_seq[i] = partition->buffer.VisitSince(subscription->next_seq[i], max_count,
+                [messages, i](uint64_t stamp, uint64_t sequence, const grpc::Slice& frame) {
+                    messages->push_back(Delivery{stamp, sequence, i, 0, frame});
+                });
         }
-        
-        // Sort messages by timestamp to ensure chronological delivery
-        std::sort(messages_to_send.begin(), messages_to_send.end(),
-                 [](const Message& a, const Message& b) {
-                     return a.timestamp() < b.timestamp();
-                 });
-        
-        for (const auto& msg : messages_to_send) {
-            writer->Write(msg);
-            std::cout << "Sent message: " << msg.content() 
-                      << " (ID: " << msg.message_id() << ")"
-                      << " to subscriber on topic: " << msg.topic() << std::endl;
+        if (messages->size() > before) {
+            subscription->run_ends.push_back(messages->size());
+            max_count -= messages->size() - before;
         }
-        
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    if (max_count == 0 && num_partitions > 0) {
+        subscription->first = (subscription->first + 1) % num_partitions;
     }
     
-    std::cout << "Subscriber disconnected from topics." << std::endl;
-    return Status::OK;
+    if (subscription->run_ends.size() > 1) {
+        MergeRuns(messages, first, subscription->run_ends, &subscription->merged);
+    }
+}
+
+/**
+ * @brief Append the next round of a subscription's messages, replaying its backlog in throttled chunks
+ *
+ * A round never collects more than kMaxRoundSize messages, so a subscriber
+ * joining a topic with a large backlog holds each partition's lock for one
+ * chunk at a time and publishers to it are only briefly held up; the
+ * subscription then reads the next chunk at once instead of waiting for the
+ * next poll. While messages retained when the subscription opened remain
+ * unsent, each round also takes its messages from the catch-up rate, a token
+ * bucket shared by every subscription that is catching up, so replaying
+ * backlogs cannot crowd out live delivery. Once a subscription has caught up
+ * it is no longer limited.
+ *
+ * @param subscription The subscription, whose cursors are advanced
+ * @param max_count Maximum number of messages to append
+ * @param poll_interval The wait before the next round when nothing more is ready
+ * @param messages Vector the messages are appended to
+ * @return The wait before the next round: zero if more messages are ready, until tokens are
+ *         available while throttled, otherwise @p poll_interval
+ */
+std::chrono::milliseconds PubSubServiceImpl::CollectRound(Subscription* subscription, size_t max_count,
+                                                          std::chrono::milliseconds poll_interval,
+                                                          std::vector<Delivery>* messages) {
+    size_t limit = std::min(max_count, kMaxRoundSize);
+    bool throttled = subscription->catching_up && catch_up_bucket_;
+    if (throttled) {
+        limit = std::min(limit, catch_up_chunk_);
+        int64_t wait = catch_up_bucket_->TryAcquire(limit, pubsub::common::steadyNanos());
+        if (wait > 0) {
+            return std::min(poll_interval, std::chrono::milliseconds((wait + 999999) / 1000000));
+        }
+    }
+    
+    size_t before = messages->size();
+    CollectNew(subscription, limit, messages);
+    size_t collected = messages->size() - before;
+    if (throttled && collected < limit) {
+        catch_up_bucket_->Release(limit - collected);
+    }
+    
+    if (subscription->catching_up) {
+        subscription->catching_up = false;
+        for (size_t i = 0; i < subscription->partitions.size(); i++) {
+            subscription->catching_up = subscription->catching_up ||
+                                        subscription->next_seq[i] < subscription->catch_up_end[i];
+        }
+    }
+    return collected > 0 && collected == limit ? std::chrono::milliseconds(0) : poll_interval;
 }
 
-void PubSubServiceImpl::SetFilterTopics(const std::vector<std::string>& topics) {
-    filter_topics_ = topics;
+/**
+ * @brief Poll the subscribed topics and hand each round of new messages to a sink
+ *
+ * Shared by Subscribe, SubscribeBatched and SubscribeSharedMemory. Resolves the requested topics and
+ * resume cursors, then repeatedly collects the messages published since the
+ * previous round, a bounded chunk at a time, and passes them to @p deliver in
+ * append order.
+ * Returns when the client cancels or @p deliver reports a failed write.
+ *
+ * @param context The gRPC server context
+ * @param request The subscribe request with the topics and cursors
+ * @param deliver Sink for each round's messages; it may move them out and may
+ *                shorten the wait before the next round
+ */
+void PubSubServiceImpl::PollSubscription(ServerContext* context, const SubscribeRequest* request,
+                                         const DeliverFn& deliver) {
+    Subscription subscription;
+    OpenSubscription(request, &subscription);
+    
+    const std::chrono::milliseconds poll_interval(100);
+    std::vector<Delivery> messages_to_send;
+    while (!context->IsCancelled()) {
+        messages_to_send.clear();
+        std::chrono::milliseconds next_poll = CollectRound(&subscription, std::numeric_limits<size_t>::max(),
+                                                           poll_interval, &messages_to_send);
+        if (!deliver(&messages_to_send, &next_poll)) {
+            break;
+        }
+        
+        std::this_thread::sleep_for(next_poll);
+    }
 }
 
 /**
@@ -157,21 +1451,198 @@ std::string PubSubServiceImpl::GenerateMessageId() {
 }
 
 /**
- * @brief Add a message to a topic queue, managing the maximum size
- * @param topic The topic to add the message to
- * @param message The message to add
+ * @brief Find the partition a message is stored in, registering its topic if needed
+ *
+ * The caller must hold mutex_. The returned reference keeps the topic from
+ * being reclaimed until the caller has stored the message and released it.
+ *
+ * @param topic The topic of the message
+ * @param key The message key
+ * @return The partition selected by the key
  */
-void PubSubServiceImpl::AddMessageToTopic(const std::string& topic, const Message& message) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    auto& topic_messages = messages_by_topic_[topic];
-    topic_messages.push_back(message);
+std::shared_ptr<PubSubServiceImpl::Partition> PubSubServiceImpl::PartitionForLocked(const std::string& topic,
+                                                                                     const std::string& key) {
+    TopicId id = InternTopicLocked(topic);
+    const auto& partitions = partitions_[id];
+    uint32_t index = partitions.size() > 1 ? PartitionOfKey(key, partitions.size()) : 0;
+    return partitions[index];
+}
+
+/**
+ * @brief Store a new message in a partition's buffer
+ *
+ * The message's frame is finished with the fields assigned here and its
+ * reference placed in the partition's TopicBuffer, stamped with the
+ * service-wide append order. The stamp is taken under the partition's
+ * mutex, so stamps increase along every partition. Once the buffer is full
+ * the oldest message's reference is dropped in its place; its frame is
+ * freed once no subscriber is still writing it. The caller must hold the
+ * partition's mutex.
+ *
+ * @param partition The partition to add the message to
+ * @param key The message key
+ * @param frame The frame holding the content; it keeps a reference to the finished message
+ * @param message_id The ID given to the message when it was scheduled, or an empty string
+ *                   that receives a newly generated ID
+ * @return The number of messages stored in the partition
+ */
+size_t PubSubServiceImpl::AddMessageToPartitionLocked(Partition* partition, const std::string& key,
+                                                      PendingFrame* frame, std::string* message_id) {
+    TopicBuffer& buffer = partition->buffer;
     
-    // If we've exceeded the max messages per topic, remove the oldest messages
-    if (topic_messages.size() > max_messages_per_topic_) {
-        topic_messages.erase(topic_messages.begin(), 
-                            topic_messages.begin() + (topic_messages.size() - max_messages_per_topic_));
+    if (message_id->empty()) {
+        pubsub::common::generateMessageId(message_id);
+    }
+    uint64_t sequence = buffer.NextSequence();
+    int64_t timestamp = pubsub::common::getCurrentTimestamp();
+    *buffer.Append(next_stamp_.fetch_add(1, std::memory_order_relaxed), key) =
+        frame->Finish(*message_id, partition->topic, timestamp, sequence, key, partition->index,
+                      partition->incarnation);
+    partition->last_active = timestamp;
+    return buffer.Size();
+}
+
+/**
+ * @brief Register a topic and create its partitions if it is new
+ *
+ * The caller must hold mutex_. A new topic may reuse the ID of a reclaimed
+ * one, whose entry in partitions_ is then empty. Every new partition gets a
+ * fresh incarnation, so cursors into a reclaimed topic of the same name are
+ * recognized as stale.
+ *
+ * @param topic The topic name
+ * @return The topic's ID, which indexes partitions_
+ */
+TopicId PubSubServiceImpl::InternTopicLocked(const std::string& topic) {
+    TopicId id = topic_registry_.Intern(topic);
+    if (id == partitions_.size()) {
+        partitions_.emplace_back();
+    }
+    auto& partitions = partitions_[id];
+    if (partitions.empty()) {
+        int64_t now = pubsub::common::getCurrentTimestamp();
+        bool compacted = MatchesTopic(compacted_topics_, topic);
+        for (size_t i = 0; i < partitions_per_topic_; i++) {
+            uint64_t incarnation;
+            do {
+                incarnation = incarnation_rng_();
+            } while (incarnation == 0);
+            partitions.push_back(std::make_shared<Partition>(topic, static_cast<uint32_t>(i),
+                                                             max_messages_per_topic_, compacted, now, incarnation));
+        }
+    }
+    return id;
+}
+
+/**
+ * @brief Tell whether a topic is unreferenced and idle
+ *
+ * The caller must hold mutex_. New references to a partition are only taken
+ * from partitions_ under mutex_, so a reference count of one (the list's own)
+ * means no publish, subscription or snapshot is using the partition and none
+ * can start. Taking the partition's mutex then orders its last append before
+ * this check; it is free, since only reference holders lock it.
+ *
+ * @param id A registered topic ID
+ * @param idle_since Wall-clock nanoseconds; the topic must not have been published to since
+ * @return true if the topic can be reclaimed
+ */
+bool PubSubServiceImpl::TopicIdleLocked(TopicId id, int64_t idle_since) {
+    for (const auto& partition : partitions_[id]) {
+        if (partition.use_count() != 1) {
+            return false;
+        }
+        std::lock_guard<std::mutex> partition_lock(partition->mutex);
+        if (partition->last_active > idle_since) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Unregister topics that have no subscribers and have been idle for a while
+ *
+ * Topics are visited kSweepBatch at a time, releasing mutex_ between batches
+ * so that publishes and subscriptions to other topics wait at most for one
+ * batch of checks. Reclaimed partitions, with their retained messages, are
+ * freed after mutex_ is released. A topic published to again later starts
+ * over with empty partitions and sequence numbers from zero. Producers that
+ * have not published for the same time are dropped from the dedup window.
+ *
+ * @param ttl How long a topic must have gone without a publish
+ * @return The number of topics reclaimed
+ */
+size_t PubSubServiceImpl::ReclaimIdleTopics(std::chrono::milliseconds ttl) {
+    int64_t idle_since = pubsub::common::getCurrentTimestamp() -
+        std::chrono::duration_cast<std::chrono::nanoseconds>(ttl).count();
+    size_t reclaimed = 0;
+    std::vector<std::vector<std::shared_ptr<Partition>>> released;
+    TopicId next = 0;
+    bool done = false;
+    while (!done) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            size_t limit = topic_registry_.IdLimit();
+            size_t end = std::min<size_t>(next + kSweepBatch, limit);
+            for (; next < end; next++) {
+                if (topic_registry_.Registered(next) && TopicIdleLocked(next, idle_since)) {
+                    released.push_back(std::move(partitions_[next]));
+                    partitions_[next].clear();
+                    topic_registry_.Remove(next);
+                }
+            }
+            done = next >= limit;
+        }
+        reclaimed += released.size();
+        released.clear();
+    }
+    size_t expired;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        expired = dedup_window_.ExpireIdle(idle_since);
+    }
+    if (reclaimed > 0 || expired > 0) {
+        std::cout << "Reclaimed " << reclaimed << " idle topics and " << expired << " idle producers" << std::endl;
+    }
+    return reclaimed;
+}
+
+/**
+ * @brief Reclaim idle topics periodically from a background thread
+ *
+ * The thread sweeps every ttl, but at least once a second, so a topic is
+ * reclaimed at most about ttl after it became idle.
+ *
+ * @param ttl How long a topic must have gone without a publish
+ */
+void PubSubServiceImpl::StartTopicSweeper(std::chrono::milliseconds ttl) {
+    StopTopicSweeper();
+    sweeper_stop_ = false;
+    std::chrono::milliseconds interval = std::min(ttl, std::chrono::milliseconds(1000));
+    sweeper_thread_ = std::thread([this, ttl, interval] {
+        std::unique_lock<std::mutex> lock(sweeper_mutex_);
+        while (!sweeper_cv_.wait_for(lock, interval, [this] { return sweeper_stop_; })) {
+            lock.unlock();
+            ReclaimIdleTopics(ttl);
+            lock.lock();
+        }
+    });
+}
+
+/**
+ * @brief Stop the topic sweeper thread
+ */
+void PubSubServiceImpl::StopTopicSweeper() {
+    if (!sweeper_thread_.joinable()) {
+        return;
     }
+    {
+        std::lock_guard<std::mutex> lock(sweeper_mutex_);
+        sweeper_stop_ = true;
+    }
+    sweeper_cv_.notify_all();
+    sweeper_thread_.join();
 }
 
 /**
@@ -181,10 +1652,12 @@ void PubSubServiceImpl::AddMessageToTopic(const std::string& topic, const Messag
 std::vector<std::string> PubSubServiceImpl::GetAllTopics() const {
     std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(mutex_));
     std::vector<std::string> topics;
-    topics.reserve(messages_by_topic_.size());
+    topics.reserve(topic_registry_.Size());
     
-    for (const auto& pair : messages_by_topic_) {
-        topics.push_back(pair.first);
+    for (TopicId id = 0; id < topic_registry_.IdLimit(); id++) {
+        if (topic_registry_.Registered(id)) {
+            topics.push_back(topic_registry_.Name(id));
+        }
     }
     
     return topics;
@@ -193,42 +1666,402 @@ std::vector<std::string> PubSubServiceImpl::GetAllTopics() const {
 /**
  * @brief Get message count for a specific topic
  * @param topic The topic name
- * @return Number of messages stored for the topic
+ * @return Number of messages stored for the topic, over all its partitions
  */
 size_t PubSubServiceImpl::GetMessageCount(const std::string& topic) const {
     std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(mutex_));
-    auto it = messages_by_topic_.find(topic);
-    if (it != messages_by_topic_.end()) {
-        return it->second.size();
+    TopicId id;
+    size_t count = 0;
+    if (topic_registry_.Find(topic, &id)) {
+        for (const auto& partition : partitions_[id]) {
+            std::lock_guard<std::mutex> partition_lock(partition->mutex);
+            count += partition->buffer.Size();
+        }
     }
-    return 0;
+    return count;
 }
 
 /**
- * @brief Runs the gRPC server with the PubSub service
+ * @brief Get the number of messages waiting for their delivery time
+ * @return Number of scheduled messages not yet stored in their topics
+ */
+size_t PubSubServiceImpl::GetScheduledCount() const {
+    return scheduled_count_.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Write the retained messages of every partition to a snapshot file
  *
- * Initializes and starts a gRPC server on the specified address.
- * The server hosts the PubSubService implementation and runs until
- * explicitly shut down.
+ * Publishes never wait for the whole snapshot. Each partition is cut at its
+ * next sequence number when the snapshot reaches it, and the messages below
+ * the cut are copied kSnapshotChunk at a time into a memory buffer, as the
+ * frames they are stored as,
+ * taking the partition's lock once per chunk; file I/O happens without any
+ * lock.
+ * Messages evicted while their partition is being copied are left out, so a
+ * partition may restore with a gap where the live buffer overtook the copy.
+ * Scheduled messages are not stored in any partition yet and are not saved.
  *
- * @param server_address The address and port on which the server should listen
- *                       in the format "address:port" (e.g., "localhost:50051")
- * @param max_messages_per_topic Maximum number of messages to store per topic (defaults to 100)
+ * @param path The snapshot path; the previous snapshot is replaced atomically
+ * @return true if the snapshot was written
+ */
+bool PubSubServiceImpl::SaveSnapshot(const std::string& path) {
+    int64_t start = pubsub::common::steadyNanos();
+    std::vector<std::shared_ptr<Partition>> partitions;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& topic_partitions : partitions_) {
+            for (const auto& partition : topic_partitions) {
+                partitions.push_back(partition);
+            }
+        }
+    }
+    
+    SnapshotWriter writer;
+    if (!writer.Open(path, static_cast<uint32_t>(partitions_per_topic_))) {
+        return false;
+    }
+    std::string records;
+    size_t count = 0;
+    for (const auto& partition : partitions) {
+        uint64_t cut;
+        uint64_t incarnation;
+        {
+            std::lock_guard<std::mutex> partition_lock(partition->mutex);
+            cut = partition->buffer.NextSequence();
+            incarnation = partition->incarnation;
+        }
+        writer.BeginSection(partition->topic, partition->index, incarnation);
+        uint64_t from = 0;
+        while (from < cut) {
+            records.clear();
+            size_t encoded = 0;
+            {
+                std::lock_guard<std::mutex> partition_lock(partition->mutex);
+                // Messages appended after the cut belong to the next snapshot
+                uint64_t next = partition->buffer.VisitSince(from, kSnapshotChunk,
+                    [&](uint64_t stamp, uint64_t sequence, const grpc::Slice& frame) {
+                        if (sequence < cut) {
+                            SnapshotWriter::AppendRecord(&records, stamp, frame.begin(), frame.size());
+                            encoded++;
+                        }
+                    });
+                from = next == from ? cut : next;
+            }
+            writer.WriteRecords(records);
+            count += encoded;
+        }
+        writer.EndSection(cut);
+    }
+    if (!writer.Commit()) {
+        return false;
+    }
+    
+    std::cout << "Saved snapshot of " << count << " messages in " << partitions.size()
+              << " partitions to " << path << " in "
+              << (pubsub::common::steadyNanos() - start) / 1000000 << " ms" << std::endl;
+    return true;
+}
+
+/**
+ * @brief Restore the partitions stored in a snapshot file
+ *
+ * The file is memory-mapped and every record is copied into a frame of its
+ * partition's buffer as is; only its sequence number and key are read. Each
+ * partition continues numbering where the snapshot left it, under the
+ * incarnation it had, so subscribers resume with their cursors after a
+ * restart, and the append stamps keep their order. Only snapshots written with the same partition count are
+ * loaded, since keys would otherwise map to other partitions. Producer dedup
+ * state is not part of the snapshot.
+ *
+ * @param path The snapshot path
+ * @return true if a snapshot was loaded
  */
-void RunServer(const std::string& server_address, size_t max_messages_per_topic) {
-    PubSubServiceImpl service(max_messages_per_topic);
+bool PubSubServiceImpl::LoadSnapshot(const std::string& path) {
+    int64_t start = pubsub::common::steadyNanos();
+    SnapshotReader reader;
+    if (!reader.Open(path)) {
+        return false;
+    }
+    if (reader.PartitionsPerTopic() != partitions_per_topic_) {
+        std::cerr << "Snapshot " << path << " was written with " << reader.PartitionsPerTopic()
+                  << " partitions per topic, not " << partitions_per_topic_ << "; not restored" << std::endl;
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string topic;
+    uint32_t index;
+    uint64_t incarnation;
+    uint64_t stamp;
+    const char* data;
+    size_t size;
+    uint64_t sequence;
+    std::string key;
+    uint64_t next_stamp = next_stamp_.load();
+    size_t count = 0;
+    while (reader.NextSection(&topic, &index, &incarnation)) {
+        if (index >= partitions_per_topic_) {
+            std::cerr << "Snapshot " << path << " names partition " << index << " of " << topic << std::endl;
+            break;
+        }
+        Partition* partition = partitions_[InternTopicLocked(topic)][index].get();
+        std::lock_guard<std::mutex> partition_lock(partition->mutex);
+        partition->incarnation = incarnation;
+        TopicBuffer& buffer = partition->buffer;
+        while (reader.NextRecord(&stamp, &data, &size)) {
+            if (!ReadFrameInfo(data, size, &sequence, &key)) {
+                std::cerr << "Snapshot " << path << " has a malformed message in " << topic << std::endl;
+                break;
+            }
+            if (buffer.Compacted()) {
+                // Replaced messages leave gaps in the sequence, which the buffer keeps
+                buffer.Skip(sequence);
+            } else if (sequence != buffer.NextSequence()) {
+                // The section starts, or continues after a gap, at this message
+                buffer.Reset(sequence);
+            }
+            *buffer.Append(stamp, key) = grpc::Slice(data, size);
+            next_stamp = std::max(next_stamp, stamp + 1);
+            count++;
+        }
+        if (buffer.Size() == 0) {
+            buffer.Reset(reader.SectionNextSequence());
+        } else if (buffer.Compacted()) {
+            buffer.Skip(reader.SectionNextSequence());
+        }
+    }
+    next_stamp_ = next_stamp;
+    if (!reader.Ok()) {
+        std::cerr << "Snapshot " << path << " is corrupt; restored " << count << " messages before the error"
+                  << std::endl;
+    }
     
+    std::cout << "Restored " << count << " messages of " << partitions_.size() << " topics from "
+              << path << " in " << (pubsub::common::steadyNanos() - start) / 1000000 << " ms" << std::endl;
+    return true;
+}
+
+/**
+ * @brief Save a snapshot periodically from a background thread
+ *
+ * The thread writes one more snapshot when it is stopped, so a clean
+ * shutdown loses nothing that was retained. Intervals in which no message
+ * was appended are skipped.
+ *
+ * @param path The snapshot path
+ * @param interval Time between snapshots
+ */
+void PubSubServiceImpl::StartSnapshots(const std::string& path, std::chrono::milliseconds interval) {
+    StopSnapshots();
+    snapshot_stop_ = false;
+    snapshot_thread_ = std::thread([this, path, interval] {
+        std::unique_lock<std::mutex> lock(snapshot_mutex_);
+        // Nothing was appended since the last snapshot while the stamp is unchanged
+        uint64_t saved_stamp = next_stamp_.load();
+        bool stop = false;
+        while (!stop) {
+            stop = snapshot_cv_.wait_for(lock, interval, [this] { return snapshot_stop_; });
+            uint64_t stamp = next_stamp_.load();
+            if (stamp == saved_stamp) {
+                continue;
+            }
+            lock.unlock();
+            if (SaveSnapshot(path)) {
+                saved_stamp = stamp;
+            }
+            lock.lock();
+        }
+    });
+}
+
+/**
+ * @brief Stop the snapshot thread after it has written a final snapshot
+ */
+void PubSubServiceImpl::StopSnapshots() {
+    if (!snapshot_thread_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(snapshot_mutex_);
+        snapshot_stop_ = true;
+    }
+    snapshot_cv_.notify_all();
+    snapshot_thread_.join();
+}
+
+/**
+ * @brief Build and start a server hosting a PubSub service
+ *
+ * Adds one insecure listener per address and applies the transport
+ * tunables: message size limits, the synchronous server's completion
+ * queues and pollers, a resource quota, and HTTP/2 channel arguments for
+ * concurrent streams, BDP probing and keepalive. Settings left at zero keep
+ * the gRPC defaults.
+ *
+ * @param service The service to register; must outlive the server
+ * @param options Listener addresses and transport tunables; the storage limits are not used
+ * @param selected_ports Receives the TCP port bound for each listener (0 for Unix sockets); may be null
+ * @return The started server, or nullptr if it could not be started
+ */
+std::unique_ptr<grpc::Server> BuildServer(PubSubServiceImpl* service, const ServerOptions& options,
+                                          std::vector<int>* selected_ports) {
     grpc::ServerBuilder builder;
-    // Listen on the given address without any authentication mechanism
-    builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
-    // Register "service" as the instance through which we'll communicate with clients
-    builder.RegisterService(&service);
-    // Assemble the server
+    std::vector<int> ports(options.listen_addresses.size(), 0);
+    for (size_t i = 0; i < options.listen_addresses.size(); i++) {
+        // Listen without any authentication mechanism
+        builder.AddListeningPort(options.listen_addresses[i], grpc::InsecureServerCredentials(), &ports[i]);
+    }
+    builder.RegisterService(service);
+    
+    if (options.max_message_bytes != 0) {
+        builder.SetMaxMessageSize(options.max_message_bytes);
+    }
+    if (options.num_cqs > 0) {
+        builder.SetSyncServerOption(grpc::ServerBuilder::SyncServerOption::NUM_CQS, options.num_cqs);
+    }
+    if (options.min_pollers > 0) {
+        builder.SetSyncServerOption(grpc::ServerBuilder::SyncServerOption::MIN_POLLERS, options.min_pollers);
+    }
+    if (options.max_pollers > 0) {
+        builder.SetSyncServerOption(grpc::ServerBuilder::SyncServerOption::MAX_POLLERS, options.max_pollers);
+    }
+    if (options.max_threads > 0 || options.memory_quota_bytes > 0) {
+        grpc::ResourceQuota quota("pubsub_server");
+        if (options.max_threads > 0) {
+            quota.SetMaxThreads(options.max_threads);
+        }
+        if (options.memory_quota_bytes > 0) {
+            quota.Resize(options.memory_quota_bytes);
+        }
+        builder.SetResourceQuota(quota);
+    }
+    if (options.max_concurrent_streams > 0) {
+        builder.AddChannelArgument(GRPC_ARG_MAX_CONCURRENT_STREAMS, options.max_concurrent_streams);
+    }
+    if (!options.bdp_probe) {
+        builder.AddChannelArgument(GRPC_ARG_HTTP2_BDP_PROBE, 0);
+    }
+    if (options.keepalive_time.count() > 0) {
+        builder.AddChannelArgument(GRPC_ARG_KEEPALIVE_TIME_MS, static_cast<int>(options.keepalive_time.count()));
+        builder.AddChannelArgument(GRPC_ARG_KEEPALIVE_TIMEOUT_MS,
+                                   static_cast<int>(options.keepalive_timeout.count()));
+        builder.AddChannelArgument(GRPC_ARG_HTTP2_MAX_PINGS_WITHOUT_DATA, 0);
+    }
+    if (options.keepalive_min_ping_interval.count() > 0) {
+        builder.AddChannelArgument(GRPC_ARG_HTTP2_MIN_RECV_PING_INTERVAL_WITHOUT_DATA_MS,
+                                   static_cast<int>(options.keepalive_min_ping_interval.count()));
+        builder.AddChannelArgument(GRPC_ARG_KEEPALIVE_PERMIT_WITHOUT_CALLS, 1);
+    }
+    
     std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
-    std::cout << "Server listening on " << server_address << std::endl;
-    std::cout << "Maximum messages per topic: " << max_messages_per_topic << std::endl;
+    if (!server) {
+        std::cerr << "Failed to start server" << std::endl;
+        return nullptr;
+    }
+    if (selected_ports) {
+        for (size_t i = 0; i < ports.size(); i++) {
+            // Unix domain sockets report 1 when they were bound
+            bool unix_socket = options.listen_addresses[i].compare(0, 5, "unix:") == 0;
+            ports[i] = unix_socket ? 0 : ports[i];
+        }
+        *selected_ports = ports;
+    }
+    return server;
+}
+
+/**
+ * @brief Runs the gRPC server with the PubSub service
+ *
+ * Starts a server on every listener address and runs until it is
+ * explicitly shut down. With a CPU list every thread of the server is
+ * confined to those CPUs. With a snapshot path the retained messages are
+ * restored before the listeners open and saved periodically; SIGINT or
+ * SIGTERM then shuts the server down cleanly and writes a final snapshot.
+ * The signals are blocked on entry, before any thread of the server exists;
+ * threads the caller started earlier would still receive them.
+ *
+ * @param options Listener addresses, storage limits and transport tunables
+ */
+void RunServer(const ServerOptions& options) {
+    if (!options.snapshot_path.empty()) {
+        // Block the signals before any thread starts (the service's, gRPC's and the coarse
+        // clock's, started by the first timestamp), so only sigwait can receive them
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    }
+    // Threads started from here on, including gRPC's, inherit the CPU set
+    if (!options.cpus.empty()) {
+        pubsub::common::pinCurrentThread(options.cpus);
+    }
+    PubSubServiceImpl service(options.max_messages_per_topic, options.partitions_per_topic);
+    service.SetRateLimits(options);
+    service.SetCompactedTopics(options);
+    service.SetThreadPlacement(options);
+    service.SetLogging(options);
+    
+    std::thread signal_thread;
+    if (!options.snapshot_path.empty()) {
+        service.LoadSnapshot(options.snapshot_path);
+    }
+    
+    std::unique_ptr<grpc::Server> server = BuildServer(&service, options);
+    if (!server) {
+        return;
+    }
+    if (options.idle_topic_ttl.count() > 0) {
+        service.StartTopicSweeper(options.idle_topic_ttl);
+    }
+    if (!options.snapshot_path.empty()) {
+        service.StartSnapshots(options.snapshot_path, options.snapshot_interval);
+        grpc::Server* running = server.get();
+        signal_thread = std::thread([running] {
+            sigset_t signals;
+            sigemptyset(&signals);
+            sigaddset(&signals, SIGINT);
+            sigaddset(&signals, SIGTERM);
+            int signal = 0;
+            sigwait(&signals, &signal);
+            std::cout << "Signal " << signal << " received, shutting down..." << std::endl;
+            // Open streams are cancelled after a second
+            running->Shutdown(std::chrono::system_clock::now() + std::chrono::seconds(1));
+        });
+    }
+    for (const auto& address : options.listen_addresses) {
+        std::cout << "Server listening on " << address << std::endl;
+    }
+    std::cout << "Maximum messages per topic: " << options.max_messages_per_topic << std::endl;
+    std::cout << "Partitions per topic: " << options.partitions_per_topic << std::endl;
     std::cout << "Ready to handle publish/subscribe requests..." << std::endl;
     
     // Wait for the server to shutdown
     server->Wait();
+    service.StopTopicSweeper();
+    if (signal_thread.joinable()) {
+        signal_thread.join();
+        service.StopSnapshots();
+    }
+}
+
+/**
+ * @brief Runs the gRPC server with the PubSub service
+ *
+ * Initializes and starts a gRPC server on the specified address with the
+ * default transport settings.
+ *
+ * @param server_address The address and port on which the server should listen
+ *                       in the format "address:port" (e.g., "localhost:50051")
+ * @param max_messages_per_topic Maximum number of messages to store per topic partition (defaults to 100)
+ * @param partitions_per_topic Number of partitions of every topic (defaults to 1)
+ */
+void RunServer(const std::string& server_address, size_t max_messages_per_topic,
+               size_t partitions_per_topic) {
+    ServerOptions options;
+    options.listen_addresses = {server_address};
+    options.max_messages_per_topic = max_messages_per_topic;
+    options.partitions_per_topic = partitions_per_topic;
+    RunServer(options);
 }
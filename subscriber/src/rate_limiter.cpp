@@ -0,0 +1,177 @@
+/**
+ * @file rate_limiter.cpp
+ * @brief Implementation of the token buckets that enforce publish quotas.
+ */
+#include "rate_limiter.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "pubsub_clock.h"
+
+namespace {
+
+// Smallest map size at which full buckets are pruned
+constexpr size_t kMinPruneSize = 1024;
+
+// Most keys a thread caches per limiter before it starts its cache over
+constexpr size_t kMaxCachedBuckets = 4096;
+
+// Source of instance IDs, so a thread's cache never outlives its instance's ID
+std::atomic<uint64_t> next_instance_id(1);
+
+} // namespace
+
+/**
+ * @struct RateLimiter::LocalCache
+ * @brief The buckets one thread has looked up in one limiter.
+ */
+struct RateLimiter::LocalCache {
+    uint64_t generation = 0;  // Generation of the limiter the entries were looked up in
+    std::unordered_map<std::string, std::shared_ptr<TokenBucket>> buckets;  // Null for unlimited keys
+};
+
+/**
+ * @brief Constructs a full bucket.
+ * @param limit The bucket's rate and burst; the rate must be positive
+ */
+TokenBucket::TokenBucket(const RateLimit& limit)
+    : interval_(std::max<int64_t>(1, static_cast<int64_t>(1e9 / limit.rate))),
+      tolerance_(interval_ * std::max<int64_t>(1, static_cast<int64_t>(
+          limit.burst > 0 ? limit.burst : limit.rate / 10))),
+      full_at_(0) {}
+
+/**
+ * @brief Take tokens if the bucket holds enough.
+ *
+ * A request larger than the burst is admitted when the bucket is full,
+ * leaving it in debt.
+ *
+ * @param count Number of tokens
+ * @param now Current steady-clock time in nanoseconds
+ * @return 0 if the tokens were taken, otherwise nanoseconds until they would be available
+ */
+int64_t TokenBucket::TryAcquire(uint64_t count, int64_t now) {
+    int64_t cost = static_cast<int64_t>(count) * interval_;
+    int64_t full_at = full_at_.load(std::memory_order_relaxed);
+    while (true) {
+        int64_t next = std::max(full_at, now) + cost;
+        if (next - now > tolerance_ && full_at > now) {
+            return std::min(next - now - tolerance_, full_at - now);
+        }
+        if (full_at_.compare_exchange_weak(full_at, next, std::memory_order_relaxed)) {
+            return 0;
+        }
+    }
+}
+
+/**
+ * @brief Return tokens taken for a request that was refused elsewhere.
+ * @param count Number of tokens
+ */
+void TokenBucket::Release(uint64_t count) {
+    full_at_.fetch_sub(static_cast<int64_t>(count) * interval_, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Tell whether the bucket has refilled completely.
+ * @param now Current steady-clock time in nanoseconds
+ * @return true if the bucket is in the same state as a new one
+ */
+bool TokenBucket::Full(int64_t now) const {
+    return full_at_.load(std::memory_order_relaxed) <= now;
+}
+
+/**
+ * @brief Constructs a limiter.
+ * @param default_limit Limit of every key without an override
+ * @param overrides Limits of individual keys
+ */
+RateLimiter::RateLimiter(const RateLimit& default_limit, const std::map<std::string, RateLimit>& overrides)
+    : default_limit_(default_limit), overrides_(overrides), enabled_(default_limit.rate > 0),
+      id_(next_instance_id.fetch_add(1, std::memory_order_relaxed)), generation_(0),
+      prune_at_(kMinPruneSize) {
+    for (const auto& entry : overrides_) {
+        enabled_ = enabled_ || entry.second.rate > 0;
+    }
+}
+
+/**
+ * @brief Get the bucket of a key.
+ *
+ * The calling thread's cache answers without a lock. It is cleared when the
+ * limiter has pruned since it was filled, or when it has grown to
+ * kMaxCachedBuckets keys.
+ *
+ * @param key The topic or publisher
+ * @return The bucket, or nullptr if the key is not limited
+ */
+std::shared_ptr<TokenBucket> RateLimiter::BucketFor(const std::string& key) {
+    LocalCache& cache = Cache();
+    uint64_t generation = generation_.load(std::memory_order_relaxed);
+    if (cache.generation != generation || cache.buckets.size() >= kMaxCachedBuckets) {
+        cache.buckets.clear();
+        cache.generation = generation;
+    }
+    auto it = cache.buckets.find(key);
+    if (it != cache.buckets.end()) {
+        return it->second;
+    }
+    std::shared_ptr<TokenBucket> bucket = SharedBucketFor(key);
+    cache.buckets.emplace(key, bucket);
+    return bucket;
+}
+
+/**
+ * @brief Get the calling thread's cache of this limiter, creating it on the thread's first lookup.
+ *
+ * Each thread keeps its caches per instance ID. A cache left behind by a
+ * destroyed instance is never matched again, since IDs are not reused.
+ *
+ * @return The cache
+ */
+RateLimiter::LocalCache& RateLimiter::Cache() {
+    thread_local std::vector<std::pair<uint64_t, std::unique_ptr<LocalCache>>> caches;
+    for (const auto& entry : caches) {
+        if (entry.first == id_) {
+            return *entry.second;
+        }
+    }
+    caches.emplace_back(id_, std::unique_ptr<LocalCache>(new LocalCache));
+    return *caches.back().second;
+}
+
+/**
+ * @brief Get the bucket of a key from the shared map, creating it if needed.
+ *
+ * Callers and thread caches keep the bucket while they use it, so pruning
+ * never frees a bucket in use; a pruned key gets a new, full bucket, which
+ * is the state the pruned one was in.
+ *
+ * @param key The topic or publisher
+ * @return The bucket, or nullptr if the key is not limited
+ */
+std::shared_ptr<TokenBucket> RateLimiter::SharedBucketFor(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = buckets_.find(key);
+    if (it != buckets_.end()) {
+        return it->second;
+    }
+    auto override_it = overrides_.find(key);
+    const RateLimit& limit = override_it != overrides_.end() ? override_it->second : default_limit_;
+    if (limit.rate <= 0) {
+        return nullptr;
+    }
+    if (buckets_.size() >= prune_at_) {
+        int64_t now = pubsub::common::steadyNanos();
+        for (auto bucket = buckets_.begin(); bucket != buckets_.end();) {
+            if (bucket->second.use_count() == 1 && bucket->second->Full(now)) {
+                bucket = buckets_.erase(bucket);
+            } else {
+                ++bucket;
+            }
+        }
+        prune_at_ = std::max(kMinPruneSize, buckets_.size() * 2);
+        generation_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return buckets_.emplace(key, std::make_shared<TokenBucket>(limit)).first->second;
+}
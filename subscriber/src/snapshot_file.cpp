@@ -0,0 +1,288 @@
+/**
+ * @file snapshot_file.cpp
+ * @brief Implementation of the binary snapshot format of retained topic partitions.
+ */
+#include "snapshot_file.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Identifies a snapshot file ("PSSNAP01")
+constexpr uint64_t kSnapshotMagic = 0x5053534E41503031ULL;
+constexpr uint32_t kSnapshotVersion = 2;
+
+constexpr uint32_t kSectionTag = 1;
+constexpr uint32_t kTrailerTag = 2;
+constexpr uint32_t kEndOfSection = 0xFFFFFFFFu;
+
+// Size of the trailer: tag and section count
+constexpr size_t kTrailerSize = sizeof(uint32_t) + sizeof(uint64_t);
+
+// Size of the file header: magic, version and partition count
+constexpr size_t kHeaderSize = sizeof(uint64_t) + 2 * sizeof(uint32_t);
+
+// Buffer of the snapshot file, so records are written in large blocks
+constexpr size_t kWriteBufferSize = 1 << 20;
+
+} // namespace
+
+/**
+ * @brief Constructs a writer with no file open.
+ */
+SnapshotWriter::SnapshotWriter() : file_(nullptr), sections_(0) {}
+
+/**
+ * @brief Destructor that discards the temporary file unless it was committed.
+ */
+SnapshotWriter::~SnapshotWriter() {
+    if (file_) {
+        std::fclose(file_);
+        std::remove(temp_path_.c_str());
+    }
+}
+
+/**
+ * @brief Create the temporary file and write the file header.
+ * @param path The final snapshot path
+ * @param partitions_per_topic Partition count of the server writing the snapshot
+ * @return true on success
+ */
+bool SnapshotWriter::Open(const std::string& path, uint32_t partitions_per_topic) {
+    path_ = path;
+    temp_path_ = path + ".tmp";
+    file_ = std::fopen(temp_path_.c_str(), "wb");
+    if (!file_) {
+        std::cerr << "Cannot create snapshot " << temp_path_ << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    std::setvbuf(file_, nullptr, _IOFBF, kWriteBufferSize);
+    Write(&kSnapshotMagic, sizeof(kSnapshotMagic));
+    Write(&kSnapshotVersion, sizeof(kSnapshotVersion));
+    Write(&partitions_per_topic, sizeof(partitions_per_topic));
+    return true;
+}
+
+/**
+ * @brief Start the section of one topic partition.
+ * @param topic The topic name
+ * @param partition The partition index
+ * @param incarnation The partition's incarnation
+ */
+void SnapshotWriter::BeginSection(const std::string& topic, uint32_t partition, uint64_t incarnation) {
+    uint32_t length = static_cast<uint32_t>(topic.size());
+    Write(&kSectionTag, sizeof(kSectionTag));
+    Write(&length, sizeof(length));
+    Write(topic.data(), topic.size());
+    Write(&partition, sizeof(partition));
+    Write(&incarnation, sizeof(incarnation));
+    sections_++;
+}
+
+/**
+ * @brief Encode one retained message as a record in memory.
+ *
+ * The message is serialized straight into the buffer behind its header, so
+ * encoding allocates only when the buffer has to grow.
+ *
+ * @param records Buffer the record is appended to
+ * @param stamp The message's append stamp
+ * @param message The serialized message
+ * @param size Size of the serialized message
+ */
+void SnapshotWriter::AppendRecord(std::string* records, uint64_t stamp, const void* message, size_t size) {
+    size_t header = records->size();
+    uint32_t length = static_cast<uint32_t>(size);
+    records->resize(header + sizeof(length) + sizeof(stamp) + length);
+    char* out = &(*records)[header];
+    std::memcpy(out, &length, sizeof(length));
+    std::memcpy(out + sizeof(length), &stamp, sizeof(stamp));
+    std::memcpy(out + sizeof(length) + sizeof(stamp), message, size);
+}
+
+/**
+ * @brief Append records encoded by AppendRecord to the current section.
+ * @param records The encoded records
+ */
+void SnapshotWriter::WriteRecords(const std::string& records) {
+    Write(records.data(), records.size());
+}
+
+/**
+ * @brief Close the current section.
+ * @param next_sequence The sequence the partition's next message will receive
+ */
+void SnapshotWriter::EndSection(uint64_t next_sequence) {
+    Write(&kEndOfSection, sizeof(kEndOfSection));
+    Write(&next_sequence, sizeof(next_sequence));
+}
+
+/**
+ * @brief Write the trailer, flush the file to disk and rename it to the snapshot path.
+ *
+ * The rename replaces the previous snapshot atomically, so a crash while
+ * writing leaves either the old or the new snapshot, never a partial one.
+ *
+ * @return true if the snapshot is now in place
+ */
+bool SnapshotWriter::Commit() {
+    Write(&kTrailerTag, sizeof(kTrailerTag));
+    Write(&sections_, sizeof(sections_));
+    bool ok = std::fflush(file_) == 0 && !std::ferror(file_) && fsync(fileno(file_)) == 0;
+    ok = std::fclose(file_) == 0 && ok;
+    file_ = nullptr;
+    if (ok && std::rename(temp_path_.c_str(), path_.c_str()) == 0) {
+        return true;
+    }
+    std::cerr << "Cannot write snapshot " << path_ << ": " << std::strerror(errno) << std::endl;
+    std::remove(temp_path_.c_str());
+    return false;
+}
+
+/**
+ * @brief Write bytes to the file; errors are reported by Commit.
+ * @param data The bytes
+ * @param size Number of bytes
+ */
+void SnapshotWriter::Write(const void* data, size_t size) {
+    std::fwrite(data, 1, size, file_);
+}
+
+/**
+ * @brief Constructs a reader with no file mapped.
+ */
+SnapshotReader::SnapshotReader()
+    : base_(nullptr), size_(0), pos_(0), end_(0), partitions_per_topic_(0),
+      section_next_sequence_(0), ok_(false) {}
+
+/**
+ * @brief Destructor that unmaps the file.
+ */
+SnapshotReader::~SnapshotReader() {
+    if (base_) {
+        munmap(const_cast<char*>(base_), size_);
+    }
+}
+
+/**
+ * @brief Map a snapshot and check its header and trailer.
+ *
+ * The mapping is advised for sequential access, so the kernel reads ahead
+ * while the records are parsed.
+ *
+ * @param path The snapshot path
+ * @return true if the file is a complete snapshot
+ */
+bool SnapshotReader::Open(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            std::cerr << "Cannot open snapshot " << path << ": " << std::strerror(errno) << std::endl;
+        }
+        return false;
+    }
+    struct stat st;
+    void* base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= kHeaderSize + kTrailerSize) {
+        size_ = static_cast<size_t>(st.st_size);
+        base = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "Cannot map snapshot " << path << std::endl;
+        return false;
+    }
+    base_ = static_cast<const char*>(base);
+    madvise(base, size_, MADV_SEQUENTIAL);
+
+    uint64_t magic;
+    uint32_t version;
+    uint32_t trailer_tag;
+    end_ = size_ - kTrailerSize;
+    std::memcpy(&magic, base_, sizeof(magic));
+    std::memcpy(&version, base_ + sizeof(magic), sizeof(version));
+    std::memcpy(&partitions_per_topic_, base_ + sizeof(magic) + sizeof(version), sizeof(partitions_per_topic_));
+    std::memcpy(&trailer_tag, base_ + end_, sizeof(trailer_tag));
+    if (magic != kSnapshotMagic || trailer_tag != kTrailerTag) {
+        std::cerr << "Snapshot " << path << " is incomplete or not a snapshot" << std::endl;
+        return false;
+    }
+    if (version != kSnapshotVersion) {
+        std::cerr << "Snapshot " << path << " has format version " << version << ", not "
+                  << kSnapshotVersion << std::endl;
+        return false;
+    }
+    pos_ = kHeaderSize;
+    ok_ = true;
+    return true;
+}
+
+/**
+ * @brief Advance to the next section.
+ * @param topic Receives the topic name
+ * @param partition Receives the partition index
+ * @param incarnation Receives the partition's incarnation
+ * @return false once every section has been read, or if the file is corrupt
+ */
+bool SnapshotReader::NextSection(std::string* topic, uint32_t* partition, uint64_t* incarnation) {
+    if (!ok_ || pos_ == end_) {
+        return false;
+    }
+    uint32_t tag;
+    uint32_t length;
+    if (!Read(&tag, sizeof(tag)) || tag != kSectionTag || !Read(&length, sizeof(length)) ||
+        end_ - pos_ < length) {
+        ok_ = false;
+        return false;
+    }
+    topic->assign(base_ + pos_, length);
+    pos_ += length;
+    return Read(partition, sizeof(*partition)) && Read(incarnation, sizeof(*incarnation));
+}
+
+/**
+ * @brief Advance to the next record of the current section.
+ * @param stamp Receives the message's append stamp
+ * @param data Receives a pointer to the serialized message inside the mapping
+ * @param size Receives the length of the serialized message
+ * @return false at the end of the section, or if the file is corrupt
+ */
+bool SnapshotReader::NextRecord(uint64_t* stamp, const char** data, size_t* size) {
+    uint32_t length;
+    if (!Read(&length, sizeof(length))) {
+        return false;
+    }
+    if (length == kEndOfSection) {
+        Read(&section_next_sequence_, sizeof(section_next_sequence_));
+        return false;
+    }
+    if (!Read(stamp, sizeof(*stamp)) || end_ - pos_ < length) {
+        ok_ = false;
+        return false;
+    }
+    *data = base_ + pos_;
+    *size = length;
+    pos_ += length;
+    return true;
+}
+
+/**
+ * @brief Copy bytes out of the mapping, checking that they lie before the trailer.
+ * @param out Receives the bytes
+ * @param size Number of bytes
+ * @return false, marking the reader as failed, if the file ends early
+ */
+bool SnapshotReader::Read(void* out, size_t size) {
+    if (!ok_ || end_ - pos_ < size) {
+        ok_ = false;
+        return false;
+    }
+    std::memcpy(out, base_ + pos_, size);
+    pos_ += size;
+    return true;
+}
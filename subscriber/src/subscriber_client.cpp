@@ -3,22 +3,46 @@
  * @brief Implementation of the Subscriber client for the PubSub gRPC service.
  */
 #include "subscriber_client.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <grpcpp/grpcpp.h>
 #include "pubsub.pb.h"
 #include "pubsub.grpc.pb.h"
+#include "shm_ring.h"
+#include "subscriber_stats.h"
 
 using grpc::ClientContext;
 using grpc::Status;
+using pubsub::AckRequest;
+using pubsub::MessageBatch;
+using pubsub::SharedMemoryAttach;
+using pubsub::SharedMemoryStatus;
 using pubsub::SubscribeRequest;
+using pubsub::TopicCursor;
 using pubsub::Message;
+using pubsub::TopicAck;
+
+namespace {
+
+// How often the ack sender flushes acknowledgements
+constexpr std::chrono::milliseconds kAckInterval(20);
+
+// Number of acknowledgements that triggers a flush before the interval is up
+constexpr size_t kMaxAcksPerRequest = 256;
+
+}  // namespace
 
 /**
  * @brief Constructs a Subscriber client.
  * @param channel Shared pointer to the gRPC channel
+ * @param options Callback dispatch settings
  */
-SubscriberClient::SubscriberClient(std::shared_ptr<Channel> channel)
-    : stub_(PubSub::NewStub(channel)), running_(false) {}
+SubscriberClient::SubscriberClient(std::shared_ptr<Channel> channel, const SubscriberOptions& options)
+    : stub_(PubSub::NewStub(channel)), options_(options), running_(false), context_(nullptr),
+      unsent_acks_(0) {
+    rng_.seed(std::random_device()());
+}
 
 /**
  * @brief Destructor that ensures subscription thread is stopped.
@@ -50,55 +74,452 @@ bool SubscriberClient::SubscribeToMultiple(const std::vector<std::string>& topic
     // Stop any existing subscription thread
     Stop();
     
+    if (options_.dispatch_threads > 0) {
+        dispatch_pool_.reset(new DispatchPool(options_.dispatch_threads, options_.max_pending,
+            [this, callback](const Message& msg) {
+                callback(msg.topic(), msg);
+                if (options_.ack) {
+                    Acked(msg);
+                }
+            }));
+    }
+
+    cursors_.clear();
+    {
+        std::lock_guard<std::mutex> lock(ack_mutex_);
+        ack_states_.clear();
+        unsent_acks_ = 0;
+    }
     running_ = true;
     subscription_thread_ = std::thread(&SubscriberClient::SubscriptionThread, this, topics, callback);
     return true;
 }
 
 /**
- * @brief Stop the subscription thread.
+ * @brief Stop the subscription thread and wait for pending callbacks.
+ *
+ * The open stream is cancelled so that a Read blocked waiting for messages
+ * returns immediately, and a pending reconnect backoff is cut short.
  */
 void SubscriberClient::Stop() {
     if (running_) {
-        running_ = false;
+        {
+            std::lock_guard<std::mutex> lock(stream_mutex_);
+            running_ = false;
+            if (context_) {
+                context_->TryCancel();
+            }
+        }
+        stop_cv_.notify_all();
         if (subscription_thread_.joinable()) {
             subscription_thread_.join();
         }
     }
+    // Runs the callbacks of every message already received before returning
+    dispatch_pool_.reset();
+}
+
+/**
+ * @brief Advance the topic cursor past a received message and hand the message to the callback.
+ *
+ * The callback runs inline or through the dispatch pool. In ack mode the
+ * message is recorded as outstanding until its callback returns. A message
+ * of another incarnation than the cursor's means the server reset the
+ * position, because the partition started over; the cursor, and in ack mode
+ * the outstanding messages of the old incarnation, are dropped. Statistics
+ * are recorded here, on arrival, so callback queueing does not count as
+ * delivery latency.
+ *
+ * @param message The received message; moved from when a dispatch pool is used
+ * @param callback The subscriber callback
+ */
+void SubscriberClient::Deliver(Message&& message, const TopicCallbackFn& callback) {
+    if (options_.stats) {
+        options_.stats->Record(message);
+    }
+    PartitionKey partition(message.topic(), message.partition());
+    Cursor& cursor = cursors_[partition];
+    if (cursor.incarnation != message.incarnation()) {
+        if (cursor.incarnation != 0) {
+            std::cerr << "Partition " << message.partition() << " of topic " << message.topic()
+                      << " started over on the server; resuming from its oldest retained message" << std::endl;
+        }
+        cursor.incarnation = message.incarnation();
+    }
+    cursor.next_sequence = message.sequence() + 1;
+    if (options_.ack) {
+        std::lock_guard<std::mutex> lock(ack_mutex_);
+        AckState& state = ack_states_[partition];
+        if (state.incarnation != message.incarnation()) {
+            unsent_acks_ -= std::min(unsent_acks_, state.acked.size());
+            state = AckState();
+            state.incarnation = message.incarnation();
+        }
+        state.outstanding.insert(message.sequence());
+        state.next = std::max(state.next, message.sequence() + 1);
+    }
+    if (!dispatch_pool_) {
+        callback(message.topic(), message);
+        if (options_.ack) {
+            Acked(message);
+        }
+    } else if (options_.ordering_key) {
+        std::string key = options_.ordering_key(message);
+        dispatch_pool_->Dispatch(key, std::move(message));
+    } else {
+        // Copy the key so it stays valid once the message is moved into the pool
+        std::string key = message.topic();
+        dispatch_pool_->Dispatch(key, std::move(message));
+    }
+}
+
+/**
+ * @brief Compute the delay before a reconnect attempt.
+ * @param attempt The attempt number, starting at 1
+ * @return The exponential backoff for the attempt, with random jitter
+ */
+std::chrono::milliseconds SubscriberClient::Backoff(int attempt) {
+    double delay = options_.initial_backoff.count() * std::pow(options_.backoff_multiplier, attempt - 1);
+    delay = std::min(delay, static_cast<double>(options_.max_backoff.count()));
+    std::uniform_real_distribution<double> jitter(0.5, 1.0);
+    return std::chrono::milliseconds(static_cast<int64_t>(delay * jitter(rng_)));
 }
 
 /**
  * @brief Thread function that handles the subscription.
+ *
+ * Keeps a stream open until Stop is called. Each delivered message advances
+ * its topic's cursor; every reconnect sends the cursors so the server
+ * continues where the broken stream left off. The backoff resets once a new
+ * stream delivers a message. Batched streams fall back to Subscribe when the
+ * server does not implement SubscribeBatched. In ack mode the cursors are
+ * the oldest unacknowledged messages instead. A shared-memory subscription
+ * falls back to the gRPC streams when the server cannot attach.
+ *
  * @param topics The topics to subscribe to
  * @param callback The function to call when a message is received
  */
 void SubscriberClient::SubscriptionThread(const std::vector<std::string>& topics, TopicCallbackFn callback) {
-    ClientContext context;
-    SubscribeRequest request;
-    
-    // Add topics to the request
-    for (const auto& topic : topics) {
-        request.add_topics(topic);
-    }
-    
     std::cout << "Subscribing to topics: ";
     for (const auto& topic : topics) {
         std::cout << topic << " ";
     }
     std::cout << std::endl;
     
-    auto reader = stub_->Subscribe(&context, request);
-    
-    Message message;
-    while (running_ && reader->Read(&message)) {
-        callback(message.topic(), message);
-    }
+    bool batched = options_.max_batch_size != 1;
+    bool shared_memory = options_.shared_memory && !options_.ack;
+    int attempt = 0;
     
-    Status status = reader->Finish();
-    if (!status.ok() && running_) {
+    while (running_) {
+        SubscribeRequest request;
+        for (const auto& topic : topics) {
+            request.add_topics(topic);
+        }
+        if (options_.ack) {
+            // Resume from the oldest unacknowledged message so it is delivered again
+            std::lock_guard<std::mutex> lock(ack_mutex_);
+            for (const auto& state : ack_states_) {
+                TopicCursor* c = request.add_cursors();
+                c->set_topic(state.first.first);
+                c->set_partition(state.first.second);
+                c->set_next_sequence(AckFloor(state.second));
+                c->set_incarnation(state.second.incarnation);
+            }
+            request.set_ack_timeout_ms(static_cast<uint32_t>(options_.ack_timeout.count()));
+            request.set_max_unacked(static_cast<uint32_t>(options_.max_unacked));
+        } else {
+            for (const auto& cursor : cursors_) {
+                TopicCursor* c = request.add_cursors();
+                c->set_topic(cursor.first.first);
+                c->set_partition(cursor.first.second);
+                c->set_next_sequence(cursor.second.next_sequence);
+                c->set_incarnation(cursor.second.incarnation);
+            }
+        }
+        for (uint32_t partition : options_.partitions) {
+            request.add_partitions(partition);
+        }
+        if (batched) {
+            request.set_max_batch_size(static_cast<uint32_t>(options_.max_batch_size));
+            request.set_max_linger_ms(static_cast<uint32_t>(options_.max_linger.count()));
+        }
+        
+        // Wait for the channel to reconnect instead of failing fast while the server is down
+        ClientContext context;
+        context.set_wait_for_ready(true);
+        {
+            std::lock_guard<std::mutex> lock(stream_mutex_);
+            if (!running_) {
+                break;
+            }
+            context_ = &context;
+        }
+        
+        Status status;
+        if (options_.ack) {
+            status = ReadAckStream(&context, request, callback, &attempt);
+        } else if (shared_memory) {
+            status = ReadSharedMemoryStream(&context, request, callback, &attempt);
+        } else if (batched) {
+            auto reader = stub_->SubscribeBatched(&context, request);
+            MessageBatch batch;
+            while (reader->Read(&batch)) {
+                attempt = 0;
+                for (auto& message : *batch.mutable_messages()) {
+                    Deliver(std::move(message), callback);
+                }
+            }
+            status = reader->Finish();
+        } else {
+            auto reader = stub_->Subscribe(&context, request);
+            Message message;
+            while (reader->Read(&message)) {
+                attempt = 0;
+                Deliver(std::move(message), callback);
+            }
+            status = reader->Finish();
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(stream_mutex_);
+            context_ = nullptr;
+        }
+        if (!running_) {
+            break;
+        }
+        
+        if (shared_memory && (status.error_code() == grpc::StatusCode::FAILED_PRECONDITION ||
+                              status.error_code() == grpc::StatusCode::UNIMPLEMENTED ||
+                              status.error_code() == grpc::StatusCode::DATA_LOSS)) {
+            std::cout << "Shared memory transport unavailable, subscribing over gRPC: "
+                      << status.error_message() << std::endl;
+            shared_memory = false;
+            continue;
+        }
+        
+        if (!options_.ack && batched && status.error_code() == grpc::StatusCode::UNIMPLEMENTED) {
+            std::cout << "Server does not support batched delivery, using Subscribe" << std::endl;
+            batched = false;
+            continue;
+        }
+        
+        attempt++;
+        std::chrono::milliseconds delay = Backoff(attempt);
         std::cerr << "Subscription stream broken: " << status.error_code() 
-                  << ": " << status.error_message() << std::endl;
+                  << ": " << status.error_message()
+                  << "; reconnecting in " << delay.count() << " ms" << std::endl;
+        
+        std::unique_lock<std::mutex> lock(stream_mutex_);
+        stop_cv_.wait_for(lock, delay, [this] { return !running_; });
     }
     
     std::cout << "Subscription thread terminated." << std::endl;
 }
+
+/**
+ * @brief Read one SubscribeAck stream until it ends.
+ *
+ * The stream's first request carries the subscription. While this thread
+ * reads and delivers batches, a second thread writes the acknowledgements
+ * collected so far every kAckInterval, or sooner once kMaxAcksPerRequest are
+ * waiting.
+ *
+ * @param context The context of the stream
+ * @param request The subscription
+ * @param callback The subscriber callback
+ * @param attempt Reconnect attempt counter, reset when a batch arrives
+ * @return The status the stream finished with
+ */
+Status SubscriberClient::ReadAckStream(ClientContext* context, const SubscribeRequest& request,
+                                       const TopicCallbackFn& callback, int* attempt) {
+    auto stream = stub_->SubscribeAck(context);
+    AckRequest first;
+    *first.mutable_subscribe() = request;
+    if (!stream->Write(first)) {
+        return stream->Finish();
+    }
+    
+    bool reading = true;  // Guarded by ack_mutex_
+    std::thread sender([&] {
+        AckRequest acks;
+        std::unique_lock<std::mutex> lock(ack_mutex_);
+        while (reading) {
+            ack_cv_.wait_for(lock, kAckInterval, [&] {
+                return !reading || unsent_acks_ >= kMaxAcksPerRequest;
+            });
+            acks.Clear();
+            CollectAcksLocked(&acks);
+            if (acks.acks_size() == 0) {
+                continue;
+            }
+            lock.unlock();
+            bool ok = stream->Write(acks);
+            lock.lock();
+            if (!ok) {
+                break;
+            }
+        }
+    });
+    
+    MessageBatch batch;
+    while (stream->Read(&batch)) {
+        *attempt = 0;
+        for (auto& message : *batch.mutable_messages()) {
+            Deliver(std::move(message), callback);
+        }
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(ack_mutex_);
+        reading = false;
+    }
+    ack_cv_.notify_all();
+    sender.join();
+    return stream->Finish();
+}
+
+/**
+ * @brief Read one SubscribeSharedMemory attachment until it ends.
+ *
+ * The client creates the ring and the server maps it, confirms on the
+ * stream and then writes each message's serialized bytes into it. This
+ * thread polls the ring while a watcher thread waits for the stream to end,
+ * which means the server has detached; whatever the server wrote before
+ * that is still delivered.
+ *
+ * @param context The context of the stream
+ * @param request The subscription
+ * @param callback The subscriber callback
+ * @param attempt Reconnect attempt counter, reset when a message arrives
+ * @return The status the stream finished with; FAILED_PRECONDITION if the ring could not be shared
+ *         or a message did not fit it, DATA_LOSS if it was found corrupt
+ */
+Status SubscriberClient::ReadSharedMemoryStream(ClientContext* context, const SubscribeRequest& request,
+                                                const TopicCallbackFn& callback, int* attempt) {
+    std::unique_ptr<pubsub::common::ShmRing> ring = pubsub::common::ShmRing::Create(options_.shared_memory_bytes);
+    if (!ring) {
+        return Status(grpc::StatusCode::FAILED_PRECONDITION, "Cannot create shared memory ring");
+    }
+    SharedMemoryAttach attach;
+    attach.set_segment(ring->Name());
+    attach.set_token(ring->Token());
+    *attach.mutable_subscribe() = request;
+    
+    auto reader = stub_->SubscribeSharedMemory(context, attach);
+    SharedMemoryStatus status;
+    if (!reader->Read(&status)) {
+        return reader->Finish();
+    }
+    ring->Unlink();
+    
+    std::atomic<bool> attached(true);
+    std::thread watcher([&] {
+        SharedMemoryStatus ignored;
+        while (reader->Read(&ignored)) {
+        }
+        attached = false;
+    });
+    
+    std::string record;
+    Message message;
+    unsigned idle = 0;
+    while (running_) {
+        // Checked before reading, so an empty ring after detaching means nothing is left
+        bool detached = !attached;
+        pubsub::common::ShmRing::ReadResult result = ring->TryRead(&record);
+        if (result == pubsub::common::ShmRing::ReadResult::kCorrupt) {
+            break;
+        }
+        if (result == pubsub::common::ShmRing::ReadResult::kRecord) {
+            idle = 0;
+            if (!message.ParseFromString(record)) {
+                std::cerr << "Dropped malformed record from shared memory" << std::endl;
+                continue;
+            }
+            *attempt = 0;
+            Deliver(std::move(message), callback);
+            continue;
+        }
+        if (detached) {
+            break;
+        }
+        pubsub::common::ShmRing::Pause(&idle);
+    }
+    
+    // Stop has cancelled the context if the loop ended because of it
+    if (attached) {
+        context->TryCancel();
+    }
+    watcher.join();
+    Status result = reader->Finish();
+    if (ring->Corrupt()) {
+        return Status(grpc::StatusCode::DATA_LOSS, "Shared memory ring is corrupt");
+    }
+    return result;
+}
+
+/**
+ * @brief Record that a message's callback returned.
+ *
+ * A message of an incarnation its partition has since left is not
+ * acknowledged, since its sequence number means another message now.
+ *
+ * @param message The message
+ */
+void SubscriberClient::Acked(const Message& message) {
+    bool full;
+    {
+        std::lock_guard<std::mutex> lock(ack_mutex_);
+        AckState& state = ack_states_[PartitionKey(message.topic(), message.partition())];
+        if (state.incarnation != message.incarnation() || state.outstanding.erase(message.sequence()) == 0) {
+            return;
+        }
+        state.acked.push_back(message.sequence());
+        full = ++unsent_acks_ == kMaxAcksPerRequest;
+    }
+    if (full) {
+        ack_cv_.notify_all();
+    }
+}
+
+/**
+ * @brief Move the unsent acks into a request.
+ *
+ * Each topic partition is acknowledged cumulatively up to its oldest
+ * outstanding message; only acks above that floor are listed individually. The caller
+ * must hold ack_mutex_.
+ *
+ * @param request Receives one TopicAck per topic with new acknowledgements
+ */
+void SubscriberClient::CollectAcksLocked(AckRequest* request) {
+    if (unsent_acks_ == 0) {
+        return;
+    }
+    for (auto& entry : ack_states_) {
+        AckState& state = entry.second;
+        if (state.acked.empty()) {
+            continue;
+        }
+        TopicAck* ack = request->add_acks();
+        ack->set_topic(entry.first.first);
+        ack->set_partition(entry.first.second);
+        uint64_t floor = AckFloor(state);
+        ack->set_cumulative(floor);
+        for (uint64_t sequence : state.acked) {
+            if (sequence >= floor) {
+                ack->add_sequences(sequence);
+            }
+        }
+        state.acked.clear();
+    }
+    unsent_acks_ = 0;
+}
+
+/**
+ * @brief Get the oldest sequence of a topic not yet acknowledged.
+ * @param state The topic's ack state
+ * @return The oldest outstanding sequence, or one past the newest received
+ */
+uint64_t SubscriberClient::AckFloor(const AckState& state) {
+    return state.outstanding.empty() ? state.next : *state.outstanding.begin();
+}
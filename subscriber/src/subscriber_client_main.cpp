@@ -4,14 +4,20 @@
  */
 
 #include "subscriber_client.h"
+#include "subscriber_stats.h"
+#include "pubsub_channel.h"
+#include <cctype>
+#include <cstdlib>
 #include <iostream>
+#include <stdexcept>
+#include <memory>
 #include <string>
 #include <vector>
-#include <unordered_map>
 #include <chrono>
 #include <thread>
 #include <atomic>
 #include <csignal>
+#include <mutex>
 #include <grpcpp/grpcpp.h>
 
 // Signal handling for clean shutdown
@@ -22,11 +28,35 @@ void signalHandler(int signal) {
     running.store(false);
 }
 
+/**
+ * @brief Parse a dispatch thread count given on the command line.
+ * @param arg Argument to parse: a positive decimal number and nothing else
+ * @param threads Set to the parsed count
+ * @return bool True if the argument was a valid count
+ */
+bool parseDispatchThreads(const std::string& arg, size_t* threads) {
+    if (arg.empty() || !std::isdigit(static_cast<unsigned char>(arg[0]))) {
+        return false;
+    }
+    try {
+        size_t parsed = 0;
+        unsigned long value = std::stoul(arg, &parsed);
+        if (parsed != arg.size() || value == 0) {
+            return false;
+        }
+        *threads = value;
+        return true;
+    } catch (const std::logic_error&) {
+        return false;
+    }
+}
+
 /**
  * @brief Main function for the subscriber client.
  * 
  * This application connects to a PubSub server and subscribes to specified topics.
- * It handles messages from topics separately and maintains statistics for each topic.
+ * It handles messages from topics separately and every 5 seconds prints each topic's
+ * receive rate, store-to-receive latency percentiles and sequence gaps.
  */
 int main(int argc, char** argv) {
     // Set up signal handler
@@ -35,10 +65,18 @@ int main(int argc, char** argv) {
     // Default values
     std::string server_address = "localhost:50051";
     std::string topics_arg = "default_topic";
+    SubscriberOptions options;
     
     // Parse command line arguments
     if (argc > 1) server_address = argv[1];
     if (argc > 2) topics_arg = argv[2];
+    if (argc > 3 && !parseDispatchThreads(argv[3], &options.dispatch_threads)) {
+        std::cerr << "Invalid dispatch thread count: " << argv[3] << std::endl;
+        std::cerr << "Usage: " << argv[0] << " [server_address] [topics] [dispatch_threads]"
+                  << " (dispatch_threads at least 1; omit it to run callbacks inline)" << std::endl;
+        return EXIT_FAILURE;
+    }
+    options.stats = std::make_shared<SubscriberStats>();
     
     // Parse comma-separated topics
     std::vector<std::string> topics;
@@ -50,22 +88,21 @@ int main(int argc, char** argv) {
     topics.push_back(topics_arg.substr(start));
     
     // Create a channel to the server
-    auto channel = grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials());
+    auto channel = pubsub::common::createChannel(server_address);
     
     // Create the subscriber client
-    SubscriberClient subscriber(channel);
+    SubscriberClient subscriber(channel, options);
     
-    // Keep track of message counts for each topic
-    std::unordered_map<std::string, int> message_counts;
+    // Prints from callbacks, which may run on several threads
+    std::mutex output_mutex;
     
     // Subscribe to the topics
-    subscriber.SubscribeToMultiple(topics, [&message_counts](const std::string& topic, const pubsub::Message& msg) {
+    subscriber.SubscribeToMultiple(topics, [&](const std::string& topic, const pubsub::Message& msg) {
+        std::lock_guard<std::mutex> lock(output_mutex);
+
         // Process the message
         std::cout << "Received message from topic '" << topic << "': " 
                   << msg.content() << " (ID: " << msg.message_id() << ")" << std::endl;
-        
-        // Increment the message count for this topic
-        message_counts[topic]++;
     });
     
     std::cout << "Subscriber client started. Press Ctrl+C to stop." << std::endl;
@@ -74,11 +111,8 @@ int main(int argc, char** argv) {
     while (running.load()) {
         std::this_thread::sleep_for(std::chrono::seconds(5));
         
-        std::cout << "\n===== Message Statistics =====" << std::endl;
-        for (auto const& pair : message_counts) {
-            std::cout << "Topic '" << pair.first << "': " << pair.second << " messages" << std::endl;
-        }
-        std::cout << "============================\n" << std::endl;
+        std::lock_guard<std::mutex> lock(output_mutex);
+        options.stats->Print(std::cout);
     }
     
     // Clean up
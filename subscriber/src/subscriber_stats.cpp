@@ -0,0 +1,229 @@
+/**
+ * @file subscriber_stats.cpp
+ * @brief Implementation of the receive rate, latency and sequence-gap statistics kept by subscribers.
+ */
+#include "subscriber_stats.h"
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <unordered_map>
+#include <utility>
+#include "pubsub_common.h"
+
+namespace {
+
+// Source of instance IDs, so a thread's cached shard never outlives its instance's ID
+std::atomic<uint64_t> next_instance_id(1);
+
+// Add to a counter that only the calling thread writes
+void increment(std::atomic<uint64_t>* counter, uint64_t amount) {
+    counter->store(counter->load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+// Take the growth of a counter since it was last taken
+uint64_t take(const std::atomic<uint64_t>& counter, uint64_t* reported) {
+    uint64_t value = counter.load(std::memory_order_relaxed);
+    uint64_t taken = value - *reported;
+    *reported = value;
+    return taken;
+}
+
+// Print a nanosecond latency in milliseconds
+double toMillis(int64_t nanos) {
+    return nanos / 1e6;
+}
+
+} // namespace
+
+/**
+ * @struct SubscriberStats::TopicCounters
+ * @brief One topic's counters in one shard.
+ *
+ * The atomics are written only by the shard's thread, which increments them
+ * with a plain load and store. Collect reads them and reports the
+ * difference from what it read last time, kept in the reported counters.
+ * The sequence expectations are touched only by the shard's thread.
+ */
+struct SubscriberStats::TopicCounters {
+    explicit TopicCounters(const std::string& name) : topic(name) {}
+
+    const std::string topic;
+    std::atomic<uint64_t> messages{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> missing{0};
+    std::atomic<uint64_t> duplicates{0};
+    pubsub::common::ConcurrentLatencyHistogram latency;
+    std::vector<uint64_t> next_sequence;  // Per partition, one past the highest received; 0 before the first
+    std::vector<uint64_t> incarnation;    // Per partition, the incarnation next_sequence counts in
+    TopicCounters* next = nullptr;        // Next topic in the shard's list
+
+    // Values of the atomics at the previous Collect
+    uint64_t reported_messages = 0;
+    uint64_t reported_bytes = 0;
+    uint64_t reported_missing = 0;
+    uint64_t reported_duplicates = 0;
+};
+
+/**
+ * @struct SubscriberStats::Shard
+ * @brief The counters of one recording thread.
+ *
+ * A new topic is pushed onto the front of the list with a release store
+ * once its counters are constructed, so Collect can walk the list while the
+ * thread records. Topics are never removed before the shard is destroyed.
+ */
+struct SubscriberStats::Shard {
+    ~Shard() {
+        TopicCounters* counters = topics.load(std::memory_order_relaxed);
+        while (counters) {
+            TopicCounters* next = counters->next;
+            delete counters;
+            counters = next;
+        }
+    }
+
+    std::atomic<TopicCounters*> topics{nullptr};
+    std::unordered_map<std::string, TopicCounters*> index;  // Lookup for the shard's thread only
+};
+
+/**
+ * @brief Constructs empty statistics; the first interval starts now.
+ */
+SubscriberStats::SubscriberStats()
+    : id_(next_instance_id.fetch_add(1, std::memory_order_relaxed)),
+      collected_at_(std::chrono::steady_clock::now()) {}
+
+/**
+ * @brief Destructor that frees every shard; no thread may be recording.
+ */
+SubscriberStats::~SubscriberStats() = default;
+
+/**
+ * @brief Get the calling thread's shard, creating it on the thread's first message.
+ *
+ * Each thread caches its shard per instance ID. An entry left behind by a
+ * destroyed instance is never matched again, since IDs are not reused.
+ *
+ * @return The shard
+ */
+SubscriberStats::Shard* SubscriberStats::LocalShard() {
+    thread_local std::vector<std::pair<uint64_t, Shard*>> cache;
+    for (const auto& entry : cache) {
+        if (entry.first == id_) {
+            return entry.second;
+        }
+    }
+    Shard* shard = new Shard;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        shards_.emplace_back(shard);
+    }
+    cache.emplace_back(id_, shard);
+    return shard;
+}
+
+/**
+ * @brief Count a received message in the calling thread's shard.
+ * @param message The message, as received from the server
+ */
+void SubscriberStats::Record(const pubsub::Message& message) {
+    int64_t latency = pubsub::common::getCurrentTimestamp() - message.timestamp();
+    Shard* shard = LocalShard();
+    TopicCounters*& counters = shard->index[message.topic()];
+    if (!counters) {
+        counters = new TopicCounters(message.topic());
+        counters->next = shard->topics.load(std::memory_order_relaxed);
+        shard->topics.store(counters, std::memory_order_release);
+    }
+
+    increment(&counters->messages, 1);
+    increment(&counters->bytes, message.content().size());
+    counters->latency.Record(latency);
+
+    if (message.partition() >= counters->next_sequence.size()) {
+        counters->next_sequence.resize(message.partition() + 1, 0);
+        counters->incarnation.resize(message.partition() + 1, 0);
+    }
+    uint64_t& next = counters->next_sequence[message.partition()];
+    if (counters->incarnation[message.partition()] != message.incarnation()) {
+        // The partition started over; its numbering has nothing in common with the old one
+        counters->incarnation[message.partition()] = message.incarnation();
+        next = 0;
+    }
+    if (next != 0 && message.sequence() > next) {
+        increment(&counters->missing, message.sequence() - next);
+    } else if (next != 0 && message.sequence() < next) {
+        increment(&counters->duplicates, 1);
+    }
+    next = std::max(next, message.sequence() + 1);
+}
+
+/**
+ * @brief Take everything recorded since the previous Collect.
+ * @param topics Receives one report per topic received since construction, sorted by topic
+ * @return Seconds since the previous Collect, or since construction for the first
+ */
+double SubscriberStats::Collect(std::vector<TopicReport>* topics) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, TopicReport> reports;
+    for (const auto& entry : totals_) {
+        reports[entry.first].total = entry.second;
+    }
+    for (const auto& shard : shards_) {
+        for (TopicCounters* counters = shard->topics.load(std::memory_order_acquire); counters;
+             counters = counters->next) {
+            TopicReport& report = reports[counters->topic];
+            report.messages += take(counters->messages, &counters->reported_messages);
+            report.bytes += take(counters->bytes, &counters->reported_bytes);
+            report.missing += take(counters->missing, &counters->reported_missing);
+            report.duplicates += take(counters->duplicates, &counters->reported_duplicates);
+            counters->latency.Drain(&report.latency);
+        }
+    }
+
+    topics->clear();
+    topics->reserve(reports.size());
+    for (auto& entry : reports) {
+        entry.second.topic = entry.first;
+        entry.second.total += entry.second.messages;
+        totals_[entry.first] = entry.second.total;
+        topics->push_back(std::move(entry.second));
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - collected_at_).count();
+    collected_at_ = now;
+    return seconds;
+}
+
+/**
+ * @brief Collect and print a table of each topic's rate, latency percentiles and gaps.
+ * @param out The stream to print to
+ */
+void SubscriberStats::Print(std::ostream& out) {
+    std::vector<TopicReport> topics;
+    double seconds = Collect(&topics);
+    double rate_scale = seconds > 0 ? 1.0 / seconds : 0;
+
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << "\n===== Message Statistics (" << std::fixed << std::setprecision(1) << seconds << " s) =====\n"
+        << std::left << std::setw(20) << "topic" << std::right
+        << std::setw(10) << "total" << std::setw(10) << "msg/s" << std::setw(9) << "MB/s"
+        << std::setw(9) << "p50 ms" << std::setw(9) << "p99 ms" << std::setw(10) << "p99.9 ms"
+        << std::setw(9) << "max ms" << std::setw(9) << "missing" << std::setw(6) << "dup" << '\n';
+    for (const TopicReport& report : topics) {
+        out << std::left << std::setw(20) << report.topic << std::right
+            << std::setw(10) << report.total
+            << std::setprecision(1) << std::setw(10) << report.messages * rate_scale
+            << std::setprecision(2) << std::setw(9) << report.bytes * rate_scale / 1e6
+            << std::setw(9) << toMillis(report.latency.ValueAt(0.5))
+            << std::setw(9) << toMillis(report.latency.ValueAt(0.99))
+            << std::setw(10) << toMillis(report.latency.ValueAt(0.999))
+            << std::setw(9) << toMillis(report.latency.Max())
+            << std::setw(9) << report.missing << std::setw(6) << report.duplicates << '\n';
+    }
+    out << "============================\n" << std::endl;
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,202 @@
+/**
+ * @file timer_wheel.cpp
+ * @brief Implementation of the timing wheel used for message redelivery and scheduled delivery.
+ */
+#include "timer_wheel.h"
+#include <algorithm>
+
+/**
+ * @brief Constructs an empty wheel whose tick 0 starts now.
+ * @param tick Duration of one tick (at least 1 ms)
+ * @param num_slots Number of slots per level, rounded up to a power of two
+ * @param levels Number of levels (at least 1); delays are clamped to between
+ *               (num_slots - 1) * num_slots^(levels - 1) and num_slots^levels - 1 ticks
+ */
+TimerWheel::TimerWheel(std::chrono::milliseconds tick, size_t num_slots, size_t levels)
+    : tick_(std::max(tick, std::chrono::milliseconds(1))), start_(Clock::now()),
+      current_tick_(0), slot_bits_(1), size_(0) {
+    while ((size_t(1) << slot_bits_) < num_slots) {
+        slot_bits_++;
+    }
+    num_slots_ = size_t(1) << slot_bits_;
+    // Keep the ticks the wheel covers within 64 bits
+    levels_ = std::min<size_t>(std::max<size_t>(levels, 1), 63 / slot_bits_);
+    slots_.resize(num_slots_ * levels_);
+    for (auto& slot : slots_) {
+        slot.prev = &slot;
+        slot.next = &slot;
+    }
+}
+
+/**
+ * @brief Schedule a timer, or reschedule it if it is already linked.
+ *
+ * The deadline is rounded up to a whole tick, at least one tick after the
+ * last processed tick and at most as far after it as the top level reaches.
+ *
+ * @param timer The timer to schedule
+ * @param delay How long from the wheel's current time until the timer fires
+ */
+void TimerWheel::Schedule(Timer* timer, std::chrono::milliseconds delay) {
+    if (timer->Scheduled()) {
+        Unlink(timer);
+    }
+    uint64_t ticks = (std::max<int64_t>(delay.count(), 0) + tick_.count() - 1) / tick_.count();
+    ticks = std::max<uint64_t>(ticks, 1);
+    timer->deadline = std::min(current_tick_ + ticks, LastTick());
+    Link(timer);
+}
+
+/**
+ * @brief Schedule a timer for a point in time, or reschedule it if it is already linked.
+ *
+ * Unlike Schedule, the deadline does not depend on when Advance last ran.
+ *
+ * @param timer The timer to schedule
+ * @param when When the timer fires; a time already passed fires on the next Advance
+ */
+void TimerWheel::ScheduleAt(Timer* timer, Clock::time_point when) {
+    if (timer->Scheduled()) {
+        Unlink(timer);
+    }
+    uint64_t deadline = 0;
+    if (when > start_) {
+        auto tick = std::chrono::duration_cast<std::chrono::nanoseconds>(tick_).count();
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(when - start_).count();
+        deadline = (elapsed + tick - 1) / tick;
+    }
+    timer->deadline = std::min(std::max(deadline, current_tick_ + 1), LastTick());
+    Link(timer);
+}
+
+/**
+ * @brief Unlink a timer; does nothing if it is not scheduled.
+ * @param timer The timer to cancel
+ */
+void TimerWheel::Cancel(Timer* timer) {
+    if (timer->Scheduled()) {
+        Unlink(timer);
+    }
+}
+
+/**
+ * @brief Fire every timer due at or before @p now.
+ *
+ * Each tick that passed since the previous call first moves the timers of
+ * every higher-level slot starting at that tick down the wheel, then empties
+ * its level-0 slot. A callback may reschedule the timer it is given, which
+ * links it into a later slot.
+ *
+ * @param now The current time
+ * @param on_expire Called once for every fired timer
+ * @return The number of timers fired
+ */
+size_t TimerWheel::Advance(Clock::time_point now, const ExpireFn& on_expire) {
+    if (now < start_) {
+        return 0;
+    }
+    uint64_t target = std::chrono::duration_cast<std::chrono::milliseconds>(now - start_).count() / tick_.count();
+    size_t fired = 0;
+    while (current_tick_ < target) {
+        current_tick_++;
+        if ((current_tick_ & (num_slots_ - 1)) == 0) {
+            for (size_t level = levels_ - 1; level > 0; level--) {
+                if ((current_tick_ & ((uint64_t(1) << (level * slot_bits_)) - 1)) == 0) {
+                    Cascade(level, current_tick_);
+                }
+            }
+        }
+        Timer& head = slots_[current_tick_ & (num_slots_ - 1)];
+        while (size_ > 0 && head.next != &head) {
+            Timer* timer = head.next;
+            Unlink(timer);
+            fired++;
+            on_expire(timer);
+        }
+        if (size_ == 0) {
+            // Nothing left to fire: jump straight to the target tick
+            current_tick_ = target;
+        }
+    }
+    return fired;
+}
+
+/**
+ * @brief Unlink every scheduled timer without waiting for it to be due.
+ * @param on_expire Called once for every unlinked timer, in no particular order
+ */
+void TimerWheel::Drain(const ExpireFn& on_expire) {
+    for (auto& head : slots_) {
+        while (head.next != &head) {
+            Timer* timer = head.next;
+            Unlink(timer);
+            on_expire(timer);
+        }
+    }
+}
+
+/**
+ * @brief Get the latest tick a timer can currently be linked for.
+ *
+ * A top-level slot must not be reused before the wheel has passed it, so the
+ * wheel reaches to the end of the top-level slot before the current one.
+ *
+ * @return The tick
+ */
+uint64_t TimerWheel::LastTick() const {
+    size_t shift = (levels_ - 1) * slot_bits_;
+    return (((current_tick_ >> shift) + num_slots_) << shift) - 1;
+}
+
+/**
+ * @brief Link a timer at the tail of the slot for its deadline.
+ *
+ * The timer goes into the lowest level in which its deadline falls less than
+ * one rotation after the current tick. A deadline equal to the current tick,
+ * which only happens while cascading, lands in the level-0 slot about to fire.
+ *
+ * @param timer The timer to link; its deadline must be set
+ */
+void TimerWheel::Link(Timer* timer) {
+    size_t level = 0;
+    while (level + 1 < levels_ &&
+           (timer->deadline >> (level * slot_bits_)) - (current_tick_ >> (level * slot_bits_)) >= num_slots_) {
+        level++;
+    }
+    Timer& head = slots_[level * num_slots_ + ((timer->deadline >> (level * slot_bits_)) & (num_slots_ - 1))];
+    timer->prev = head.prev;
+    timer->next = &head;
+    head.prev->next = timer;
+    head.prev = timer;
+    size_++;
+}
+
+/**
+ * @brief Remove a timer from its slot's list.
+ * @param timer The linked timer to remove
+ */
+void TimerWheel::Unlink(Timer* timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = nullptr;
+    timer->next = nullptr;
+    size_--;
+}
+
+/**
+ * @brief Relink the timers of one slot of a higher level into the levels below.
+ * @param level The level, at least 1
+ * @param tick The tick at which the slot starts, which must be the current tick
+ */
+void TimerWheel::Cascade(size_t level, uint64_t tick) {
+    Timer& head = slots_[level * num_slots_ + ((tick >> (level * slot_bits_)) & (num_slots_ - 1))];
+    Timer* timer = head.next;
+    head.prev = &head;
+    head.next = &head;
+    while (timer != &head) {
+        Timer* next = timer->next;
+        size_--;
+        Link(timer);
+        timer = next;
+    }
+}
@@ -0,0 +1,191 @@
+/**
+ * @file topic_buffer.cpp
+ * @brief Implementation of the fixed-capacity message store used for each topic.
+ */
+#include "topic_buffer.h"
+#include <algorithm>
+
+namespace {
+
+// Stale index entries a compacted buffer tolerates beyond one per key before dropping them
+constexpr size_t kMinStaleEntries = 64;
+
+} // namespace
+
+/**
+ * @brief Constructs an empty buffer.
+ * @param capacity Maximum number of messages to retain (at least one slot is kept); ignored
+ *                 when compacted
+ * @param compacted Retain the latest message of every key instead of the latest messages
+ */
+TopicBuffer::TopicBuffer(size_t capacity, bool compacted)
+    : capacity_(std::max<size_t>(capacity, 1)), compacted_(compacted), next_sequence_(0), base_(0) {}
+
+/**
+ * @brief Claim the slot for the next message, evicting the oldest one when full.
+ *
+ * While the buffer is filling up a new slot is constructed at the back. Once the
+ * buffer is full the slot of the oldest message is handed out again, still
+ * holding that message's frame until the caller stores the new one over it. A
+ * compacted buffer hands out the slot of the key's previous message in the same
+ * way.
+ *
+ * @param stamp Ordering stamp of the message; must not decrease between appends
+ * @param key The message's key; in a compacted buffer the message replaces the one with this key
+ * @return The slot to store the message's frame in
+ */
+grpc::Slice* TopicBuffer::Append(uint64_t stamp, const std::string& key) {
+    if (compacted_) {
+        KeyEntry& entry = latest_[key];
+        entry.sequence = next_sequence_;
+        entry.stamp = stamp;
+        order_.emplace_back(next_sequence_, &entry);
+        next_sequence_++;
+        if (order_.size() >= 2 * latest_.size() + kMinStaleEntries) {
+            CompactOrder();
+        }
+        return &entry.frame;
+    }
+    grpc::Slice* slot;
+    if (slots_.size() < capacity_) {
+        slots_.emplace_back();
+        stamps_.push_back(stamp);
+        slot = &slots_.back();
+    } else {
+        slot = &slots_[SlotOf(next_sequence_)];
+        stamps_[SlotOf(next_sequence_)] = stamp;
+    }
+    next_sequence_++;
+    return slot;
+}
+
+/**
+ * @brief Drop every retained message and continue numbering at @p next_sequence.
+ *
+ * Used when restoring a snapshot, whose partitions do not start at sequence 0.
+ * The slots are freed, so the buffer warms up again, filling them from the
+ * first slot on with @p next_sequence.
+ *
+ * @param next_sequence The sequence number the next appended message will receive
+ */
+void TopicBuffer::Reset(uint64_t next_sequence) {
+    slots_.clear();
+    stamps_.clear();
+    latest_.clear();
+    order_.clear();
+    next_sequence_ = next_sequence;
+    base_ = next_sequence;
+}
+
+/**
+ * @brief Continue numbering at a later sequence, leaving a gap.
+ *
+ * A ring cannot hold a gap, so it drops its messages; a compacted buffer keeps them.
+ *
+ * @param next_sequence The sequence number the next appended message will receive; does
+ *                      nothing unless it is above NextSequence()
+ */
+void TopicBuffer::Skip(uint64_t next_sequence) {
+    if (next_sequence <= next_sequence_) {
+        return;
+    }
+    if (!compacted_) {
+        slots_.clear();
+        stamps_.clear();
+        base_ = next_sequence;
+    }
+    next_sequence_ = next_sequence;
+}
+
+/**
+ * @brief Visit at most @p max_count retained messages with a sequence at or after @p from.
+ *
+ * If @p from points at messages that were already evicted, visiting starts at
+ * the oldest retained message. The visitor may keep a reference to a frame
+ * by copying the slice; the frame stays valid after the message is evicted.
+ *
+ * @param from The first sequence number the caller has not seen yet
+ * @param max_count Maximum number of messages to visit
+ * @param visit Called with the stamp, sequence number and frame of each, oldest first
+ * @return The sequence number to pass on the next call
+ */
+uint64_t TopicBuffer::VisitSince(uint64_t from, size_t max_count,
+                                 const std::function<void(uint64_t, uint64_t, const grpc::Slice&)>& visit) const {
+    if (compacted_) {
+        return VisitCompacted(from, max_count, visit);
+    }
+    uint64_t oldest = next_sequence_ - slots_.size();
+    uint64_t seq = std::min(std::max(from, oldest), next_sequence_);
+    uint64_t end = next_sequence_ - seq > max_count ? seq + max_count : next_sequence_;
+    for (; seq < end; seq++) {
+        visit(stamps_[SlotOf(seq)], seq, slots_[SlotOf(seq)]);
+    }
+    return end;
+}
+
+/**
+ * @brief Look up a retained message by sequence number.
+ * @param sequence The message's sequence number
+ * @return The message's frame, or nullptr if it was evicted or not appended yet
+ */
+const grpc::Slice* TopicBuffer::Get(uint64_t sequence) const {
+    if (compacted_) {
+        size_t index = OrderIndex(sequence);
+        if (index == order_.size() || order_[index].first != sequence ||
+            order_[index].second->sequence != sequence) {
+            return nullptr;
+        }
+        return &order_[index].second->frame;
+    }
+    if (sequence >= next_sequence_ || next_sequence_ - sequence > slots_.size()) {
+        return nullptr;
+    }
+    return &slots_[SlotOf(sequence)];
+}
+
+/**
+ * @brief Visit the current messages of a compacted buffer updated at or after @p from.
+ *
+ * Entries of the index whose key has been updated since are skipped.
+ *
+ * @param from The first sequence number the caller has not seen yet
+ * @param max_count Maximum number of messages to visit
+ * @param visit Called with the stamp, sequence number and frame of each, in sequence order
+ * @return The sequence number to pass on the next call
+ */
+template <typename VisitFn>
+uint64_t TopicBuffer::VisitCompacted(uint64_t from, size_t max_count, const VisitFn& visit) const {
+    size_t visited = 0;
+    for (size_t i = OrderIndex(from); i < order_.size(); i++) {
+        const OrderEntry& entry = order_[i];
+        if (entry.second->sequence != entry.first) {
+            continue;
+        }
+        if (visited == max_count) {
+            return entry.first;
+        }
+        visit(entry.second->stamp, entry.first, entry.second->frame);
+        visited++;
+    }
+    return next_sequence_;
+}
+
+/**
+ * @brief Find where a read of a compacted buffer starts.
+ * @param from The first sequence number to read
+ * @return Position in order_ of the first entry with a sequence at or after @p from
+ */
+size_t TopicBuffer::OrderIndex(uint64_t from) const {
+    auto it = std::lower_bound(order_.begin(), order_.end(), from,
+                               [](const OrderEntry& entry, uint64_t sequence) { return entry.first < sequence; });
+    return static_cast<size_t>(it - order_.begin());
+}
+
+/**
+ * @brief Drop the index entries of a compacted buffer whose key has been updated since.
+ */
+void TopicBuffer::CompactOrder() {
+    order_.erase(std::remove_if(order_.begin(), order_.end(),
+                                [](const OrderEntry& entry) { return entry.second->sequence != entry.first; }),
+                 order_.end());
+}
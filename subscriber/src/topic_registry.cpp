@@ -0,0 +1,197 @@
+/**
+ * @file topic_registry.cpp
+ * @brief Implementation of the registry that interns topic names into dense integer IDs.
+ */
+#include "topic_registry.h"
+#include <cstring>
+#include <functional>
+
+namespace {
+
+// Slots in a new table; the table doubles whenever it would become more than half full
+constexpr size_t kInitialSlots = 64;
+
+// Bytes in front of a name's characters: its length and its hash
+constexpr size_t kNameHeader = 2 * sizeof(uint32_t);
+
+/**
+ * @brief Hash a topic name down to the 32 bits kept in its slot.
+ * @param name The topic name
+ * @return The hash
+ */
+uint32_t HashName(const std::string& name) {
+    return static_cast<uint32_t>(std::hash<std::string>()(name));
+}
+
+/**
+ * @brief Get the length of a name stored in a block.
+ * @param block The name's block
+ * @return The length in bytes
+ */
+uint32_t NameLength(const char* block) {
+    uint32_t length;
+    std::memcpy(&length, block, sizeof(length));
+    return length;
+}
+
+/**
+ * @brief Get the hash of a name stored in a block.
+ * @param block The name's block
+ * @return The hash
+ */
+uint32_t NameHash(const char* block) {
+    uint32_t hash;
+    std::memcpy(&hash, block + sizeof(uint32_t), sizeof(hash));
+    return hash;
+}
+
+} // namespace
+
+constexpr TopicId TopicRegistry::kEmpty;
+
+/**
+ * @brief Constructs an empty registry.
+ */
+TopicRegistry::TopicRegistry() : slots_(kInitialSlots, Slot{0, kEmpty, nullptr}), size_(0) {}
+
+/**
+ * @brief Destructor that frees the interned names.
+ */
+TopicRegistry::~TopicRegistry() {
+    for (char* block : names_) {
+        delete[] block;
+    }
+}
+
+/**
+ * @brief Get the ID of a topic, registering it if it is new.
+ *
+ * New topics receive the most recently freed ID, or the next unused one.
+ *
+ * @param name The topic name
+ * @return The topic's ID
+ */
+TopicId TopicRegistry::Intern(const std::string& name) {
+    uint32_t hash = HashName(name);
+    size_t slot = Probe(name.data(), name.size(), hash);
+    if (slots_[slot].id != kEmpty) {
+        return slots_[slot].id;
+    }
+    if ((size_ + 1) * 2 > slots_.size()) {
+        Grow();
+        slot = Probe(name.data(), name.size(), hash);
+    }
+
+    uint32_t length = static_cast<uint32_t>(name.size());
+    char* block = new char[kNameHeader + length];
+    std::memcpy(block, &length, sizeof(length));
+    std::memcpy(block + sizeof(length), &hash, sizeof(hash));
+    std::memcpy(block + kNameHeader, name.data(), length);
+
+    TopicId id;
+    if (!free_ids_.empty()) {
+        id = free_ids_.back();
+        free_ids_.pop_back();
+        names_[id] = block;
+    } else {
+        id = static_cast<TopicId>(names_.size());
+        names_.push_back(block);
+    }
+    slots_[slot] = Slot{hash, id, block};
+    size_++;
+    return id;
+}
+
+/**
+ * @brief Look up the ID of a topic without registering it.
+ * @param name The topic name
+ * @param id Receives the topic's ID when found
+ * @return true if the topic is registered
+ */
+bool TopicRegistry::Find(const std::string& name, TopicId* id) const {
+    const Slot& slot = slots_[Probe(name.data(), name.size(), HashName(name))];
+    if (slot.id == kEmpty) {
+        return false;
+    }
+    *id = slot.id;
+    return true;
+}
+
+/**
+ * @brief Unregister a topic, making its ID available to the next new topic.
+ *
+ * The slots after the removed one are shifted back over the gap for as long
+ * as that keeps each of them at or after its home slot, which leaves the
+ * table exactly as if the topic had never been inserted.
+ *
+ * @param id A registered topic ID
+ */
+void TopicRegistry::Remove(TopicId id) {
+    const size_t mask = slots_.size() - 1;
+    size_t gap = NameHash(names_[id]) & mask;
+    while (slots_[gap].id != id) {
+        gap = (gap + 1) & mask;
+    }
+    for (size_t next = (gap + 1) & mask; slots_[next].id != kEmpty; next = (next + 1) & mask) {
+        size_t home = slots_[next].hash & mask;
+        if (((next - home) & mask) >= ((next - gap) & mask)) {
+            slots_[gap] = slots_[next];
+            gap = next;
+        }
+    }
+    slots_[gap] = Slot{0, kEmpty, nullptr};
+
+    delete[] names_[id];
+    names_[id] = nullptr;
+    free_ids_.push_back(id);
+    size_--;
+}
+
+/**
+ * @brief Get the interned name of a topic.
+ * @param id A registered topic ID
+ * @return A copy of the topic name
+ */
+std::string TopicRegistry::Name(TopicId id) const {
+    return std::string(names_[id] + kNameHeader, NameLength(names_[id]));
+}
+
+/**
+ * @brief Find the slot of a name.
+ * @param data The name's characters
+ * @param size The name's length
+ * @param hash The name's hash
+ * @return The slot holding the name, or the empty slot where it would be inserted
+ */
+size_t TopicRegistry::Probe(const char* data, size_t size, uint32_t hash) const {
+    const size_t mask = slots_.size() - 1;
+    size_t slot = hash & mask;
+    while (slots_[slot].id != kEmpty) {
+        const Slot& entry = slots_[slot];
+        if (entry.hash == hash && NameLength(entry.name) == size &&
+            std::memcmp(entry.name + kNameHeader, data, size) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/**
+ * @brief Double the table and reinsert every registered topic.
+ */
+void TopicRegistry::Grow() {
+    std::vector<Slot> old(slots_.size() * 2, Slot{0, kEmpty, nullptr});
+    old.swap(slots_);
+    const size_t mask = slots_.size() - 1;
+    for (const Slot& entry : old) {
+        if (entry.id == kEmpty) {
+            continue;
+        }
+        size_t slot = entry.hash & mask;
+        while (slots_[slot].id != kEmpty) {
+            slot = (slot + 1) & mask;
+        }
+        slots_[slot] = entry;
+    }
+}
@@ -0,0 +1,62 @@
+/**
+ * @file test_check.h
+ * @brief Minimal assertion helpers shared by the unit test executables.
+ *
+ * Each test is a plain executable registered with CTest. A failed CHECK
+ * prints its location and expression and the test keeps going, so one run
+ * reports every failure; testResult gives the exit status for main.
+ */
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+#include <iostream>
+
+namespace pubsub {
+namespace test {
+
+/**
+ * @brief Get the number of failed checks of this test executable.
+ * @return The counter, incremented by CHECK
+ */
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+/**
+ * @brief Get the exit status of the test.
+ * @return 0 if every check passed, 1 otherwise
+ */
+inline int testResult() {
+    if (failures() > 0) {
+        std::cerr << failures() << " check(s) failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace test
+} // namespace pubsub
+
+// Record a failure unless the condition holds
+#define CHECK(condition)                                                                      \
+    do {                                                                                      \
+        if (!(condition)) {                                                                   \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #condition << std::endl; \
+            ++pubsub::test::failures();                                                       \
+        }                                                                                     \
+    } while (0)
+
+// Record a failure unless the two values are equal, printing both
+#define CHECK_EQ(actual, expected)                                                            \
+    do {                                                                                      \
+        auto check_actual_ = (actual);                                                        \
+        auto check_expected_ = (expected);                                                    \
+        if (!(check_actual_ == check_expected_)) {                                            \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_EQ failed: " #actual " is "  \
+                      << check_actual_ << ", expected " << check_expected_ << std::endl;      \
+            ++pubsub::test::failures();                                                       \
+        }                                                                                     \
+    } while (0)
+
+#endif // TEST_CHECK_H
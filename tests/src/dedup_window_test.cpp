@@ -0,0 +1,117 @@
+/**
+ * @file dedup_window_test.cpp
+ * @brief Tests of the per-producer dedup window: its edge, producer eviction and idle expiry.
+ */
+#include <string>
+#include "dedup_window.h"
+#include "test_check.h"
+
+namespace {
+
+const uint64_t kWindow = DedupWindow::kWindowSize;
+
+// Sequences exactly kWindowSize below the high-water mark fall out of the window
+void testWindowEdge() {
+    DedupWindow window;
+    CHECK(window.Accept("p", 5000, 0));
+    CHECK(!window.Accept("p", 5000, 0));
+
+    // The oldest sequence still tracked is accepted once, the next older one never
+    CHECK(window.Accept("p", 5000 - (kWindow - 1), 0));
+    CHECK(!window.Accept("p", 5000 - (kWindow - 1), 0));
+    CHECK(!window.Accept("p", 5000 - kWindow, 0));
+    CHECK(!window.Accept("p", 1, 0));
+
+    // Untracked publishes are always accepted
+    CHECK(window.Accept("p", 0, 0));
+    CHECK(window.Accept("p", 0, 0));
+    CHECK(window.Accept("", 7, 0));
+    CHECK(window.Accept("", 7, 0));
+}
+
+// Sliding the window clears the bits it passes over, which the sequences a window ahead share
+void testSliding() {
+    DedupWindow window;
+    for (uint64_t sequence = 1; sequence <= kWindow; sequence++) {
+        CHECK(window.Accept("p", sequence, 0));
+    }
+    // Shares its bit with sequence 1, which leaves the window
+    CHECK(window.Accept("p", kWindow + 1, 0));
+    CHECK(!window.Accept("p", kWindow + 1, 0));
+    CHECK(!window.Accept("p", 1, 0));
+    CHECK(!window.Accept("p", 2, 0));
+
+    // A jump within the window: the sequences skipped are accepted once, out of order
+    CHECK(window.Accept("p", kWindow + 100, 0));
+    for (uint64_t sequence = kWindow + 99; sequence > kWindow + 1; sequence--) {
+        CHECK(window.Accept("p", sequence, 0));
+        CHECK(!window.Accept("p", sequence, 0));
+    }
+    CHECK(!window.Accept("p", 100, 0));
+    CHECK(!window.Accept("p", 101, 0));  // Still in the window, and seen
+
+    // A jump of a whole window or more forgets everything below it
+    uint64_t far = 10 * kWindow;
+    CHECK(window.Accept("p", far, 0));
+    CHECK(window.Accept("p", far - kWindow + 1, 0));
+    CHECK(!window.Accept("p", far - kWindow, 0));
+    CHECK(window.Accept("p", far - 1, 0));
+}
+
+// The producer that published least recently is evicted for a new one and starts over
+void testEviction() {
+    DedupWindow window(3);
+    CHECK(window.Accept("a", 1, 10));
+    CHECK(window.Accept("b", 1, 20));
+    CHECK(window.Accept("c", 1, 30));
+    CHECK(!window.Accept("a", 1, 40));  // a becomes the most recent
+    CHECK_EQ(window.Size(), 3u);
+
+    CHECK(window.Accept("d", 1, 50));   // Evicts b
+    CHECK_EQ(window.Size(), 3u);
+    CHECK(!window.Accept("a", 1, 60));
+    CHECK(!window.Accept("c", 1, 70));
+    CHECK(!window.Accept("d", 1, 80));
+    CHECK(window.Accept("b", 1, 90));   // Forgotten, so accepted again; evicts a
+
+    // Lowering the limit keeps only the most recent producers
+    window.SetMaxProducers(1);
+    CHECK_EQ(window.Size(), 1u);
+    CHECK(!window.Accept("b", 1, 100));
+    CHECK(window.Accept("d", 1, 110));
+
+    // A limit of zero still tracks one producer
+    window.SetMaxProducers(0);
+    CHECK_EQ(window.Size(), 1u);
+    CHECK(!window.Accept("d", 1, 120));
+}
+
+// Producers idle since before the given time are forgotten, whatever order they arrived in
+void testExpireIdle() {
+    DedupWindow window;
+    CHECK(window.Accept("a", 1, 10));
+    CHECK(window.Accept("b", 1, 20));
+    CHECK(window.Accept("c", 1, 30));
+    CHECK(window.Accept("a", 2, 40));
+
+    CHECK_EQ(window.ExpireIdle(30), 1u);  // b; c published at 30, which is not older
+    CHECK_EQ(window.Size(), 2u);
+    CHECK(!window.Accept("a", 1, 50));
+    CHECK(!window.Accept("c", 1, 60));
+    CHECK(window.Accept("b", 1, 70));
+
+    CHECK_EQ(window.ExpireIdle(0), 0u);
+    CHECK_EQ(window.ExpireIdle(1000), 3u);
+    CHECK_EQ(window.Size(), 0u);
+    CHECK(window.Accept("a", 1, 1000));
+}
+
+} // namespace
+
+int main() {
+    testWindowEdge();
+    testSliding();
+    testEviction();
+    testExpireIdle();
+    return pubsub::test::testResult();
+}
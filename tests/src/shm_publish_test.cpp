@@ -0,0 +1,131 @@
+/**
+ * @file shm_publish_test.cpp
+ * @brief Completion of publishes handed to the server through the shared-memory transport.
+ *
+ * A publish completes only once the server has confirmed storing its
+ * record. When the server goes away first, the records it did not confirm
+ * are resent over gRPC, here to a new server on the same port.
+ */
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "async_publisher.h"
+#include "pubsub_service.h"
+#include "test_check.h"
+
+namespace {
+
+// A server running in this process on a loopback port
+struct TestServer {
+    PubSubServiceImpl service;
+    std::unique_ptr<grpc::Server> server;
+    int port = 0;
+
+    TestServer(ServerOptions options, int fixed_port) : service(1000, options.partitions_per_topic) {
+        service.SetRateLimits(options);
+        options.listen_addresses = {"127.0.0.1:" + std::to_string(fixed_port)};
+        std::vector<int> ports;
+        server = BuildServer(&service, options, &ports);
+        CHECK(server != nullptr && !ports.empty() && ports[0] != 0);
+        port = server && !ports.empty() ? ports[0] : 0;
+    }
+
+    ~TestServer() {
+        if (server) {
+            server->Shutdown(std::chrono::system_clock::now());
+        }
+    }
+};
+
+// Results collected from publish callbacks
+struct Results {
+    std::mutex mutex;
+    size_t completed = 0;
+    size_t failed = 0;
+    std::set<std::string> message_ids;
+
+    AsyncPublisher::CompletionFn Callback() {
+        return [this](const PublishResult& result) {
+            std::lock_guard<std::mutex> lock(mutex);
+            completed++;
+            if (!result.ok() || result.message_id.empty()) {
+                failed++;
+            }
+            message_ids.insert(result.message_id);
+        };
+    }
+};
+
+ProducerOptions sharedMemoryOptions() {
+    ProducerOptions options;
+    options.shared_memory = true;
+    options.shared_memory_bytes = 64 << 10;
+    return options;
+}
+
+// Every publish completes with its own message ID once the server stored it
+void testConfirmed() {
+    TestServer server(ServerOptions(), 0);
+    Results results;
+    {
+        AsyncPublisher publisher("127.0.0.1:" + std::to_string(server.port), sharedMemoryOptions());
+        for (int i = 0; i < 900; i++) {
+            publisher.PublishAsync("topic", "message " + std::to_string(i), results.Callback());
+        }
+        publisher.Flush();
+        CHECK_EQ(results.completed, 900u);
+        CHECK_EQ(server.service.GetMessageCount("topic"), 900u);
+    }
+    CHECK_EQ(results.failed, 0u);
+    CHECK_EQ(results.message_ids.size(), 900u);
+}
+
+// Records the server holds back over quota are unconfirmed when it shuts down, and are
+// resent to its replacement
+void testResentAfterDetach() {
+    ServerOptions throttled;
+    throttled.topic_rate_limit.rate = 0.5;
+    throttled.topic_rate_limit.burst = 1;
+    std::unique_ptr<TestServer> first(new TestServer(throttled, 0));
+    int port = first->port;
+    Results results;
+    ProducerOptions options = sharedMemoryOptions();
+    // Resends keep failing until the channel reconnects, which it waits up to a second to do
+    options.max_retries = 10;
+    {
+        AsyncPublisher publisher("127.0.0.1:" + std::to_string(port), options);
+        // Uses up the quota for the next two seconds
+        publisher.PublishAsync("topic", "first", results.Callback());
+        publisher.Flush();
+        CHECK_EQ(results.completed, 1u);
+
+        for (int i = 0; i < 50; i++) {
+            publisher.PublishAsync("topic", "message " + std::to_string(i), results.Callback());
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        {
+            std::lock_guard<std::mutex> lock(results.mutex);
+            CHECK_EQ(results.completed, 1u);
+        }
+
+        // Shutting down stores what is left in the ring, but can no longer confirm it
+        first.reset();
+        TestServer second(ServerOptions(), port);
+        publisher.Flush();
+        CHECK_EQ(results.completed, 51u);
+        CHECK_EQ(second.service.GetMessageCount("topic"), 50u);
+    }
+    CHECK_EQ(results.failed, 0u);
+    CHECK_EQ(results.message_ids.size(), 51u);
+}
+
+} // namespace
+
+int main() {
+    testConfirmed();
+    testResentAfterDetach();
+    return pubsub::test::testResult();
+}
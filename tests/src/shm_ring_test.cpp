@@ -0,0 +1,300 @@
+/**
+ * @file shm_ring_test.cpp
+ * @brief Tests of the shared-memory ring: records that wrap, and the checks against a corrupt peer.
+ *
+ * Each test maps a segment twice in this process, as the writer that
+ * created it and the reader that opened it. Corruption is simulated by a
+ * third raw mapping through which the test overwrites the counters and
+ * record lengths the way a misbehaving peer could.
+ */
+#include <cstring>
+#include <memory>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "shm_ring.h"
+#include "test_check.h"
+
+using pubsub::common::ShmRing;
+
+namespace {
+
+// Offsets of the counters in the segment header: head and tail each start a cache line
+const size_t kHeadOffset = 64;
+const size_t kTailOffset = 128;
+
+const uint32_t kWrapMarker = 0xFFFFFFFFu;
+
+// A ring mapped by its writer and its reader, plus raw access to the segment
+struct RingPair {
+    std::unique_ptr<ShmRing> writer;
+    std::unique_ptr<ShmRing> reader;
+    char* raw = nullptr;
+    size_t raw_size = 0;
+    size_t capacity = 0;
+
+    explicit RingPair(size_t bytes) : writer(ShmRing::Create(bytes)) {
+        CHECK(writer != nullptr);
+        if (!writer) {
+            return;
+        }
+        reader = ShmRing::Open(writer->Name(), writer->Token());
+        CHECK(reader != nullptr);
+        int fd = shm_open(writer->Name().c_str(), O_RDWR, 0);
+        CHECK(fd >= 0);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0) {
+            raw_size = static_cast<size_t>(st.st_size);
+            void* base = mmap(nullptr, raw_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            raw = base == MAP_FAILED ? nullptr : static_cast<char*>(base);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        CHECK(raw != nullptr);
+        capacity = bytes;
+        writer->Unlink();
+    }
+
+    ~RingPair() {
+        if (raw) {
+            munmap(raw, raw_size);
+        }
+    }
+
+    bool Ok() const { return writer && reader && raw; }
+
+    uint64_t Counter(size_t offset) const {
+        uint64_t value;
+        std::memcpy(&value, raw + offset, sizeof(value));
+        return value;
+    }
+
+    void SetCounter(size_t offset, uint64_t value) { std::memcpy(raw + offset, &value, sizeof(value)); }
+
+    // Start of the data area, which fills the rest of the segment
+    char* Data() const { return raw + raw_size - capacity; }
+
+    void SetLength(size_t pos, uint32_t length) { std::memcpy(Data() + pos, &length, sizeof(length)); }
+};
+
+// A record of the given size whose bytes depend on a seed
+std::string makeRecord(size_t size, unsigned seed) {
+    std::string record(size, '\0');
+    for (size_t i = 0; i < size; i++) {
+        record[i] = static_cast<char>(seed * 31 + i * 7);
+    }
+    return record;
+}
+
+// Records of every size that fits, written and read in turn so the ring wraps many times
+void testRoundTrip() {
+    RingPair ring(256);
+    if (!ring.Ok()) {
+        return;
+    }
+    CHECK_EQ(ring.writer->MaxRecordSize(), 124u);
+    std::string read;
+    CHECK(ring.reader->TryRead(&read) == ShmRing::ReadResult::kEmpty);
+    for (unsigned i = 0; i < 1000; i++) {
+        std::string record = makeRecord(i % 125, i);
+        CHECK(ring.writer->TryWrite(record.data(), record.size()));
+        CHECK(ring.reader->TryRead(&read) == ShmRing::ReadResult::kRecord);
+        CHECK(read == record);
+        CHECK(ring.reader->Empty());
+    }
+    CHECK(!ring.writer->Corrupt());
+    CHECK(!ring.reader->Corrupt());
+
+    // A record over the limit is refused without harming the ring
+    std::string too_large(125, 'x');
+    CHECK(!ring.writer->TryWrite(too_large.data(), too_large.size()));
+    CHECK(!ring.writer->Corrupt());
+}
+
+// A record that does not fit before the end is written at the start behind a wrap marker
+void testWrapMarker() {
+    RingPair ring(256);
+    if (!ring.Ok()) {
+        return;
+    }
+    std::string read;
+    std::string first = makeRecord(100, 1);   // 104 bytes with its length
+    std::string second = makeRecord(100, 2);
+    CHECK(ring.writer->TryWrite(first.data(), first.size()));
+    CHECK(ring.writer->TryWrite(second.data(), second.size()));
+    CHECK_EQ(ring.Counter(kHeadOffset), 208u);
+
+    // 48 bytes left before the end; the next record needs 104 and the space at the end
+    std::string third = makeRecord(100, 3);
+    CHECK(!ring.writer->TryWrite(third.data(), third.size()));
+    CHECK(ring.reader->TryRead(&read) == ShmRing::ReadResult::kRecord);
+    CHECK(read == first);
+    CHECK(ring.writer->TryWrite(third.data(), third.size()));
+    uint32_t marker;
+    std::memcpy(&marker, ring.Data() + 208, sizeof(marker));
+    CHECK_EQ(marker, kWrapMarker);
+    CHECK_EQ(ring.Counter(kHeadOffset), 256u + 104u);
+
+    CHECK(ring.reader->TryRead(&read) == ShmRing::ReadResult::kRecord);
+    CHECK(read == second);
+    CHECK(ring.reader->TryRead(&read) == ShmRing::ReadResult::kRecord);
+    CHECK(read == third);
+    CHECK_EQ(ring.Counter(kTailOffset), 256u + 104u);
+    CHECK(ring.reader->TryRead(&read) == ShmRing::ReadResult::kEmpty);
+
+    // Once drained, the largest record fits wherever the ring stands; a small record and a
+    // largest one advance 136 bytes, which reaches every position in 32 rounds
+    std::string filler = makeRecord(4, 4);
+    std::string largest = makeRecord(ring.writer->MaxRecordSize(), 5);
+    for (int i = 0; i < 32; i++) {
+        CHECK(ring.writer->TryWrite(filler.data(), filler.size()));
+        CHECK(ring.reader->TryRead(&read) == ShmRing::ReadResult::kRecord);
+        CHECK(ring.writer->TryWrite(largest.data(), largest.size()));
+        CHECK(ring.reader->TryRead(&read) == ShmRing::ReadResult::kRecord);
+        CHECK(read == largest);
+    }
+    CHECK(!ring.reader->Corrupt());
+}
+
+// Counters the peer moved out of range make the ring unusable for good
+void testCorruptCounters() {
+    std::string record = makeRecord(20, 6);
+    std::string read;
+    {
+        // More unread bytes than the capacity
+        RingPair ring(256);
+        if (ring.Ok()) {
+            ring.SetCounter(kHeadOffset, 256 + 8);
+            CHECK(ring.reader->TryRead(&read) == ShmRing::ReadResult::kCorrupt);
+            CHECK(ring.reader->Corrupt());
+            ring.SetCounter(kHeadOffset, 0);
+            CHECK(ring.reader->TryRead(&read) == ShmRing::ReadResult::kCorrupt);
+        }
+    }
+    {
+        // A head that is not 8-byte aligned
+        RingPair ring(256);
+        if (ring.Ok()) {
+            ring.SetCounter(kHeadOffset, 4);
+            CHECK(ring.reader->TryRead(&read) == ShmRing::ReadResult::kCorrupt);
+        }
+    }
+    {
+        // A tail ahead of the head, seen by the writer
+        RingPair ring(256);
+        if (ring.Ok()) {
+            CHECK(ring.writer->TryWrite(record.data(), record.size()));
+            ring.SetCounter(kTailOffset, 64);
+            CHECK(!ring.writer->TryWrite(record.data(), record.size()));
+            CHECK(ring.writer->Corrupt());
+            ring.SetCounter(kTailOffset, 0);
+            CHECK(!ring.writer->TryWrite(record.data(), record.size()));
+        }
+    }
+    {
+        // A misaligned tail, seen by the writer
+        RingPair ring(256);
+        if (ring.Ok()) {
+            ring.SetCounter(kTailOffset, 12);
+            CHECK(!ring.writer->TryWrite(record.data(), record.size()));
+            CHECK(ring.writer->Corrupt());
+        }
+    }
+}
+
+// Record lengths that would reach beyond the buffer or the written bytes are refused
+void testCorruptLengths() {
+    std::string record = makeRecord(20, 7);
+    std::string read;
+    {
+        // Longer than any record the ring accepts
+        RingPair ring(256);
+        if (ring.Ok()) {
+            CHECK(ring.writer->TryWrite(record.data(), record.size()));
+            ring.SetLength(0, 125);
+            CHECK(ring.reader->TryRead(&read) == ShmRing::ReadResult::kCorrupt);
+        }
+    }
+    {
+        // Longer than what the writer has published
+        RingPair ring(256);
+        if (ring.Ok()) {
+            CHECK(ring.writer->TryWrite(record.data(), record.size()));
+            ring.SetLength(0, 40);
+            CHECK(ring.reader->TryRead(&read) == ShmRing::ReadResult::kCorrupt);
+        }
+    }
+    {
+        // Running past the end of the buffer
+        RingPair ring(256);
+        if (ring.Ok()) {
+            ring.SetCounter(kTailOffset, 200);
+            ring.SetCounter(kHeadOffset, 256 + 40);
+            ring.SetLength(200, 100);
+            CHECK(ring.reader->TryRead(&read) == ShmRing::ReadResult::kCorrupt);
+        }
+    }
+    {
+        // A wrap marker with nothing published after it
+        RingPair ring(256);
+        if (ring.Ok()) {
+            ring.SetCounter(kTailOffset, 200);
+            ring.SetCounter(kHeadOffset, 256);
+            ring.SetLength(200, kWrapMarker);
+            CHECK(ring.reader->TryRead(&read) == ShmRing::ReadResult::kCorrupt);
+        }
+    }
+    {
+        // A wrap marker followed by a record too long for what was published
+        RingPair ring(256);
+        if (ring.Ok()) {
+            ring.SetCounter(kTailOffset, 200);
+            ring.SetCounter(kHeadOffset, 256 + 8);
+            ring.SetLength(200, kWrapMarker);
+            ring.SetLength(0, 20);
+            CHECK(ring.reader->TryRead(&read) == ShmRing::ReadResult::kCorrupt);
+        }
+    }
+    {
+        // The same marker and record, consistently published, are read normally
+        RingPair ring(256);
+        if (ring.Ok()) {
+            ring.SetCounter(kTailOffset, 200);
+            ring.SetCounter(kHeadOffset, 256 + 24);
+            ring.SetLength(200, kWrapMarker);
+            ring.SetLength(0, 20);
+            std::memcpy(ring.Data() + 4, record.data(), record.size());
+            CHECK(ring.reader->TryRead(&read) == ShmRing::ReadResult::kRecord);
+            CHECK(read == record);
+            CHECK(ring.reader->TryRead(&read) == ShmRing::ReadResult::kEmpty);
+        }
+    }
+}
+
+// Opening checks the token and the header of the segment
+void testOpen() {
+    std::unique_ptr<ShmRing> ring = ShmRing::Create(256);
+    CHECK(ring != nullptr);
+    if (!ring) {
+        return;
+    }
+    CHECK(ShmRing::Open(ring->Name(), ring->Token() + 1) == nullptr);
+    CHECK(ShmRing::Open(ring->Name() + "-missing", ring->Token()) == nullptr);
+    CHECK(ShmRing::Open(ring->Name(), ring->Token()) != nullptr);
+    ring->Unlink();
+    CHECK(ShmRing::Open(ring->Name(), ring->Token()) == nullptr);
+}
+
+} // namespace
+
+int main() {
+    testRoundTrip();
+    testWrapMarker();
+    testCorruptCounters();
+    testCorruptLengths();
+    testOpen();
+    return pubsub::test::testResult();
+}
@@ -0,0 +1,86 @@
+/**
+ * @file shm_subscribe_test.cpp
+ * @brief Delivery through the shared-memory transport when a message does not fit the ring.
+ *
+ * A subscriber with a small ring receives messages around one larger than
+ * half of it. The server ends the attachment right before that message and
+ * the subscriber continues over gRPC, so every message arrives exactly once
+ * and in order.
+ */
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "pubsub_channel.h"
+#include "pubsub_service.h"
+#include "subscriber_client.h"
+#include "test_check.h"
+
+int main() {
+    const size_t ring_bytes = 64 << 10;
+    const int before = 20;
+    const int after = 20;
+    std::string large(ring_bytes / 2 + 1000, '\0');
+    for (size_t i = 0; i < large.size(); i++) {
+        large[i] = static_cast<char>(i * 7);
+    }
+
+    ServerOptions options;
+    options.listen_addresses = {"127.0.0.1:0"};
+    PubSubServiceImpl service(1000, options.partitions_per_topic);
+    std::vector<int> ports;
+    std::unique_ptr<grpc::Server> server = BuildServer(&service, options, &ports);
+    CHECK(server != nullptr && !ports.empty() && ports[0] != 0);
+    if (!server || ports.empty() || ports[0] == 0) {
+        return pubsub::test::testResult();
+    }
+    std::string address = "127.0.0.1:" + std::to_string(ports[0]);
+
+    std::mutex mutex;
+    std::condition_variable arrived;
+    std::vector<std::string> received;
+    SubscriberOptions subscriber_options;
+    subscriber_options.shared_memory = true;
+    subscriber_options.shared_memory_bytes = ring_bytes;
+    SubscriberClient subscriber(pubsub::common::createChannel(address), subscriber_options);
+    subscriber.Subscribe("topic", [&](const Message& message) {
+        std::lock_guard<std::mutex> lock(mutex);
+        received.push_back(message.content());
+        arrived.notify_all();
+    });
+    // Let the subscriber attach its ring before anything is published
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    std::vector<std::string> published;
+    for (int i = 0; i < before; i++) {
+        published.push_back("before " + std::to_string(i));
+    }
+    published.push_back(large);
+    for (int i = 0; i < after; i++) {
+        published.push_back("after " + std::to_string(i));
+    }
+    for (const auto& content : published) {
+        pubsub::PublishRequest request;
+        pubsub::PublishResponse response;
+        request.set_topic("topic");
+        request.set_content(content);
+        CHECK(service.Publish(nullptr, &request, &response).ok() && response.success());
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        arrived.wait_for(lock, std::chrono::seconds(10), [&] { return received.size() >= published.size(); });
+    }
+    // Anything delivered twice would arrive shortly after the rest
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    subscriber.Stop();
+    server->Shutdown(std::chrono::system_clock::now());
+
+    CHECK_EQ(received.size(), published.size());
+    for (size_t i = 0; i < received.size() && i < published.size(); i++) {
+        CHECK(received[i] == published[i]);
+    }
+    return pubsub::test::testResult();
+}
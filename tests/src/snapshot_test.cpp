@@ -0,0 +1,135 @@
+/**
+ * @file snapshot_test.cpp
+ * @brief Round trips of retained messages through snapshots saved and restored by the service.
+ *
+ * A restored partition is read back by saving it again, which visits its
+ * buffer the way subscriptions do, and by publishing on top of it.
+ */
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+#include "pubsub_service.h"
+#include "snapshot_file.h"
+#include "test_check.h"
+
+namespace {
+
+// Messages of each topic in a snapshot, as (sequence, content) pairs in file order
+using SnapshotContents = std::map<std::string, std::vector<std::pair<uint64_t, std::string>>>;
+
+// Publish count messages to a topic, each with its topic and sequence number as content,
+// numbered from first
+void publish(PubSubServiceImpl* service, const std::string& topic, uint64_t first, int count) {
+    for (int i = 0; i < count; i++) {
+        pubsub::PublishRequest request;
+        pubsub::PublishResponse response;
+        request.set_topic(topic);
+        request.set_content(topic + "#" + std::to_string(first + i));
+        CHECK(service->Publish(nullptr, &request, &response).ok() && response.success());
+    }
+}
+
+// Read every message of a snapshot file
+SnapshotContents readSnapshot(const std::string& path) {
+    SnapshotContents contents;
+    SnapshotReader reader;
+    CHECK(reader.Open(path));
+    std::string topic;
+    uint32_t partition;
+    uint64_t incarnation;
+    uint64_t stamp;
+    const char* data;
+    size_t size;
+    while (reader.NextSection(&topic, &partition, &incarnation)) {
+        auto& messages = contents[topic];
+        while (reader.NextRecord(&stamp, &data, &size)) {
+            pubsub::Message message;
+            CHECK(message.ParseFromArray(data, static_cast<int>(size)));
+            messages.emplace_back(message.sequence(), message.content());
+        }
+    }
+    CHECK(reader.Ok());
+    return contents;
+}
+
+// Check that a topic holds exactly the messages [first, end), each with its own content
+void checkTopic(const SnapshotContents& contents, const std::string& topic, uint64_t first, uint64_t end) {
+    auto it = contents.find(topic);
+    CHECK(it != contents.end());
+    if (it == contents.end()) {
+        return;
+    }
+    CHECK_EQ(it->second.size(), end - first);
+    for (size_t i = 0; i < it->second.size(); i++) {
+        CHECK_EQ(it->second[i].first, first + i);
+        CHECK_EQ(it->second[i].second, topic + "#" + std::to_string(first + i));
+    }
+}
+
+} // namespace
+
+int main() {
+    std::string prefix = "snapshot_test." + std::to_string(getpid());
+    std::string first_path = prefix + ".1";
+    std::string second_path = prefix + ".2";
+    std::string third_path = prefix + ".3";
+
+    // wrapped: 250 messages in a ring of 100, so the oldest retained is 150
+    // partial: 30 messages, the ring never filled
+    // odd: 137 messages, the oldest retained is 37, which the capacity does not divide
+    {
+        PubSubServiceImpl service(100);
+        publish(&service, "wrapped", 0, 250);
+        publish(&service, "partial", 0, 30);
+        publish(&service, "odd", 0, 137);
+        CHECK(service.SaveSnapshot(first_path));
+    }
+    SnapshotContents saved = readSnapshot(first_path);
+    checkTopic(saved, "wrapped", 150, 250);
+    checkTopic(saved, "partial", 0, 30);
+    checkTopic(saved, "odd", 37, 137);
+
+    // Restored into the same capacity: saving again yields the same messages, and new
+    // publishes continue the numbering and wrap the restored ring
+    {
+        PubSubServiceImpl service(100);
+        CHECK(service.LoadSnapshot(first_path));
+        CHECK_EQ(service.GetMessageCount("wrapped"), 100u);
+        CHECK_EQ(service.GetMessageCount("partial"), 30u);
+        CHECK_EQ(service.GetMessageCount("odd"), 100u);
+        CHECK(service.SaveSnapshot(second_path));
+        CHECK(readSnapshot(second_path) == saved);
+
+        publish(&service, "wrapped", 250, 70);
+        publish(&service, "partial", 30, 5);
+        publish(&service, "odd", 137, 1);
+        CHECK(service.SaveSnapshot(second_path));
+        SnapshotContents resaved = readSnapshot(second_path);
+        checkTopic(resaved, "wrapped", 220, 320);
+        checkTopic(resaved, "partial", 0, 35);
+        checkTopic(resaved, "odd", 38, 138);
+    }
+
+    // Restored into a larger ring, which the restored messages only partly fill: a single
+    // publish must not be read beyond the slots in use
+    {
+        PubSubServiceImpl service(130);
+        CHECK(service.LoadSnapshot(first_path));
+        publish(&service, "wrapped", 250, 1);
+        CHECK(service.SaveSnapshot(third_path));
+        SnapshotContents resaved = readSnapshot(third_path);
+        checkTopic(resaved, "wrapped", 150, 251);
+        checkTopic(resaved, "odd", 37, 137);
+        publish(&service, "wrapped", 251, 60);
+        CHECK(service.SaveSnapshot(third_path));
+        checkTopic(readSnapshot(third_path), "wrapped", 181, 311);
+    }
+
+    std::remove(first_path.c_str());
+    std::remove(second_path.c_str());
+    std::remove(third_path.c_str());
+    return pubsub::test::testResult();
+}
@@ -0,0 +1,148 @@
+/**
+ * @file timer_wheel_test.cpp
+ * @brief Tests of the hierarchical timing wheel: fire times across cascade boundaries.
+ *
+ * A wheel of 8 slots and 3 levels cascades every 8 and every 64 ticks, so
+ * short delays exercise every level. Ticks are 10 ms and the wheel is
+ * advanced to the middle of each tick, so the test does not depend on how
+ * long it takes to run.
+ */
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "timer_wheel.h"
+#include "test_check.h"
+
+namespace {
+
+using Clock = TimerWheel::Clock;
+
+const std::chrono::milliseconds kTick(10);
+
+// A timer that records the tick it fired at
+struct TestTimer : TimerWheel::Timer {
+    uint64_t expected = 0;  // Tick the timer should fire at
+    uint64_t fired_at = 0;
+    int fired = 0;
+};
+
+// A wheel and the clock reading taken just before it was created
+struct TestWheel {
+    Clock::time_point start;
+    TimerWheel wheel;
+    uint64_t tick = 0;  // Last tick advanced to
+
+    TestWheel() : start(Clock::now()), wheel(kTick, 8, 3) {}
+
+    // Middle of a tick of the wheel
+    Clock::time_point At(uint64_t tick) const { return start + kTick * tick + kTick / 2; }
+
+    // Advance one tick at a time up to the given tick, recording when timers fire
+    void StepTo(uint64_t target) {
+        while (tick < target) {
+            tick++;
+            wheel.Advance(At(tick), [this](TimerWheel::Timer* timer) {
+                TestTimer* test = static_cast<TestTimer*>(timer);
+                test->fired_at = tick;
+                test->fired++;
+            });
+        }
+    }
+};
+
+// Check that every timer fired once, at its expected tick
+void checkFired(const std::vector<std::unique_ptr<TestTimer>>& timers) {
+    for (const auto& timer : timers) {
+        CHECK_EQ(timer->fired, 1);
+        CHECK_EQ(timer->fired_at, timer->expected);
+        CHECK(!timer->Scheduled());
+    }
+}
+
+// Timers scheduled at tick 0 on both sides of each cascade boundary
+void testFromStart() {
+    TestWheel test;
+    std::vector<std::unique_ptr<TestTimer>> timers;
+    for (uint64_t delay : {1, 7, 8, 9, 15, 16, 17, 56, 63, 64, 65, 72, 127, 128, 129, 200, 448, 511}) {
+        timers.emplace_back(new TestTimer);
+        timers.back()->expected = delay;
+        test.wheel.Schedule(timers.back().get(), kTick * delay);
+    }
+    // Beyond the top level: clamped to the last tick it reaches
+    timers.emplace_back(new TestTimer);
+    timers.back()->expected = 511;
+    test.wheel.Schedule(timers.back().get(), kTick * 600);
+    CHECK_EQ(test.wheel.Size(), timers.size());
+
+    test.StepTo(520);
+    checkFired(timers);
+    CHECK_EQ(test.wheel.Size(), 0u);
+}
+
+// Timers scheduled partway through a higher-level slot, and moved before they fire
+void testFromMidSlot() {
+    TestWheel test;
+    TestTimer keep_busy;  // Keeps Advance from jumping ahead over empty ticks
+    test.wheel.Schedule(&keep_busy, kTick * 500);
+    test.StepTo(37);
+
+    std::vector<std::unique_ptr<TestTimer>> timers;
+    for (uint64_t delay : {3, 26, 27, 28, 34, 90, 91, 92, 155, 300}) {
+        timers.emplace_back(new TestTimer);
+        timers.back()->expected = 37 + delay;
+        test.wheel.Schedule(timers.back().get(), kTick * delay);
+    }
+    // Scheduled by absolute time, which does not depend on the last Advance
+    timers.emplace_back(new TestTimer);
+    timers.back()->expected = 130;
+    test.wheel.ScheduleAt(timers.back().get(), test.start + kTick * 130);
+
+    // Rescheduled before they fire: one from the top level to the bottom, one the other way
+    test.StepTo(60);
+    timers[8]->expected = 60 + 5;
+    test.wheel.Schedule(timers[8].get(), kTick * 5);
+    timers[5]->expected = 60 + 200;
+    test.wheel.Schedule(timers[5].get(), kTick * 200);
+
+    // A cancelled timer never fires
+    TestTimer cancelled;
+    test.wheel.Schedule(&cancelled, kTick * 70);
+    test.StepTo(100);
+    test.wheel.Cancel(&cancelled);
+
+    test.StepTo(400);
+    checkFired(timers);
+    CHECK_EQ(cancelled.fired, 0);
+    CHECK_EQ(keep_busy.fired, 0);
+    CHECK_EQ(test.wheel.Size(), 1u);
+}
+
+// One Advance across many boundaries fires everything due, in deadline order
+void testLargeStep() {
+    TestWheel test;
+    std::vector<std::unique_ptr<TestTimer>> timers;
+    for (uint64_t delay = 1; delay < 300; delay += 7) {
+        timers.emplace_back(new TestTimer);
+        timers.back()->expected = delay;
+        test.wheel.Schedule(timers.back().get(), kTick * delay);
+    }
+    std::vector<uint64_t> deadlines;
+    size_t fired = test.wheel.Advance(test.At(200), [&](TimerWheel::Timer* timer) {
+        deadlines.push_back(static_cast<TestTimer*>(timer)->expected);
+    });
+    CHECK_EQ(fired, deadlines.size());
+    CHECK_EQ(deadlines.size(), 29u);  // 1, 8, ..., 197
+    for (size_t i = 0; i < deadlines.size(); i++) {
+        CHECK_EQ(deadlines[i], 1 + 7 * i);
+    }
+    CHECK_EQ(test.wheel.Size(), timers.size() - deadlines.size());
+}
+
+} // namespace
+
+int main() {
+    testFromStart();
+    testFromMidSlot();
+    testLargeStep();
+    return pubsub::test::testResult();
+}
@@ -0,0 +1,130 @@
+/**
+ * @file topic_buffer_test.cpp
+ * @brief Tests of the ring of retained messages, including rings renumbered by Reset and Skip.
+ */
+#include <string>
+#include <vector>
+#include "topic_buffer.h"
+#include "test_check.h"
+
+namespace {
+
+// Append a message whose frame is its own sequence number as text
+void appendNumbered(TopicBuffer* buffer) {
+    uint64_t sequence = buffer->NextSequence();
+    *buffer->Append(sequence) = grpc::Slice(std::to_string(sequence));
+}
+
+// Frame of a retained message as text, or "missing"
+std::string frameAt(const TopicBuffer& buffer, uint64_t sequence) {
+    const grpc::Slice* frame = buffer.Get(sequence);
+    return frame ? std::string(reinterpret_cast<const char*>(frame->begin()), frame->size()) : "missing";
+}
+
+// Check that the buffer retains exactly the messages [first, end), by Get and by VisitSince
+void checkRetained(const TopicBuffer& buffer, uint64_t first, uint64_t end) {
+    CHECK_EQ(buffer.Size(), end - first);
+    CHECK_EQ(buffer.NextSequence(), end);
+    if (first > 0) {
+        CHECK_EQ(frameAt(buffer, first - 1), std::string("missing"));
+    }
+    CHECK_EQ(frameAt(buffer, end), std::string("missing"));
+    for (uint64_t sequence = first; sequence < end; sequence++) {
+        CHECK_EQ(frameAt(buffer, sequence), std::to_string(sequence));
+    }
+
+    std::vector<uint64_t> visited;
+    uint64_t next = buffer.VisitSince(0, end, [&](uint64_t stamp, uint64_t sequence, const grpc::Slice& frame) {
+        CHECK_EQ(stamp, sequence);
+        CHECK_EQ(std::string(reinterpret_cast<const char*>(frame.begin()), frame.size()), std::to_string(sequence));
+        visited.push_back(sequence);
+    });
+    CHECK_EQ(next, end);
+    CHECK_EQ(visited.size(), end - first);
+    for (size_t i = 0; i < visited.size(); i++) {
+        CHECK_EQ(visited[i], first + i);
+    }
+}
+
+// A ring that fills up and wraps from sequence 0
+void testWrap() {
+    TopicBuffer buffer(100);
+    for (int i = 0; i < 30; i++) {
+        appendNumbered(&buffer);
+    }
+    checkRetained(buffer, 0, 30);
+    for (int i = 0; i < 220; i++) {
+        appendNumbered(&buffer);
+    }
+    checkRetained(buffer, 150, 250);
+}
+
+// A ring renumbered at a sequence the capacity does not divide, as a snapshot restore does
+void testReset() {
+    TopicBuffer buffer(100);
+    for (int i = 0; i < 42; i++) {
+        appendNumbered(&buffer);
+    }
+    buffer.Reset(950);
+    checkRetained(buffer, 950, 950);
+    appendNumbered(&buffer);
+    checkRetained(buffer, 950, 951);
+    for (int i = 0; i < 99; i++) {
+        appendNumbered(&buffer);
+    }
+    checkRetained(buffer, 950, 1050);
+    for (int i = 0; i < 137; i++) {
+        appendNumbered(&buffer);
+    }
+    checkRetained(buffer, 1087, 1187);
+}
+
+// Skip empties a ring and continues at the new sequence like Reset
+void testSkip() {
+    TopicBuffer buffer(7);
+    for (int i = 0; i < 10; i++) {
+        appendNumbered(&buffer);
+    }
+    buffer.Skip(5);  // Not ahead; changes nothing
+    checkRetained(buffer, 3, 10);
+    buffer.Skip(23);
+    checkRetained(buffer, 23, 23);
+    for (int i = 0; i < 3; i++) {
+        appendNumbered(&buffer);
+    }
+    checkRetained(buffer, 23, 26);
+    for (int i = 0; i < 9; i++) {
+        appendNumbered(&buffer);
+    }
+    checkRetained(buffer, 28, 35);
+}
+
+// VisitSince resumes where the previous call stopped
+void testVisitInChunks() {
+    TopicBuffer buffer(10);
+    buffer.Reset(13);
+    for (int i = 0; i < 14; i++) {
+        appendNumbered(&buffer);
+    }
+    uint64_t from = 0;
+    std::vector<uint64_t> visited;
+    while (from < buffer.NextSequence()) {
+        from = buffer.VisitSince(from, 3, [&](uint64_t, uint64_t sequence, const grpc::Slice&) {
+            visited.push_back(sequence);
+        });
+    }
+    CHECK_EQ(visited.size(), 10u);
+    for (size_t i = 0; i < visited.size(); i++) {
+        CHECK_EQ(visited[i], 17 + i);
+    }
+}
+
+} // namespace
+
+int main() {
+    testWrap();
+    testReset();
+    testSkip();
+    testVisitInChunks();
+    return pubsub::test::testResult();
+}
@@ -0,0 +1,174 @@
+/**
+ * @file topic_registry_test.cpp
+ * @brief Tests of the topic name index: collision chains, wrap-around and backward-shift removal.
+ *
+ * Names are picked by the home slot their hash selects in the registry's
+ * initial 64-slot table, so the chains they form are known without looking
+ * inside the registry.
+ */
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "topic_registry.h"
+#include "test_check.h"
+
+namespace {
+
+// Slots in a new registry, which grows once it would be more than half full
+const size_t kInitialSlots = 64;
+
+// Home slot of a name in the initial table, as the registry computes it
+size_t homeSlot(const std::string& name) {
+    return static_cast<uint32_t>(std::hash<std::string>()(name)) & (kInitialSlots - 1);
+}
+
+// Generate count names whose home slot is home
+std::vector<std::string> namesAt(size_t home, size_t count) {
+    std::vector<std::string> names;
+    for (int i = 0; names.size() < count; i++) {
+        std::string name = "topic-" + std::to_string(i);
+        if (homeSlot(name) == home) {
+            names.push_back(name);
+        }
+    }
+    return names;
+}
+
+// Check that the registry holds exactly the topics of the model, under their IDs
+void checkRegistry(const TopicRegistry& registry, const std::map<std::string, TopicId>& model,
+                   const std::vector<std::string>& all_names) {
+    CHECK_EQ(registry.Size(), model.size());
+    for (const auto& name : all_names) {
+        TopicId id = 0;
+        auto it = model.find(name);
+        bool found = registry.Find(name, &id);
+        CHECK_EQ(found, it != model.end());
+        if (found && it != model.end()) {
+            CHECK_EQ(id, it->second);
+            CHECK(registry.Registered(id));
+            CHECK_EQ(registry.Name(id), name);
+        }
+    }
+}
+
+// A chain that starts in the last slots and wraps around to the first ones, with names of
+// the wrapped-over slots inserted behind it
+void testWrappedChain() {
+    std::vector<std::string> at62 = namesAt(62, 4);
+    std::vector<std::string> at0 = namesAt(0, 2);
+    std::vector<std::string> at1 = namesAt(1, 1);
+    std::vector<std::string> all;
+    all.insert(all.end(), at62.begin(), at62.end());
+    all.insert(all.end(), at0.begin(), at0.end());
+    all.insert(all.end(), at1.begin(), at1.end());
+
+    // Slots 62, 63, 0, 1 for the first chain, then 2 and 3 for the names of slot 0 and 4
+    // for the name of slot 1
+    TopicRegistry registry;
+    std::map<std::string, TopicId> model;
+    for (const auto& name : all) {
+        model[name] = registry.Intern(name);
+    }
+    checkRegistry(registry, model, all);
+    CHECK_EQ(registry.Intern(at0[1]), model[at0[1]]);
+    CHECK_EQ(registry.Size(), all.size());
+
+    // An absent name probes through the whole wrapped chain and stops at its end
+    TopicId id;
+    CHECK(!registry.Find(namesAt(62, 5)[4], &id));
+    CHECK(!registry.Find(namesAt(1, 2)[1], &id));
+
+    // Removing the head of the chain shifts the rest back across the wrap; the names of
+    // slots 0 and 1 must stay reachable from their home slots
+    registry.Remove(model[at62[0]]);
+    model.erase(at62[0]);
+    checkRegistry(registry, model, all);
+
+    // Removing from the middle, right after the wrap
+    registry.Remove(model[at62[2]]);
+    model.erase(at62[2]);
+    checkRegistry(registry, model, all);
+
+    // A name whose home slot is occupied by a shifted entry
+    TopicId last_freed = model[at0[0]];
+    registry.Remove(last_freed);
+    model.erase(at0[0]);
+    checkRegistry(registry, model, all);
+
+    // Reinserting reuses the most recently freed ID
+    TopicId freed = registry.Intern(at62[0]);
+    CHECK_EQ(freed, last_freed);
+    model[at62[0]] = freed;
+    checkRegistry(registry, model, all);
+    CHECK_EQ(registry.IdLimit(), all.size());
+}
+
+// Random inserts and removals of names crowded around the wrap, checked against a map
+void testRandomAroundWrap() {
+    std::vector<std::string> all;
+    for (size_t home : {61u, 62u, 63u, 0u, 1u}) {
+        std::vector<std::string> names = namesAt(home, 8);
+        all.insert(all.end(), names.begin(), names.end());
+    }
+
+    TopicRegistry registry;
+    std::map<std::string, TopicId> model;
+    std::mt19937 rng(42);
+    size_t most_registered = 0;
+    for (int step = 0; step < 3000; step++) {
+        const std::string& name = all[rng() % all.size()];
+        auto it = model.find(name);
+        if (it != model.end()) {
+            registry.Remove(it->second);
+            model.erase(it);
+        } else if (model.size() < kInitialSlots / 2 - 4) {
+            TopicId id = registry.Intern(name);
+            for (const auto& entry : model) {
+                CHECK(entry.second != id);
+            }
+            model[name] = id;
+        }
+        most_registered = std::max(most_registered, model.size());
+        checkRegistry(registry, model, all);
+    }
+    // Freed IDs are reused, so IDs stay below the most topics registered at once
+    CHECK_EQ(registry.IdLimit(), most_registered);
+}
+
+// Many topics through several doublings of the table, then half of them removed and
+// others added in their place
+void testGrowth() {
+    std::vector<std::string> all;
+    for (int i = 0; i < 2000; i++) {
+        all.push_back("grown-" + std::to_string(i));
+    }
+    TopicRegistry registry;
+    std::map<std::string, TopicId> model;
+    for (size_t i = 0; i < 1500; i++) {
+        model[all[i]] = registry.Intern(all[i]);
+        CHECK_EQ(model[all[i]], i);
+    }
+    checkRegistry(registry, model, all);
+    for (size_t i = 0; i < 1500; i += 2) {
+        registry.Remove(model[all[i]]);
+        model.erase(all[i]);
+    }
+    checkRegistry(registry, model, all);
+    for (size_t i = 1500; i < 2000; i++) {
+        model[all[i]] = registry.Intern(all[i]);
+    }
+    checkRegistry(registry, model, all);
+    CHECK_EQ(registry.IdLimit(), 1500u);
+}
+
+} // namespace
+
+int main() {
+    testWrappedChain();
+    testRandomAroundWrap();
+    testGrowth();
+    return pubsub::test::testResult();
+}